@@ -30,6 +30,17 @@ static void benchContextBinaryIO(benchmark::State& state, Meta& meta)
   }
 }
 
+static void benchContextCacheIO(benchmark::State& state, Meta& meta)
+{
+  std::stringstream ss;
+
+  for (auto _ : state) {
+    meta.data->context.writeCacheTo(ss);
+    helib::Context newContext = helib::Context::readFromCache(ss);
+    ::benchmark::DoNotOptimize(newContext);
+  }
+}
+
 static void benchContextJSONIO(benchmark::State& state, Meta& meta)
 {
   std::stringstream ss;
@@ -122,6 +133,9 @@ Params no_boot_params(/*m =*/45,
 BENCHMARK_CAPTURE(benchContextBinaryIO, no_boot_params, fn(no_boot_params))
     ->Unit(benchmark::kMillisecond)
     ->Iterations(200);
+BENCHMARK_CAPTURE(benchContextCacheIO, no_boot_params, fn(no_boot_params))
+    ->Unit(benchmark::kMillisecond)
+    ->Iterations(200);
 BENCHMARK_CAPTURE(benchPublicKeyBinaryIO, no_boot_params, fn(no_boot_params))
     ->Unit(benchmark::kMillisecond)
     ->Iterations(200);
@@ -157,6 +171,9 @@ Params tiny_params(/*m =*/31 * 41,
 BENCHMARK_CAPTURE(benchContextBinaryIO, tiny_params, fn(tiny_params))
     ->Unit(benchmark::kMillisecond)
     ->Iterations(10);
+BENCHMARK_CAPTURE(benchContextCacheIO, tiny_params, fn(tiny_params))
+    ->Unit(benchmark::kMillisecond)
+    ->Iterations(10);
 BENCHMARK_CAPTURE(benchPublicKeyBinaryIO, tiny_params, fn(tiny_params))
     ->Unit(benchmark::kMillisecond)
     ->Iterations(10);
@@ -192,6 +209,9 @@ Params small_params(/*m =*/31775,
 BENCHMARK_CAPTURE(benchContextBinaryIO, small_params, fn(small_params))
     ->Unit(benchmark::kMillisecond)
     ->Iterations(1);
+BENCHMARK_CAPTURE(benchContextCacheIO, small_params, fn(small_params))
+    ->Unit(benchmark::kMillisecond)
+    ->Iterations(1);
 BENCHMARK_CAPTURE(benchPublicKeyBinaryIO, small_params, fn(small_params))
     ->Unit(benchmark::kMillisecond)
     ->Iterations(1);
@@ -227,6 +247,9 @@ Params big_params(/*m =*/35113,
 BENCHMARK_CAPTURE(benchContextBinaryIO, big_params, fn(big_params))
     ->Unit(benchmark::kMillisecond)
     ->Iterations(1);
+BENCHMARK_CAPTURE(benchContextCacheIO, big_params, fn(big_params))
+    ->Unit(benchmark::kMillisecond)
+    ->Iterations(1);
 BENCHMARK_CAPTURE(benchPublicKeyBinaryIO, big_params, fn(big_params))
     ->Unit(benchmark::kMillisecond)
     ->Iterations(1);
@@ -0,0 +1,97 @@
+/* Copyright (C) 2012-2020 IBM Corp.
+ * This program is Licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. See accompanying LICENSE file.
+ */
+#ifndef HELIB_AUTOMORPHCACHE_H
+#define HELIB_AUTOMORPHCACHE_H
+/**
+ * @file AutomorphCache.h
+ * @brief A bounded cache of the permutations that implement automorphisms
+ * on the rows of a DoubleCRT.
+ **/
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace helib {
+
+/**
+ * @class AutomorphCache
+ * @brief Thread-safe, memory-bounded cache of automorphism permutations.
+ *
+ * Applying X -> X^k to a row of evaluations just permutes it: the new value
+ * in position j is the old value in position perm_k[j]. This class keeps
+ * the tables perm_k, keyed by the Galois element k, evicting the least
+ * recently used tables once their total size exceeds the memory budget.
+ *
+ * Tables are handed out as shared pointers, so a table that is evicted while
+ * another thread is using it stays valid until that thread is done with it.
+ **/
+class AutomorphCache
+{
+public:
+  //! A permutation table, 32-bit indices keep it small and allow gathers
+  using Table = std::vector<std::uint32_t>;
+
+  //! Default memory budget, in bytes
+  static constexpr std::size_t DEFAULT_BUDGET = 64UL << 20;
+
+  explicit AutomorphCache(std::size_t bytes = DEFAULT_BUDGET) : budget(bytes)
+  {}
+
+  AutomorphCache(const AutomorphCache&) = delete;
+  AutomorphCache& operator=(const AutomorphCache&) = delete;
+
+  //! @brief Look up the table of k, null if it is not in the cache
+  std::shared_ptr<const Table> find(long k);
+
+  //! @brief Add the table of k to the cache (evicting old tables as needed)
+  //! and return the cached copy, which may be a table that another thread
+  //! inserted first.
+  std::shared_ptr<const Table> insert(long k,
+                                      std::shared_ptr<const Table> table);
+
+  //! @brief Change the memory budget, evicting tables if needed
+  void setBudget(std::size_t bytes);
+  std::size_t getBudget() const;
+
+  //! @brief Memory currently used by the cached tables, in bytes
+  std::size_t memoryUsed() const;
+
+  //! @brief Number of cached tables
+  std::size_t size() const;
+
+  void clear();
+
+private:
+  struct Entry
+  {
+    std::shared_ptr<const Table> table;
+    std::list<long>::iterator lruPos;
+  };
+
+  mutable std::mutex lock;
+  std::size_t budget;
+  std::size_t used = 0;
+  std::unordered_map<long, Entry> tables;
+  std::list<long> lru; // most recently used first
+
+  // Evict tables until used <= budget, always keeping the most recent one.
+  // Must be called with the lock held.
+  void evict();
+};
+
+} // namespace helib
+
+#endif // ifndef HELIB_AUTOMORPHCACHE_H
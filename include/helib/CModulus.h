@@ -30,7 +30,11 @@
  * @brief Supports forward and backward length-m FFT transformations
  *
  * This is a wrapper around the bluesteinFFT routines, for one modulus q.
+ * When m is a product of small prime powers, the direct transform of
+ * PrimeFactorFFT.h is used instead.
  **/
+#include <memory>
+
 #include <helib/NumbTh.h>
 #include <helib/PAlgebra.h>
 #include <helib/bluestein.h>
@@ -38,6 +42,9 @@
 
 namespace helib {
 
+class NativeNTT;
+class PrimeFactorFFT;
+
 /**
  * @class Cmodulus
  * @brief Provides FFT and iFFT routines modulo a single-precision prime
@@ -52,6 +59,17 @@ namespace helib {
  * modulo Phi_m(X). The "frequency domain" are just vectors of integers
  * (vec_long), that store only the evaluation in primitive m-th
  * roots of unity.
+ *
+ * When m is a power of two the evaluations are kept in the bit-reversed
+ * order in which the NTT produces them, rather than being permuted into the
+ * order of Zm* (this saves a full pass over the data in every FFT and iFFT).
+ * Code that depends on the order of the evaluations should go through
+ * evalIndex() or permuteEvalOrder(). Building with HELIB_NATURAL_EVAL_ORDER
+ * defined restores the natural order.
+ *
+ * Also when m is a power of two, and HElib is built without HEXL, the
+ * transforms use the in-tree SIMD NTT of NativeNTT.h unless it is disabled
+ * with setNativeNTTEnabled(false), in which case NTL's FFT is used.
  **/
 class Cmodulus
 {
@@ -88,11 +106,24 @@ private:
   // PhimX modulo q, for faster division w/ remainder
   CopiedPtr<zz_pXModulus1> phimx;
 
+  // The bit-reversal permutation of [0, phi(m)), when the evaluations are
+  // kept in bit-reversed order, and null otherwise. Points to a table that
+  // is shared by all the moduli and never freed.
+  const long* bitRev = nullptr;
+
+  // The native NTT tables, when m is a power of two (and HEXL is not used)
+  std::shared_ptr<const NativeNTT> nativeNTT;
+
+  // The direct transforms (with root^2 and rInv^2), when m is not a power of
+  // two and PrimeFactorFFT::preferable(m). Otherwise BluesteinFFT is used.
+  std::shared_ptr<const PrimeFactorFFT> directFFT;
+  std::shared_ptr<const PrimeFactorFFT> directIFFT;
+
   // Allocate memory and compute roots
   void privateInit(const PAlgebra&, long rt);
 
   // auxiliary routine used by the two FFT routines
-  void FFT_aux(NTL::vec_long& y, NTL::zz_pX& tmp) const;
+  void FFT_aux(long* y, NTL::zz_pX& tmp) const;
 
 public:
 #ifdef HELIB_OPENCL
@@ -130,6 +161,18 @@ public:
   //! @brief Restore NTL's current modulus
   void restoreModulus() const { context.restore(); }
 
+  //! @brief Are the evaluations kept in bit-reversed order?
+  bool bitReversedOrder() const { return bitRev != nullptr; }
+
+  //! @brief The index in Zm* of the root whose evaluation is stored in
+  //! position j of a row. As bit reversal is an involution, this is also the
+  //! position in a row of the evaluation at the j'th root.
+  long evalIndex(long j) const { return bitRev ? bitRev[j] : j; }
+
+  //! @brief Permute a row of phi(m) evaluations in place, between the
+  //! storage order and the natural order of Zm* (either way).
+  void permuteEvalOrder(long* y) const;
+
   // FFT routines
 
   // sets zp context internally
@@ -140,9 +183,17 @@ public:
   // y = FFT(x)
   void FFT(NTL::vec_long& y, NTL::zz_pX& x) const;
 
+  // The same, but writing the phi(m) evaluations into a raw row,
+  // e.g. a row of the contiguous storage of a DoubleCRT
+  void FFT(long* y, const NTL::ZZX& x) const;
+  void FFT(long* y, const zzX& x) const;
+  void FFT(long* y, NTL::zz_pX& x) const;
+
   // expects zp context to be set externally
   // x = FFT^{-1}(y)
   void iFFT(NTL::zz_pX& x, const NTL::vec_long& y) const;
+  // y is a raw row of phi(m) evaluations
+  void iFFT(NTL::zz_pX& x, const long* y) const;
 
   // returns thread-local scratch space
   // DIRT: this zz_pX is used for several zz_p moduli,
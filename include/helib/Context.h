@@ -15,7 +15,12 @@
  * @file Context.h
  * @brief Keeps the parameters of an instance of the cryptosystem
  **/
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <helib/AutomorphCache.h>
 #include <helib/PAlgebra.h>
 #include <helib/CModulus.h>
 #include <helib/IndexSet.h>
@@ -31,6 +36,8 @@
 
 namespace helib {
 
+class RNSBaseConverter;
+
 constexpr int MIN_SK_HWT = 120;
 constexpr int BOOT_DFLT_SK_HWT = MIN_SK_HWT;
 
@@ -99,6 +106,10 @@ class ContextBuilder;
  **/
 class Context
 {
+public:
+  // Defined with the public API below
+  enum class DigitNoiseEstimate;
+
 private:
   template <typename SCHEME>
   friend class ContextBuilder;
@@ -111,6 +122,9 @@ private:
   // For serialization.
   struct SerializableContent;
 
+  // The precomputed tables of a context cache, see writeCacheTo.
+  struct CacheContent;
+
   // Cmodulus objects for the different primes
   // The implementation assumes that the list of
   // primes only grows and no prime is ever modified or removed.
@@ -188,23 +202,48 @@ private:
   // Bootstrapping-related data in the context includes both thin and thick
   ThinRecryptData rcData;
 #endif
+
+  // Tables for fast RNS base conversion, built on demand and indexed by the
+  // (source, target) prime sets. See getBaseConverter.
+  mutable std::mutex baseConvertersLock;
+  mutable std::map<std::pair<std::vector<long>, std::vector<long>>,
+                   std::shared_ptr<const RNSBaseConverter>>
+      baseConverters;
+
+  // Permutations implementing the automorphisms on DoubleCRT rows, built on
+  // demand. See getAutomorphTable.
+  mutable AutomorphCache automorphTables;
+
+  // The key-switching noise estimate, see setDigitNoiseEstimate
+  std::atomic<DigitNoiseEstimate> digitNoiseEstimate{
+      DigitNoiseEstimate::EXACT};
+  std::atomic<long> digitNoiseSamplePeriod{DEFAULT_DIGIT_NOISE_SAMPLE_PERIOD};
+  mutable std::atomic<long> digitNoiseCalls{0};
+  mutable std::atomic<double> digitNoiseRatio{1.0};
+
   // Helper for serialisation.
   static SerializableContent readParamsFrom(std::istream& str);
 
   // Helper for serialisation.
   static SerializableContent readParamsFromJSON(const JsonWrapper& str);
 
+  // Helper for serialisation, also reads the tables of the cache.
+  static SerializableContent readCacheFrom(std::istream& str,
+                                           CacheContent& cache);
+
   // Constructor for the `Context` object.
   // m The index of the cyclotomic polynomial.
   // p The plaintext modulus.
   // r BGV: The Hensel lifting parameter. CKKS: The bit precision.
   // gens The generators of `(Z/mZ)^*` (other than `p`).
   // ords The orders of each of the generators of `(Z/mZ)^*`.
+  // factorization The factorization of Phi_m(X) mod p^r, computed if null.
   Context(unsigned long m,
           const NTL::ZZ& p,
           unsigned long r,
           const std::vector<long>& gens = std::vector<long>(),
-          const std::vector<long>& ords = std::vector<long>());
+          const std::vector<long>& ords = std::vector<long>(),
+          const SlotFactorization* factorization = nullptr);
 
   // Used by ContextBuilder
   Context(long m,
@@ -215,8 +254,10 @@ private:
           const std::optional<ModChainParams>& mparams,
           const std::optional<BootStrapParams>& bparams);
 
-  // Used for serialisation
-  Context(const SerializableContent& content);
+  // Used for serialisation, with the tables read from a context cache if
+  // there is one
+  Context(const SerializableContent& content,
+          const CacheContent* cache = nullptr);
 
   // Methods for adding primes.
   void addSpecialPrimes(long nDgts,
@@ -369,6 +410,98 @@ public:
    **/
   const IndexSet& getDigit(long i) const { return digits[i]; }
 
+  /**
+   * @brief Get the tables for converting residues modulo the primes in
+   * `from` to residues modulo the primes in `to`, without big integers.
+   * @param from The source prime set.
+   * @param to The target prime set, disjoint from `from`.
+   * @return A shared pointer to the (immutable) converter.
+   * @note The tables are computed on the first call for each pair of sets
+   * and cached in the context. This method is thread safe.
+   **/
+  std::shared_ptr<const RNSBaseConverter>
+  getBaseConverter(const IndexSet& from, const IndexSet& to) const;
+
+  /**
+   * @brief Get the permutation that applies the automorphism X -> X^k to a
+   * row of a DoubleCRT: the new value in position j of the row is the old
+   * value in position table[j].
+   * @param k The Galois element, must be in Zm*.
+   * @return A shared pointer to the (immutable) table.
+   * @note The tables are cached in the context, subject to a memory budget
+   * (see setAutomorphCacheBudget). This method is thread safe.
+   **/
+  std::shared_ptr<const AutomorphCache::Table> getAutomorphTable(long k) const;
+
+  /**
+   * @brief Set the maximum memory (in bytes) used to cache the automorphism
+   * permutations, the least recently used ones are dropped beyond that.
+   * @param bytes The new budget, the default is
+   * `AutomorphCache::DEFAULT_BUDGET`.
+   **/
+  void setAutomorphCacheBudget(std::size_t bytes)
+  {
+    automorphTables.setBudget(bytes);
+  }
+
+  /**
+   * @brief How `DoubleCRT::breakIntoDigits` estimates the size of the
+   * digits, which makes up the noise added by key switching.
+   * - `EXACT`: the canonical-embedding norm of every digit, which needs its
+   *   coefficients and a complex FFT.
+   * - `BOUND`: the high-probability bound for uniform digits of their size
+   *   (`Context::noiseBoundForUniform`).
+   * - `SAMPLED`: `EXACT` once every N calls, and in between `BOUND` scaled
+   *   by the ratio exact/bound of the last exact call.
+   **/
+  enum class DigitNoiseEstimate
+  {
+    EXACT,
+    BOUND,
+    SAMPLED,
+  };
+
+  //! @brief Default N of `DigitNoiseEstimate::SAMPLED`
+  static constexpr long DEFAULT_DIGIT_NOISE_SAMPLE_PERIOD = 64;
+
+  /**
+   * @brief Set how the noise of key switching is estimated, see
+   * `DigitNoiseEstimate`. The default is `DigitNoiseEstimate::EXACT`.
+   * @param policy The new policy.
+   * @param samplePeriod The N of `DigitNoiseEstimate::SAMPLED`, must be
+   * positive.
+   **/
+  void setDigitNoiseEstimate(
+      DigitNoiseEstimate policy,
+      long samplePeriod = DEFAULT_DIGIT_NOISE_SAMPLE_PERIOD);
+
+  DigitNoiseEstimate getDigitNoiseEstimate() const
+  {
+    return digitNoiseEstimate.load();
+  }
+
+  long getDigitNoiseSamplePeriod() const
+  {
+    return digitNoiseSamplePeriod.load();
+  }
+
+  /**
+   * @brief Count a call of `DoubleCRT::breakIntoDigits` under the `SAMPLED`
+   * policy. This method is thread safe.
+   * @return Whether this call should compute the exact estimate.
+   **/
+  bool sampleDigitNoise() const;
+
+  //! @brief The ratio exact/bound of the last exact `SAMPLED` estimate
+  double getDigitNoiseRatio() const { return digitNoiseRatio.load(); }
+  void setDigitNoiseRatio(double ratio) const { digitNoiseRatio.store(ratio); }
+
+  /**
+   * @brief Getter method for the cache of automorphism permutations.
+   * @return A `const` reference to the cache, e.g. to query its memory use.
+   **/
+  const AutomorphCache& getAutomorphCache() const { return automorphTables; }
+
 #ifndef BIGINT_P
   /**
    * @brief Getter method for a recryption data object.
@@ -1016,6 +1149,47 @@ public:
    **/
   static Context* readPtrFromJSON(std::istream& str);
 
+  /**
+   * @brief Write out the `Context` object in binary format, along with
+   * tables derived from its parameters, as a "context cache".
+   *
+   * `readFromCache` restores the `Context` without computing these tables
+   * again. They are the factorizations of `Phi_m(X)` modulo `p^r`, which
+   * take most of the time of building a `BGV` `Context`, and if the
+   * `Context` is bootstrappable, the factorization modulo `p^{e-e'+r}` and
+   * the encoded constants of the linear maps of recryption (thin, and thick
+   * if enabled), which take most of the time of enabling bootstrapping.
+   * The cache is checked against a hash of its content.
+   * @param str Output `std::ostream`.
+   * @note The constants of the linear maps are written as they are in this
+   * `Context`: with `buildCache` they are `DoubleCRT` objects, which make a
+   * much larger cache.
+   * @note The FFT tables of the primes (`Cmodulus`), `PowerfulDCRT` and the
+   * `EncryptedArray` maps are still built on reading. The former two are
+   * NTL contexts and `fftRep`s, which NTL can only compute itself; the
+   * latter are derived from the cached factorization without factoring.
+   **/
+  void writeCacheTo(std::ostream& str) const;
+
+  /**
+   * @brief Read from the stream a `Context` object written by
+   * `writeCacheTo`.
+   * @param str Input `std::istream`.
+   * @return The deserialized `Context` object.
+   * @note An `IOError` is raised if the cache is damaged or was written by
+   * another version of HElib. The `Context` can then be read from its
+   * parameters with `readFrom` (and its cache written again).
+   **/
+  static Context readFromCache(std::istream& str);
+
+  /**
+   * @brief Read from the stream a `Context` object written by
+   * `writeCacheTo`.
+   * @param str Input `std::istream`.
+   * @return Raw pointer to the deserialized `Context` object.
+   **/
+  static Context* readPtrFromCache(std::istream& str);
+
   // Internal function to undo buldModChain.
   // Used for parameter generation programs.
   // FIXME Should this not be private?
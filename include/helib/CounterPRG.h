@@ -0,0 +1,59 @@
+/* Copyright (C) 2012-2020 IBM Corp.
+ * This program is Licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. See accompanying LICENSE file.
+ */
+#ifndef HELIB_COUNTERPRG_H
+#define HELIB_COUNTERPRG_H
+/**
+ * @file CounterPRG.h
+ * @brief A counter-mode pseudorandom generator (ChaCha20), whose output at
+ * any position can be computed without generating what comes before it.
+ **/
+
+#include <array>
+#include <cstdint>
+#include <NTL/ZZ.h>
+
+namespace helib {
+
+/**
+ * @class CounterPRG
+ * @brief The ChaCha20 block function of RFC 8439, keyed with a 256-bit seed.
+ *
+ * Unlike NTL's RandomStream, every 96-bit nonce selects an independent
+ * stream, and every 64-byte block of a stream is computed from its counter
+ * alone. This lets the pseudorandom part of a key-switching matrix be
+ * expanded one row (prime) at a time, in any order and in parallel.
+ **/
+class CounterPRG
+{
+public:
+  //! @brief The key is the 256 low-order bits of seed, which must be
+  //! non-negative
+  explicit CounterPRG(const NTL::ZZ& seed);
+
+  //! @brief The 16 little-endian words of block number counter of the stream
+  //! with the given nonce
+  void block(std::uint32_t out[16],
+             std::uint32_t counter,
+             const std::array<std::uint32_t, 3>& nonce) const;
+
+  //! @brief out[0..n-1] uniform in [0, q), for 2 <= q < 2^62, drawn by
+  //! rejection from the 64-bit words of the stream with nonce
+  //! (0, stream mod 2^32, stream / 2^32)
+  void uniformMod(long* out, long n, long q, std::uint64_t stream) const;
+
+private:
+  std::array<std::uint32_t, 8> key;
+};
+
+} // namespace helib
+
+#endif // ifndef HELIB_COUNTERPRG_H
@@ -294,6 +294,10 @@ public:
       DoubleCRT(other), skHandle(otherHandle)
   {}
 
+  CtxtPart(DoubleCRT&& other, const SKHandle& otherHandle) :
+      DoubleCRT(std::move(other)), skHandle(otherHandle)
+  {}
+
   /**
    * @brief Write out the `CtxtPart` object in binary format.
    * @param str Output `std::ostream`.
@@ -360,6 +364,20 @@ public:
    * @param j The `JsonWrapper` containing the serialized `SKHandle` object.
    **/
   void readJSON(const JsonWrapper& j);
+
+  /**
+   * @brief Write out the ciphertext part (`CtxtPart`) object to a
+   * `JsonWriter`, straight from its rows.
+   * @param writer The `JsonWriter` to write to.
+   **/
+  void writeToJSON(JsonWriter& writer) const;
+
+  /**
+   * @brief In-place read from the `JsonReader` the serialized ciphertext part
+   * (`CtxtPart`) object, straight into its rows.
+   * @param reader The `JsonReader` to read from.
+   **/
+  void readJSON(JsonReader& reader);
 };
 
 std::istream& operator>>(std::istream& s, CtxtPart& p);
@@ -403,6 +421,7 @@ class Ctxt
   friend class SecKey;
   friend class BasicAutomorphPrecon;
   friend class GaloisKey2k;
+  friend class SeededCtxt;
 
   const Context& context;      // points to the parameters of this FHE instance
   const PubKey& pubKey;        // points to the public encryption key;
@@ -456,6 +475,10 @@ class Ctxt
     addPart(part, part.skHandle, matchPrimeSet);
   }
 
+  // Same as above, but a part that is appended to *this is moved rather
+  // than copied
+  void addPart(CtxtPart&& part, bool matchPrimeSet = false);
+
   void subPart(const DoubleCRT& part,
                const SKHandle& handle,
                bool matchPrimeSet = false)
@@ -483,7 +506,8 @@ class Ctxt
   void keySwitchPart(const CtxtPart& p, const KeySwitch& W);
 
   // internal procedure used in key-switching
-  void keySwitchDigits(const KeySwitch& W, std::vector<DoubleCRT>& digits);
+  void keySwitchDigits(const KeySwitch& W,
+                       const std::vector<DoubleCRT>& digits);
 
   long getPartIndexByHandle(const SKHandle& handle) const
   {
@@ -501,6 +525,7 @@ class Ctxt
   // public key, this is needed when we copy the pubEncrKey member between
   // different public keys.
   Ctxt& privateAssign(const Ctxt& other);
+  Ctxt& privateAssign(Ctxt&& other);
 
   // explicitly multiply intFactor by e, which should be
   // in the interval [0, ptxtSpace)
@@ -516,6 +541,9 @@ public:
   // Default copy-constructor
   Ctxt(const Ctxt& other) = default;
 
+  // Moving takes over the parts of other, which is left with none
+  Ctxt(Ctxt&& other) = default;
+
   // VJS-FIXME: this was really a messy design choice to not
   // have ciphertext constructors that specify prime sets.
   // The default value of ctxtPrimes is kind of pointless.
@@ -544,6 +572,17 @@ public:
     return privateAssign(other);
   }
 
+  Ctxt& operator=(Ctxt&& other)
+  {
+    assertEq(&context,
+             &other.context,
+             "Cannot assign Ctxts with different context");
+    assertEq(&pubKey,
+             &other.pubKey,
+             "Cannot assign Ctxts with different pubKey");
+    return privateAssign(std::move(other));
+  }
+
   bool operator==(const Ctxt& other) const { return equalsTo(other); }
   bool operator!=(const Ctxt& other) const { return !equalsTo(other); }
 
@@ -571,7 +610,10 @@ public:
 
   void addCtxt(const Ctxt& other, bool negative = false);
 
-  // Multiply by another ciphertext
+  //! @brief Multiply by another ciphertext, with the modulus management of
+  //! multiplyBy but without re-linearization. The result has a part relative
+  //! to s^2 (or higher, if *this or other were not re-linearized) until
+  //! reLinearize() is called. See ProductAccumulator for sums of products.
   void multLowLvl(const Ctxt& other, bool destructive = false);
 
   // This is a high-level mul with relinearization
@@ -1477,6 +1519,21 @@ public:
    **/
   void readJSON(const JsonWrapper& j);
 
+  /**
+   * @brief Write out the ciphertext (`Ctxt`) object to a `JsonWriter`,
+   * without building the JSON document in memory. The JSON stream functions
+   * above go through this.
+   * @param writer The `JsonWriter` to write to.
+   **/
+  void writeToJSON(JsonWriter& writer) const;
+
+  /**
+   * @brief In-place read from the `JsonReader` the serialized ciphertext
+   * (`Ctxt`) object, without building the JSON document in memory.
+   * @param reader The `JsonReader` to read from.
+   **/
+  void readJSON(JsonReader& reader);
+
   // scale up c1, c2 so they have the same ratFactor
   static void equalizeRationalFactors(Ctxt& c1, Ctxt& c2);
 
@@ -1509,6 +1566,35 @@ inline Ctxt innerProduct(const std::vector<Ctxt>& v1,
   return ret;
 }
 
+/**
+ * @class ProductAccumulator
+ * @brief Sum of ciphertext products with a single re-linearization.
+ *
+ * The terms are added as they come out of multLowLvl, relative to s^2,
+ * after bringing them and the running sum down to the primes they share.
+ * The sum is re-linearized once by getSum(), so a sum of n products costs
+ * one key switch rather than n.
+ **/
+class ProductAccumulator
+{
+  Ctxt sum;
+
+public:
+  explicit ProductAccumulator(const PubKey& pubKey) : sum(pubKey) {}
+
+  //! @brief Add a*b to the sum
+  void addProduct(const Ctxt& a, const Ctxt& b);
+
+  //! @brief Add c to the sum, c need not be re-linearized
+  void add(const Ctxt& c, bool negative = false);
+
+  bool isEmpty() const { return sum.isEmpty(); }
+
+  //! @brief The sum so far, re-linearized. More terms can still be added
+  //! after this call, but each call re-linearizes the sum again.
+  Ctxt getSum() const;
+};
+
 //! Compute the inner product of a vectors of ciphertexts and a constant vector
 void innerProduct(Ctxt& result,
                   const std::vector<Ctxt>& v1,
@@ -32,11 +32,21 @@
 #include <helib/zzX.h>
 #include <helib/NumbTh.h>
 #include <helib/IndexMap.h>
+#include <helib/ResidueMap.h>
 #include <helib/timing.h>
 
 namespace helib {
 
 class Context;
+class CounterPRG;
+
+//! @brief The element-wise DoubleCRT operations (arithmetic, negation,
+//! automorphisms, scaling) are spread over the primes with NTL's thread pool
+//! only when phi(m) times the number of primes is at least this threshold,
+//! initially 2^16. Smaller objects are processed serially, as are calls made
+//! from within another NTL_EXEC_RANGE.
+long getDoubleCRTParallelThreshold();
+void setDoubleCRTParallelThreshold(long threshold);
 
 /**
  * @class DoubleCRTHelper
@@ -74,10 +84,11 @@ private:
  * The polynomial thus represented is defined modulo the product of all the
  * primes in use.
  *
- * The list of primes is defined by the data member indexMap.
- * indexMap.getIndexSet() defines the set of indices of primes
+ * The list of primes is defined by the data member map.
+ * map.getIndexSet() defines the set of indices of primes
  * associated with this DoubleCRT object: they index the
- * primes stored in the associated Context.
+ * primes stored in the associated Context. The rows themselves are kept
+ * in a single contiguous buffer (see ResidueMap).
  *
  * Arithmetic operations are computed modulo the product of the primes in use
  * and also modulo Phi_m(X). Arithmetic operations can only be applied to
@@ -89,14 +100,22 @@ class DoubleCRT
 private:
   const Context& context; // the context
 
-  // the data itself: if the i'th prime is in use then map[i] is the std::vector
-  // of evaluations wrt this prime
-  IndexMap<NTL::vec_long> map;
+  // the data itself: if the i'th prime is in use then map[i] points to the
+  // row of phi(m) evaluations wrt this prime
+  ResidueMap map;
 
   //! a "sanity check" method, verifies consistency of the map with
   //! current moduli chain, an error is raised if they are not consistent
   void verify();
 
+  // Add the primes in s1 (disjoint from the current index set), filling in
+  // their rows by base extension from the rows of the primes in from only
+  void extendFrom(const IndexSet& from, const IndexSet& s1);
+
+  // The rows in the mappable layout, see setMappableLayout in MappedFile.h
+  void writeAligned(std::ostream& str) const;
+  void readAligned(std::istream& str, const IndexSet& set, long sizeOfRow);
+
   // Generic operators.
   // The behavior when *this and other use different primes depends on the flag
   // matchIndexSets. When it is set to true then the effective modulus is
@@ -128,6 +147,9 @@ public:
   // Default copy-constructor:
   DoubleCRT(const DoubleCRT& other) = default;
 
+  // Moving takes over the rows of other, which is left with no primes
+  DoubleCRT(DoubleCRT&& other) noexcept = default;
+
   //! @brief Initializing DoubleCRT from a ZZX polynomial
   //! @param poly The ring element itself, zero if not specified
   //! @param _context The context for this DoubleCRT object, use "current active
@@ -180,6 +202,7 @@ public:
   //    DoubleCRT dCRT(context, indexSet); dCRT = poly;
 
   DoubleCRT& operator=(const DoubleCRT& other);
+  DoubleCRT& operator=(DoubleCRT&& other);
 
   // Copy only the primes in s \intersect other.getIndexSet()
   //  void partialCopy(const DoubleCRT& other, const IndexSet& s);
@@ -258,6 +281,16 @@ public:
   //! Returns the sum of the canonical embedding of the digits
   NTL::xdouble breakIntoDigits(std::vector<DoubleCRT>& dgts) const;
 
+  //! @brief The inner products of key switching, accA += sum_i d[i] * a[i]
+  //! and accB += sum_i d[i] * b[i], computed in one pass over the rows of
+  //! each prime with a single modular reduction per element. accA and accB
+  //! must have the same index set, contained in those of all the inputs.
+  static void innerProducts(DoubleCRT& accA,
+                            DoubleCRT& accB,
+                            const std::vector<DoubleCRT>& d,
+                            const std::vector<DoubleCRT>& a,
+                            const std::vector<DoubleCRT>& b);
+
   //! @brief Expand the index set by s1.
   //! It is assumed that s1 is disjoint from the current index set.
   //! If poly_p != 0, then *poly_p will first be set to the result of applying
@@ -325,6 +358,14 @@ public:
   void Sub(const DoubleCRT& other, bool matchIndexSets = true);
   void Mul(const DoubleCRT& other, bool matchIndexSets = true);
 
+  //! @brief Set *this = a * b, over the index set of *this, which must be
+  //! contained in those of a and b. Neither operand is copied, and either
+  //! may alias *this.
+  DoubleCRT& setProduct(const DoubleCRT& a, const DoubleCRT& b);
+
+  //! @brief *this += a * b, with the same requirements as setProduct
+  DoubleCRT& addProduct(const DoubleCRT& a, const DoubleCRT& b);
+
   // Division by constant
   DoubleCRT& operator/=(const NTL::ZZ& num);
   DoubleCRT& operator/=(long num) { return (*this /= NTL::to_ZZ(num)); }
@@ -347,15 +388,25 @@ public:
   // Utilities
 
   const Context& getContext() const { return context; }
-  const IndexMap<NTL::vec_long>& getMap() const { return map; }
+  const ResidueMap& getMap() const { return map; }
   const IndexSet& getIndexSet() const { return map.getIndexSet(); }
 
+  //! @brief Whether the rows are used in place from a MappedFile, rather
+  //! than owned by this object. The rows of a view are copied before they
+  //! are first modified, so a view never writes to the file's pages
+  bool isView() const { return map.isView(); }
+
   // Choose random DoubleCRT's, either at random or with small/Gaussian
   // coefficients.
 
   //! @brief Fills each row i with random ints mod pi, uses NTL's PRG
   void randomize(const NTL::ZZ* seed = nullptr);
 
+  //! @brief Fills each row i with random ints mod pi, taken from the stream
+  //! (stream, i) of prg. Every row only depends on prg, stream and i, so any
+  //! subset of the rows can be generated on its own.
+  void randomize(const CounterPRG& prg, long stream);
+
   //! Sampling routines:
   //! Each of these return a high probability bound on L-infty norm
   //! of canonical embedding
@@ -381,6 +432,14 @@ public:
   // used to implement modulus switching
   void scaleDownToSet(const IndexSet& s, NTL::ZZ& ptxtSpace, NTL::ZZX& delta);
 
+  //! @brief Same as above, but instead of delta return the scaled-down
+  //! fdelta[i] = delta[i]/diffProd, which is what modulus switching needs for
+  //! its noise estimate. Unless HElib is built with HELIB_LEGACY_MODSWITCH,
+  //! this is done fully in RNS, without ever computing delta itself.
+  void scaleDownToSet(const IndexSet& s,
+                      NTL::ZZ& ptxtSpace,
+                      std::vector<double>& fdelta);
+
   void FFT(const NTL::ZZX& poly, const IndexSet& s);
   void FFT(const zzX& poly, const IndexSet& s);
   // for internal use
@@ -390,7 +449,9 @@ public:
   // Raw I/O
 
   /**
-   * @brief Write out the `DoubleCRT` object in binary format.
+   * @brief Write out the `DoubleCRT` object in binary format: bit-packed
+   * rows, or the mappable layout if it was set on str (see
+   * setMappableLayout in MappedFile.h).
    * @param str Output `std::ostream`.
    **/
   void writeTo(std::ostream& str) const;
@@ -405,7 +466,8 @@ public:
 
   /**
    * @brief In-place read from the stream the serialized `DoubleCRT` object in
-   * binary format.
+   * binary format. Rows in the mappable layout are not copied when str is a
+   * `MappedStream`: the object is then a view of the file (see isView()).
    * @param str Input `std::istream`.
    **/
   void read(std::istream& str);
@@ -455,6 +517,20 @@ public:
    **/
   void readJSON(const JsonWrapper& j);
 
+  /**
+   * @brief Write out the `DoubleCRT` object to a `JsonWriter`, straight from
+   * its rows. The JSON stream functions above go through this.
+   * @param writer The `JsonWriter` to write to.
+   **/
+  void writeToJSON(JsonWriter& writer) const;
+
+  /**
+   * @brief In-place read from the `JsonReader` the serialized `DoubleCRT`
+   * object, straight into its rows.
+   * @param reader The `JsonReader` to read from.
+   **/
+  void readJSON(JsonReader& reader);
+
   // I/O: ONLY the matrix is outputted/recovered, not the moduli chain!! An
   // error is raised on input if this is not consistent with the current chain
 
@@ -25,6 +25,7 @@
 #include <helib/DoubleCRT.h>
 #include <helib/Context.h>
 #include <helib/Ctxt.h>
+#include <helib/HoistedCtxt.h>
 #include <helib/keys.h>
 #include <helib/exceptions.h>
 #include <helib/log.h>
@@ -150,6 +151,17 @@ public:
   //! @brief Right shift k positions along the i'th dimension with zero fill
   virtual void shift1D(Ctxt& ctxt, long i, long k) const = 0;
 
+  //! @brief The rotations rotate(ctxt, k) for every k in amounts. The
+  //! automorphisms applied to the original ciphertext share its digits,
+  //! and the rotations are computed in parallel
+  virtual std::vector<Ctxt> rotateMany(
+      const HoistedCtxt& ctxt,
+      const std::vector<long>& amounts) const = 0;
+
+  //! @brief Same as above, hoisting ctxt first
+  std::vector<Ctxt> rotateMany(const Ctxt& ctxt,
+                               const std::vector<long>& amounts) const;
+
   ///@{
   //! @name Encoding/decoding methods
   // encode/decode arrays into plaintext polynomials
@@ -511,6 +523,11 @@ public:
   }
   virtual void shift1D(Ctxt& ctxt, long i, long k) const override;
 
+  virtual std::vector<Ctxt> rotateMany(
+      const HoistedCtxt& ctxt,
+      const std::vector<long>& amounts) const override;
+  using EncryptedArrayBase::rotateMany;
+
   /* Begin CKKS functions. They will simply throw here. */
   /**
    * @brief Unimplemented decrypt function for CKKS. It will always
@@ -812,6 +829,17 @@ public:
   virtual void buildLinPolyCoeffs(std::vector<RX>& C,
                                   const std::vector<RX>& L) const;
 
+private:
+  // rotate and rotate1D, where the automorphisms that rotate/rotate1D
+  // apply to their input are instead computed from hoisted (if not null),
+  // which must then hold the same ciphertext as ctxt
+  void rotateFrom(Ctxt& ctxt, long k, const HoistedCtxt* hoisted) const;
+  void rotate1DFrom(Ctxt& ctxt,
+                    long i,
+                    long k,
+                    bool dc,
+                    const HoistedCtxt* hoisted) const;
+
 private:
   /* helper template methods, to avoid repetitive code */
 
@@ -929,6 +957,9 @@ public:
   void shift(Ctxt& ctxt, long k) const override;
   void rotate1D(Ctxt& ctxt, long i, long k, bool dc = false) const override;
   void shift1D(Ctxt& ctxt, long i, long k) const override;
+  std::vector<Ctxt> rotateMany(const HoistedCtxt& ctxt,
+                               const std::vector<long>& amounts) const override;
+  using EncryptedArrayBase::rotateMany;
 
   NTL::ZZ getP2R() const override { return alMod.getPPowR(); }
 
@@ -1684,6 +1715,16 @@ public:
     rep->rotate1D(ctxt, i, k, dc);
   }
   void shift1D(Ctxt& ctxt, long i, long k) const { rep->shift1D(ctxt, i, k); }
+  std::vector<Ctxt> rotateMany(const HoistedCtxt& ctxt,
+                               const std::vector<long>& amounts) const
+  {
+    return rep->rotateMany(ctxt, amounts);
+  }
+  std::vector<Ctxt> rotateMany(const Ctxt& ctxt,
+                               const std::vector<long>& amounts) const
+  {
+    return rep->rotateMany(ctxt, amounts);
+  }
 
   void encode(zzX& ptxt, const std::vector<long>& array) const
   {
@@ -62,6 +62,9 @@ private:
   std::unique_ptr<BlockMatMul1DExec> mat1;        // one block matrix
   NTL::Vec<std::unique_ptr<MatMul1DExec>> matvec; // regular matrices
 
+  // Used by readPtrFrom, the other fields are read from the stream
+  explicit EvalMap(const EncryptedArray& _ea) : ea(_ea) {}
+
 public:
   EvalMap(const EncryptedArray& _ea,
           bool minimal,
@@ -76,6 +79,12 @@ public:
 
   void upgrade();
   void apply(Ctxt& ctxt) const;
+
+  //! Binary serialization of the precomputed transformation, so that it
+  //! need not be computed again (see Context::writeCacheTo). The map must be
+  //! read with the EncryptedArray that it was built with.
+  void writeTo(std::ostream& str) const;
+  static EvalMap* readPtrFrom(std::istream& str, const EncryptedArray& ea);
 };
 
 //! @class ThinEvalMap
@@ -94,6 +103,9 @@ private:
   long nfactors; // how many factors of m
   NTL::Vec<std::unique_ptr<MatMulExecBase>> matvec; // regular matrices
 
+  // Used by readPtrFrom, the other fields are read from the stream
+  explicit ThinEvalMap(const EncryptedArray& _ea) : ea(_ea) {}
+
 public:
   ThinEvalMap(const EncryptedArray& _ea,
               bool minimal,
@@ -103,6 +115,10 @@ public:
 
   void upgrade();
   void apply(Ctxt& ctxt) const;
+
+  //! Binary serialization, as for EvalMap
+  void writeTo(std::ostream& str) const;
+  static ThinEvalMap* readPtrFrom(std::istream& str, const EncryptedArray& ea);
 };
 
 } // namespace helib
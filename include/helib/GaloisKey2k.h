@@ -1,7 +1,10 @@
 #pragma once
 
 #include <helib/keys.h>
+#include <helib/multicore.h>
+#include <iostream>
 #include <map>
+#include <vector>
 
 namespace helib {
 
@@ -10,17 +13,51 @@ class GaloisKey2k {
     size_t m;
     std::map<size_t, KeySwitch> keys;
 
+    //! Lookups in keys hold it shared, insertions exclusive. Entries are
+    //! never removed nor replaced, so a reference to one stays valid
+    mutable HELIB_SHARED_MUTEX_TYPE keys_lock;
+
+    //! step_elts[s] = 3^s mod m, for 0 <= s < m/4
+    std::vector<size_t> step_elts;
+
     //! Translates a step into a galois_elt
-    size_t get_elt_from_step(int32_t step);
+    size_t get_elt_from_step(int32_t step) const;
+
+    //! The galois_elts whose keys rotate by step: the one of step itself if
+    //! we have its key, otherwise those of the signed powers of two in the
+    //! non-adjacent form (NAF) of step
+    std::vector<size_t> get_elts_for_step(int32_t step) const;
+
+    //! The key for galois_elt, or nullptr
+    const KeySwitch* find_key(size_t galois_elt) const;
+
+    const KeySwitch& get_key(size_t galois_elt) const;
+
+    //! The automorphism followed by the actual key switch
+    void apply_galois(Ctxt& ctxt, size_t galois_elt) const;
 
     //! The actual key switch after the automorphism
-    void key_switch(Ctxt& ctxt, size_t galois_elt);
+    void key_switch(Ctxt& ctxt, size_t galois_elt) const;
+
+    //! The automorphism of ctxt, key-switched from the digits of its
+    //! part 1 (breakIntoDigits) rather than from a fresh decomposition
+    Ctxt hoisted_galois(const Ctxt& ctxt,
+                        const std::vector<DoubleCRT>& digits,
+                        NTL::xdouble added_noise,
+                        size_t galois_elt) const;
 
   public:
     GaloisKey2k(size_t m) : m(m) {
       if (m == 0 ||  (m & (m - 1)) != 0) { // check if power of 2
         throw RuntimeError("DoubleCRT::power_of_two_galois_automorph: Wrong configuration");
       }
+      size_t row_size = m >> 2;
+      step_elts.resize(row_size);
+      size_t galois_elt = 1;
+      for (size_t i = 0; i < row_size; i++) {
+        step_elts[i] = galois_elt;
+        galois_elt = (galois_elt * 3) % m;
+      }
     }
     virtual ~GaloisKey2k() = default;
 
@@ -29,11 +66,42 @@ class GaloisKey2k {
     GaloisKey2k(GaloisKey2k&& other) = delete;
     GaloisKey2k& operator=(const GaloisKey2k&) = delete;
 
-    //! Generate a key-switching matrix for a given step
+    //! Generate a key-switching matrix for a given step. Can run while
+    //! other threads rotate with the keys we already have
     void generate_step(const SecKey& sKey, int32_t step);
 
-    //! Apply the galois automorphism to a ciphertext, where step=0 implys rotate columns
-    void rotate(Ctxt& ctxt, int32_t step);
+    //! Generate the key-switching matrices for many steps at once, over
+    //! the threads of NTL. The matrix of each step depends on seed and on
+    //! the step, not on the number of threads; a zero seed (the default)
+    //! is replaced by a fresh random one. If out is given, the new matrices
+    //! are written to it as they are done, in the format of writeTo.
+    //! As for SecKey::GenKeySWmatrices, a nonzero seed is secret key
+    //! material: it must be uniformly random, of at least 256 bits, and
+    //! kept as secret as sKey, since it determines the RLWE errors
+    void generate_steps(const SecKey& sKey,
+                        const std::vector<int32_t>& steps,
+                        const NTL::ZZ& seed = NTL::ZZ::zero(),
+                        std::ostream* out = nullptr);
+
+    //! Generate the key-switching matrices for the steps +-2^k, enough to
+    //! rotate by any step
+    void generate_power_of_two_steps(const SecKey& sKey);
+
+    //! Apply the galois automorphism to a ciphertext, where step=0 implys rotate columns.
+    //! Without a key for step, rotates by the powers of two in the NAF of step
+    void rotate(Ctxt& ctxt, int32_t step) const;
+
+    //! The rotations of ctxt by each of steps. ctxt is broken into digits
+    //! once, and the digits are shared by the first key switch of every step
+    std::vector<Ctxt> rotateMany(const Ctxt& ctxt,
+                                 const std::vector<int32_t>& steps) const;
+
+    //! Write all the key-switching matrices in binary. Each one is written
+    //! as its b part and PRG seed, its a part is expanded again when used
+    void writeTo(std::ostream& str) const;
+
+    //! Read matrices written by writeTo, adding those we do not have yet
+    void read(std::istream& str, const Context& context);
 };
 
 } // namespace helib
@@ -0,0 +1,133 @@
+/* Copyright (C) 2012-2020 IBM Corp.
+ * This program is Licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. See accompanying LICENSE file.
+ */
+#ifndef HELIB_HOISTEDCTXT_H
+#define HELIB_HOISTEDCTXT_H
+/**
+ * @file HoistedCtxt.h
+ * @brief Applying many automorphisms to one ciphertext, breaking it into
+ * digits only once ("hoisting")
+ **/
+
+#include <memory>
+#include <vector>
+#include <helib/Ctxt.h>
+#include <helib/multicore.h>
+
+namespace helib {
+
+class EncryptedArray; // forward reference
+
+/**
+ * @class BasicAutomorphPrecon
+ * @brief Pre-computation to speed many automorphism on the same ciphertext.
+ *
+ * The expensive part of homomorphic automorphism is breaking the ciphertext
+ * parts into digits. The usual setting is we first rotate the ciphertext
+ * parts, then break them into digits. But when we apply many automorphisms
+ * it is faster to break the original ciphertext into digits, then rotate
+ * the digits (as opposed to first rotate, then break).
+ * An BasicAutomorphPrecon object breaks the original ciphertext and keeps
+ * the digits, then when you call automorph is only needs to apply the
+ * native automorphism and key switching to the digits, which is fast(er).
+ *
+ * The ciphertexts returned by automorph are still defined relative to the
+ * special primes. Many of them can be added up before a single cleanUp().
+ **/
+class BasicAutomorphPrecon
+{
+  Ctxt ctxt;
+  NTL::xdouble noise;
+  std::vector<DoubleCRT> polyDigits;
+
+public:
+  BasicAutomorphPrecon(const Ctxt& _ctxt);
+
+  //! @brief rho_k(ctxt). Only the first key-switching hop on the way to k
+  //! uses the stored digits, the others (if any) go through smartAutomorph
+  std::shared_ptr<Ctxt> automorph(long k) const;
+
+  //! @brief The ciphertext whose digits are stored (after cleanUp)
+  const Ctxt& getCtxt() const { return ctxt; }
+};
+
+/**
+ * @class GeneralAutomorphPrecon
+ * @brief Pre-computation for the automorphisms rho_dim^i, 0 <= i < D, along
+ * one dimension of size D, using the key-switching strategy of the public key
+ * for that dimension (see PubKey::getKSStrategy)
+ **/
+class GeneralAutomorphPrecon
+{
+public:
+  virtual ~GeneralAutomorphPrecon() {}
+
+  virtual std::shared_ptr<Ctxt> automorph(long i) const = 0;
+};
+
+//! @brief Build the GeneralAutomorphPrecon for dimension dim of ea, where
+//! dim == -1 stands for Frobenius and dim == ea.dimension() for the dummy
+//! generator of order 1
+std::shared_ptr<GeneralAutomorphPrecon> buildGeneralAutomorphPrecon(
+    const Ctxt& ctxt,
+    long dim,
+    const EncryptedArray& ea);
+
+/**
+ * @class HoistedCtxt
+ * @brief A ciphertext broken into digits once, from which any number of
+ * automorphisms can be computed.
+ *
+ * automorph1D picks the key-switching chain of each dimension from the
+ * public key: with the BSGS strategy the giant steps are computed once per
+ * dimension (on first use) and then shared by all the rotations along it;
+ * otherwise the first hop to the target automorphism reuses the digits of
+ * the original ciphertext.
+ *
+ * A HoistedCtxt can be used concurrently from several threads.
+ * See also EncryptedArray::rotateMany.
+ **/
+class HoistedCtxt
+{
+  BasicAutomorphPrecon basic;
+  mutable HELIB_MUTEX_TYPE preconLock;
+  // the BSGS pre-computation of dimension dim is at index dim+1
+  mutable std::vector<std::shared_ptr<GeneralAutomorphPrecon>> precon;
+
+public:
+  explicit HoistedCtxt(const Ctxt& ctxt);
+
+  HoistedCtxt(const HoistedCtxt& other) = delete;
+  HoistedCtxt& operator=(const HoistedCtxt& other) = delete;
+
+  //! @brief The original ciphertext (after cleanUp)
+  const Ctxt& getCtxt() const { return basic.getCtxt(); }
+
+  //! @brief rho_k(ctxt), for any k in Zm* reachable by the key-switching
+  //! matrices of the public key. The result is still defined relative to the
+  //! special primes, call cleanUp() on it (or on a sum of several of them)
+  Ctxt automorph(long k) const;
+
+  //! @brief rho_dim^e(ctxt), i.e. automorph(genToPow(dim, e)), with
+  //! -1 <= dim <= #gens as in buildGeneralAutomorphPrecon
+  Ctxt automorph1D(long dim, long e) const;
+
+  //! @brief Do now the per-dimension pre-computation that automorph1D would
+  //! otherwise do on first use, so that it can use all the threads
+  void precompute1D(long dim) const;
+
+private:
+  const GeneralAutomorphPrecon* getPrecon(long dim) const;
+};
+
+} // namespace helib
+
+#endif // ifndef HELIB_HOISTEDCTXT_H
@@ -5,6 +5,11 @@
 
 namespace helib {
 
+// Streaming counterparts of JsonWrapper, used internally by the JSON
+// serialization of keys and ciphertexts
+class JsonWriter;
+class JsonReader;
+
 struct JsonWrapper
 {
 public:
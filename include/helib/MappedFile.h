@@ -0,0 +1,151 @@
+/* Copyright (C) 2012-2020 IBM Corp.
+ * This program is Licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. See accompanying LICENSE file.
+ */
+#ifndef HELIB_MAPPEDFILE_H
+#define HELIB_MAPPEDFILE_H
+/**
+ * @file MappedFile.h
+ * @brief Reading keys and ciphertexts from memory-mapped files, without
+ * copying their rows.
+ **/
+
+#include <cstddef>
+#include <istream>
+#include <memory>
+#include <streambuf>
+#include <string>
+
+namespace helib {
+
+// Memory mapping needs POSIX mmap: elsewhere HELIB_MAPPED_FILES is not
+// defined and objects are always read by copying them from a stream (the
+// mappable layout can still be written and read, see setMappableLayout).
+#ifdef HELIB_MAPPED_FILES
+
+/**
+ * @class MappedFile
+ * @brief A whole file, mapped into memory.
+ *
+ * The mapping is private and read-only: its pages are read from the file
+ * only when first touched and are shared by all the processes that map the
+ * same file. Objects read in place from it copy their rows before they
+ * modify them (see ResidueMap::detach), they never write to the mapping.
+ **/
+class MappedFile
+{
+public:
+  //! @brief Map the file at path, raises an IOError if it cannot be mapped
+  //! or is not a regular file
+  explicit MappedFile(const std::string& path);
+
+  //! @brief A mapping of the file at path if it is a regular file that can
+  //! be mapped, nullptr otherwise (e.g., for a pipe or a missing file). Other
+  //! files are not opened, so they can still be read as a stream
+  static std::shared_ptr<MappedFile> mapIfRegular(const std::string& path);
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  char* data() const { return base; }
+  std::size_t size() const { return length; }
+  const std::string& getPath() const { return path; }
+
+private:
+  std::string path;
+  char* base = nullptr;
+  std::size_t length = 0;
+};
+
+/**
+ * @class MappedStreamBuf
+ * @brief A read-only, seekable stream buffer over a MappedFile.
+ *
+ * The readers of DoubleCRT objects recognize this buffer: the rows that
+ * were written with the mappable layout (see setMappableLayout) are not
+ * copied but used in place, and the resulting objects keep the file mapped.
+ *
+ * @note Objects read in place from the same bytes of the same MappedFile
+ * share their rows only as long as they are not modified: the first write
+ * to one of them copies its rows, and never changes the file or the others.
+ **/
+class MappedStreamBuf : public std::streambuf
+{
+public:
+  explicit MappedStreamBuf(std::shared_ptr<MappedFile> file);
+
+  const std::shared_ptr<MappedFile>& getFile() const { return file; }
+
+  //! @brief The next byte to be read
+  char* position() const { return gptr(); }
+
+  //! @brief The number of bytes left to be read
+  std::size_t remaining() const { return egptr() - gptr(); }
+
+  //! @brief Skip n bytes, n must be at most remaining()
+  void advance(std::size_t n) { setg(eback(), gptr() + n, egptr()); }
+
+protected:
+  pos_type seekoff(off_type off,
+                   std::ios_base::seekdir dir,
+                   std::ios_base::openmode which) override;
+  pos_type seekpos(pos_type pos, std::ios_base::openmode which) override;
+
+private:
+  std::shared_ptr<MappedFile> file;
+};
+
+/**
+ * @class MappedStream
+ * @brief An std::istream over a MappedFile, to pass to the usual readFrom
+ * methods, e.g.
+ * @code
+ *   auto file = std::make_shared<helib::MappedFile>("pk.bin");
+ *   helib::MappedStream str(file);
+ *   helib::PubKey pk = helib::PubKey::readFrom(str, context);
+ * @endcode
+ **/
+class MappedStream : public std::istream
+{
+public:
+  explicit MappedStream(std::shared_ptr<MappedFile> file);
+
+  const std::shared_ptr<MappedFile>& getFile() const { return buf.getFile(); }
+
+private:
+  MappedStreamBuf buf;
+};
+
+#endif // ifdef HELIB_MAPPED_FILES
+
+/**
+ * @brief Make the binary writers of DoubleCRT objects, and hence of
+ * ciphertexts and keys, use the mappable layout on str.
+ *
+ * In this layout the rows of a DoubleCRT are written as in memory: 64-bit
+ * residues, in the evaluation order of this build, with every row padded
+ * to `ResidueMap::ROW_ALIGN` bytes and the first one starting at a multiple
+ * of `ResidueMap::ROW_ALIGN` from the beginning of str. This takes more
+ * space than the default bit-packed rows, but reading it through a
+ * MappedStream costs neither a copy nor any memory besides the page cache.
+ * Any stream can still read it, by copying the rows.
+ *
+ * @note The alignment is taken from str.tellp(), so str should be a file
+ * stream opened at the beginning of the file to be mapped.
+ **/
+void setMappableLayout(std::ios_base& str, bool mappable = true);
+
+//! @brief Whether setMappableLayout is on for str
+bool hasMappableLayout(std::ios_base& str);
+
+} // namespace helib
+
+#endif // ifndef HELIB_MAPPEDFILE_H
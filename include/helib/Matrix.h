@@ -571,12 +571,21 @@ inline Tensor<T, 2> operator*(const Tensor<T, 2>& M1, const Tensor<T2, 2>& M2)
   for (long i = first; i < last; ++i)
     // For reference before NTL threads: for (std::size_t i = 0; i < M1.dims(0);
     // ++i)
-    for (std::size_t j = 0; j < M2.dims(1); ++j)
-      for (std::size_t k = 0; k < M2.dims(0); ++k) {
-        T R_tmp = M1(i, k);
-        R_tmp *= M2(k, j);
-        R(i, j) += R_tmp;
+    for (std::size_t j = 0; j < M2.dims(1); ++j) {
+      if constexpr (std::is_same_v<T, Ctxt> && std::is_same_v<T2, Ctxt>) {
+        // One re-linearization per entry rather than one per product
+        ProductAccumulator acc(R(i, j).getPubKey());
+        for (std::size_t k = 0; k < M2.dims(0); ++k)
+          acc.addProduct(M1(i, k), M2(k, j));
+        R(i, j) += acc.getSum();
+      } else {
+        for (std::size_t k = 0; k < M2.dims(0); ++k) {
+          T R_tmp = M1(i, k);
+          R_tmp *= M2(k, j);
+          R(i, j) += R_tmp;
+        }
       }
+    }
   NTL_EXEC_RANGE_END
 
   HELIB_NTIMER_STOP(MatrixMultiplicationNotConv);
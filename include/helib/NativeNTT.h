@@ -0,0 +1,145 @@
+/* Copyright (C) 2012-2020 IBM Corp.
+ * This program is Licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. See accompanying LICENSE file.
+ */
+#ifndef HELIB_NATIVENTT_H
+#define HELIB_NATIVENTT_H
+/**
+ * @file NativeNTT.h
+ * @brief In-tree negacyclic NTT and element-wise modular arithmetic kernels,
+ * with AVX2 and AVX-512 versions selected at runtime.
+ *
+ * These are used by Cmodulus (when m is a power of two) and by DoubleCRT
+ * when HElib is built without Intel HEXL.
+ **/
+
+#include <cstdint>
+#include <vector>
+#include <NTL/ZZ.h>
+
+namespace helib {
+
+//! @brief The instruction sets that the native kernels can use
+enum class SimdLevel
+{
+  SCALAR = 0,
+  AVX2 = 1,
+  AVX512 = 2,      // AVX512F + AVX512DQ
+  AVX512_IFMA = 3, // AVX512 + IFMA52, used for moduli below 2^50
+};
+
+//! @brief The best level supported by this CPU (and compiler)
+SimdLevel detectSimdLevel();
+
+//! @brief The level currently used by the native kernels, initially
+//! detectSimdLevel()
+SimdLevel getSimdLevel();
+
+//! @brief Change the level used by the native kernels, e.g. for testing or
+//! benchmarking. Levels that the CPU does not support are lowered to
+//! detectSimdLevel().
+void setSimdLevel(SimdLevel level);
+
+//! @brief Whether Cmodulus uses the native NTT (the default) rather than
+//! NTL's FFT when m is a power of two. Has no effect in builds with HEXL.
+bool nativeNTTEnabled();
+void setNativeNTTEnabled(bool enabled);
+
+/**
+ * @class NativeNTT
+ * @brief Negacyclic NTT of length n (a power of two) modulo a prime q.
+ *
+ * Given a primitive 2n-th root of unity psi mod q, forward() maps the
+ * coefficients of a(X) mod (X^n + 1) to the evaluations a(psi^(2i+1)), in
+ * bit-reversed order: position j holds the evaluation with i = bitrev(j).
+ * This is the same output as multiplying by the powers of psi followed by
+ * NTL's FFTFwd, and inverse() is its exact inverse.
+ *
+ * The butterflies are Harvey's, with Shoup's precomputed quotients for the
+ * twiddle factors and lazy reduction: values stay in [0, 4q) during the
+ * forward transform and in [0, 2q) during the inverse, and are reduced to
+ * [0, q) only at the end. This requires q < 2^62.
+ **/
+class NativeNTT
+{
+public:
+  NativeNTT(long n, long q, long psi);
+
+  //! @brief Can a NativeNTT be built for the modulus q?
+  static bool supports(long q) { return q > 2 && q < (1L << 62); }
+
+  long getN() const { return n; }
+  long getQ() const { return long(q); }
+
+  //! @brief In place forward transform, inputs and outputs in [0, q)
+  void forward(long* a) const;
+
+  //! @brief In place inverse transform, inputs and outputs in [0, q)
+  void inverse(long* a) const;
+
+private:
+  long n;
+  long logn;
+  std::uint64_t q;
+
+  // psi^bitrev(i) and psi^-bitrev(i), with their Shoup quotients
+  // floor(w * 2^64 / q)
+  std::vector<std::uint64_t> fwdW, fwdWp;
+  std::vector<std::uint64_t> invW, invWp;
+  // n^{-1} mod q
+  std::uint64_t nInv, nInvp;
+
+  // The same quotients with 52 bits (floor(w * 2^52 / q)) for IFMA, only
+  // when q < 2^50
+  std::vector<std::uint64_t> fwdWp52, invWp52;
+  std::uint64_t nInvp52 = 0;
+};
+
+// Element-wise modular arithmetic on rows of length n, with all the inputs
+// in [0, q). The result may alias either operand.
+
+void eltwiseAddMod(long* result,
+                   const long* a,
+                   const long* b,
+                   long n,
+                   long q);
+void eltwiseAddMod(long* result, const long* a, long scalar, long n, long q);
+
+void eltwiseSubMod(long* result,
+                   const long* a,
+                   const long* b,
+                   long n,
+                   long q);
+void eltwiseSubMod(long* result, const long* a, long scalar, long n, long q);
+
+void eltwiseMulMod(long* result,
+                   const long* a,
+                   const long* b,
+                   long n,
+                   long q,
+                   NTL::mulmod_t qinv);
+void eltwiseMulMod(long* result, const long* a, long scalar, long n, long q);
+
+//! @brief The two inner products of key switching, which share their left
+//! operand: ra[j] += sum_k d[k][j] * a[k][j] and rb[j] += sum_k d[k][j] *
+//! b[k][j] (mod q), for k < count. The products are accumulated lazily in
+//! 128 bits and reduced once per element. Requires q < 2^62.
+void eltwiseFusedDotMod(long* ra,
+                        long* rb,
+                        const long* const* d,
+                        const long* const* a,
+                        const long* const* b,
+                        long count,
+                        long n,
+                        long q);
+
+} // namespace helib
+
+#endif // ifndef HELIB_NATIVENTT_H
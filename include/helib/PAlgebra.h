@@ -304,6 +304,25 @@ public:
   // TODO: should have a special case when m is power of two
 };
 
+/**
+ * @struct SlotFactorization
+ * @brief The factorization of Phi_m(X) modulo p^r into the polynomials F_t
+ * of the slots, with their CRT coefficients (see
+ * PAlgebraModDerived::getCrtCoeffs), as coefficient vectors over Z.
+ *
+ * Computing them is the bulk of the construction of a PAlgebraMod. A
+ * PAlgebraMod built from a SlotFactorization taken from another one with the
+ * same PAlgebra and r (see PAlgebraMod::getSlotFactorization) skips that
+ * computation, this is how a context is restored from its cache (see
+ * Context::writeCacheTo).
+ **/
+struct SlotFactorization
+{
+  long r = 0;
+  std::vector<NTL::ZZX> factors;
+  std::vector<NTL::ZZX> crtCoeffs;
+};
+
 #ifndef BIGINT_P
 
 enum PA_tag
@@ -477,6 +496,9 @@ public:
   //! Returns reference to the factorization of Phi_m(X) mod p^r, but as ZZX's
   virtual const std::vector<NTL::ZZX>& getFactorsOverZZ() const = 0;
 
+  //! Returns the factorization of Phi_m(X) mod p^r with its CRT coefficients
+  virtual SlotFactorization getSlotFactorization() const = 0;
+
   //! The value r
   virtual long getR() const = 0;
 
@@ -596,13 +618,19 @@ private:
   std::vector<RX> crtTable;
   std::shared_ptr<TNode<RX>> crtTree;
 
+  // Set factors and crtCoeffs, along with PhimXMod and pPowRContext
+  void factorPhimX();
+  void setFactors(const SlotFactorization& factorization);
   void genMaskTable();
   void genCrtTable();
 
 public:
   PAlgebraModDerived& operator=(const PAlgebraModDerived&) = delete;
 
-  PAlgebraModDerived(const PAlgebra& zMStar, long r);
+  //! The factors of Phi_m(X) mod p^r are computed, unless they are given
+  PAlgebraModDerived(const PAlgebra& zMStar,
+                     long r,
+                     const SlotFactorization* factorization = nullptr);
 
   PAlgebraModDerived(const PAlgebraModDerived& other) // copy constructor
       :
@@ -616,6 +644,8 @@ public:
     restoreContext();
     PhimXMod = other.PhimXMod;
     factors = other.factors;
+    factorsOverZZ = other.factorsOverZZ;
+    crtCoeffs = other.crtCoeffs;
     maskTable = other.maskTable;
     crtTable = other.crtTable;
     crtTree = other.crtTree;
@@ -639,6 +669,9 @@ public:
     return factorsOverZZ;
   }
 
+  //! Returns the factorization of Phi_m(X) mod p^r with its CRT coefficients
+  virtual SlotFactorization getSlotFactorization() const override;
+
   //! The value r
   virtual long getR() const override { return r; }
 
@@ -806,6 +839,11 @@ public:
     throw LogicError("PAlgebraModCx::getFactorsOverZZ undefined");
   }
 
+  SlotFactorization getSlotFactorization() const override
+  {
+    throw LogicError("PAlgebraModCx::getSlotFactorization undefined");
+  }
+
   zzX getMask_zzX(UNUSED long i, UNUSED long j) const override
   {
     throw LogicError("PAlgebraModCx::getMask_zzX undefined");
@@ -815,7 +853,10 @@ public:
 typedef PAlgebraModDerived<PA_cx> PAlgebraModCx;
 
 //! Builds a table, of type PA_GF2 if p == 2 and r == 1, and PA_zz_p otherwise
-PAlgebraModBase* buildPAlgebraMod(const PAlgebra& zMStar, long r);
+PAlgebraModBase* buildPAlgebraMod(
+    const PAlgebra& zMStar,
+    long r,
+    const SlotFactorization* factorization = nullptr);
 
 // A simple wrapper for a pointer to an object of type PAlgebraModBase.
 //
@@ -837,10 +878,13 @@ public:
 
   PAlgebraMod& operator=(const PAlgebraMod&) = delete;
 
-  explicit PAlgebraMod(const PAlgebra& zMStar, long r) :
-      rep(buildPAlgebraMod(zMStar, r))
+  explicit PAlgebraMod(const PAlgebra& zMStar,
+                       long r,
+                       const SlotFactorization* factorization = nullptr) :
+      rep(buildPAlgebraMod(zMStar, r, factorization))
   {}
-  // constructor
+  // constructor, the factorization of Phi_m(X) mod p^r is computed unless
+  // it is given
 
   //! Downcast operator
   //! example: const PAlgebraModDerived<PA_GF2>& rep =
@@ -875,6 +919,11 @@ public:
   {
     return rep->getFactorsOverZZ();
   }
+  //! Returns the factorization of Phi_m(X) mod p^r with its CRT coefficients
+  SlotFactorization getSlotFactorization() const
+  {
+    return rep->getSlotFactorization();
+  }
   //! The value r
   long getR() const { return rep->getR(); }
   //! The value p^r
@@ -907,7 +956,10 @@ private:
 public:
   PAlgebraMod& operator=(const PAlgebraMod&) = delete;
 
-  explicit PAlgebraMod(const PAlgebra& zMStar, long r) :
+  // There is no factorization of Phi_m(X) to compute here
+  explicit PAlgebraMod(const PAlgebra& zMStar,
+                       long r,
+                       UNUSED const SlotFactorization* factorization = nullptr) :
     zMStar(zMStar), r(r)
   {
     NTL::ZZ p = zMStar.getP();
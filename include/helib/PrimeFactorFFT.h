@@ -0,0 +1,102 @@
+/* Copyright (C) 2012-2020 IBM Corp.
+ * This program is Licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. See accompanying LICENSE file.
+ */
+#ifndef HELIB_PRIMEFACTORFFT_H
+#define HELIB_PRIMEFACTORFFT_H
+/**
+ * @file PrimeFactorFFT.h
+ * @brief A direct length-n FFT modulo a single-precision prime, for n that
+ * is a product of small prime powers. Used by Cmodulus instead of
+ * BluesteinFFT when it is expected to be faster.
+ **/
+
+#include <vector>
+#include <helib/NumbTh.h>
+
+namespace helib {
+
+/**
+ * @class PrimeFactorFFT
+ * @brief Computes y[k] = sum_j x[j] omega^{jk} for a primitive n-th root of
+ * unity omega, without the zero padding of Bluestein's algorithm.
+ *
+ * The transform is split along the prime-power factors n = n_1 * ... * n_r
+ * with the Good-Thomas (prime factor) index mapping, which needs no twiddle
+ * factors between the factors. The transforms of length p^e along each
+ * factor are radix-p Cooley-Tukey transforms. Their length-p butterflies are
+ * computed directly for small p, and with Rader's algorithm (a cyclic
+ * convolution of length p-1, using NTL's FFT) for larger p.
+ *
+ * As with BluesteinInit/BluesteinFFT, the tables are relative to NTL's
+ * current zz_p modulus, which must be the same when the object is built and
+ * when it is used. Like BluesteinFFT, the inverse transform is obtained with
+ * omega^{-1} and is not scaled.
+ **/
+class PrimeFactorFFT
+{
+public:
+  PrimeFactorFFT(long n, const NTL::zz_p& omega);
+
+  long getN() const { return n; }
+
+  //! @brief out = DFT(in), both of length n with entries in [0, q).
+  //! out may be equal to in.
+  void apply(long* out, const long* in) const;
+
+  //! @brief Is this transform expected to be faster than BluesteinFFT for
+  //! length n? This is a rough operation count, good enough to tell apart
+  //! the m's with only small prime factors from those with a large one.
+  static bool preferable(long n);
+
+private:
+  // The transform along one prime-power factor p^e of n
+  struct Factor
+  {
+    long p;      // the prime
+    long e;      // its exponent
+    long len;    // p^e
+    long stride; // distance between consecutive elements in the buffer
+
+    // powers of the len-th root of unity used along this factor
+    std::vector<long> wPow;
+    std::vector<NTL::mulmod_precon_t> wPowAux;
+
+    // base-p digit reversal of [0, len)
+    std::vector<long> digitRev;
+
+    // powers of zeta, the p-th root of unity (for direct butterflies)
+    std::vector<long> zeta;
+    std::vector<NTL::mulmod_precon_t> zetaAux;
+
+    // Rader's algorithm: g^b mod p, g^{-b} mod p, and the FFT of the
+    // convolution kernel zeta^{g^{-b}}, of size 2^raderK
+    bool rader = false;
+    std::vector<long> gPow;
+    std::vector<long> gInvPow;
+    long raderK = 0;
+    NTL::fftRep kernel;
+  };
+
+  long n;
+  long q;
+  std::vector<Factor> factors;
+
+  // perm[t] is the index in [0, n) of position t in the multi-dimensional
+  // buffer, for both the input and the output
+  std::vector<long> perm;
+
+  void primePowerDFT(long* v, const Factor& f) const;
+  void butterfly(long* u, const Factor& f) const;
+};
+
+} // namespace helib
+
+#endif // ifndef HELIB_PRIMEFACTORFFT_H
@@ -0,0 +1,118 @@
+/* Copyright (C) 2012-2020 IBM Corp.
+ * This program is Licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. See accompanying LICENSE file.
+ */
+#ifndef HELIB_RNSBASECONVERTER_H
+#define HELIB_RNSBASECONVERTER_H
+/**
+ * @file RNSBaseConverter.h
+ * @brief Fast base extension between two sets of primes, using only
+ * single-precision arithmetic.
+ **/
+
+#include <vector>
+#include <NTL/ZZ.h>
+#include <helib/IndexSet.h>
+
+namespace helib {
+
+class Context;
+
+/**
+ * @class RNSBaseConverter
+ * @brief Converts residues modulo the primes of one IndexSet to residues
+ * modulo the primes of another IndexSet, without going through NTL::ZZ.
+ *
+ * Let Q be the product of the primes q_j in `from`, and qhat_j = Q/q_j.
+ * For an integer x given by its residues c_j = x mod q_j, we compute
+ * y_j = [c_j * qhat_j^{-1}]_{q_j} and v = round(sum_j y_j/q_j), and then
+ *
+ *   x = sum_j y_j * qhat_j - v * Q
+ *
+ * is the representative of x in the balanced interval [-Q/2, Q/2], the same
+ * one returned by DoubleCRT::toPoly. Reducing this sum modulo every prime
+ * p_i in `to` only needs the word-sized tables qhat_j mod p_i and v*Q mod
+ * p_i (note 0 <= v <= |from|). The quotient v is computed in extended
+ * precision floating point, so the result is exact unless x is within a
+ * relative distance of about 2^{-60} of +-Q/2.
+ *
+ * The conversion works on coefficients, i.e., callers must apply the inverse
+ * FFT to DoubleCRT rows before converting them and the forward FFT after.
+ * Objects are immutable once constructed, and are shared through
+ * Context::getBaseConverter.
+ **/
+class RNSBaseConverter
+{
+public:
+  RNSBaseConverter(const Context& context,
+                   const IndexSet& from,
+                   const IndexSet& to);
+
+  const IndexSet& getFrom() const { return from; }
+  const IndexSet& getTo() const { return to; }
+
+  /**
+   * @brief Convert n integers from the `from` basis to the `to` basis.
+   * @param out Output, row k (starting at out + k*outStride) holds the
+   * residues modulo the k'th prime of `to`, in the range [0, p_k).
+   * @param outStride Distance between the starts of consecutive output rows.
+   * @param in Input, row k holds the residues modulo the k'th prime of
+   * `from`, in the range [0, q_k).
+   * @param inStride Distance between the starts of consecutive input rows.
+   * @param n Number of integers (columns) to convert.
+   * @param frac If not null, frac[h] is set to x_h/Q, which lies in
+   * [-1/2, 1/2]. This is used to estimate the size of x_h without
+   * reconstructing it.
+   **/
+  void convert(long* out,
+               long outStride,
+               const long* in,
+               long inStride,
+               long n,
+               double* frac = nullptr) const;
+
+  /**
+   * @brief Same as convert, but to a single modulus t which does not have to
+   * be prime (e.g., the plaintext space).
+   * @param out Output, out[h] = x_h mod t in the range [0, t).
+   * @param t The modulus, 1 < t < NTL_SP_BOUND.
+   * @note The quotient v is computed exactly as in convert, so the results of
+   * the two methods describe the same integers x_h.
+   **/
+  void convertTo(long* out, long t, const long* in, long inStride, long n)
+      const;
+
+  //! @brief Q mod t, for any single-precision t
+  long productMod(long t) const;
+
+private:
+  IndexSet from;
+  IndexSet to;
+
+  std::vector<long> fromQ; // the primes q_j of from
+  std::vector<long> toQ;   // the primes p_i of to
+
+  // qhat_j^{-1} mod q_j
+  std::vector<long> qhatInv;
+  std::vector<NTL::mulmod_precon_t> qhatInvPrecon;
+  // 1/q_j
+  std::vector<long double> qRecip;
+
+  // qhatMod[i*nFrom + j] = qhat_j mod p_i
+  std::vector<long> qhatMod;
+  std::vector<NTL::mulmod_precon_t> qhatModPrecon;
+
+  // vQMod[i*(nFrom+1) + v] = v*Q mod p_i, for v = 0..nFrom
+  std::vector<long> vQMod;
+};
+
+} // namespace helib
+
+#endif // ifndef HELIB_RNSBASECONVERTER_H
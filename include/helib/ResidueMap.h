@@ -0,0 +1,217 @@
+/* Copyright (C) 2012-2020 IBM Corp.
+ * This program is Licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. See accompanying LICENSE file.
+ */
+#ifndef HELIB_RESIDUEMAP_H
+#define HELIB_RESIDUEMAP_H
+/**
+ * @file ResidueMap.h
+ * @brief Contiguous storage for the rows of a DoubleCRT object.
+ **/
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include <helib/IndexSet.h>
+
+namespace helib {
+
+/**
+ * @class ResidueMap
+ * @brief A map from prime indices to rows of residues, kept in a single
+ * aligned, contiguous buffer.
+ *
+ * This plays the same role for DoubleCRT as IndexMap<NTL::vec_long>, but
+ * instead of one heap allocation per prime all the rows live in one
+ * `[row][coeff]` buffer. Every row starts on a `ROW_ALIGN`-byte boundary
+ * (the row stride is padded accordingly), and a dense table maps each prime
+ * index to its row, so `map[i]` is an array access rather than a hash lookup.
+ *
+ * Rows are not kept in the order of their prime indices: a new prime is
+ * appended after the last used row, and removing a prime moves the last row
+ * into the freed slot. Iteration should therefore go through the IndexSet.
+ *
+ * Buffers can be recycled: with `setScratchPoolLimit()`, a map that
+ * releases its buffer gives it to a pool of the current thread, and the
+ * next map of this thread that needs room takes it from there rather than
+ * from malloc. Temporaries of the same shape, as in key switching, mod
+ * switching or tensoring, thus reuse the same few buffers. The pools are
+ * off by default, since every thread keeps up to the limit to itself.
+ *
+ * A map may also be a view of rows that it does not own, e.g., rows in a
+ * memory-mapped file (see view()). A view keeps its backing alive and is
+ * only ever read: before any mutable access (the non-const operator[] and
+ * data(), or a change of the index set) it copies its rows into a buffer of
+ * its own, see detach(). Two views of the same rows thus never see each
+ * other's writes, and the pages of the backing stay shared. Copies of a
+ * view own their rows.
+ *
+ * @note Inserting new primes may reallocate the buffer, which invalidates
+ * all row pointers previously obtained from this object. The content of
+ * newly inserted rows is unspecified, callers are expected to fill them in.
+ **/
+class ResidueMap
+{
+public:
+  //! Alignment (in bytes) of the buffer and of every row
+  static constexpr long ROW_ALIGN = 64;
+
+  //! @brief The empty map, rows of length zero
+  ResidueMap() = default;
+
+  //! @brief The empty map, with rows of length rowLength
+  explicit ResidueMap(long rowLength);
+
+  ResidueMap(const ResidueMap& other);
+  ResidueMap(ResidueMap&& other) noexcept;
+  ResidueMap& operator=(const ResidueMap& other);
+  ResidueMap& operator=(ResidueMap&& other) noexcept;
+  ~ResidueMap() = default;
+
+  /**
+   * @brief A map over rows that it does not own.
+   * @param rowLength The number of residues in every row.
+   * @param s The primes of the map, the row of the k'th prime of s is at
+   * rows + k * rowStride().
+   * @param rows The rows, aligned to `ROW_ALIGN` bytes.
+   * @param backing Whatever keeps the rows valid, held by the map (and by
+   * the maps moved from it) for as long as they use the rows.
+   **/
+  static ResidueMap view(long rowLength,
+                         const IndexSet& s,
+                         long* rows,
+                         std::shared_ptr<void> backing);
+
+  //! @brief Whether the rows are those of another object, see view()
+  bool isView() const { return backing != nullptr; }
+
+  /**
+   * @brief Turn a view into an ordinary map, by copying its rows into a
+   * buffer of its own. Does nothing if the map is not a view.
+   * @note The mutable accessors detach by themselves, but that is not
+   * thread-safe: code that writes to the rows from several threads must
+   * call detach() before it starts them.
+   **/
+  void detach()
+  {
+    if (isView())
+      copyRows();
+  }
+
+  //! @brief Get the underlying index set
+  const IndexSet& getIndexSet() const { return indexSet; }
+
+  //! @brief The number of residues in every row
+  long rowLength() const { return rowLen; }
+
+  //! @brief Distance (in longs) between the starts of consecutive rows
+  long rowStride() const { return stride; }
+
+  //! @brief Number of rows currently in use
+  long numRows() const { return nRows; }
+
+  //! @brief Access functions: will raise an error
+  //! if j does not belong to the current index set
+  long* operator[](long j)
+  {
+    assertTrue(indexSet.contains(j), "Key not found");
+    detach();
+    return buf.get() + slot[j] * stride;
+  }
+  const long* operator[](long j) const
+  {
+    assertTrue(indexSet.contains(j), "Key not found");
+    return buf.get() + slot[j] * stride;
+  }
+
+  //! @brief The position of the row of prime j in the buffer
+  long rowOf(long j) const
+  {
+    assertTrue(indexSet.contains(j), "Key not found");
+    return slot[j];
+  }
+
+  //! @brief Raw access to the buffer, numRows() rows of rowStride() longs
+  long* data()
+  {
+    detach();
+    return buf.get();
+  }
+  const long* data() const { return buf.get(); }
+
+  //! @brief Insert indexes to the IndexSet, adding rows for them.
+  void insert(long j);
+  void insert(const IndexSet& s);
+
+  //! @brief Delete indexes from the IndexSet, releasing their rows.
+  void remove(long j);
+  void remove(const IndexSet& s);
+
+  //! @brief Make the index set equal to s. The rows of primes that were
+  //! already in the map are kept, the content of new rows is unspecified.
+  void setIndexSet(const IndexSet& s);
+
+  void clear();
+
+  //! @brief Make sure there is room for n rows without reallocating
+  void reserve(long n);
+
+  //! @brief The number of buffers obtained from the system allocator so far,
+  //! by all threads (buffers taken from a pool are not counted)
+  static long allocationCount();
+
+  //! @brief The number of bytes that the pool of every thread may keep, 0
+  //! (the default) if released buffers are freed right away
+  static std::size_t getScratchPoolLimit();
+
+  //! @brief Let every thread keep up to bytes of released buffers for
+  //! reuse, 0 disables the pools. The limit is per thread, so the process
+  //! may hold up to bytes times the number of threads that use DoubleCRT
+  //! objects. A limit of a few times the size of the largest DoubleCRT
+  //! (number of primes times phi(m) times 8 bytes) is enough for the
+  //! temporaries of a multiplication or rotation to be reused. The pool of
+  //! the calling thread is trimmed right away, those of other threads when
+  //! they next get a buffer back.
+  static void setScratchPoolLimit(std::size_t bytes);
+
+private:
+  // Returns the buffer to the pool of the current thread, or frees it
+  struct AlignedFree
+  {
+    std::size_t bytes; // size of the buffer, 0 for the rows of a view
+    void operator()(long* p) const;
+  };
+
+  long rowLen = 0; // number of residues in a row
+  long stride = 0; // rowLen rounded up to a multiple of ROW_ALIGN bytes
+  long nRows = 0;  // number of rows in use
+  long capacity = 0;
+
+  IndexSet indexSet;
+  std::vector<long> slot;  // slot[j] = row of prime j, -1 if none
+  std::vector<long> owner; // owner[r] = the prime index stored in row r
+  std::unique_ptr<long[], AlignedFree> buf;
+  std::shared_ptr<void> backing; // what holds the rows of a view
+
+  void grow(long minCapacity);
+  void copyRows();
+};
+
+//! @brief Comparing maps, by comparing all the rows
+bool operator==(const ResidueMap& map1, const ResidueMap& map2);
+
+inline bool operator!=(const ResidueMap& map1, const ResidueMap& map2)
+{
+  return !(map1 == map2);
+}
+
+} // namespace helib
+
+#endif // ifndef HELIB_RESIDUEMAP_H
@@ -0,0 +1,97 @@
+/* Copyright (C) 2012-2020 IBM Corp.
+ * This program is Licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. See accompanying LICENSE file.
+ */
+#ifndef HELIB_SEEDEDCTXT_H
+#define HELIB_SEEDEDCTXT_H
+/**
+ * @file SeededCtxt.h
+ * @brief Secret-key ciphertexts whose random part is kept as a seed
+ **/
+
+#include <iostream>
+#include <helib/Ctxt.h>
+
+namespace helib {
+
+/**
+ * @class SeededCtxt
+ * @brief A fresh secret-key encryption (c0, c1), with c1 kept as the seed
+ * it was drawn from.
+ *
+ * In a secret-key encryption c1 is uniform, so it can be drawn from a PRG
+ * and replaced by the seed of the PRG, as is done for the a-parts of the
+ * key-switching matrices. c1 is drawn from CounterPRG, which gives each of
+ * its rows from the seed and the prime alone: expand() builds the rows of
+ * the primes of the ciphertext only, in parallel. Writing a SeededCtxt out
+ * takes about half the space of the full ciphertext, and reading it does
+ * not expand c1 until expand() is called.
+ *
+ * SeededCtxt objects are made by SecKey::Encrypt. They cannot be computed
+ * on, expand() them first.
+ **/
+class SeededCtxt
+{
+  friend class SecKey;
+
+  Ctxt ctxt; // all of the ciphertext but part 1
+  SKHandle seededHandle; // the handle of part 1
+  NTL::ZZ seed;
+
+public:
+  //! @brief The size of the seeds, in bits
+  static constexpr long SEED_BITS = 256;
+
+  //! @brief An empty SeededCtxt, to be filled by SecKey::Encrypt or read
+  explicit SeededCtxt(const PubKey& pubKey);
+
+  const Context& getContext() const { return ctxt.getContext(); }
+  const PubKey& getPubKey() const { return ctxt.getPubKey(); }
+  const IndexSet& getPrimeSet() const { return ctxt.getPrimeSet(); }
+  const NTL::ZZ& getSeed() const { return seed; }
+
+  //! @brief Whether this holds a ciphertext, i.e., has been encrypted to or
+  //! read into
+  bool isEmpty() const { return ctxt.parts.empty(); }
+
+  /**
+   * @brief The full ciphertext, with part 1 expanded from the seed over
+   * the primes of the ciphertext.
+   * @return The `Ctxt`, equal to the one SecKey::Encrypt would have made
+   * with the same randomness.
+   **/
+  Ctxt expand() const;
+
+  /**
+   * @brief Write out the `SeededCtxt` in binary format: the header, the
+   * metadata and part 0 as in `Ctxt::writeTo`, then the handle of part 1
+   * and its seed.
+   * @param str Output `std::ostream`.
+   **/
+  void writeTo(std::ostream& str) const;
+
+  /**
+   * @brief Read a `SeededCtxt` written by `writeTo`, without expanding it.
+   * @param str Input `std::istream`.
+   * @param pubKey The public key the ciphertext is relative to.
+   * @return The deserialized `SeededCtxt`.
+   **/
+  static SeededCtxt readFrom(std::istream& str, const PubKey& pubKey);
+
+  /**
+   * @brief In-place version of `readFrom`.
+   * @param str Input `std::istream`.
+   **/
+  void read(std::istream& str);
+};
+
+} // namespace helib
+
+#endif // ifndef HELIB_SEEDEDCTXT_H
@@ -7,6 +7,8 @@
 #define _HRESULT_TYPEDEF_(hr) ((HRESULT)hr)
 
 #define E_POINTER _HRESULT_TYPEDEF_(0x80004003L)
+#define E_FAIL _HRESULT_TYPEDEF_(0x80004005L)
+#define E_INVALIDARG _HRESULT_TYPEDEF_(0x80070057L)
 
 #define S_OK _HRESULT_TYPEDEF_(0L)
 #define S_FALSE _HRESULT_TYPEDEF_(1L)
@@ -9,3 +9,19 @@ C_FUNC GK_destroy(void *gk);
 C_FUNC GK_generate_step(void *gk, void *seckey, int step);
 
 C_FUNC GK_rotate(void *gk, void *ctxt, int step);
+
+C_FUNC GK_generate_power_of_two_steps(void *gk, void *seckey);
+
+// Generates the keys of count steps in parallel, from fresh randomness. path
+// (if not NULL) receives the new keys as they are done, in the format of
+// GK_save. A negative count gives E_INVALIDARG
+C_FUNC GK_generate_steps(void *gk, void *seckey, const int *steps, long count, const char *path);
+
+// results must have room for count pointers, each set to a new ctxt. A
+// negative count gives E_INVALIDARG
+C_FUNC GK_rotate_many(void *gk, void *ctxt, const int *steps, long count, void **results);
+
+// Binary save/load of the generated keys, load adds them to gk
+C_FUNC GK_save(void *gk, const char *path);
+
+C_FUNC GK_load(void *gk, void *context, const char *path);
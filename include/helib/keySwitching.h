@@ -21,6 +21,7 @@
  */
 
 #include <climits>
+#include <memory>
 #include <helib/DoubleCRT.h>
 #include <helib/Context.h>
 #include <helib/Ctxt.h>
@@ -101,6 +102,29 @@ public:
   NTL::xdouble noiseBound; // high probability bound on noise magnitude
   // in each column
 
+  //! @brief How the ai's are expanded from prgSeed. NTL_STREAM is NTL's
+  //! random stream run over all the primes of a0, a1, ... in turn, as in
+  //! matrices from older versions. COUNTER uses CounterPRG, with a separate
+  //! stream for each column and prime, so the ai's can be generated in
+  //! parallel and only over the primes that are needed.
+  enum class PrgKind : long
+  {
+    NTL_STREAM = 0,
+    COUNTER = 1,
+  };
+  PrgKind prgKind = PrgKind::NTL_STREAM;
+
+  //! @brief Whether the expanded ai's are kept in memory, at the cost of as
+  //! much space as the bi's: NONE regenerates them on every use, LAZY keeps
+  //! them after the first use and EAGER expands them right away. Copies of a
+  //! matrix share the kept ai's.
+  enum class ACaching
+  {
+    NONE,
+    LAZY,
+    EAGER,
+  };
+
   explicit KeySwitch(long sPow = 0,
                      long xPow = 0,
                      long fromID = 0,
@@ -116,6 +140,66 @@ public:
 
   unsigned long NumCols() const;
 
+  //! @brief Expand a0, ..., a_{n-1} from prgSeed into a, defined over the
+  //! primes in s (over all the primes of the context when prgKind is
+  //! NTL_STREAM).
+  void generateA(std::vector<DoubleCRT>& a,
+                 const Context& context,
+                 const IndexSet& s,
+                 long n) const;
+
+  //! @brief At least the first n ai's, defined at least over the primes in
+  //! s. These are the kept ones if there are any, else they are generated
+  //! into scratch.
+  const std::vector<DoubleCRT>& getA(std::vector<DoubleCRT>& scratch,
+                                     const IndexSet& s,
+                                     long n) const;
+
+  //! @brief Change the ACaching policy. This does not change the value of
+  //! the matrix, so it can be done through a const reference, but not while
+  //! other threads are key-switching with it.
+  void setACaching(ACaching policy) const;
+  ACaching getACaching() const { return aCaching; }
+
+  //! @brief When a key switch uses fewer primes than the matrix has, the
+  //! rows it needs are read from the full matrix by default. The matrix can
+  //! instead keep copies truncated to the prime sets in use, so that a key
+  //! switch at a low level only streams the residues it needs. A copy is
+  //! made for a prime set with at most maxFraction of the primes of the
+  //! matrix, and copies are kept (the least recently used is dropped first)
+  //! while they take at most budget bytes. A zero budget disables them.
+  //! The full matrix is always kept as well, as it serves the key switches
+  //! over the prime sets that have no copy.
+  struct TruncationPolicy
+  {
+    std::size_t budget = 0;
+    double maxFraction = 0.5;
+  };
+
+  //! @brief The bi's, and the ai's if they are kept, over exactly the
+  //! primes in primes
+  struct Truncated
+  {
+    IndexSet primes;
+    std::vector<DoubleCRT> a; // empty if the ai's are not kept
+    std::vector<DoubleCRT> b;
+    std::size_t bytes = 0;
+  };
+
+  //! @brief The copy of the matrix truncated to the primes in s, made now if
+  //! there is none yet. nullptr if the policy says to use the full matrix.
+  //! Threads making copies over different prime sets do not wait for each
+  //! other.
+  std::shared_ptr<const Truncated> getTruncated(const IndexSet& s) const;
+
+  //! @brief Change the TruncationPolicy, dropping the copies made so far.
+  //! As with setACaching, not while other threads are key-switching with it.
+  void setTruncation(const TruncationPolicy& policy) const;
+  const TruncationPolicy& getTruncation() const { return truncation; }
+
+  //! @brief The bytes taken by the truncated copies of this matrix
+  std::size_t truncatedBytes() const;
+
   //! @brief returns a dummy static matrix with toKeyId == -1
   static const KeySwitch& dummy();
   bool isDummy() const;
@@ -187,6 +271,32 @@ public:
    * @param context The `Context` to be used.
    **/
   void readJSON(const JsonWrapper& j, const Context& context);
+
+  /**
+   * @brief Write out the switch key (`KeySwitch`) object to a `JsonWriter`,
+   * without building the JSON document in memory.
+   * @param writer The `JsonWriter` to write to.
+   **/
+  void writeToJSON(JsonWriter& writer) const;
+
+  /**
+   * @brief In-place read from the `JsonReader` the serialized switch key
+   * (`KeySwitch`) object, without building the JSON document in memory.
+   * @param reader The `JsonReader` to read from.
+   * @param context The `Context` to be used.
+   **/
+  void readJSON(JsonReader& reader, const Context& context);
+
+private:
+  struct ACache; // the kept ai's, see keySwitching.cpp
+
+  mutable ACaching aCaching = ACaching::NONE;
+  mutable std::shared_ptr<ACache> aCache;
+
+  struct TCache; // the truncated copies, see keySwitching.cpp
+
+  mutable TruncationPolicy truncation;
+  mutable std::shared_ptr<TCache> tCache;
 };
 std::ostream& operator<<(std::ostream& str, const KeySwitch& matrix);
 // We DO NOT have std::istream& operator>>(std::istream& str, KeySwitch&
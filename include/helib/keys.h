@@ -24,11 +24,15 @@
  * Copyright IBM Corporation 2019 All rights reserved.
  */
 
+#include <functional>
+
 #include <helib/keySwitching.h>
 #include <helib/EncodedPtxt.h>
 
 namespace helib {
 
+class SeededCtxt; // forward declaration
+
 #define HELIB_KSS_UNKNOWN (0)
 // unknown KS strategy
 
@@ -87,6 +91,10 @@ public:
   //! Copy constructor
   PubKey(const PubKey& other);
 
+  //! Move constructor, takes over the key-switching matrices of other (so
+  //! that those read from a MappedFile stay views of it)
+  PubKey(PubKey&& other);
+
   //! Default destructor
   virtual ~PubKey() = default;
 
@@ -301,6 +309,22 @@ public:
    **/
   void readJSON(const JsonWrapper& j);
 
+  /**
+   * @brief Write out the public key (`PubKey`) object to a `JsonWriter`,
+   * without building the JSON document in memory. The JSON stream functions
+   * above go through this.
+   * @param writer The `JsonWriter` to write to.
+   **/
+  void writeToJSON(JsonWriter& writer) const;
+
+  /**
+   * @brief In-place read from the `JsonReader` the serialized public key
+   * (`PubKey`) object, without building the JSON document in memory. The
+   * key is left as it was if the object cannot be read.
+   * @param reader The `JsonReader` to read from.
+   **/
+  void readJSON(JsonReader& reader);
+
   // defines plaintext space for the bootstrapping encrypted secret key
   static long ePlusR(long p);
 
@@ -323,6 +347,35 @@ private:
   std::vector<DoubleCRT> sKeys; // The secret key(s) themselves
   explicit SecKey(const PubKey& pk);
 
+  // The matrix of GenKeySWmatrix, without storing it. All its randomness
+  // comes from the current PRG of NTL, so it can be built by any thread
+  KeySwitch buildKeySWmatrix(long fromSPower,
+                             long fromXPower,
+                             long fromIdx,
+                             long toIdx,
+                             NTL::ZZ p) const;
+
+  // Builds the matrices for all of fromXPowers, several at a time over the
+  // threads of NTL, as described in GenKeySWmatrices (with a nonzero seed).
+  // done is called with each one, in order, once its group is finished
+  void buildKeySWmatrices(long fromSPower,
+                          const std::vector<long>& fromXPowers,
+                          long fromIdx,
+                          long toIdx,
+                          NTL::ZZ p,
+                          const NTL::ZZ& seed,
+                          const std::function<void(KeySwitch&)>& done) const;
+
+  // The Encrypt methods of the EncodedPtxt interface. If prgSeed is not
+  // null, part 1 is drawn from CounterPRG(*prgSeed), stream 0, so that it
+  // can be expanded again from the seed (see SeededCtxt)
+  void skEncrypt(Ctxt& ctxt,
+                 const EncodedPtxt_BGV& eptxt,
+                 const NTL::ZZ* prgSeed) const;
+  void skEncrypt(Ctxt& ctxt,
+                 const EncodedPtxt_CKKS& eptxt,
+                 const NTL::ZZ* prgSeed) const;
+
 public:
   /**
    * @brief Class label to be added to JSON serialization as object type
@@ -372,6 +425,31 @@ public:
                       long toKeyIdx = 0,
                       NTL::ZZ ptxtSpace = NTL::ZZ(0));
 
+  //! Called by GenKeySWmatrices with every new matrix, in the order of the
+  //! requested powers of X, e.g. to write it out as soon as it is ready
+  using KeySWSink = std::function<void(const KeySwitch&)>;
+
+  //! Generate the matrices s_fromKeyIdx^fromSPower(X^t) -> s_toKeyIdx for
+  //! all t in fromXPowers, as GenKeySWmatrix does, but several at a time
+  //! over the threads of NTL. The matrix for t is drawn from a PRG seeded
+  //! by a hash of seed and of (fromSPower, t, fromKeyIdx, toKeyIdx), so the
+  //! matrices do not depend on the number of threads. A zero seed (the
+  //! default) is replaced by a fresh random one. The matrices we already
+  //! have are skipped, the others are stored in the order of fromXPowers and
+  //! passed to sink (if any) as soon as their group of threads is done.
+  //! @warning The seed fixes all the randomness of the matrices, including
+  //! their RLWE errors: anyone who knows it can recover the secret key from
+  //! the matrices. A nonzero seed is secret key material, it must be drawn
+  //! uniformly at random with at least 256 bits and kept as secret as the
+  //! key. Passing one only makes sense to regenerate the same matrices.
+  void GenKeySWmatrices(long fromSPower,
+                        const std::vector<long>& fromXPowers,
+                        long fromKeyIdx = 0,
+                        long toKeyIdx = 0,
+                        NTL::ZZ ptxtSpace = NTL::ZZ(0),
+                        const NTL::ZZ& seed = NTL::ZZ::zero(),
+                        const KeySWSink& sink = nullptr);
+
   // Decryption
   void Decrypt(NTL::ZZX& plaintxt, const Ctxt& ciphertxt) const;
 
@@ -415,6 +493,21 @@ public:
   virtual void Encrypt(Ctxt& ctxt,
                        const EncodedPtxt_CKKS& eptxt) const override;
 
+  /**
+   * @brief Encrypt into a `SeededCtxt`: the same as the `Ctxt` version,
+   * except that part 1 of the ciphertext is expanded from a fresh 256-bit
+   * seed, which is kept (and written out) in place of that part.
+   **/
+  void Encrypt(SeededCtxt& ctxt, const EncodedPtxt& eptxt) const;
+
+  /**
+   * @brief Encrypt a plaintext into a `SeededCtxt`, as `Encrypt(Ctxt&,
+   * const Ptxt<Scheme>&)` does into a `Ctxt`.
+   * @tparam Scheme Encryption scheme used (must be `BGV` or `CKKS`).
+   **/
+  template <typename Scheme>
+  void Encrypt(SeededCtxt& ctxt, const Ptxt<Scheme>& plaintxt) const;
+
   //============================================================
 
   //! @brief Generate bootstrapping data if needed, returns index of key
@@ -510,6 +603,24 @@ public:
    **/
   void readJSON(const JsonWrapper& j, bool sk_only = false);
 
+  /**
+   * @brief Write out the secret key (`SecKey`) object to a `JsonWriter`,
+   * without building the JSON document in memory.
+   * @param writer The `JsonWriter` to write to.
+   * @param sk_only whether to write only secret key polynomial and context, and
+   *not the public key.
+   **/
+  void writeToJSON(JsonWriter& writer, bool sk_only = false) const;
+
+  /**
+   * @brief In-place read from the `JsonReader` the serialized secret key
+   * (`SecKey`) object, without building the JSON document in memory.
+   * @param reader The `JsonReader` to read from.
+   * @param sk_only whether the stream contains only the secret key polynomial
+   *and context, and not the public key.
+   **/
+  void readJSON(JsonReader& reader, bool sk_only = false);
+
   // TODO: Add a similar method for binary serialization
   // This just writes the derived part, not including the public key
   std::ostream& writeSecKeyDerivedASCII(std::ostream& str) const;
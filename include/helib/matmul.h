@@ -263,6 +263,12 @@ struct ConstMultiplierCache
 
   // Upgrade zzX constants to DoubleCRT constants.
   void upgrade(const Context& context);
+
+  // Binary serialization of the constants, in whichever format they are.
+  // Used by the context cache (see Context::writeCacheTo), only the
+  // constants of BGV can be written.
+  void writeTo(std::ostream& str) const;
+  void read(std::istream& str, const Context& context);
 };
 
 //====================================
@@ -333,6 +339,15 @@ public:
   }
 
   const EncryptedArray& getEA() const override { return ea; }
+
+  // Binary serialization of the encoded constants, so that they need not be
+  // computed again, see Context::writeCacheTo
+  void writeTo(std::ostream& str) const;
+  static MatMul1DExec readFrom(std::istream& str, const EncryptedArray& ea);
+
+private:
+  // Used by readFrom, the other fields are read from the stream
+  explicit MatMul1DExec(const EncryptedArray& _ea) : ea(_ea) {}
 };
 
 // A more convenient and naturally-named interface for CKKS
@@ -385,6 +400,16 @@ public:
   }
 
   const EncryptedArray& getEA() const override { return ea; }
+
+  // Binary serialization of the encoded constants, so that they need not be
+  // computed again, see Context::writeCacheTo
+  void writeTo(std::ostream& str) const;
+  static BlockMatMul1DExec readFrom(std::istream& str,
+                                    const EncryptedArray& ea);
+
+private:
+  // Used by readFrom, the other fields are read from the stream
+  explicit BlockMatMul1DExec(const EncryptedArray& _ea) : ea(_ea) {}
 };
 
 //====================================
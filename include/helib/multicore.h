@@ -21,6 +21,7 @@
 
 #include <atomic>
 #include <mutex>
+#include <shared_mutex>
 
 namespace helib {
 
@@ -30,6 +31,13 @@ namespace helib {
 #define HELIB_MUTEX_TYPE std::mutex
 #define HELIB_MUTEX_GUARD(mx) std::lock_guard<std::mutex> _lock##__LINE__(mx)
 
+// A reader-writer lock: any number of readers, or a single writer
+#define HELIB_SHARED_MUTEX_TYPE std::shared_mutex
+#define HELIB_SHARED_GUARD(mx)                                                 \
+  std::shared_lock<std::shared_mutex> _shared_lock##__LINE__(mx)
+#define HELIB_EXCLUSIVE_GUARD(mx)                                              \
+  std::unique_lock<std::shared_mutex> _unique_lock##__LINE__(mx)
+
 } // namespace helib
 
 #else
@@ -42,6 +50,10 @@ namespace helib {
 #define HELIB_MUTEX_TYPE int
 #define HELIB_MUTEX_GUARD(mx) ((void)mx)
 
+#define HELIB_SHARED_MUTEX_TYPE int
+#define HELIB_SHARED_GUARD(mx) ((void)mx)
+#define HELIB_EXCLUSIVE_GUARD(mx) ((void)mx)
+
 } // namespace helib
 
 #endif // ifdef HELIB_THREADS
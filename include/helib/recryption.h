@@ -26,6 +26,7 @@ extern long fhe_force_chen_han;
 extern long printFlag;
 
 class PAlgebraMod;
+struct SlotFactorization;
 class EncryptedArray;
 class EvalMap;
 class ThinEvalMap;
@@ -74,12 +75,21 @@ public:
     alsoThick = false;
   }
 
-  //! Initialize the recryption data in the context
+  //! Initialize the recryption data in the context, the factorization of
+  //! Phi_m(X) mod p^{e-e'+r} is computed unless it is given, and so are the
+  //! linear transforms unless cachedMaps holds them (as written by
+  //! writeMapsTo)
   void init(const Context& context,
             const NTL::Vec<long>& mvec_,
             bool enableThick, /*init linear transforms for non-thin*/
             bool build_cache = false,
-            bool minimal = false);
+            bool minimal = false,
+            const SlotFactorization* factorization = nullptr,
+            std::istream* cachedMaps = nullptr);
+
+  //! Write the linear transforms and the constants for unpacking the slots,
+  //! for a context cache (see Context::writeCacheTo)
+  void writeMapsTo(std::ostream& str) const;
 
   bool operator==(const RecryptData& other) const;
   bool operator!=(const RecryptData& other) const
@@ -108,7 +118,12 @@ public:
             const NTL::Vec<long>& mvec_,
             bool alsoThick, /*init linear transforms also for non-thin*/
             bool build_cache = false,
-            bool minimal = false);
+            bool minimal = false,
+            const SlotFactorization* factorization = nullptr,
+            std::istream* cachedMaps = nullptr);
+
+  //! Write the linear transforms, thin and thick, for a context cache
+  void writeMapsTo(std::ostream& str) const;
 };
 
 #define HELIB_MIN_CAP_FRAC (2.0 / 3.0)
@@ -55,7 +55,11 @@ helib::Database<TXT> readDbFromFile(const std::string& databaseFilePath,
   if constexpr (std::is_same_v<TXT, Ptxt>) {
     std::tie(nrow, ncol) = parseDimsHeader(readline(databaseFile));
   } else {
-    reader.emplace(Reader<helib::Ctxt>(databaseFilePath, zero_txt));
+    // Map the database: the ciphertexts written in the mappable layout are
+    // then paged in on demand and shared with other processes using them,
+    // rather than copied into memory
+    reader.emplace(
+        Reader<helib::Ctxt>(databaseFilePath, zero_txt, /*mapped=*/true));
     nrow = reader.value().getTOC().getRows();
     ncol = reader.value().getTOC().getCols();
   }
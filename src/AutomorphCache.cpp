@@ -0,0 +1,98 @@
+/* Copyright (C) 2012-2020 IBM Corp.
+ * This program is Licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. See accompanying LICENSE file.
+ */
+
+/* AutomorphCache.cpp - a bounded LRU cache of automorphism permutations
+ */
+#include <helib/AutomorphCache.h>
+
+namespace helib {
+
+static std::size_t tableBytes(const AutomorphCache::Table& table)
+{
+  return table.size() * sizeof(AutomorphCache::Table::value_type);
+}
+
+std::shared_ptr<const AutomorphCache::Table> AutomorphCache::find(long k)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  auto it = tables.find(k);
+  if (it == tables.end())
+    return nullptr;
+
+  // move to the front of the LRU list
+  lru.splice(lru.begin(), lru, it->second.lruPos);
+  return it->second.table;
+}
+
+std::shared_ptr<const AutomorphCache::Table> AutomorphCache::insert(
+    long k,
+    std::shared_ptr<const Table> table)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  auto it = tables.find(k);
+  if (it != tables.end()) { // someone else got there first
+    lru.splice(lru.begin(), lru, it->second.lruPos);
+    return it->second.table;
+  }
+
+  lru.push_front(k);
+  tables.emplace(k, Entry{table, lru.begin()});
+  used += tableBytes(*table);
+  evict();
+  return table;
+}
+
+void AutomorphCache::evict()
+{
+  while (used > budget && lru.size() > 1) {
+    long k = lru.back();
+    auto it = tables.find(k);
+    used -= tableBytes(*it->second.table);
+    tables.erase(it);
+    lru.pop_back();
+  }
+}
+
+void AutomorphCache::setBudget(std::size_t bytes)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  budget = bytes;
+  evict();
+}
+
+std::size_t AutomorphCache::getBudget() const
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return budget;
+}
+
+std::size_t AutomorphCache::memoryUsed() const
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return used;
+}
+
+std::size_t AutomorphCache::size() const
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return tables.size();
+}
+
+void AutomorphCache::clear()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  tables.clear();
+  lru.clear();
+  used = 0;
+}
+
+} // namespace helib
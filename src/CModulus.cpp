@@ -38,7 +38,14 @@
  * (vec_long), that store only the evaluation in primitive m-th
  * roots of unity.
  */
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
 #include <helib/CModulus.h>
+#include <helib/NativeNTT.h>
+#include <helib/PrimeFactorFFT.h>
 #include <helib/timing.h>
 
 #ifdef USE_INTEL_HEXL
@@ -59,6 +66,28 @@ NTL::zz_pContext BuildContext(long p, long maxroot)
     return NTL::zz_pContext(p, maxroot);
 }
 
+// Returns the bit-reversal permutation of [0, 2^k). The tables are built on
+// demand, shared by all the Cmodulus objects and never freed.
+static const long* bitReversalTable(long k)
+{
+  static std::mutex lock;
+  static std::map<long, std::unique_ptr<std::vector<long>>> tables;
+
+  std::lock_guard<std::mutex> guard(lock);
+  std::unique_ptr<std::vector<long>>& table = tables[k];
+  if (!table) {
+    long n = 1L << k;
+    table.reset(new std::vector<long>(n));
+    for (long i = 0; i < n; i++) {
+      long r = 0;
+      for (long b = 0; b < k; b++)
+        r |= ((i >> b) & 1) << (k - 1 - b);
+      (*table)[i] = r;
+    }
+  }
+  return table->data();
+}
+
 // Constructor: it is assumed that zms is already set with m>1
 // If q == 0, then the current context is used
 Cmodulus::Cmodulus(const PAlgebra& zms, long qq, long rt) :
@@ -134,6 +163,16 @@ Cmodulus::Cmodulus(const PAlgebra& zms, long qq, long rt) :
       w = NTL::MulMod(w, w1, q);
     }
 
+#ifndef HELIB_NATURAL_EVAL_ORDER
+    // keep the evaluations in the bit-reversed order of the NTT output
+    bitRev = bitReversalTable(k - 1);
+#endif
+
+#ifndef USE_INTEL_HEXL
+    // Same root as the NTL tables, so the two transforms agree exactly
+    if (NativeNTT::supports(q))
+      nativeNTT = std::make_shared<NativeNTT>(phim, q, w0);
+#endif
     return;
   }
 
@@ -176,6 +215,17 @@ Cmodulus::Cmodulus(const PAlgebra& zms, long qq, long rt) :
   iRb.reset(new NTL::fftRep);
   phimx.reset(new zz_pXModulus1(zms.getM(), phimx_poly));
 
+  // Use the direct prime-factor transform if m has only small prime
+  // factors, and Bluestein's algorithm otherwise. Both compute the DFT with
+  // the m-th root root^2 (see bluestein.h).
+  if (PrimeFactorFFT::preferable(mm)) {
+    NTL::zz_p rt = NTL::conv<NTL::zz_p>(root);
+    NTL::zz_p irt = NTL::conv<NTL::zz_p>(rInv);
+    directFFT = std::make_shared<PrimeFactorFFT>(mm, rt * rt);
+    directIFFT = std::make_shared<PrimeFactorFFT>(mm, irt * irt);
+    return;
+  }
+
   BluesteinInit(mm, NTL::conv<NTL::zz_p>(root), *powers, powers_aux, *Rb);
   BluesteinInit(mm, NTL::conv<NTL::zz_p>(rInv), *ipowers, ipowers_aux, *iRb);
 }
@@ -215,6 +265,10 @@ Cmodulus& Cmodulus::operator=(const Cmodulus& other)
   ipowers = other.ipowers;
   iRb = other.iRb;
   phimx = other.phimx;
+  bitRev = other.bitRev;
+  nativeNTT = other.nativeNTT;
+  directFFT = other.directFFT;
+  directIFFT = other.directIFFT;
 
 #ifdef HELIB_OPENCL
   altFFTInfo = other.altFFTInfo;
@@ -355,7 +409,7 @@ static void BitReverseCopy(long* NTL_RESTRICT B,
 
 //================================================
 
-void Cmodulus::FFT_aux(NTL::vec_long& y, NTL::zz_pX& tmp) const
+void Cmodulus::FFT_aux(long* y, NTL::zz_pX& tmp) const
 {
   HELIB_TIMER_START;
 
@@ -367,8 +421,7 @@ void Cmodulus::FFT_aux(NTL::vec_long& y, NTL::zz_pX& tmp) const
     long dx = deg(tmp);
     long p = NTL::zz_p::modulus();
 
-    y.SetLength(phim);
-    long* yp = y.elts();
+    long* yp = y;
 
     const NTL::zz_p* tmp_p = tmp.rep.elts();
 
@@ -386,34 +439,48 @@ void Cmodulus::FFT_aux(NTL::vec_long& y, NTL::zz_pX& tmp) const
 
 #else
 
-    const NTL::zz_p* powers_p = (*powers).rep.elts();
-    const NTL::mulmod_precon_t* powers_aux_p = powers_aux.elts();
-
-    for (long i = 0; i <= dx; i++) {
-      yp[i] = NTL::MulModPrecon(rep(tmp_p[i]),
-                                rep(powers_p[i]),
-                                p,
-                                powers_aux_p[i]);
-    }
-
-    for (long i = dx + 1; i < phim; i++) {
-      yp[i] = 0;
-    }
+    if (nativeNTT && nativeNTTEnabled()) {
+      // The native NTT does the multiplication by the powers of the root
+      for (long i = 0; i <= dx; i++)
+        yp[i] = rep(tmp_p[i]);
+      for (long i = dx + 1; i < phim; i++)
+        yp[i] = 0;
+      nativeNTT->forward(yp);
+    } else {
+      const NTL::zz_p* powers_p = (*powers).rep.elts();
+      const NTL::mulmod_precon_t* powers_aux_p = powers_aux.elts();
+
+      for (long i = 0; i <= dx; i++) {
+        yp[i] = NTL::MulModPrecon(rep(tmp_p[i]),
+                                  rep(powers_p[i]),
+                                  p,
+                                  powers_aux_p[i]);
+      }
+
+      for (long i = dx + 1; i < phim; i++) {
+        yp[i] = 0;
+      }
 
 #ifdef HELIB_OPENCL
-    AltFFTFwd(yp, yp, k - 1, *altFFTInfo);
+      AltFFTFwd(yp, yp, k - 1, *altFFTInfo);
 #else
 
 #ifndef NTL_PROVIDES_TRUNC_FFT
-    NTL::FFTFwd(yp, yp, k - 1, *NTL::zz_pInfo->p_info);
+      NTL::FFTFwd(yp, yp, k - 1, *NTL::zz_pInfo->p_info);
 #else
-    NTL::FFTFwd(yp, yp, k - 1, *NTL::zz_pInfo->p_info);
+      NTL::FFTFwd(yp, yp, k - 1, *NTL::zz_pInfo->p_info);
 #endif
 
 #endif // HELIB_OPENCL
+    }
 
 #endif // USE_INTEL_HEXL
 
+    // The output is in bit-reversed order, which is how we keep it unless
+    // the evaluations are stored in the natural order
+    if (bitRev)
+      return;
+
     // Now we have to bit reverse the result
     // The BitReverseCopy routine does not allow aliasing, so
     // we have to do an extra copy here.
@@ -428,6 +495,24 @@ void Cmodulus::FFT_aux(NTL::vec_long& y, NTL::zz_pX& tmp) const
     return;
   }
 
+  if (directFFT) {
+    long m = getM();
+    long p = NTL::zz_p::modulus();
+    NTL::vec_long& buf = Cmodulus::getScratch_vec_long();
+    buf.SetLength(m);
+    long* bp = buf.elts();
+    std::fill_n(bp, m, 0L);
+    for (long i = 0; i <= deg(tmp); i++)
+      bp[i % m] = NTL::AddMod(bp[i % m], rep(tmp.rep[i]), p);
+
+    directFFT->apply(bp, bp);
+
+    for (long i = 0, j = 0; i < m; i++)
+      if (zMStar->inZmStar(i))
+        y[j++] = bp[i];
+    return;
+  }
+
   NTL::zz_p rt;
   conv(rt, root); // convert root to zp format
 
@@ -436,14 +521,30 @@ void Cmodulus::FFT_aux(NTL::vec_long& y, NTL::zz_pX& tmp) const
 
   // copy the result to the output vector y, keeping only the
   // entries corresponding to primitive roots of unity
-  y.SetLength(zMStar->getPhiM());
-
   for (long i = 0, j = 0; i < long(this->getM()); i++)
     if (zMStar->inZmStar(i))
       y[j++] = rep(coeff(tmp, i));
 }
 
 void Cmodulus::FFT(NTL::vec_long& y, const NTL::ZZX& x) const
+{
+  y.SetLength(getPhiM());
+  FFT(y.elts(), x);
+}
+
+void Cmodulus::FFT(NTL::vec_long& y, const zzX& x) const
+{
+  y.SetLength(getPhiM());
+  FFT(y.elts(), x);
+}
+
+void Cmodulus::FFT(NTL::vec_long& y, NTL::zz_pX& x) const
+{
+  y.SetLength(getPhiM());
+  FFT(y.elts(), x);
+}
+
+void Cmodulus::FFT(long* y, const NTL::ZZX& x) const
 {
   HELIB_TIMER_START;
   NTL::zz_pBak bak;
@@ -459,7 +560,7 @@ void Cmodulus::FFT(NTL::vec_long& y, const NTL::ZZX& x) const
   FFT(y, tmp);
 }
 
-void Cmodulus::FFT(NTL::vec_long& y, const zzX& x) const
+void Cmodulus::FFT(long* y, const zzX& x) const
 {
   HELIB_TIMER_START;
   NTL::zz_pBak bak;
@@ -474,7 +575,7 @@ void Cmodulus::FFT(NTL::vec_long& y, const zzX& x) const
   FFT(y, tmp);
 }
 
-void Cmodulus::FFT(NTL::vec_long& y, NTL::zz_pX& x) const
+void Cmodulus::FFT(long* y, NTL::zz_pX& x) const
 {
   HELIB_TIMER_START;
   NTL::zz_pBak bak;
@@ -484,6 +585,11 @@ void Cmodulus::FFT(NTL::vec_long& y, NTL::zz_pX& x) const
 }
 
 void Cmodulus::iFFT(NTL::zz_pX& x, const NTL::vec_long& y) const
+{
+  iFFT(x, y.elts());
+}
+
+void Cmodulus::iFFT(NTL::zz_pX& x, const long* y) const
 {
   HELIB_TIMER_START;
   NTL::zz_pBak bak;
@@ -497,17 +603,21 @@ void Cmodulus::iFFT(NTL::zz_pX& x, const NTL::vec_long& y) const
     long phim = (1L << (k - 1));
     long p = NTL::zz_p::modulus();
 
-    const long* yp = y.elts();
+    const long* yp = y;
 
     NTL::vec_long& tmp = Cmodulus::getScratch_vec_long();
     tmp.SetLength(phim);
     long* tmp_p = tmp.elts();
 
-    // We have to bit reverse the inputs to FFTRev1
+    // FFTRev1 expects its inputs in bit-reversed order: if this is how
+    // we keep them then just copy, otherwise we have to bit reverse them.
     // The BitReverseCopy routine does not allow aliasing.
     // We use the fact that y and tmp do not alias
 
-    BitReverseCopy(tmp_p, yp, k - 1);
+    if (bitRev)
+      std::copy_n(yp, phim, tmp_p);
+    else
+      BitReverseCopy(tmp_p, yp, k - 1);
 
 #ifdef USE_INTEL_HEXL
 
@@ -522,6 +632,20 @@ void Cmodulus::iFFT(NTL::zz_pX& x, const NTL::vec_long& y) const
 
 #else
 
+    if (nativeNTT && nativeNTTEnabled()) {
+      // The native inverse NTT includes the scaling by 1/phi(m) and the
+      // multiplication by the inverse powers of the root
+      nativeNTT->inverse(tmp_p);
+
+      x.rep.SetLength(phim);
+      NTL::zz_p* xp = x.rep.elts();
+      for (long i = 0; i < phim; ++i)
+        xp[i].LoopHole() = tmp_p[i];
+
+      x.normalize();
+      return;
+    }
+
     const NTL::zz_p* ipowers_p = (*ipowers).rep.elts();
     const NTL::mulmod_precon_t* ipowers_aux_p = ipowers_aux.elts();
 
@@ -555,15 +679,31 @@ void Cmodulus::iFFT(NTL::zz_pX& x, const NTL::vec_long& y) const
   NTL::zz_p rt;
   long m = getM();
 
-  // convert input to zpx format, initializing only the coeffs i s.t. (i,m)=1
-  x.rep.SetLength(m);
-  for (long i = 0, j = 0; i < m; i++)
-    if (zMStar->inZmStar(i))
-      x.rep[i].LoopHole() = y[j++]; // DIRT: y[j] already reduced
-  x.normalize();
-  conv(rt, rInv); // convert rInv to zp format
+  if (directIFFT) {
+    NTL::vec_long& buf = Cmodulus::getScratch_vec_long();
+    buf.SetLength(m);
+    long* bp = buf.elts();
+    for (long i = 0, j = 0; i < m; i++)
+      bp[i] = zMStar->inZmStar(i) ? y[j++] : 0;
 
-  BluesteinFFT(x, m, rt, *ipowers, ipowers_aux, *iRb); // call the FFT routine
+    directIFFT->apply(bp, bp);
+
+    x.rep.SetLength(m);
+    for (long i = 0; i < m; i++)
+      x.rep[i].LoopHole() = bp[i];
+    x.normalize();
+  } else {
+    // convert input to zpx format, initializing only the coeffs i s.t.
+    // (i,m)=1
+    x.rep.SetLength(m);
+    for (long i = 0, j = 0; i < m; i++)
+      if (zMStar->inZmStar(i))
+        x.rep[i].LoopHole() = y[j++]; // DIRT: y[j] already reduced
+    x.normalize();
+    conv(rt, rInv); // convert rInv to zp format
+
+    BluesteinFFT(x, m, rt, *ipowers, ipowers_aux, *iRb); // call the FFT routine
+  }
 
   // reduce the result mod (Phi_m(X),q) and copy to the output polynomial x
   {
@@ -577,6 +717,16 @@ void Cmodulus::iFFT(NTL::zz_pX& x, const NTL::vec_long& y) const
   x *= mm_inv;
 }
 
+void Cmodulus::permuteEvalOrder(long* y) const
+{
+  if (!bitRev)
+    return;
+  long phim = getPhiM();
+  for (long j = 0; j < phim; j++)
+    if (j < bitRev[j])
+      std::swap(y[j], y[bitRev[j]]);
+}
+
 NTL::zz_pX& Cmodulus::getScratch_zz_pX()
 {
   NTL_THREAD_LOCAL static NTL::zz_pX scratch;
@@ -10,8 +10,10 @@
  * limitations under the License. See accompanying LICENSE file.
  */
 #include <cstring>
+#include <cstdint>
 #include <algorithm>
 #include <optional>
+#include <sstream>
 
 #include <json.hpp>
 using json = ::nlohmann::json;
@@ -22,6 +24,7 @@ using json = ::nlohmann::json;
 #include <helib/sample.h>
 #include <helib/EncryptedArray.h>
 #include <helib/PolyModRing.h>
+#include <helib/RNSBaseConverter.h>
 #include <helib/fhe_stats.h>
 
 #include "macro.h"
@@ -113,6 +116,16 @@ struct Context::SerializableContent
   bool alsoThick;
 };
 
+struct Context::CacheContent
+{
+  // The factorizations of Phi_m(X) mod p^r, and mod p^{e-e'+r} if the
+  // context is bootstrappable
+  std::vector<SlotFactorization> factorizations;
+  // The linear maps of recryption, as written by ThinRecryptData::writeMapsTo,
+  // empty if the context is not bootstrappable
+  std::string recryptMaps;
+};
+
 long FindM(long k,
            long nBits,
            long c,
@@ -277,6 +290,73 @@ void Context::productOfPrimes(NTL::ZZ& p, const IndexSet& s) const
     p *= ithPrime(i);
 }
 
+std::shared_ptr<const RNSBaseConverter> Context::getBaseConverter(
+    const IndexSet& from,
+    const IndexSet& to) const
+{
+  std::pair<std::vector<long>, std::vector<long>> key;
+  for (long i : from)
+    key.first.push_back(i);
+  for (long i : to)
+    key.second.push_back(i);
+
+  {
+    std::lock_guard<std::mutex> lock(baseConvertersLock);
+    auto it = baseConverters.find(key);
+    if (it != baseConverters.end())
+      return it->second;
+  }
+
+  // Build the tables without holding the lock, if another thread got there
+  // first we just use its copy.
+  auto converter = std::make_shared<const RNSBaseConverter>(*this, from, to);
+  std::lock_guard<std::mutex> lock(baseConvertersLock);
+  return baseConverters.emplace(std::move(key), converter).first->second;
+}
+
+void Context::setDigitNoiseEstimate(DigitNoiseEstimate policy,
+                                    long samplePeriod)
+{
+  assertTrue<InvalidArgument>(samplePeriod > 0,
+                              "Noise sample period must be positive");
+  digitNoiseSamplePeriod.store(samplePeriod);
+  digitNoiseCalls.store(0); // so that the next estimate is an exact one
+  digitNoiseEstimate.store(policy);
+}
+
+bool Context::sampleDigitNoise() const
+{
+  return digitNoiseCalls.fetch_add(1) % digitNoiseSamplePeriod.load() == 0;
+}
+
+std::shared_ptr<const AutomorphCache::Table> Context::getAutomorphTable(
+    long k) const
+{
+  std::shared_ptr<const AutomorphCache::Table> table =
+      automorphTables.find(k);
+  if (table)
+    return table;
+
+  assertTrue(zMStar.inZmStar(k), "Context::getAutomorphTable: k not in Zm*");
+  assertTrue(!moduli.empty(), "Context::getAutomorphTable: no primes");
+
+  // All the moduli keep their evaluations in the same order
+  const Cmodulus& cmod = moduli.front();
+  long m = zMStar.getM();
+  long phim = zMStar.getPhiM();
+  NTL::mulmod_precon_t precon = NTL::PrepMulModPrecon(k, m);
+
+  // new[j] = old[j'], where the root evaluated in position j' is the k'th
+  // power of the root evaluated in position j
+  auto newTable = std::make_shared<AutomorphCache::Table>(phim);
+  for (long j : range(phim)) {
+    long rep = zMStar.repInZmstar_unchecked(cmod.evalIndex(j));
+    rep = NTL::MulModPrecon(rep, k, m, precon);
+    (*newTable)[j] = cmod.evalIndex(zMStar.indexInZmstar_unchecked(rep));
+  }
+  return automorphTables.insert(k, std::move(newTable));
+}
+
 bool Context::operator==(const Context& other) const
 {
   if (&other == this)
@@ -515,6 +595,158 @@ Context* Context::readPtrFromJSON(std::istream& is)
   });
 }
 
+// FNV-1a, to check that the content of a context cache is whole
+static std::uint64_t hashCacheContent(const std::string& content)
+{
+  std::uint64_t hash = 14695981039346656037ull;
+  for (unsigned char c : content) {
+    hash ^= c;
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+// The coefficients of a factorization mod p^r, which are in [0, p^r)
+static void writeCachedPoly(std::ostream& str, const NTL::ZZX& poly)
+{
+  NTL::Vec<long> coeffs;
+  convert(coeffs, poly);
+  write_ntl_vec_long(str, coeffs);
+}
+
+static NTL::ZZX readCachedPoly(std::istream& str)
+{
+  NTL::Vec<long> coeffs;
+  read_ntl_vec_long(str, coeffs);
+  NTL::ZZX poly;
+  convert(poly, coeffs);
+  return poly;
+}
+
+// The factorization mod p^r in factorizations, null if there is none
+static const SlotFactorization* findSlotFactorization(
+    const std::vector<SlotFactorization>& factorizations,
+    long r)
+{
+  for (const SlotFactorization& factorization : factorizations)
+    if (factorization.r == r)
+      return &factorization;
+  return nullptr;
+}
+
+void Context::writeCacheTo(std::ostream& str) const
+{
+  std::vector<SlotFactorization> factorizations;
+#ifndef BIGINT_P
+  if (!isCKKS()) {
+    factorizations.push_back(alMod.getSlotFactorization());
+    if (isBootstrappable())
+      factorizations.push_back(rcData.alMod->getSlotFactorization());
+  }
+#endif
+
+  // The content is written out after its size, and followed by its hash
+  std::ostringstream content;
+  writeTo(content);
+  write_raw_int(content, factorizations.size());
+  for (const SlotFactorization& factorization : factorizations) {
+    write_raw_int(content, factorization.r);
+    write_raw_int(content, factorization.factors.size());
+    for (std::size_t i = 0; i < factorization.factors.size(); i++) {
+      writeCachedPoly(content, factorization.factors[i]);
+      writeCachedPoly(content, factorization.crtCoeffs[i]);
+    }
+  }
+#ifndef BIGINT_P
+  // The linear maps of recryption take up the rest of the content
+  if (isBootstrappable())
+    rcData.writeMapsTo(content);
+#endif
+  const std::string bytes = content.str();
+
+  SerializeHeader<ContextCache>().writeTo(str);
+  writeEyeCatcher(str, EyeCatcher::CCACHE_BEGIN);
+  write_raw_int(str, bytes.size());
+  str.write(bytes.data(), bytes.size());
+  write_raw_int(str, static_cast<long>(hashCacheContent(bytes)));
+  writeEyeCatcher(str, EyeCatcher::CCACHE_END);
+}
+
+Context::SerializableContent Context::readCacheFrom(std::istream& str,
+                                                   CacheContent& cache)
+{
+  const auto header = SerializeHeader<ContextCache>::readFrom(str);
+  assertEq<IOError>(header.version,
+                    Binio::VERSION_0_0_1_0,
+                    "Header: version " + header.versionString() +
+                        " not supported");
+  // Another version of HElib may order the factors differently
+  assertTrue<IOError>(header.helibVersion ==
+                          SerializeHeader<ContextCache>().helibVersion,
+                      "Context cache written by another version of HElib");
+
+  bool eyeCatcherFound = readEyeCatcher(str, EyeCatcher::CCACHE_BEGIN);
+  assertTrue<IOError>(eyeCatcherFound,
+                      "Could not find pre-context-cache eye catcher");
+
+  long size = read_raw_int(str);
+  assertTrue<IOError>(size >= 0, "Negative size of context cache");
+  // The hash does not cover the size, so grow the buffer only as far as the
+  // stream actually has bytes rather than trusting the size up front
+  constexpr long chunkSize = 1L << 20;
+  std::string bytes;
+  for (long done = 0; done < size;) {
+    const long chunk = std::min(chunkSize, size - done);
+    bytes.resize(done + chunk);
+    str.read(&bytes[done], chunk);
+    if (!str)
+      throw IOError("Context cache is truncated");
+    done += chunk;
+  }
+  long hash = read_raw_int(str);
+  assertEq<IOError>(hash,
+                    static_cast<long>(hashCacheContent(bytes)),
+                    "Context cache does not match its hash");
+
+  eyeCatcherFound = readEyeCatcher(str, EyeCatcher::CCACHE_END);
+  assertTrue<IOError>(eyeCatcherFound,
+                      "Could not find post-context-cache eye catcher");
+
+  std::istringstream content(bytes);
+  Context::SerializableContent context_params = readParamsFrom(content);
+  cache.factorizations.resize(read_raw_int(content));
+  for (SlotFactorization& factorization : cache.factorizations) {
+    factorization.r = read_raw_int(content);
+    long nFactors = read_raw_int(content);
+    factorization.factors.reserve(nFactors);
+    factorization.crtCoeffs.reserve(nFactors);
+    for (long i = 0; i < nFactors; i++) {
+      factorization.factors.push_back(readCachedPoly(content));
+      factorization.crtCoeffs.push_back(readCachedPoly(content));
+    }
+  }
+  if (!content)
+    throw IOError("Could not read the factorizations of the context cache");
+  std::size_t mapsBegin = static_cast<std::size_t>(content.tellg());
+  cache.recryptMaps = bytes.substr(mapsBegin);
+
+  return context_params;
+}
+
+Context Context::readFromCache(std::istream& str)
+{
+  CacheContent cache;
+  const SerializableContent content = readCacheFrom(str, cache);
+  return Context(content, &cache);
+}
+
+Context* Context::readPtrFromCache(std::istream& str)
+{
+  CacheContent cache;
+  const SerializableContent content = readCacheFrom(str, cache);
+  return new Context(content, &cache);
+}
+
 JsonWrapper Context::writeToJSON() const
 {
   std::function<JsonWrapper()> body = [this]() {
@@ -619,9 +851,10 @@ Context::Context(unsigned long m,
                  const NTL::ZZ& p,
                  unsigned long r,
                  const std::vector<long>& gens,
-                 const std::vector<long>& ords) :
+                 const std::vector<long>& ords,
+                 const SlotFactorization* factorization) :
     zMStar(m, p, gens, ords),
-    alMod(zMStar, r),
+    alMod(zMStar, r, factorization),
 
 #ifndef BIGINT_P
     // VJS-FIXME: I'm not sure this makes sense.
@@ -702,8 +935,15 @@ Context::Context(long m,
   }
 }
 
-Context::Context(const SerializableContent& content) :
-    Context(content.m, content.p, content.r, content.gens, content.ords)
+Context::Context(const SerializableContent& content,
+                 const CacheContent* cache) :
+    Context(content.m,
+            content.p,
+            content.r,
+            content.gens,
+            content.ords,
+            cache ? findSlotFactorization(cache->factorizations, content.r)
+                  : nullptr)
 {
   this->stdev = content.stdev;
   this->scale = content.scale;
@@ -731,10 +971,26 @@ Context::Context(const SerializableContent& content) :
   // Read in the partition of m into co-prime factors (if bootstrappable)
   if (content.mvec.length() > 0) {
     #ifndef BIGINT_P
-    // VJS-FIXME: what about the build_cache and alsoThick params?
-    this->enableBootStrapping(content.mvec,
-                              content.build_cache,
-                              content.alsoThick);
+    // As enableBootStrapping, with the factorization mod p^{e-e'+r} and the
+    // linear maps of the cache if there is one
+    assertTrue(e_param > 0, "Bootstrapping data without e");
+    const SlotFactorization* factorization = nullptr;
+    std::unique_ptr<std::istringstream> maps;
+    if (cache != nullptr) {
+      factorization = findSlotFactorization(cache->factorizations,
+                                            e_param - ePrime_param + content.r);
+      if (!cache->recryptMaps.empty())
+        maps = std::make_unique<std::istringstream>(cache->recryptMaps);
+    }
+    this->rcData.init(*this,
+                      content.mvec,
+                      content.alsoThick,
+                      content.build_cache,
+                      /*minimal=*/false,
+                      factorization,
+                      maps.get());
+    if (maps && !(*maps && maps->peek() == std::char_traits<char>::eof()))
+      throw IOError("Could not read the linear maps of the context cache");
   #endif
   }
 }
@@ -0,0 +1,122 @@
+/* Copyright (C) 2012-2020 IBM Corp.
+ * This program is Licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. See accompanying LICENSE file.
+ */
+
+/* CounterPRG.cpp - ChaCha20 (RFC 8439) as a counter-mode generator
+ */
+#include <helib/CounterPRG.h>
+#include <helib/assertions.h>
+#include <helib/exceptions.h>
+
+namespace helib {
+
+static inline std::uint32_t rotl(std::uint32_t x, int n)
+{
+  return (x << n) | (x >> (32 - n));
+}
+
+static inline void quarterRound(std::uint32_t* x, int a, int b, int c, int d)
+{
+  x[a] += x[b];
+  x[d] = rotl(x[d] ^ x[a], 16);
+  x[c] += x[d];
+  x[b] = rotl(x[b] ^ x[c], 12);
+  x[a] += x[b];
+  x[d] = rotl(x[d] ^ x[a], 8);
+  x[c] += x[d];
+  x[b] = rotl(x[b] ^ x[c], 7);
+}
+
+CounterPRG::CounterPRG(const NTL::ZZ& seed)
+{
+  assertTrue<InvalidArgument>(seed >= 0, "CounterPRG: negative seed");
+
+  unsigned char bytes[32];
+  NTL::BytesFromZZ(bytes, seed, 32); // little-endian, truncated to 256 bits
+  for (long i = 0; i < 8; i++)
+    key[i] = std::uint32_t(bytes[4 * i]) |
+             (std::uint32_t(bytes[4 * i + 1]) << 8) |
+             (std::uint32_t(bytes[4 * i + 2]) << 16) |
+             (std::uint32_t(bytes[4 * i + 3]) << 24);
+}
+
+void CounterPRG::block(std::uint32_t out[16],
+                       std::uint32_t counter,
+                       const std::array<std::uint32_t, 3>& nonce) const
+{
+  // "expand 32-byte k"
+  std::uint32_t state[16] = {0x61707865,
+                             0x3320646e,
+                             0x79622d32,
+                             0x6b206574,
+                             key[0],
+                             key[1],
+                             key[2],
+                             key[3],
+                             key[4],
+                             key[5],
+                             key[6],
+                             key[7],
+                             counter,
+                             nonce[0],
+                             nonce[1],
+                             nonce[2]};
+
+  for (long i = 0; i < 16; i++)
+    out[i] = state[i];
+
+  for (long round = 0; round < 10; round++) {
+    quarterRound(out, 0, 4, 8, 12);
+    quarterRound(out, 1, 5, 9, 13);
+    quarterRound(out, 2, 6, 10, 14);
+    quarterRound(out, 3, 7, 11, 15);
+    quarterRound(out, 0, 5, 10, 15);
+    quarterRound(out, 1, 6, 11, 12);
+    quarterRound(out, 2, 7, 8, 13);
+    quarterRound(out, 3, 4, 9, 14);
+  }
+
+  for (long i = 0; i < 16; i++)
+    out[i] += state[i];
+}
+
+void CounterPRG::uniformMod(long* out,
+                            long n,
+                            long q,
+                            std::uint64_t stream) const
+{
+  assertInRange<InvalidArgument>(q,
+                                 2L,
+                                 1L << 62,
+                                 "CounterPRG::uniformMod: modulus out of range");
+
+  const std::array<std::uint32_t, 3> nonce = {
+      0,
+      std::uint32_t(stream),
+      std::uint32_t(stream >> 32)};
+  std::uint64_t mask = (std::uint64_t(1) << NTL::NumBits(q - 1)) - 1;
+
+  std::uint32_t buf[16];
+  std::uint32_t counter = 0;
+  long j = 0;
+  while (j < n) {
+    assertTrue(counter != UINT32_MAX, "CounterPRG: stream exhausted");
+    block(buf, counter++, nonce);
+    for (long w = 0; w < 16 && j < n; w += 2) {
+      std::uint64_t x =
+          (std::uint64_t(buf[w]) | (std::uint64_t(buf[w + 1]) << 32)) & mask;
+      out[j] = long(x);
+      j += (x < std::uint64_t(q));
+    }
+  }
+}
+
+} // namespace helib
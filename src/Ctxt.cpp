@@ -13,6 +13,7 @@
 #include <NTL/ZZ.h>
 
 #include "io.h"
+#include "JsonStream.h"
 #include "binio.h"
 #include "macro.h"
 
@@ -194,48 +195,49 @@ bool Ctxt::verifyPrimeSet() const
 }
 
 // Multiply vector of digits by key-switching matrix and add to *this.
-// It is assumed that W has at least as many b[i]'s as there are digits.
-// The vector of digits is modified in place.
-void Ctxt::keySwitchDigits(const KeySwitch& W, std::vector<DoubleCRT>& digits)
-{ // An object to hold the pseudorandom ai's, note that it must be defined
-  // with the maximum number of levels, else the PRG will go out of sync.
-  // FIXME: This is a bug waiting to happen.
-
-  DoubleCRT ai(context, context.getCtxtPrimes() | context.getSpecialPrimes());
-
-  // Subsequent ai's use the evolving RNG state
-  RandomState state; // backup the NTL PRG seed
-  NTL::SetSeed(W.prgSeed);
-
-  // Add the columns in, one by one
-  DoubleCRT tmpDCRT(context, IndexSet::emptySet());
-  for (size_t i = 0; i < digits.size(); i++) {
-    HELIB_NTIMER_START(KS_loop);
-    ai.randomize();
-    tmpDCRT = digits[i];
-
-    // The operations below all use the IndexSet of tmpDCRT
-
-    // add digit*a[i] with a handle pointing to base of W.toKeyID
-    {
-      HELIB_NTIMER_START(KS_loop_1);
-      tmpDCRT.Mul(ai, /*matchIndexSet=*/false);
-    }
-    {
-      HELIB_NTIMER_START(KS_loop_2);
-      this->addPart(tmpDCRT, SKHandle(1, 1, W.toKeyID), /*matchPrimeSet=*/true);
-    }
-    // add digit*b[i] with a handle pointing to one
-    {
-      HELIB_NTIMER_START(KS_loop_3);
-      digits[i].Mul(W.b[i], /*matchIndexSet=*/false);
-    }
-    {
-      HELIB_NTIMER_START(KS_loop_4);
-      this->addPart(digits[i], SKHandle(), /*matchPrimeSet=*/true);
+// It is assumed that W has at least as many b[i]'s as there are digits, and
+// that the digits are all defined over the primeSet of *this.
+void Ctxt::keySwitchDigits(const KeySwitch& W,
+                           const std::vector<DoubleCRT>& digits)
+{
+  HELIB_TIMER_START;
+
+  if (digits.empty())
+    return;
+
+  // The same requirements as addPart(..., /*matchPrimeSet=*/true)
+  const IndexSet& s = digits[0].getIndexSet();
+  if (!(primeSet <= s))
+    throw RuntimeError("Ctxt::keySwitchDigits: ctxt has primes not in digits");
+  if (!(s <= primeSet))
+    throw RuntimeError("Ctxt::keySwitchDigits: digits have primes not in ctxt");
+
+  // A copy of W truncated to s, if W keeps them (see KeySwitch::Truncated)
+  std::shared_ptr<const KeySwitch::Truncated> t = W.getTruncated(s);
+  const std::vector<DoubleCRT>& b = t ? t->b : W.b;
+
+  // The pseudorandom ai's, either kept in W or expanded from W.prgSeed
+  // (only over the primes in s, unless W uses NTL's stream)
+  std::vector<DoubleCRT> scratch;
+  const std::vector<DoubleCRT>& a =
+      (t && !t->a.empty()) ? t->a : W.getA(scratch, s, lsize(digits));
+
+  // The parts pointing to the base of W.toKeyID and to one, created as zero
+  // if they are not there yet
+  auto partIndex = [this](const SKHandle& handle) {
+    long j = getPartIndexByHandle(handle);
+    if (j < 0) {
+      parts.emplace_back(context, primeSet, handle);
+      j = lsize(parts) - 1;
     }
-  }
-} // restore random state upon destruction of the RandomState, see NumbTh.h
+    return j;
+  };
+  long ja = partIndex(SKHandle(1, 1, W.toKeyID));
+  long jb = partIndex(SKHandle());
+
+  // Add sum_i digit[i]*a[i] and sum_i digit[i]*b[i], in a single pass
+  DoubleCRT::innerProducts(parts[ja], parts[jb], digits, a, b);
+}
 
 bool CtxtPart::operator==(const CtxtPart& other) const
 {
@@ -334,6 +336,21 @@ Ctxt& Ctxt::privateAssign(const Ctxt& other)
   return *this;
 }
 
+Ctxt& Ctxt::privateAssign(Ctxt&& other)
+{
+  if (this == &other)
+    return *this;
+
+  parts = std::move(other.parts);
+  primeSet = std::move(other.primeSet);
+  ptxtSpace = std::move(other.ptxtSpace);
+  noiseBound = other.noiseBound;
+  intFactor = std::move(other.intFactor);
+  ratFactor = other.ratFactor;
+  ptxtMag = other.ptxtMag;
+  return *this;
+}
+
 // explicitly multiply intFactor by e, which should be
 // in the interval [0, ptxtSpace)
 void Ctxt::mulIntFactor(NTL::ZZ e)
@@ -470,22 +487,16 @@ void Ctxt::modDownToSet(const IndexSet& s)
     Warning("Ctxt::modDownToSet: DEGENERATE DROP");
   } else { // do real mod switching
 #if 1
-    NTL::ZZX delta;
-    NTL::ZZ diff = context.productOfPrimes(setDiff);
-    NTL::xdouble xdiff = NTL::conv<NTL::xdouble>(diff);
-
     long nparts = parts.size();
 
+    // fdeltas[i][j] = delta[j]/diffProd for the rounding term delta that is
+    // subtracted from the i'th part before scaling it down
     std::vector<std::vector<double>> fdeltas(nparts);
     for (long i : range(nparts)) {
       CtxtPart& part = parts[i];
       std::vector<double>& fdelta = fdeltas[i];
-      part.scaleDownToSet(intersection, ptxtSpace, delta);
-      fdelta.resize(delta.rep.length());
-      for (long j : range(delta.rep.length())) {
-        fdelta[j] =
-            NTL::conv<double>(NTL::conv<NTL::xdouble>(delta.rep[j]) / xdiff);
-
+      part.scaleDownToSet(intersection, ptxtSpace, fdelta);
+      for (long j : range(lsize(fdelta))) {
         // sanity check: |fdelta[j]| <= ptxtSpace/2
         if (std::fabs(fdelta[j]) > NTL::to_double(ptxtSpace) / 2.0 + 0.0001) {
           std::stringstream ss;
@@ -771,7 +782,7 @@ void Ctxt::reLinearize(long keyID)
     // For a part relative to 1 or base,  only scale and add
     if (part.skHandle.isOne() || part.skHandle.isBase(keyID)) {
       part.addPrimesAndScale(context.getSpecialPrimes());
-      tmp.addPart(part, /*matchPrimeSet=*/true);
+      tmp.addPart(std::move(part), /*matchPrimeSet=*/true);
       continue;
     }
     // Look for a key-switching matrix to re-linearize this part
@@ -790,7 +801,7 @@ void Ctxt::reLinearize(long keyID)
     }
     tmp.keySwitchPart(part, W); // switch this part & update noiseBound
   }
-  *this = tmp;
+  *this = std::move(tmp);
   // std::cerr << "====== " << ratFactor << "\n";
 }
 
@@ -824,7 +835,7 @@ void Ctxt::keySwitchPart(const CtxtPart& p, const KeySwitch& W)
   if (p.skHandle.isOne() || p.skHandle.isBase(W.toKeyID)) {
     CtxtPart pp = p;
     pp.addPrimesAndScale(context.getSpecialPrimes());
-    addPart(pp, /*matchPrimeSet=*/true);
+    addPart(std::move(pp), /*matchPrimeSet=*/true);
     return;
   }
 
@@ -901,6 +912,22 @@ void Ctxt::addPart(const DoubleCRT& part,
   }
 }
 
+void Ctxt::addPart(CtxtPart&& part, bool matchPrimeSet)
+{
+  if (getPartIndexByHandle(part.skHandle) >= 0 ||
+      !(primeSet <= part.getIndexSet())) {
+    addPart(part, part.skHandle, matchPrimeSet);
+    return;
+  }
+  if (!(part.getIndexSet() <= primeSet) && matchPrimeSet)
+    throw RuntimeError("Ctxt::addPart: matchPrimeSet not honored");
+
+  // no matching part found, take over this one
+  parts.push_back(std::move(part));
+  if (parts.back().getIndexSet() != primeSet)
+    parts.back().removePrimes(parts.back().getIndexSet() / primeSet);
+}
+
 // Add a constant polynomial
 void Ctxt::addConstant(const DoubleCRT& dcrt, double size)
 {
@@ -1595,26 +1622,41 @@ void Ctxt::tensorProduct(const Ctxt& c1, const Ctxt& c2)
     intFactor = NTL::MulMod(intFactor, q, ptxtSp);
   }
 
-  // The actual tensoring
-  CtxtPart tmpPart(context, IndexSet::emptySet()); // a scratch CtxtPart
+  // The actual tensoring. Every product is written directly into its part
+  // of *this (or added to it, if we already have a part for its handle),
+  // the parts of c1 and c2 are never copied. When squaring, the product of
+  // parts i and j for i<j is the same as that of j and i, so we compute it
+  // once and double it: for (c0, c1) that is c0^2, 2*c0*c1, c1^2.
+  bool squaring = (&c1 == &c2);
   for (long i : range(c1.parts.size())) {
-    CtxtPart thisPart = c1.parts[i];
+    const CtxtPart& part1 = c1.parts[i];
+
+    for (long j : range(squaring ? i : 0, c2.parts.size())) {
+      const CtxtPart& part2 = c2.parts[j];
+      bool twice = squaring && (i != j);
 
-    for (long j : range(c2.parts.size())) {
-      tmpPart = c2.parts[j];
       // What secret key will the product point to?
-      if (!tmpPart.skHandle.mul(thisPart.skHandle, tmpPart.skHandle))
+      SKHandle handle;
+      if (!handle.mul(part1.skHandle, part2.skHandle))
         throw LogicError(
             "Ctxt::tensorProduct: cannot multiply secret-key handles");
 
-      tmpPart *= thisPart; // The element of the tensor product
-
       // Check if we already have a part relative to this secret-key handle
-      long k = getPartIndexByHandle(tmpPart.skHandle);
-      if (k >= 0) // found a matching part
-        parts[k] += tmpPart;
-      else
-        parts.push_back(tmpPart);
+      long k = getPartIndexByHandle(handle);
+      if (k < 0) {
+        parts.emplace_back(context, primeSet, handle);
+        CtxtPart& prod = parts.back();
+        prod.setProduct(part1, part2);
+        if (twice)
+          prod += prod;
+      } else if (!twice) {
+        parts[k].addProduct(part1, part2);
+      } else { // only for inputs that were not re-linearized
+        DoubleCRT prod(context, primeSet);
+        prod.setProduct(part1, part2);
+        prod += prod;
+        parts[k] += prod;
+      }
     }
   }
 
@@ -1770,7 +1812,7 @@ void Ctxt::multLowLvl(const Ctxt& other_orig, bool destructive)
   // Perform the actual tensor product
   Ctxt tmpCtxt(pubKey, ptxtSpace);
   tmpCtxt.tensorProduct(*this, *other_pt);
-  *this = tmpCtxt;
+  *this = std::move(tmpCtxt);
 }
 
 // Higher-level multiply routines that include also modulus-switching
@@ -2648,17 +2690,16 @@ Ctxt Ctxt::readFrom(std::istream& str, const PubKey& pubKey)
 void Ctxt::read(std::istream& str)
 {
   const auto header = SerializeHeader<Ctxt>::readFrom(str);
-  assertEq<IOError>(header.version,
-                    Binio::VERSION_0_0_1_0,
-                    "Header: version " + header.versionString() +
-                        " not supported");
+  assertTrue<IOError>(header.isReadableVersion(),
+                      "Header: version " + header.versionString() +
+                          " not supported");
 
   bool eyeCatcherFound = readEyeCatcher(str, EyeCatcher::CTXT_BEGIN);
   assertTrue<IOError>(eyeCatcherFound,
                       "Could not find pre-ciphertext eye catcher");
 
-  ptxtSpace = read_raw_int(str);
-  intFactor = read_raw_int(str);
+  read_raw_ZZ(str, ptxtSpace);
+  read_raw_ZZ(str, intFactor);
   ptxtMag = read_raw_xdouble(str);
   ratFactor = read_raw_xdouble(str);
   noiseBound = read_raw_xdouble(str);
@@ -2675,7 +2716,10 @@ void Ctxt::read(std::istream& str)
 
 void Ctxt::writeToJSON(std::ostream& str) const
 {
-  executeRedirectJsonError<void>([&]() { str << writeToJSON(); });
+  executeRedirectJsonError<void>([&]() {
+    JsonWriter writer(str);
+    this->writeToJSON(writer);
+  });
 }
 
 JsonWrapper Ctxt::writeToJSON() const
@@ -2696,11 +2740,9 @@ JsonWrapper Ctxt::writeToJSON() const
 
 Ctxt Ctxt::readFromJSON(std::istream& str, const PubKey& pubKey)
 {
-  return executeRedirectJsonError<Ctxt>([&]() {
-    json j;
-    str >> j;
-    return Ctxt::readFromJSON(wrap(j), pubKey);
-  });
+  Ctxt ret(pubKey);
+  ret.readJSON(str);
+  return ret;
 }
 
 Ctxt Ctxt::readFromJSON(const JsonWrapper& j, const PubKey& pubKey)
@@ -2713,9 +2755,8 @@ Ctxt Ctxt::readFromJSON(const JsonWrapper& j, const PubKey& pubKey)
 void Ctxt::readJSON(std::istream& str)
 {
   executeRedirectJsonError<void>([&]() {
-    json j;
-    str >> j;
-    this->readJSON(wrap(j));
+    JsonReader reader(str);
+    this->readJSON(reader);
   });
 }
 
@@ -2747,6 +2788,77 @@ void Ctxt::readJSON(const JsonWrapper& jw)
   executeRedirectJsonError<void>(body);
 }
 
+void Ctxt::writeToJSON(JsonWriter& writer) const
+{
+  // The keys are sorted, as in the json objects
+  writeTypedJson<Ctxt>(writer, [&]() {
+    writer.beginObject();
+    writer.key("intFactor");
+    writer.value(this->intFactor);
+    writer.key("noiseBound");
+    writer.value(this->noiseBound);
+    writer.key("parts");
+    writer.beginArray();
+    for (const CtxtPart& part : this->parts)
+      part.writeToJSON(writer);
+    writer.endArray();
+    writer.key("primeSet");
+    writer.value(unwrap(this->primeSet.writeToJSON()));
+    writer.key("ptxtMag");
+    writer.value(this->ptxtMag);
+    writer.key("ptxtSpace");
+    writer.value(this->ptxtSpace);
+    writer.key("ratFactor");
+    writer.value(this->ratFactor);
+    writer.endObject();
+  });
+}
+
+void Ctxt::readJSON(JsonReader& reader)
+{
+  auto readParts = [&]() {
+    // The parts are read in place, as in the JsonWrapper version
+    CtxtPart blankCtxtPart(context, IndexSet::emptySet());
+    std::size_t n = 0;
+    reader.beginArray();
+    while (reader.nextElement()) {
+      if (n == this->parts.size())
+        this->parts.push_back(blankCtxtPart);
+      this->parts[n++].readJSON(reader);
+    }
+    this->parts.resize(n, blankCtxtPart);
+  };
+
+  readTypedJson<Ctxt>(reader, [&]() {
+    reader.readObject(
+        {{"intFactor",
+          [&]() { this->intFactor = reader.readValue().get<NTL::ZZ>(); }},
+         {"noiseBound",
+          [&]() {
+            this->noiseBound = reader.readValue().get<NTL::xdouble>();
+          }},
+         {"parts", readParts},
+         {"primeSet",
+          [&]() {
+            this->primeSet = IndexSet::readFromJSON(wrap(reader.readValue()));
+          }},
+         {"ptxtMag",
+          [&]() { this->ptxtMag = reader.readValue().get<NTL::xdouble>(); }},
+         {"ptxtSpace",
+          [&]() { this->ptxtSpace = reader.readValue().get<NTL::ZZ>(); }},
+         {"ratFactor", [&]() {
+            this->ratFactor = reader.readValue().get<NTL::xdouble>();
+          }}});
+  });
+
+  // sanity-check
+  for (const auto& part : this->parts) {
+    assertEq(part.getIndexSet(),
+             this->primeSet,
+             "Ciphertext part's index set does not match prime set");
+  }
+}
+
 void CtxtPart::writeTo(std::ostream& str) const
 {
   this->DoubleCRT::writeTo(str); // CtxtPart is a child.
@@ -2768,7 +2880,10 @@ void CtxtPart::read(std::istream& str)
 
 void CtxtPart::writeToJSON(std::ostream& str) const
 {
-  str << this->writeToJSON();
+  executeRedirectJsonError<void>([&]() {
+    JsonWriter writer(str);
+    this->writeToJSON(writer);
+  });
 }
 
 JsonWrapper CtxtPart::writeToJSON() const
@@ -2780,9 +2895,9 @@ JsonWrapper CtxtPart::writeToJSON() const
 
 CtxtPart CtxtPart::readFromJSON(std::istream& str, const Context& context)
 {
-  json j;
-  str >> j;
-  return CtxtPart::readFromJSON(wrap(j), context);
+  CtxtPart ret(DoubleCRT(context, IndexSet::emptySet()));
+  ret.readJSON(str);
+  return ret;
 }
 
 CtxtPart CtxtPart::readFromJSON(const JsonWrapper& j, const Context& context)
@@ -2794,9 +2909,10 @@ CtxtPart CtxtPart::readFromJSON(const JsonWrapper& j, const Context& context)
 
 void CtxtPart::readJSON(std::istream& str)
 {
-  json j;
-  str >> j;
-  this->readJSON(wrap(j));
+  executeRedirectJsonError<void>([&]() {
+    JsonReader reader(str);
+    this->readJSON(reader);
+  });
 }
 
 void CtxtPart::readJSON(const JsonWrapper& jw)
@@ -2807,6 +2923,25 @@ void CtxtPart::readJSON(const JsonWrapper& jw)
   this->skHandle = SKHandle::readFromJSON(wrap(inner.at("skHandle")));
 }
 
+void CtxtPart::writeToJSON(JsonWriter& writer) const
+{
+  writer.beginObject();
+  writer.key("DoubleCRT");
+  this->DoubleCRT::writeToJSON(writer); // CtxtPart is a child.
+  writer.key("skHandle");
+  writer.value(unwrap(skHandle.writeToJSON()));
+  writer.endObject();
+}
+
+void CtxtPart::readJSON(JsonReader& reader)
+{
+  reader.readObject(
+      {{"DoubleCRT", [&]() { this->DoubleCRT::readJSON(reader); }},
+       {"skHandle", [&]() {
+          this->skHandle = SKHandle::readFromJSON(wrap(reader.readValue()));
+        }}});
+}
+
 std::istream& operator>>(std::istream& str, SKHandle& handle)
 {
   handle.readFrom(str);
@@ -2908,8 +3043,40 @@ void totalProduct(Ctxt& out, const std::vector<Ctxt>& v)
     recursiveTotalProduct(out, &v[0], n); // do the actual work
 }
 
-// Compute the inner product of two vectors of ciphertexts, this routine uses
-// the lower-level *= operator and does only one re-linearization at the end.
+void ProductAccumulator::addProduct(const Ctxt& a, const Ctxt& b)
+{
+  Ctxt tmp = a;
+  tmp.multLowLvl(b);
+  add(tmp);
+}
+
+void ProductAccumulator::add(const Ctxt& c, bool negative)
+{
+  HELIB_TIMER_START;
+  if (sum.isEmpty() || c.isEmpty() || c.getPrimeSet() == sum.getPrimeSet()) {
+    sum.addCtxt(c, negative);
+    return;
+  }
+
+  // addCtxt would mod-up both terms to the union of their primes, so
+  // mod-down both to the intersection instead, which is much cheaper
+  IndexSet common = sum.getPrimeSet() & c.getPrimeSet();
+  assertFalse(empty(common), "Terms of the sum have no primes in common");
+  sum.bringToSet(common);
+  Ctxt tmp = c;
+  tmp.bringToSet(common);
+  sum.addCtxt(tmp, negative);
+}
+
+Ctxt ProductAccumulator::getSum() const
+{
+  Ctxt result = sum;
+  result.reLinearize();
+  return result;
+}
+
+// Compute the inner product of two vectors of ciphertexts, this routine
+// defers re-linearization and does only one at the end.
 void innerProduct(Ctxt& result, const CtPtrs& v1, const CtPtrs& v2)
 {
   long n = std::min(v1.size(), v2.size());
@@ -2917,14 +3084,10 @@ void innerProduct(Ctxt& result, const CtPtrs& v1, const CtPtrs& v2)
     result.clear();
     return;
   }
-  result = *v1[0];
-  result.multLowLvl(*v2[0]);
-  for (long i = 1; i < n; i++) {
-    Ctxt tmp = *v1[i];
-    tmp.multLowLvl(*v2[i]);
-    result += tmp;
-  }
-  result.reLinearize();
+  ProductAccumulator acc(v1[0]->getPubKey());
+  for (long i = 0; i < n; i++)
+    acc.addProduct(*v1[i], *v2[i]);
+  result = acc.getSum();
 }
 
 void innerProduct(Ctxt& result,
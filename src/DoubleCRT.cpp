@@ -32,20 +32,33 @@
  * in use. The list of primes is defined by the data member modChain, which is
  * a vector of Cmodulus objects.
  */
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+#if (defined(__AVX2__) || defined(__AVX512F__)) && defined(__LP64__)
+#include <immintrin.h>
+#endif
+
 #include <NTL/ZZVec.h>
 #include <NTL/BasicThreadPool.h>
 
 #include "binio.h"
 #include "io.h"
+#include "JsonStream.h"
 #include "intelExt.h"
 
 #include <helib/timing.h>
 #include <helib/sample.h>
 #include <helib/DoubleCRT.h>
 #include <helib/Context.h>
+#include <helib/RNSBaseConverter.h>
+#include <helib/NativeNTT.h>
+#include <helib/CounterPRG.h>
 #include <helib/norms.h>
 #include <helib/fhe_stats.h>
 #include <helib/log.h>
+#include <helib/MappedFile.h>
 
 namespace helib {
 
@@ -60,6 +73,95 @@ static long MakeIndexVector(const IndexSet& s, NTL::Vec<long>& v)
   return sz;
 }
 
+static std::atomic<long> parallelThreshold(1L << 16);
+
+long getDoubleCRTParallelThreshold() { return parallelThreshold.load(); }
+
+void setDoubleCRTParallelThreshold(long threshold)
+{
+  assertTrue<InvalidArgument>(threshold >= 0,
+                              "Parallel threshold must be non-negative");
+  parallelThreshold.store(threshold);
+}
+
+// Call fun(i) for every i in s, with the primes split among the threads of
+// NTL's pool when there is enough work (phim * |s| elements) to pay for it.
+// Within an enclosing NTL_EXEC_RANGE (e.g. one ciphertext part per thread)
+// the pool is busy and AvailableThreads() is 1, so this runs serially on the
+// calling thread. fun must only touch data that belongs to prime i, and a
+// map that it writes to must not be a view (see ResidueMap::detach).
+template <typename Fun>
+static void forEachPrime(const IndexSet& s, long phim, const Fun& fun)
+{
+  long n = s.card();
+  if (n <= 1 || NTL::AvailableThreads() <= 1 ||
+      phim * n < parallelThreshold.load()) {
+    for (long i : s)
+      fun(i);
+    return;
+  }
+
+  static thread_local NTL::Vec<long> tls_ivec;
+  NTL::Vec<long>& ivec = tls_ivec;
+  MakeIndexVector(s, ivec);
+
+  NTL_EXEC_RANGE(n, first, last)
+  for (long k : range(first, last))
+    fun(ivec[k]);
+  NTL_EXEC_RANGE_END
+}
+
+// Apply the inverse FFT to the rows of the primes in s, the coefficients
+// modulo the k'th prime of s are written to out[k*phim .. (k+1)*phim-1].
+static void rowsToCoeffs(long* out,
+                         const Context& context,
+                         const ResidueMap& map,
+                         const IndexSet& s)
+{
+  long phim = context.getPhiM();
+  NTL::Vec<long> ivec;
+  long n = MakeIndexVector(s, ivec);
+
+  NTL_EXEC_RANGE(n, first, last)
+  NTL::zz_pX tmp;
+  for (long k : range(first, last)) {
+    long i = ivec[k];
+    context.ithModulus(i).iFFT(tmp, map[i]);
+    long* row = out + k * phim;
+    long d = deg(tmp);
+    for (long h = 0; h <= d; h++)
+      row[h] = rep(tmp.rep[h]);
+    std::fill(row + d + 1, row + phim, 0L);
+  }
+  NTL_EXEC_RANGE_END
+}
+
+// The reverse of rowsToCoeffs: apply the forward FFT to the coefficients in
+// in[k*phim .. (k+1)*phim-1] and store them in the row of the k'th prime of s.
+static void coeffsToRows(ResidueMap& map,
+                         const Context& context,
+                         const long* in,
+                         const IndexSet& s)
+{
+  long phim = context.getPhiM();
+  NTL::Vec<long> ivec;
+  long n = MakeIndexVector(s, ivec);
+  map.detach();
+
+  NTL_EXEC_RANGE(n, first, last)
+  NTL::zz_pX tmp;
+  for (long k : range(first, last)) {
+    long i = ivec[k];
+    const long* row = in + k * phim;
+    tmp.rep.SetLength(phim);
+    for (long h : range(phim))
+      tmp.rep[h].LoopHole() = row[h];
+    tmp.normalize();
+    context.ithModulus(i).FFT(map[i], tmp);
+  }
+  NTL_EXEC_RANGE_END
+}
+
 // representing an integer polynomial as DoubleCRT. If the number of moduli
 // to use is not specified, the resulting object uses all the moduli in
 // the context. If the coefficients of poly are larger than the product of
@@ -76,6 +178,7 @@ void DoubleCRT::FFT(const NTL::ZZX& poly, const IndexSet& s)
   NTL::Vec<long>& ivec = tls_ivec;
 
   long icard = MakeIndexVector(s, ivec);
+  map.detach();
   NTL_EXEC_RANGE(icard, first, last)
   for (long j = first; j < last; j++) {
     long i = ivec[j];
@@ -96,6 +199,7 @@ void DoubleCRT::FFT(const zzX& poly, const IndexSet& s)
   NTL::Vec<long>& ivec = tls_ivec;
 
   long icard = MakeIndexVector(s, ivec);
+  map.detach();
   NTL_EXEC_RANGE(icard, first, last)
   for (long j = first; j < last; j++) {
     long i = ivec[j];
@@ -118,12 +222,12 @@ void DoubleCRT::verify()
 
   long phim = context.getPhiM();
 
+  if (map.rowLength() != phim)
+    throw RuntimeError("DoubleCRT object has bad row length");
+
   // check that the content of i'th row is in [0,pi) for all i
   for (long i : s) {
-    NTL::vec_long& row = map[i];
-
-    if (row.length() != phim)
-      throw RuntimeError("DoubleCRT object has bad row length");
+    const long* row = map[i];
 
     long pi = context.ithPrime(i); // the i'th modulus
     for (long j : range(phim))
@@ -198,17 +302,65 @@ struct MulFun
 #else
 struct AddFun
 {
-  long apply(long a, long b, long n) const { return NTL::AddMod(a, b, n); }
+  void apply(long* result,
+             const long* a,
+             const long* b,
+             long size,
+             long modulus) const
+  {
+    eltwiseAddMod(result, a, b, size, modulus);
+  }
+
+  void apply(long* result,
+             const long* a,
+             long scalar,
+             long size,
+             long modulus) const
+  {
+    eltwiseAddMod(result, a, scalar, size, modulus);
+  }
 };
 
 struct SubFun
 {
-  long apply(long a, long b, long n) const { return NTL::SubMod(a, b, n); }
+  void apply(long* result,
+             const long* a,
+             const long* b,
+             long size,
+             long modulus) const
+  {
+    eltwiseSubMod(result, a, b, size, modulus);
+  }
+
+  void apply(long* result,
+             const long* a,
+             long scalar,
+             long size,
+             long modulus) const
+  {
+    eltwiseSubMod(result, a, scalar, size, modulus);
+  }
 };
 
 struct MulFun
 {
-  long apply(long a, long b, long n) const { return NTL::MulMod(a, b, n); }
+  void apply(long* result,
+             const long* a,
+             const long* b,
+             long size,
+             long modulus) const
+  {
+    eltwiseMulMod(result, a, b, size, modulus, NTL::PrepMulMod(modulus));
+  }
+
+  void apply(long* result,
+             const long* a,
+             long scalar,
+             long size,
+             long modulus) const
+  {
+    eltwiseMulMod(result, a, scalar, size, modulus);
+  }
 };
 #endif
 
@@ -236,7 +388,7 @@ DoubleCRT& DoubleCRT::Op(const DoubleCRT& other, Fun fun, bool matchIndexSets)
 
   // If you need to mod-up the other, do it on a temporary scratch copy
   DoubleCRT tmp(context, IndexSet());
-  const IndexMap<NTL::vec_long>* other_map = &other.map;
+  const ResidueMap* other_map = &other.map;
 
   // VJS-FIXME: experiment to insist that
   // map.getIndexSet() <= other.map.getIndexSet()
@@ -257,18 +409,14 @@ DoubleCRT& DoubleCRT::Op(const DoubleCRT& other, Fun fun, bool matchIndexSets)
   long phim = context.getPhiM();
 
   // add/sub/mul the data, element by element, modulo the respective primes
-  for (long i : s) {
+  map.detach();
+  forEachPrime(s, phim, [&](long i) {
     long pi = context.ithPrime(i);
-    NTL::vec_long& row = map[i];
-    const NTL::vec_long& other_row = (*other_map)[i];
+    long* row = map[i];
+    const long* other_row = (*other_map)[i];
 
-#ifdef USE_INTEL_HEXL
-    fun.apply(row.elts(), row.elts(), other_row.elts(), phim, pi);
-#else
-    for (long j : range(phim))
-      row[j] = fun.apply(row[j], other_row[j], pi);
-#endif
-  }
+    fun.apply(row, row, other_row, phim, pi);
+  });
   return *this;
 }
 
@@ -299,7 +447,7 @@ DoubleCRT& DoubleCRT::do_mul(const DoubleCRT& other, bool matchIndexSets)
 
   // If you need to mod-up the other, do it on a temporary scratch copy
   DoubleCRT tmp(context, IndexSet());
-  const IndexMap<NTL::vec_long>* other_map = &other.map;
+  const ResidueMap* other_map = &other.map;
 
   // VJS-FIXME: experiment to insist that
   // map.getIndexSet() <= other.map.getIndexSet()
@@ -320,19 +468,19 @@ DoubleCRT& DoubleCRT::do_mul(const DoubleCRT& other, bool matchIndexSets)
   long phim = context.getPhiM();
 
   // add/sub/mul the data, element by element, modulo the respective primes
-  for (long i : s) {
+  map.detach();
+  forEachPrime(s, phim, [&](long i) {
     long pi = context.ithPrime(i);
-    NTL::vec_long& row = map[i];
-    const NTL::vec_long& other_row = (*other_map)[i];
+    long* row = map[i];
+    const long* other_row = (*other_map)[i];
 
 #ifdef USE_INTEL_HEXL
-    intel::EltwiseMultMod(row.elts(), row.elts(), other_row.elts(), phim, pi);
+    intel::EltwiseMultMod(row, row, other_row, phim, pi);
 #else
     NTL::mulmod_t pi_inv = context.ithModulus(i).getQInv();
-    for (long j : range(phim))
-      row[j] = MulMod(row[j], other_row[j], pi, pi_inv);
+    eltwiseMulMod(row, row, other_row, phim, pi, pi_inv);
 #endif // USE_INTEL_HEXL
-  }
+  });
   return *this;
 }
 
@@ -345,18 +493,14 @@ DoubleCRT& DoubleCRT::Op(const NTL::ZZ& num, Fun fun)
   const IndexSet& s = map.getIndexSet();
   long phim = context.getPhiM();
 
-  for (long i : s) {
+  map.detach();
+  forEachPrime(s, phim, [&](long i) {
     long pi = context.ithPrime(i);
     long n = rem(num, pi); // n = num % pi
-    NTL::vec_long& row = map[i];
+    long* row = map[i];
 
-#ifdef USE_INTEL_HEXL
-    fun.apply(row.elts(), row.elts(), n, phim, pi);
-#else
-    for (long j : range(phim))
-      row[j] = fun.apply(row[j], n, pi);
-#endif
-  }
+    fun.apply(row, row, n, phim, pi);
+  });
   return *this;
 }
 
@@ -373,13 +517,14 @@ DoubleCRT& DoubleCRT::Negate(const DoubleCRT& other)
   }
   const IndexSet& s = map.getIndexSet();
   long phim = context.getPhiM();
-  for (long i : s) {
+  map.detach();
+  forEachPrime(s, phim, [&](long i) {
     long pi = context.ithPrime(i);
-    NTL::vec_long& row = map[i];
-    const NTL::vec_long& other_row = other.map[i];
+    long* row = map[i];
+    const long* other_row = other.map[i];
     for (long j : range(phim))
       row[j] = NTL::NegateMod(other_row[j], pi);
-  }
+  });
   return *this;
 }
 
@@ -474,6 +619,66 @@ void DoubleCRT::Mul(const DoubleCRT& other, bool matchIndexSets)
   do_mul(other, matchIndexSets);
 }
 
+DoubleCRT& DoubleCRT::setProduct(const DoubleCRT& a, const DoubleCRT& b)
+{
+  HELIB_TIMER_START;
+
+  if (isDryRun())
+    return *this;
+
+  const IndexSet& s = map.getIndexSet();
+  if (&context != &a.context || &context != &b.context)
+    throw RuntimeError("DoubleCRT::setProduct: incompatible objects");
+  if (!(s <= a.map.getIndexSet() && s <= b.map.getIndexSet()))
+    throw RuntimeError("DoubleCRT::setProduct: missing primes");
+
+  long phim = context.getPhiM();
+  map.detach();
+  forEachPrime(s, phim, [&](long i) {
+    long pi = context.ithPrime(i);
+#ifdef USE_INTEL_HEXL
+    intel::EltwiseMultMod(map[i], a.map[i], b.map[i], phim, pi);
+#else
+    NTL::mulmod_t pi_inv = context.ithModulus(i).getQInv();
+    eltwiseMulMod(map[i], a.map[i], b.map[i], phim, pi, pi_inv);
+#endif // USE_INTEL_HEXL
+  });
+  return *this;
+}
+
+DoubleCRT& DoubleCRT::addProduct(const DoubleCRT& a, const DoubleCRT& b)
+{
+  HELIB_TIMER_START;
+
+  if (isDryRun())
+    return *this;
+
+  const IndexSet& s = map.getIndexSet();
+  if (&context != &a.context || &context != &b.context)
+    throw RuntimeError("DoubleCRT::addProduct: incompatible objects");
+  if (!(s <= a.map.getIndexSet() && s <= b.map.getIndexSet()))
+    throw RuntimeError("DoubleCRT::addProduct: missing primes");
+
+  long phim = context.getPhiM();
+  map.detach();
+  forEachPrime(s, phim, [&](long i) {
+    static thread_local std::vector<long> tls_prod;
+    std::vector<long>& prod = tls_prod;
+    prod.resize(phim);
+
+    long pi = context.ithPrime(i);
+#ifdef USE_INTEL_HEXL
+    intel::EltwiseMultMod(prod.data(), a.map[i], b.map[i], phim, pi);
+    intel::EltwiseAddMod(map[i], map[i], prod.data(), phim, pi);
+#else
+    NTL::mulmod_t pi_inv = context.ithModulus(i).getQInv();
+    eltwiseMulMod(prod.data(), a.map[i], b.map[i], phim, pi, pi_inv);
+    eltwiseAddMod(map[i], map[i], prod.data(), phim, pi);
+#endif // USE_INTEL_HEXL
+  });
+  return *this;
+}
+
 // break *this into n digits,according to the primeSets in context.digits
 // returns the sum of the canonical embedding norms of the digits
 NTL::xdouble DoubleCRT::breakIntoDigits(std::vector<DoubleCRT>& digits) const
@@ -512,54 +717,149 @@ NTL::xdouble DoubleCRT::breakIntoDigits(std::vector<DoubleCRT>& digits) const
     digits[i].removePrimes(notInDigit); // reduce modulo the digit primes
   }
 
-  NTL::xdouble noise(0.0);
-
-  for (long i : range(digits.size())) {
+  // Only the exact estimate needs the coefficients of the digits (and their
+  // canonical embedding), the bound depends on the size of the digits alone
+  Context::DigitNoiseEstimate policy = context.getDigitNoiseEstimate();
+  bool exact = (policy == Context::DigitNoiseEstimate::EXACT) ||
+               (policy == Context::DigitNoiseEstimate::SAMPLED &&
+                context.sampleDigitNoise());
+
+  std::vector<IndexSet> own(n); // the primes of each digit
+  for (long i : range(n))
+    own[i] = digits[i].getIndexSet();
+  std::vector<NTL::ZZX> polys(exact ? n : 0);
+
+  // Digit i is carried into the digits after it, so it must be lifted to
+  // their primes before we can go on to digit i+1. Its rows for the other
+  // primes (of the digits before it, and the special primes) are only
+  // needed at the end, they are filled in below for all the digits at once.
+  IndexSet later = getIndexSet(); // the primes of the digits after i
+  for (long i : range(n)) {
     HELIB_NTIMER_START(addPrimes_5);
-    IndexSet notInDigit = allPrimes / digits[i].getIndexSet();
-
-#if 0
-// This version coumputes a high-probability bound
-
-    double digitSize = context.logOfProduct(digits[i].getIndexSet());
-    NTL::xdouble norm_bnd =
-      context.noiseBoundForUniform( NTL::xexp(digitSize)/2.0, phim );
-    noise += norm_bnd;
+    later.remove(own[i]);
+    if (exact) {
+      if (empty(own[i]))
+        clear(polys[i]);
+      else
+        digits[i].toPoly(polys[i]);
+    }
+    digits[i].extendFrom(own[i], later);
+    HELIB_NTIMER_STOP(addPrimes_5);
 
-    digits[i].addPrimes(notInDigit); // add back all the primes
+    NTL::ZZ pi = context.productOfPrimes(context.getDigit(i));
+    for (long j : range(i + 1, n)) {
+      digits[j].Sub(digits[i], /*matchIndexSets=*/false);
+      digits[j] /= pi;
+    }
+  }
 
-#else
-    // This version computes an "exact" value
+  // Lifting from the primes of the digit only, the rows are the same as
+  // if the digit had been lifted to all the primes at once. The exact norms
+  // are serial, and so are the lifts of digits with few rows left to fill,
+  // so these go across the digits when there are threads to spare.
+  std::vector<NTL::xdouble> norms(exact ? n : 0);
+  long maxRows = 0;
+  for (long i : range(n))
+    maxRows = std::max(maxRows, (allPrimes / digits[i].getIndexSet()).card());
+  auto finish = [&](long i) {
+    digits[i].extendFrom(own[i], allPrimes / digits[i].getIndexSet());
+    if (exact) {
+      HELIB_NTIMER_START(NORM_VAL);
+      norms[i] = embeddingLargestCoeff(polys[i], context.getZMStar());
+      HELIB_NTIMER_STOP(NORM_VAL);
+    }
+  };
+  if (n > 1 && NTL::AvailableThreads() > 1 &&
+      (exact || maxRows < NTL::AvailableThreads())) {
+    NTL_EXEC_RANGE(n, first, last)
+    for (long i : range(first, last))
+      finish(i);
+    NTL_EXEC_RANGE_END
+  } else {
+    for (long i : range(n))
+      finish(i);
+  }
 
-    double digitSize = context.logOfProduct(digits[i].getIndexSet());
+  // Summed in order, so the estimate does not depend on the threads
+  NTL::xdouble noise(0.0);
+  NTL::xdouble bound(0.0);
+  for (long i : range(n)) {
+    // A high-probability bound
+    double digitSize = context.logOfProduct(own[i]);
     NTL::xdouble norm_bnd =
         context.noiseBoundForUniform(NTL::xexp(digitSize) / 2.0, phim);
+    bound += norm_bnd;
 
-    NTL::ZZX poly;
-    digits[i].addPrimes(notInDigit, &poly); // add back all the primes
-
-    HELIB_NTIMER_START(NORM_VAL);
-    NTL::xdouble norm_val = embeddingLargestCoeff(poly, context.getZMStar());
-    HELIB_NTIMER_STOP(NORM_VAL);
-
-    noise += norm_val;
-
-    double ratio = NTL::conv<double>(norm_val / norm_bnd);
-    HELIB_STATS_UPDATE("break-into-digits-ratio", ratio);
-
-#endif
-
-    NTL::ZZ pi = context.productOfPrimes(context.getDigit(i));
-    for (long j : range(i + 1, digits.size())) {
-      digits[j].Sub(digits[i], /*matchIndexSets=*/false);
-      digits[j] /= pi;
+    if (exact) { // The "exact" value
+      noise += norms[i];
+      double ratio = NTL::conv<double>(norms[i] / norm_bnd);
+      HELIB_STATS_UPDATE("break-into-digits-ratio", ratio);
     }
   }
   HELIB_TIMER_STOP;
 
+  if (policy == Context::DigitNoiseEstimate::SAMPLED) {
+    if (exact && bound > 0)
+      context.setDigitNoiseRatio(NTL::conv<double>(noise / bound));
+    else if (!exact)
+      noise = bound * context.getDigitNoiseRatio();
+  } else if (!exact) {
+    noise = bound;
+  }
   return noise;
 }
 
+void DoubleCRT::innerProducts(DoubleCRT& accA,
+                              DoubleCRT& accB,
+                              const std::vector<DoubleCRT>& d,
+                              const std::vector<DoubleCRT>& a,
+                              const std::vector<DoubleCRT>& b)
+{
+  HELIB_TIMER_START;
+
+  const Context& context = accA.context;
+  const IndexSet& s = accA.getIndexSet();
+  long count = d.size();
+
+  assertEq(&accB.context,
+           &context,
+           "DoubleCRT::innerProducts: incompatible contexts");
+  assertEq(accB.getIndexSet(),
+           s,
+           "DoubleCRT::innerProducts: index sets differ");
+  assertTrue(lsize(a) >= count && lsize(b) >= count,
+             "DoubleCRT::innerProducts: not enough a's or b's");
+  for (long k : range(count))
+    if (!(s <= d[k].getIndexSet() && s <= a[k].getIndexSet() &&
+          s <= b[k].getIndexSet()))
+      throw RuntimeError("DoubleCRT::innerProducts: missing primes");
+
+  if (isDryRun() || count == 0)
+    return;
+
+  long phim = context.getPhiM();
+  accA.map.detach();
+  accB.map.detach();
+  forEachPrime(s, phim, [&](long i) {
+    static thread_local std::vector<const long*> tls_rows;
+    std::vector<const long*>& rows = tls_rows;
+    rows.resize(3 * count);
+    for (long k : range(count)) {
+      rows[k] = d[k].map[i];
+      rows[count + k] = a[k].map[i];
+      rows[2 * count + k] = b[k].map[i];
+    }
+    eltwiseFusedDotMod(accA.map[i],
+                       accB.map[i],
+                       rows.data(),
+                       rows.data() + count,
+                       rows.data() + 2 * count,
+                       count,
+                       phim,
+                       context.ithPrime(i));
+  });
+}
+
 // expand index set by s1.
 // it is assumed that s1 is disjoint from the current index set.
 void DoubleCRT::addPrimes(const IndexSet& s1, NTL::ZZX* poly_p)
@@ -581,21 +881,48 @@ void DoubleCRT::addPrimes(const IndexSet& s1, NTL::ZZX* poly_p)
       clear(*poly_p);
     return;
   }
-  NTL::ZZX poly;
-  toPoly(poly); // recover in coefficient representation
-
   if (poly_p)
-    *poly_p = poly;
+    toPoly(*poly_p); // the caller wants the coefficient representation
 
-  map.insert(s1); // add new rows to the map
-  if (isDryRun())
+  if (isDryRun()) {
+    map.insert(s1); // add new rows to the map
     return;
+  }
 
-  // fill in new rows
-  if (deg(poly) <= 0)       // special case for a constant polynomial
-    *this = coeff(poly, 0); // no FFT is needed
-  else
-    FFT(poly, s1);
+  extendFrom(getIndexSet(), s1);
+}
+
+void DoubleCRT::extendFrom(const IndexSet& from, const IndexSet& s1)
+{
+  if (empty(s1))
+    return;
+  if (empty(from)) { // extending zero
+    map.insert(s1);
+    for (long i : s1)
+      std::fill_n(map[i], context.getPhiM(), 0L);
+    return;
+  }
+
+  // Fill in the new rows by fast base extension: convert the rows of from
+  // to coefficients, extend them to s1 using single-precision arithmetic
+  // only, and transform back.
+  IndexSet s0 = from;
+  std::shared_ptr<const RNSBaseConverter> converter =
+      context.getBaseConverter(s0, s1);
+
+  long phim = context.getPhiM();
+  static thread_local std::vector<long> tls_in;
+  static thread_local std::vector<long> tls_out;
+  std::vector<long>& in = tls_in;
+  std::vector<long>& out = tls_out;
+  in.resize(s0.card() * phim);
+  out.resize(s1.card() * phim);
+
+  rowsToCoeffs(in.data(), context, map, s0);
+  converter->convert(out.data(), phim, in.data(), phim, phim);
+
+  map.insert(s1); // add new rows to the map
+  coeffsToRows(map, context, out.data(), s1);
 }
 
 // Expand index set by s1, and multiply by \prod{q \in s1}. s1 is assumed to
@@ -625,23 +952,20 @@ double DoubleCRT::addPrimesAndScale(const IndexSet& s1)
   // scale existing rows
   long phim = context.getPhiM();
   const IndexSet& iSet = map.getIndexSet();
-  for (long i : iSet) {
+  map.detach();
+  forEachPrime(iSet, phim, [&](long i) {
     long qi = context.ithPrime(i);
     long f = rem(factor, qi); // f = factor % qi
-    NTL::vec_long& row = map[i];
+    long* row = map[i];
     // scale row by a factor of f modulo qi
     NTL::mulmod_precon_t bninv = NTL::PrepMulModPrecon(f, qi);
     for (long j : range(phim))
       row[j] = NTL::MulModPrecon(row[j], f, qi, bninv);
-  }
+  });
 
   // insert new rows and fill them with zeros
   map.insert(s1); // add new rows to the map
-  for (long i : s1) {
-    NTL::vec_long& row = map[i];
-    for (long j : range(phim))
-      row[j] = 0;
-  }
+  forEachPrime(s1, phim, [&](long i) { std::fill_n(map[i], phim, 0L); });
 
   return logFactor;
 }
@@ -655,7 +979,7 @@ DoubleCRTHelper::DoubleCRTHelper(const Context& context)
 DoubleCRT::DoubleCRT(const NTL::ZZX& poly,
                      const Context& _context,
                      const IndexSet& s) :
-    context(_context), map(new DoubleCRTHelper(_context))
+    context(_context), map(_context.getPhiM())
 {
   HELIB_TIMER_START;
   assertTrue(s.last() < context.numPrimes(),
@@ -715,7 +1039,7 @@ DoubleCRT::DoubleCRT(const NTL::ZZX& poly)
 DoubleCRT::DoubleCRT(const zzX& poly,
                      const Context& _context,
                      const IndexSet& s) :
-    context(_context), map(new DoubleCRTHelper(_context))
+    context(_context), map(_context.getPhiM())
 {
   HELIB_TIMER_START;
   assertTrue(s.last() < context.numPrimes(),
@@ -772,7 +1096,7 @@ DoubleCRT::DoubleCRT(const zzX& poly)
 #endif
 
 DoubleCRT::DoubleCRT(const Context& _context, const IndexSet& s) :
-    context(_context), map(new DoubleCRTHelper(_context))
+    context(_context), map(_context.getPhiM())
 {
   assertTrue(s.last() < context.numPrimes(),
              "s must end with a smaller element than context.numPrimes()");
@@ -783,11 +1107,8 @@ DoubleCRT::DoubleCRT(const Context& _context, const IndexSet& s) :
 
   long phim = context.getPhiM();
 
-  for (long i : s) {
-    NTL::vec_long& row = map[i];
-    for (long j : range(phim))
-      row[j] = 0;
-  }
+  for (long i : s)
+    std::fill_n(map[i], phim, 0L);
 }
 
 // *****************************************************
@@ -821,18 +1142,21 @@ DoubleCRT& DoubleCRT::operator=(const DoubleCRT& other)
   if (&context != &other.context)
     throw RuntimeError("DoubleCRT assignment: incompatible contexts");
 
-  if (map.getIndexSet() != other.map.getIndexSet()) {
-    map = other.map; // copy the data
-  } else {
-    const IndexSet& s = map.getIndexSet();
-    long phim = context.getPhiM();
-    for (long i : s) {
-      NTL::vec_long& row = map[i];
-      const NTL::vec_long& other_row = other.map[i];
-      for (long j : range(phim))
-        row[j] = other_row[j];
-    }
-  }
+  // ResidueMap reuses its buffer when it is large enough, so this is
+  // a single copy of the contiguous rows
+  map = other.map;
+  return *this;
+}
+
+DoubleCRT& DoubleCRT::operator=(DoubleCRT&& other)
+{
+  if (this == &other)
+    return *this;
+
+  if (&context != &other.context)
+    throw RuntimeError("DoubleCRT assignment: incompatible contexts");
+
+  map = std::move(other.map);
   return *this;
 }
 
@@ -872,12 +1196,9 @@ DoubleCRT& DoubleCRT::operator=(const NTL::ZZ& num)
   long phim = context.getPhiM();
 
   for (long i : s) {
-    NTL::vec_long& row = map[i];
     long pi = context.ithPrime(i);
     long n = rem(num, pi);
-
-    for (long j : range(phim))
-      row[j] = n;
+    std::fill_n(map[i], phim, n);
   }
 
   return *this;
@@ -1127,14 +1448,15 @@ DoubleCRT& DoubleCRT::operator/=(const NTL::ZZ& num)
   const IndexSet& s = map.getIndexSet();
   long phim = context.getPhiM();
 
-  for (long i : s) {
+  map.detach();
+  forEachPrime(s, phim, [&](long i) {
     long pi = context.ithPrime(i);
     long n = NTL::InvMod(rem(num, pi), pi); // n = num^{-1} mod pi
-    NTL::vec_long& row = map[i];
+    long* row = map[i];
     NTL::mulmod_precon_t precon = NTL::PrepMulModPrecon(n, pi);
     for (long j : range(phim))
       row[j] = NTL::MulModPrecon(row[j], n, pi, precon);
-  }
+  });
   return *this;
 }
 
@@ -1147,12 +1469,41 @@ void DoubleCRT::Exp(long e)
   const IndexSet& s = map.getIndexSet();
   long phim = context.getPhiM();
 
-  for (long i : s) {
+  map.detach();
+  forEachPrime(s, phim, [&](long i) {
     long pi = context.ithPrime(i);
-    NTL::vec_long& row = map[i];
+    long* row = map[i];
     for (long j : range(phim))
       row[j] = NTL::PowerMod(row[j], e, pi);
+  });
+}
+
+// dst[j] = src[idx[j]] for all j < n, src and dst must not alias
+static void gatherRow(long* NTL_RESTRICT dst,
+                      const long* NTL_RESTRICT src,
+                      const std::uint32_t* idx,
+                      long n)
+{
+  long j = 0;
+#if defined(__AVX512F__) && defined(__LP64__)
+  for (; j + 8 <= n; j += 8) {
+    __m256i vi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(idx + j));
+    // NOTE: the masked form avoids a spurious -Wmaybe-uninitialized in gcc
+    __m512i v =
+        _mm512_mask_i32gather_epi64(_mm512_setzero_si512(), 0xFF, vi, src, 8);
+    _mm512_storeu_si512(dst + j, v);
   }
+#elif defined(__AVX2__) && defined(__LP64__)
+  for (; j + 4 <= n; j += 4) {
+    __m128i vi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(idx + j));
+    __m256i v = _mm256_i32gather_epi64(reinterpret_cast<const long long*>(src),
+                                       vi,
+                                       8);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + j), v);
+  }
+#endif
+  for (; j < n; j++)
+    dst[j] = src[idx[j]];
 }
 
 // Apply the automorphism F(X) --> F(X^k)  (with gcd(k,m)=1)
@@ -1166,39 +1517,29 @@ void DoubleCRT::automorph(long k)
   if (!zMStar.inZmStar(k))
     throw RuntimeError("DoubleCRT::automorph: k not in Zm*");
 
-  long m = zMStar.getM();
-  long phim = context.getPhiM();
-  std::vector<long> tmp(m); // temporary array of size m
-  NTL::mulmod_precon_t precon = NTL::PrepMulModPrecon(k, m);
-
   const IndexSet& s = map.getIndexSet();
+  if (empty(s))
+    return;
 
-  // go over the rows, permute them one at a time
-  for (long i : s) {
-    NTL::vec_long& row = map[i];
-
-    // Compute new[j] = old[j*k mod m]
+  // The automorphism just permutes every row, new[j] = old[perm[j]].
+  // The permutation is computed once and then cached in the context.
+  std::shared_ptr<const AutomorphCache::Table> perm =
+      context.getAutomorphTable(k);
 
-    // for (long j=1; j<m; j++) { // 1st pass: copy to temporary array
-    //   long idx = zMStar.indexInZmstar_unchecked(j);
-    //   if (idx>=0) tmp[j] = row[idx];
-    // }
-    // for (long j=1; j<m; j++) { // 2nd pass: copy back from temporary array
-    //   long idx = zMStar.indexInZmstar_unchecked(j);
-    //   if (idx>=0) row[idx] = tmp[NTL::MulModPrecon(j,k,m,precon)];
-    //                                        // new[j] = old[j*k mod m]
-    // }
+  long phim = context.getPhiM();
 
-    // slightly faster...
+  // go over the rows, permute them one at a time, each thread with its own
+  // scratch row
+  map.detach();
+  forEachPrime(s, phim, [&](long i) {
+    static thread_local std::vector<long> tls_tmp;
+    std::vector<long>& tmp = tls_tmp;
+    tmp.resize(phim);
 
-    for (long j : range(phim)) { // 1st pass: copy to temporary array
-      tmp[zMStar.repInZmstar_unchecked(j)] = row[j];
-    }
-    for (long j : range(phim)) { // 2nd pass: copy back from temp array
-      row[j] =
-          tmp[NTL::MulModPrecon(zMStar.repInZmstar_unchecked(j), k, m, precon)];
-    }
-  }
+    long* row = map[i];
+    std::copy_n(row, phim, tmp.data());
+    gatherRow(row, tmp.data(), perm->data(), phim);
+  });
 }
 
 #else
@@ -1221,7 +1562,7 @@ void DoubleCRT::automorph(long k)
   // go over the rows, permute them one at a time
   // new[j*k mod m] = old[j]
   for (long i = s.first(); i <= s.last(); i = s.next(i)) {
-    NTL::vec_long& row = map[i];
+    long* row = map[i];
 
     for (long j = 0; j < phim; j++)
       tmp[j] = row[j];
@@ -1244,7 +1585,9 @@ size_t ilog2(size_t n) {
   return log;
 }
 
-// Compute the complex conjugate, this is the same as automorph(m-1)
+// Compute the complex conjugate, this is the same as automorph(m-1).
+// NOTE: this also holds when the rows are kept in bit-reversed order, since
+// reversing the bits of phi(m)-j-1 gives phi(m)-rev(j)-1.
 void DoubleCRT::complexConj()
 {
   if (isDryRun())
@@ -1254,12 +1597,13 @@ void DoubleCRT::complexConj()
   const IndexSet& s = map.getIndexSet();
 
   // go over the rows, permute them one at a time
-  for (long i : s) {
-    NTL::vec_long& row = map[i];
+  map.detach();
+  forEachPrime(s, phim, [&](long i) {
+    long* row = map[i];
     for (long j : range(phim / 2)) { // swap i <-> phi(m)-i-1
       std::swap(row[j], row[phim - j - 1]);
     }
-  }
+  });
 }
 
 // fills each row i with random integers mod pi
@@ -1284,14 +1628,20 @@ void DoubleCRT::randomize(const NTL::ZZ* seed)
 
   unsigned char* buf = buf_storage.elts();
 
+  // NOTE: this loop stays serial over the primes. All the rows are drawn
+  // from one random stream, with a data-dependent number of bytes per row
+  // (rejection sampling), and a given seed must give the same element.
   for (long i : s) {
     long pi = context.ithPrime(i);
     long k = NTL::NumBits(pi - 1);
     long nb = (k + 7) / 8;
     unsigned long mask = (1UL << k) - 1UL;
 
-    NTL::vec_long& row = map[i];
+    long* row = map[i];
     long j = 0;
+    // The values are generated in the natural order of Zm*, so the same
+    // seed gives the same element whatever order the rows are kept in
+    const Cmodulus& cmod = context.ithModulus(i);
 
     for (;;) {
       {
@@ -1374,7 +1724,7 @@ void DoubleCRT::randomize(const NTL::ZZ* seed)
 
         long tmp = utmp;
 
-        row[j] = tmp;
+        row[cmod.evalIndex(j)] = tmp;
         j += (tmp < pi);
         if (j >= phim)
           break;
@@ -1385,6 +1735,39 @@ void DoubleCRT::randomize(const NTL::ZZ* seed)
   }
 }
 
+void DoubleCRT::randomize(const CounterPRG& prg, long stream)
+{
+  HELIB_TIMER_START;
+
+  if (isDryRun())
+    return;
+
+  assertInRange<InvalidArgument>(stream,
+                                 0L,
+                                 1L << 31,
+                                 "DoubleCRT::randomize: stream out of range");
+
+  const IndexSet& s = map.getIndexSet();
+  long phim = context.getPhiM();
+
+  map.detach();
+  forEachPrime(s, phim, [&](long i) {
+    static thread_local std::vector<long> tls_vals;
+    std::vector<long>& vals = tls_vals;
+    vals.resize(phim);
+    prg.uniformMod(vals.data(),
+                   phim,
+                   context.ithPrime(i),
+                   (std::uint64_t(stream) << 32) | std::uint64_t(i));
+
+    // As above, the values are in the natural order of Zm*
+    const Cmodulus& cmod = context.ithModulus(i);
+    long* row = map[i];
+    for (long j : range(phim))
+      row[cmod.evalIndex(j)] = vals[j];
+  });
+}
+
 // Coefficients are -1/0/1, Prob[0]=1/2
 double DoubleCRT::sampleSmall()
 {
@@ -1526,6 +1909,128 @@ void DoubleCRT::scaleDownToSet(const IndexSet& s,
                       // actually scales it down
 }
 
+void DoubleCRT::scaleDownToSet(const IndexSet& s,
+                               NTL::ZZ& ptxtSpace,
+                               std::vector<double>& fdelta)
+{
+  HELIB_TIMER_START;
+  IndexSet diff = getIndexSet() / s;
+  fdelta.clear();
+  if (empty(diff))
+    return; // nothing to do
+
+  assertTrue(bool(ptxtSpace >= 1), "ptxtSpace must be at least 1");
+  // cannot mod-down to the empty set
+  assertNeq(diff,
+            getIndexSet(),
+            "s and the index set must have some intersection");
+  if (isDryRun()) {
+    removePrimes(diff); // remove the primes from consideration
+    return;
+  }
+
+#ifndef HELIB_LEGACY_MODSWITCH
+  if (ptxtSpace < NTL_SP_BOUND) {
+    IndexSet kept = getIndexSet() / diff;
+    long phim = context.getPhiM();
+    long t = NTL::conv<long>(ptxtSpace);
+
+    std::shared_ptr<const RNSBaseConverter> converter =
+        context.getBaseConverter(diff, kept);
+
+    static thread_local std::vector<long> tls_in;
+    static thread_local std::vector<long> tls_out;
+    static thread_local std::vector<long> tls_e;
+    std::vector<long>& in = tls_in;   // coefficients of the dropped rows
+    std::vector<long>& out = tls_out; // delta modulo the kept primes
+    std::vector<long>& e = tls_e;     // the correction mod ptxtSpace
+    in.resize(diff.card() * phim);
+    out.resize(kept.card() * phim);
+    e.assign(phim, 0);
+    fdelta.resize(phim);
+
+    // delta0 = the balanced representative of *this mod diffProd, obtained
+    // by fast base extension from the dropped primes to the kept ones.
+    rowsToCoeffs(in.data(), context, map, diff);
+    converter->convert(out.data(), phim, in.data(), phim, phim, fdelta.data());
+
+    if (t > 1) { // make delta divisible by ptxtSpace
+      // As in the ZZX version, delta = delta0 - diffProd * e with
+      // e = delta0 * diffProd^{-1} mod ptxtSpace, in balanced form.
+      converter->convertTo(e.data(), t, in.data(), phim, phim);
+      long prodInv = NTL::InvMod(converter->productMod(t), t);
+      long t_over_2 = t / 2;
+      for (long h : range(phim)) {
+        long r = e[h];
+        if (r != 0) { // if not already 0 mod ptxtSpace
+          r = NTL::MulMod(r, prodInv, t);
+          // NOTE: this makes sure we get a more truly balanced remainder
+          if (r > t_over_2 ||
+              (t % 2 == 0 && r == t_over_2 &&
+               (fdelta[h] < 0 || (fdelta[h] == 0 && NTL::RandomBnd(2)))))
+            r -= t;
+        }
+        e[h] = r;
+        fdelta[h] -= r;
+      }
+    }
+
+    removePrimes(diff); // remove the primes from consideration
+
+    // For every remaining prime q: row = (row - FFT(delta mod q)) / diffProd
+    NTL::Vec<long> ivec;
+    long n = MakeIndexVector(kept, ivec);
+    map.detach();
+    NTL_EXEC_RANGE(n, first, last)
+    // per-thread scratch, reused by the next mod switch of this thread
+    static thread_local NTL::zz_pX tls_tmp;
+    static thread_local NTL::Vec<long> tls_deltaRow;
+    NTL::zz_pX& tmp = tls_tmp;
+    NTL::Vec<long>& deltaRow = tls_deltaRow;
+    deltaRow.SetLength(phim);
+    for (long k : range(first, last)) {
+      long i = ivec[k];
+      long q = context.ithPrime(i);
+      long prodModQ = converter->productMod(q);
+      long* d = out.data() + k * phim;
+
+      tmp.rep.SetLength(phim);
+      for (long h : range(phim)) {
+        long dh = d[h];
+        if (e[h] != 0) {
+          long eh = e[h] % q;
+          if (eh < 0)
+            eh += q;
+          dh = NTL::SubMod(dh, NTL::MulMod(eh, prodModQ, q), q);
+        }
+        tmp.rep[h].LoopHole() = dh;
+      }
+      tmp.normalize();
+      context.ithModulus(i).FFT(deltaRow.elts(), tmp);
+
+      long prodInv = NTL::InvMod(prodModQ, q);
+      NTL::mulmod_precon_t prodInvPrecon = NTL::PrepMulModPrecon(prodInv, q);
+      long* row = map[i];
+      for (long h : range(phim))
+        row[h] = NTL::MulModPrecon(NTL::SubMod(row[h], deltaRow[h], q),
+                                   prodInv,
+                                   q,
+                                   prodInvPrecon);
+    }
+    NTL_EXEC_RANGE_END
+    return;
+  }
+#endif
+
+  // Go through the ZZX representation of delta
+  NTL::xdouble xdiff = NTL::conv<NTL::xdouble>(context.productOfPrimes(diff));
+  NTL::ZZX delta;
+  scaleDownToSet(s, ptxtSpace, delta);
+  fdelta.resize(delta.rep.length());
+  for (long j : range(delta.rep.length()))
+    fdelta[j] = NTL::conv<double>(NTL::conv<NTL::xdouble>(delta.rep[j]) / xdiff);
+}
+
 std::ostream& operator<<(std::ostream& str, const DoubleCRT& d)
 {
   str << d.writeToJSON();
@@ -1543,10 +2048,22 @@ void DoubleCRT::writeTo(std::ostream& str) const
   const IndexSet& set = map.getIndexSet();
   //  std::cerr << "[DCRT::write] set: " << set << std::endl;
   set.writeTo(str);
+  if (set.card() > 0 && hasMappableLayout(str)) {
+    writeAligned(str);
+    return;
+  }
 
+  // The rows are written in the natural order of Zm*, with just the bits
+  // of q_i - 1 per residue
+  long phim = context.getPhiM();
+  std::vector<long> row;
   for (long i : set) {
-    write_ntl_vec_long(str, map[i]);
-    //   std::cerr << "[DCRT::write] map[i]: " << map[i] << std::endl;
+    row.assign(map[i], map[i] + phim);
+    context.ithModulus(i).permuteEvalOrder(row.data());
+    write_packed_long_row(str,
+                          row.data(),
+                          phim,
+                          NTL::NumBits(context.ithPrime(i) - 1));
   }
 }
 
@@ -1561,29 +2078,152 @@ DoubleCRT DoubleCRT::readFrom(std::istream& str, const Context& context)
 void DoubleCRT::read(std::istream& str)
 {
   IndexSet set = IndexSet::readFrom(str); // read in the indexSet
+  //  std::cerr << "[DCRT::read] set: " << set << std::endl;
+  if (set.card() == 0) {
+    map.clear();
+    return;
+  }
+
+  // The first row says which of the layouts follows
+  int sizeOfRow = read_raw_int32(str);
+  int intSize = read_raw_int32(str);
+  if (intSize == Binio::ALIGNED) {
+    readAligned(str, set, sizeOfRow);
+    return;
+  }
+
   map.clear();
   map.insert(set); // fix the index set for the data
-                   //  std::cerr << "[DCRT::read] set: " << set << std::endl;
+  long phim = context.getPhiM();
+  for (long i : set) {
+    if (i != set.first()) {
+      sizeOfRow = read_raw_int32(str);
+      intSize = read_raw_int32(str);
+    }
+    read_raw_long_row_data(str, map[i], phim, sizeOfRow, intSize);
+    context.ithModulus(i).permuteEvalOrder(map[i]);
+  }
+}
+
+/* The mappable layout: int32 phi(m), int32 Binio::ALIGNED, int32 stride,
+ * int32 1 if the rows are in bit-reversed evaluation order (0 if natural),
+ * int32 pad, pad zero bytes to get to a multiple of ROW_ALIGN from the
+ * beginning of the stream, then the rows in the order of the index set,
+ * each of stride longs of which the last stride - phi(m) are zero.
+ */
+void DoubleCRT::writeAligned(std::ostream& str) const
+{
+  const IndexSet& set = map.getIndexSet();
+  long phim = context.getPhiM();
+  long stride = map.rowStride();
+
+  write_raw_int32(str, phim);
+  write_raw_int32(str, Binio::ALIGNED);
+  write_raw_int32(str, stride);
+  write_raw_int32(str, context.ithModulus(set.first()).bitReversedOrder());
+  // tellp fails on streams that cannot seek, the rows are then only copied
+  // on reading
+  std::streamoff pos = str.tellp();
+  long pad = 0;
+  if (pos >= 0)
+    pad = (ResidueMap::ROW_ALIGN - (pos + 4) % ResidueMap::ROW_ALIGN) %
+          ResidueMap::ROW_ALIGN;
+  write_raw_int32(str, pad);
+  const char zeros[ResidueMap::ROW_ALIGN] = {};
+  str.write(zeros, pad);
 
   for (long i : set) {
-    read_ntl_vec_long(str, map[i]);
-    //   std::cerr << "[DCRT::read] map[i]: " << map[i] << std::endl;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    str.write(reinterpret_cast<const char*>(map[i]), sizeof(long) * phim);
+#else
+    for (long j = 0; j < phim; j++)
+      write_raw_int(str, map[i][j]);
+#endif
+    for (long j = phim; j < stride; j++)
+      write_raw_int(str, 0);
   }
 }
 
+void DoubleCRT::readAligned(std::istream& str,
+                            const IndexSet& set,
+                            long sizeOfRow)
+{
+  long phim = context.getPhiM();
+  if (sizeOfRow != phim)
+    throw IOError("Row length mismatch: read " + std::to_string(sizeOfRow) +
+                  ", expected " + std::to_string(phim));
+
+  long stride = read_raw_int32(str);
+  bool bitReversed = read_raw_int32(str);
+  long pad = read_raw_int32(str);
+  if (stride != ResidueMap(phim).rowStride())
+    throw IOError("Aligned rows with a stride of " + std::to_string(stride) +
+                  ", expected " + std::to_string(ResidueMap(phim).rowStride()));
+  if (bitReversed != context.ithModulus(set.first()).bitReversedOrder())
+    throw IOError("Aligned rows in another evaluation order than the one of "
+                  "this build (see HELIB_NATURAL_EVAL_ORDER)");
+  assertInRange<IOError>(pad,
+                         0l,
+                         ResidueMap::ROW_ALIGN,
+                         "Aligned rows with a padding of " +
+                             std::to_string(pad) + " bytes");
+  str.ignore(pad);
+  if (!str)
+    throw IOError("Could not read the padding of aligned rows");
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ && defined(HELIB_MAPPED_FILES)
+  // Use the rows in place if they are mapped (and aligned, which they are
+  // unless the writer could not tell where it was in the file)
+  std::size_t bytes = sizeof(long) * stride * set.card();
+  auto mapped = dynamic_cast<MappedStreamBuf*>(str.rdbuf());
+  if (mapped != nullptr && mapped->remaining() >= bytes &&
+      reinterpret_cast<std::uintptr_t>(mapped->position()) %
+              ResidueMap::ROW_ALIGN ==
+          0) {
+    map = ResidueMap::view(phim,
+                           set,
+                           reinterpret_cast<long*>(mapped->position()),
+                           mapped->getFile());
+    mapped->advance(bytes);
+    return;
+  }
+#endif
+
+  map.clear();
+  map.insert(set);
+  for (long i : set) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    str.read(reinterpret_cast<char*>(map[i]), sizeof(long) * phim);
+#else
+    for (long j = 0; j < phim; j++)
+      map[i][j] = read_raw_int(str);
+#endif
+    str.ignore(sizeof(long) * (stride - phim));
+  }
+  if (!str)
+    throw IOError("Could not read " + std::to_string(set.card()) +
+                  " aligned rows");
+}
+
 void DoubleCRT::writeToJSON(std::ostream& str) const
 {
-  str << this->writeToJSON();
+  executeRedirectJsonError<void>([&]() {
+    JsonWriter writer(str);
+    this->writeToJSON(writer);
+  });
 }
 
 JsonWrapper DoubleCRT::writeToJSON() const
 {
   const IndexSet& set = this->map.getIndexSet();
-  std::vector<NTL::Vec<long>> map_cnt;
+  long phim = context.getPhiM();
+  std::vector<std::vector<long>> map_cnt;
 
-  // check that the content of i'th row is in [0,pi) for all i
-  for (long i : set)
-    map_cnt.emplace_back(this->map[i]);
+  // The rows are written in the natural order of Zm*
+  for (long i : set) {
+    map_cnt.emplace_back(this->map[i], this->map[i] + phim);
+    context.ithModulus(i).permuteEvalOrder(map_cnt.back().data());
+  }
 
   json j = {{"set", unwrap(set.writeToJSON())}, {"map", map_cnt}};
   return wrap(j);
@@ -1591,9 +2231,9 @@ JsonWrapper DoubleCRT::writeToJSON() const
 
 DoubleCRT DoubleCRT::readFromJSON(std::istream& str, const Context& context)
 {
-  json j;
-  str >> j;
-  return DoubleCRT::readFromJSON(wrap(j), context);
+  DoubleCRT ret{context, IndexSet::emptySet()};
+  ret.readJSON(str);
+  return ret;
 }
 
 DoubleCRT DoubleCRT::readFromJSON(const JsonWrapper& j, const Context& context)
@@ -1605,9 +2245,10 @@ DoubleCRT DoubleCRT::readFromJSON(const JsonWrapper& j, const Context& context)
 
 void DoubleCRT::readJSON(std::istream& str)
 {
-  json j;
-  str >> j;
-  return this->readJSON(wrap(j));
+  executeRedirectJsonError<void>([&]() {
+    JsonReader reader(str);
+    this->readJSON(reader);
+  });
 }
 
 void DoubleCRT::readJSON(const JsonWrapper& jw)
@@ -1624,16 +2265,104 @@ void DoubleCRT::readJSON(const JsonWrapper& jw)
   this->map.clear();
   this->map.insert(set); // fix the index set for the data
 
-  std::vector<NTL::Vec<long>> map_cnt = j.at("map");
+  std::vector<std::vector<long>> map_cnt = j.at("map");
 
   std::size_t cnt = 0;
   for (long i : set) {
-    this->map[i] = map_cnt[cnt++]; // read the actual data
+    const std::vector<long>& row = map_cnt[cnt++];
 
     // verify that the data is valid
-    assertEq(this->map[i].length(),
-             phim,
-             "Data not valid: d.map[i].length() != phim");
+    assertEq(lsize(row), phim, "Data not valid: d.map[i].length() != phim");
+    std::copy(row.begin(), row.end(), this->map[i]); // read the actual data
+    context.ithModulus(i).permuteEvalOrder(this->map[i]);
+
+    for (long j : range(phim))
+      assertInRange(
+          this->map[i][j],
+          0l,
+          context.ithPrime(i),
+          "this->map[i][j] invalid: must be between 0 and context.ithPrime(i)");
+  }
+}
+
+void DoubleCRT::writeToJSON(JsonWriter& writer) const
+{
+  const IndexSet& set = this->map.getIndexSet();
+  long phim = context.getPhiM();
+  std::vector<long> row(phim);
+
+  writer.beginObject();
+  writer.key("map");
+  writer.beginArray();
+  // The rows are written in the natural order of Zm*
+  for (long i : set) {
+    std::copy(this->map[i], this->map[i] + phim, row.begin());
+    context.ithModulus(i).permuteEvalOrder(row.data());
+    writer.row(row.data(), phim);
+  }
+  writer.endArray();
+  writer.key("set");
+  writer.value(unwrap(set.writeToJSON()));
+  writer.endObject();
+}
+
+void DoubleCRT::readJSON(JsonReader& reader)
+{
+  const Context& context = this->context;
+  long phim = context.getPhiM();
+
+  // The rows are read straight into the map once the set is known. They
+  // come before it when the keys are sorted, and are then buffered until the
+  // set is read.
+  IndexSet set;
+  bool hasSet = false;
+  std::vector<long> buffered;
+  long nRows = 0;
+  long next = 0; // the prime of the next row, once the set is known
+
+  auto readMap = [&]() {
+    reader.beginArray();
+    while (reader.nextElement()) {
+      long* row;
+      if (hasSet) {
+        assertTrue<IOError>(nRows < set.card(),
+                            "Data not valid: more rows than primes");
+        row = this->map[next];
+        next = set.next(next);
+      } else {
+        buffered.resize((nRows + 1) * phim);
+        row = buffered.data() + nRows * phim;
+      }
+      // verify that the data is valid
+      assertEq(reader.readRow(row, phim),
+               phim,
+               "Data not valid: d.map[i].length() != phim");
+      nRows++;
+    }
+  };
+  auto readSet = [&]() {
+    set = IndexSet::readFromJSON(wrap(reader.readValue()));
+    assertTrue(set <= (context.getSmallPrimes() | context.getSpecialPrimes() |
+                       context.getCtxtPrimes()),
+               "Stream does not contain subset of the context's primes");
+    this->map.clear();
+    this->map.insert(set); // fix the index set for the data
+    next = set.first();
+    hasSet = true;
+  };
+  reader.readObject({{"map", readMap}, {"set", readSet}});
+
+  assertEq<IOError>(nRows,
+                    set.card(),
+                    "Data not valid: number of rows != number of primes");
+  const long* row = buffered.data();
+  for (long i : set) {
+    if (!buffered.empty()) {
+      std::copy(row, row + phim, this->map[i]);
+      row += phim;
+    }
+    context.ithModulus(i).permuteEvalOrder(this->map[i]);
+
     for (long j : range(phim))
       assertInRange(
           this->map[i][j],
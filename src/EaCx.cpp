@@ -14,6 +14,7 @@
 #include <algorithm>
 #include <type_traits>
 
+#include <NTL/BasicThreadPool.h>
 #include <helib/zzX.h>
 #include <helib/EncryptedArray.h>
 
@@ -235,6 +236,35 @@ void EncryptedArrayCx::shift(Ctxt& ctxt, long amt) const
   shift1D(ctxt, 0, amt);
 }
 
+std::vector<Ctxt> EncryptedArrayCx::rotateMany(
+    const HoistedCtxt& hoisted,
+    const std::vector<long>& amounts) const
+{
+  HELIB_TIMER_START;
+  assertTrue(dimension() == 1,
+             "CKKS rotation not supported in multi-dimensional hypercube");
+  assertEq(&context, &hoisted.getCtxt().getContext(), "Context mismatch");
+
+  long ord = sizeOfDimension(0);
+  std::vector<Ctxt> result(amounts.size(), hoisted.getCtxt());
+  hoisted.precompute1D(0);
+
+  NTL_EXEC_RANGE(lsize(amounts), first, last)
+  for (long j : range(first, last)) {
+    long amt = amounts[j] % ord;
+    if (amt < 0)
+      amt += ord;
+    if (amt != 0) {
+      result[j] = hoisted.automorph1D(0, amt);
+      result[j].cleanUp();
+    }
+  }
+  NTL_EXEC_RANGE_END
+
+  HELIB_TIMER_STOP;
+  return result;
+}
+
 //====== New Encoding Functions ====
 
 void EncryptedArrayCx::encode(EncodedPtxt& eptxt,
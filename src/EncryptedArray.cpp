@@ -12,6 +12,7 @@
 /* EncryptedArray.cpp - Data-movement operations on arrays of slots
  */
 #include <algorithm>
+#include <NTL/BasicThreadPool.h>
 #include <helib/zzX.h>
 #include <helib/EncryptedArray.h>
 #include <helib/timing.h>
@@ -55,6 +56,14 @@ EncryptedArrayBase* buildEncryptedArray(const Context& context,
   }
 }
 
+std::vector<Ctxt> EncryptedArrayBase::rotateMany(
+    const Ctxt& ctxt,
+    const std::vector<long>& amounts) const
+{
+  HoistedCtxt hoisted(ctxt);
+  return rotateMany(hoisted, amounts);
+}
+
 template <typename type>
 EncryptedArrayDerived<type>::EncryptedArrayDerived(const Context& _context,
                                                    const RX& _G,
@@ -72,6 +81,16 @@ void EncryptedArrayDerived<type>::rotate1D(Ctxt& ctxt,
                                            bool dc) const
 {
   HELIB_TIMER_START;
+  rotate1DFrom(ctxt, i, amt, dc, nullptr);
+}
+
+template <typename type>
+void EncryptedArrayDerived<type>::rotate1DFrom(Ctxt& ctxt,
+                                               long i,
+                                               long amt,
+                                               bool dc,
+                                               const HoistedCtxt* hoisted) const
+{
   helib::assertEq(&context, &ctxt.getContext(), "Context mismatch");
   helib::assertInRange(i,
                        0l,
@@ -94,7 +113,10 @@ void EncryptedArrayDerived<type>::rotate1D(Ctxt& ctxt,
 
   if (dc || nativeDimension(i)) { // native dimension or don't-care
     // For don't-care, we assume that any shifts "off the end" are zero
-    ctxt.smartAutomorph(zMStar.genToPow(i, amt));
+    if (hoisted)
+      ctxt = hoisted->automorph1D(i, amt);
+    else
+      ctxt.smartAutomorph(zMStar.genToPow(i, amt));
     return;
   }
 
@@ -103,15 +125,21 @@ void EncryptedArrayDerived<type>::rotate1D(Ctxt& ctxt,
   helib::assertTrue(maskTable[i].size() > 0,
                     "Found non-positive sized mask table entry");
 
-  ctxt.smartAutomorph(zMStar.genToPow(i, amt));
-  // ctxt = \rho_i^{amt}(originalCtxt)
+  Ctxt T(ZeroCtxtLike, ctxt);
+  if (hoisted) {
+    ctxt = hoisted->automorph1D(i, amt);
+    T = hoisted->automorph1D(i, amt - ord);
+  } else {
+    ctxt.smartAutomorph(zMStar.genToPow(i, amt));
+    // ctxt = \rho_i^{amt}(originalCtxt)
 
-  Ctxt T(ctxt);
-  T.smartAutomorph(zMStar.genToPow(i, -ord));
-  // T = \rho_i^{amt-ord}(originalCtxt).
-  // This strategy is geared toward the
-  // assumption that we have the key switch matrix
-  // for \rho_i^{-ord}
+    T = ctxt;
+    T.smartAutomorph(zMStar.genToPow(i, -ord));
+    // T = \rho_i^{amt-ord}(originalCtxt).
+    // This strategy is geared toward the
+    // assumption that we have the key switch matrix
+    // for \rho_i^{-ord}
+  }
 
   const RX& mask = maskTable[i][amt];
   zzX mask_poly = balanced_zzX(mask);
@@ -183,7 +211,14 @@ template <typename type>
 void EncryptedArrayDerived<type>::rotate(Ctxt& ctxt, long amt) const
 {
   HELIB_TIMER_START;
+  rotateFrom(ctxt, amt, nullptr);
+}
 
+template <typename type>
+void EncryptedArrayDerived<type>::rotateFrom(Ctxt& ctxt,
+                                             long amt,
+                                             const HoistedCtxt* hoisted) const
+{
   const PAlgebra& al = getPAlgebra();
   const std::vector<std::vector<RX>>& maskTable = tab.getMaskTable();
 
@@ -195,7 +230,7 @@ void EncryptedArrayDerived<type>::rotate(Ctxt& ctxt, long amt) const
 
   // Simple case: just one generator
   if (al.numOfGens() == 1) { // VJS: bug fix: <= must be ==
-    rotate1D(ctxt, 0, amt);
+    rotate1DFrom(ctxt, 0, amt, false, hoisted);
     return;
   }
 
@@ -221,20 +256,25 @@ void EncryptedArrayDerived<type>::rotate(Ctxt& ctxt, long amt) const
   // inside rotate1D as in the loop below.
 
   if (al.SameOrd(i) || v == 0)
-    rotate1D(ctxt, i, v); // no need to optimize
+    rotate1DFrom(ctxt, i, v, false, hoisted); // no need to optimize
   else {
 
     long ord = al.OrderOf(i);
 
-    ctxt.smartAutomorph(al.genToPow(i, v));
-    // ctxt = \rho_i^{v}(originalCtxt)
-
-    tmp = ctxt;
-    tmp.smartAutomorph(al.genToPow(i, -ord));
-    // tmp = \rho_i^{v-ord}(originalCtxt).
-    // This strategy assumes is geared toward the
-    // assumption that we have the key switch matrix
-    // for \rho_i^{-ord}
+    if (hoisted) {
+      ctxt = hoisted->automorph1D(i, v);
+      tmp = hoisted->automorph1D(i, v - ord);
+    } else {
+      ctxt.smartAutomorph(al.genToPow(i, v));
+      // ctxt = \rho_i^{v}(originalCtxt)
+
+      tmp = ctxt;
+      tmp.smartAutomorph(al.genToPow(i, -ord));
+      // tmp = \rho_i^{v-ord}(originalCtxt).
+      // This strategy assumes is geared toward the
+      // assumption that we have the key switch matrix
+      // for \rho_i^{-ord}
+    }
 
     zzX mask_poly = balanced_zzX(mask);
     double sz = embeddingLargestCoeff(mask_poly, al);
@@ -283,7 +323,32 @@ void EncryptedArrayDerived<type>::rotate(Ctxt& ctxt, long amt) const
              maskTable[i][v + 1]; // update the mask for next iteration
     }
   }
+}
+
+// Only the first stage of rotate (the automorphisms along the last
+// dimension) is applied to the original ciphertext, so only that stage can
+// reuse its digits. The later stages work on masked intermediate values.
+template <typename type>
+std::vector<Ctxt> EncryptedArrayDerived<type>::rotateMany(
+    const HoistedCtxt& hoisted,
+    const std::vector<long>& amounts) const
+{
+  HELIB_TIMER_START;
+  assertEq(&context, &hoisted.getCtxt().getContext(), "Context mismatch");
+
+  std::vector<Ctxt> result(amounts.size(), hoisted.getCtxt());
+  if (getPAlgebra().numOfGens() > 0)
+    hoisted.precompute1D(getPAlgebra().numOfGens() - 1);
+
+  NTL_EXEC_RANGE(lsize(amounts), first, last)
+  for (long j : range(first, last)) {
+    rotateFrom(result[j], amounts[j], &hoisted);
+    result[j].cleanUp();
+  }
+  NTL_EXEC_RANGE_END
+
   HELIB_TIMER_STOP;
+  return result;
 }
 
 template <typename type>
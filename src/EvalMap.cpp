@@ -16,6 +16,8 @@
 #include <NTL/lzz_pXFactoring.h>
 #include <NTL/GF2XFactoring.h>
 
+#include "binio.h"
+
 #ifndef BIGINT_P
 
 namespace helib {
@@ -169,6 +171,34 @@ void EvalMap::upgrade()
     matvec[i]->upgrade();
 }
 
+void EvalMap::writeTo(std::ostream& str) const
+{
+  write_raw_int(str, invert);
+  write_raw_int(str, nfactors);
+  mat1->writeTo(str);
+  write_raw_int(str, matvec.length());
+  for (long i = 0; i < matvec.length(); i++)
+    matvec[i]->writeTo(str);
+}
+
+EvalMap* EvalMap::readPtrFrom(std::istream& str, const EncryptedArray& ea)
+{
+  std::unique_ptr<EvalMap> map(new EvalMap(ea));
+  map->invert = read_raw_int(str);
+  map->nfactors = read_raw_int(str);
+  map->mat1 = std::make_unique<BlockMatMul1DExec>(
+      BlockMatMul1DExec::readFrom(str, ea));
+  long n = read_raw_int(str);
+  assertEq<IOError>(n,
+                    map->nfactors - 1,
+                    "EvalMap: wrong number of matrices");
+  map->matvec.SetLength(n);
+  for (long i = 0; i < n; i++)
+    map->matvec[i] =
+        std::make_unique<MatMul1DExec>(MatMul1DExec::readFrom(str, ea));
+  return map.release();
+}
+
 // Applying the evaluation (or its inverse) map to a ciphertext
 void EvalMap::apply(Ctxt& ctxt) const
 {
@@ -647,6 +677,38 @@ void ThinEvalMap::upgrade()
       matvec[i]->upgrade();
 }
 
+void ThinEvalMap::writeTo(std::ostream& str) const
+{
+  write_raw_int(str, invert);
+  write_raw_int(str, nfactors);
+  write_raw_int(str, matvec.length());
+  for (long i = 0; i < matvec.length(); i++) {
+    // All the matrices of a thin map are 1D, the last one may be missing
+    auto mat = dynamic_cast<const MatMul1DExec*>(matvec[i].get());
+    if (matvec[i] && !mat)
+      throw LogicError("ThinEvalMap: cannot serialize this matrix");
+    write_raw_int(str, mat != nullptr);
+    if (mat)
+      mat->writeTo(str);
+  }
+}
+
+ThinEvalMap* ThinEvalMap::readPtrFrom(std::istream& str,
+                                      const EncryptedArray& ea)
+{
+  std::unique_ptr<ThinEvalMap> map(new ThinEvalMap(ea));
+  map->invert = read_raw_int(str);
+  map->nfactors = read_raw_int(str);
+  long n = read_raw_int(str);
+  assertEq<IOError>(n, map->nfactors, "ThinEvalMap: wrong number of matrices");
+  map->matvec.SetLength(n);
+  for (long i = 0; i < n; i++)
+    if (read_raw_int(str))
+      map->matvec[i] =
+          std::make_unique<MatMul1DExec>(MatMul1DExec::readFrom(str, ea));
+  return map.release();
+}
+
 // Applying the evaluation (or its inverse) map to a ciphertext
 void ThinEvalMap::apply(Ctxt& ctxt) const
 {
@@ -1,11 +1,13 @@
+#include <algorithm>
+#include <NTL/BasicThreadPool.h>
 #include <helib/GaloisKey2k.h>
 
+#include "binio.h"
+
 namespace helib {
 
-size_t GaloisKey2k::get_elt_from_step(int32_t step) {
-  const size_t GENERATOR = 3;
-  size_t n = m >> 1;
-  size_t row_size = n >> 1;
+size_t GaloisKey2k::get_elt_from_step(int32_t step) const {
+  size_t row_size = step_elts.size();
   if (step == 0) {
      return m - 1; // rotate columns
   }
@@ -17,17 +19,64 @@ size_t GaloisKey2k::get_elt_from_step(int32_t step) {
   }
   size_t step_ = sign ? row_size - step_abs : step_abs;
 
-  size_t galois_elt = 1;
-  for (size_t i = 0; i < step_; i++) {
-    galois_elt = (galois_elt * GENERATOR) % m;
+  return step_elts[step_];
+}
+
+// The signed powers of two whose sum is value, no two of them adjacent
+static std::vector<int32_t> naf(int32_t value) {
+  std::vector<int32_t> res;
+  bool sign = value < 0;
+  int64_t v = sign ? -int64_t(value) : int64_t(value);
+  for (int32_t i = 0; v != 0; i++) {
+    int64_t zi = (v & 1) ? 2 - (v & 3) : 0;
+    v = (v - zi) >> 1;
+    if (zi != 0) {
+      res.push_back(int32_t((sign ? -zi : zi) * (int64_t(1) << i)));
+    }
+  }
+  return res;
+}
+
+std::vector<size_t> GaloisKey2k::get_elts_for_step(int32_t step) const {
+  size_t galois_elt = get_elt_from_step(step);
+  if (step == 0 || find_key(galois_elt) != nullptr) {
+    return {galois_elt};
+  }
+
+  std::vector<size_t> elts;
+  int64_t row_size = step_elts.size();
+  for (int32_t term : naf(step)) {
+    if (term == row_size || term == -row_size) {
+      continue; // 3^row_size = 1 (mod m), the identity
+    }
+    size_t elt = get_elt_from_step(term);
+    if (find_key(elt) == nullptr) {
+      throw RuntimeError("GaloisKey2k::rotate: No key for step " +
+                         std::to_string(step) + " nor for its NAF term " +
+                         std::to_string(term));
+    }
+    elts.push_back(elt);
   }
-  return galois_elt;
+  return elts;
 }
 
+const KeySwitch* GaloisKey2k::find_key(size_t galois_elt) const {
+  HELIB_SHARED_GUARD(keys_lock);
+  auto it = keys.find(galois_elt);
+  return (it == keys.end()) ? nullptr : &it->second;
+}
+
+const KeySwitch& GaloisKey2k::get_key(size_t galois_elt) const {
+  const KeySwitch* ksMatrix = find_key(galois_elt);
+  if (ksMatrix == nullptr) {
+    throw RuntimeError("GaloisKey2k::key_switch: Key-switching matrix not found");
+  }
+  return *ksMatrix;
+}
 
 void GaloisKey2k::generate_step(const SecKey& sKey, int32_t step) {
   size_t galois_elt = get_elt_from_step(step);
-  if (keys.find(galois_elt) != keys.end()) {
+  if (find_key(galois_elt) != nullptr) {
     return;
   }
 
@@ -36,59 +85,77 @@ void GaloisKey2k::generate_step(const SecKey& sKey, int32_t step) {
   if (m != this->m) {
     throw RuntimeError("GaloisKey2k::generate_step: Mismatched context");
   }
-  auto p = context.getP();
-
-  KeySwitch ksMatrix(1, galois_elt, 0, 0, p);
-  RandomBits(ksMatrix.prgSeed, 256); // a random 256-bit seed
+  NTL::ZZ p(context.getP());
 
-  long n = context.getDigits().size();
+  KeySwitch ksMatrix = sKey.buildKeySWmatrix(1, galois_elt, 0, 0, p);
 
-  // size-n vector
-  ksMatrix.b.resize(
-      n,
-      DoubleCRT(context, context.getCtxtPrimes() | context.getSpecialPrimes()));
+  // Push the new matrix onto our list, unless another thread was faster
+  HELIB_EXCLUSIVE_GUARD(keys_lock);
+  keys.emplace(galois_elt, std::move(ksMatrix));
+}
 
-  std::vector<DoubleCRT> a;
-  a.resize(
-      n,
-      DoubleCRT(context, context.getCtxtPrimes() | context.getSpecialPrimes()));
+void GaloisKey2k::generate_steps(const SecKey& sKey,
+                                 const std::vector<int32_t>& steps,
+                                 const NTL::ZZ& seed,
+                                 std::ostream* out) {
+  const Context& context = sKey.getContext();
+  if (size_t(context.getZMStar().getM()) != m) {
+    throw RuntimeError("GaloisKey2k::generate_steps: Mismatched context");
+  }
+  NTL::ZZ p(context.getP());
 
-  {
-    RandomState state;
-    SetSeed(ksMatrix.prgSeed);
-    for (long i = 0; i < n; i++)
-      a[i].randomize();
-  } // restore state upon destruction of state
+  NTL::ZZ batch_seed = seed;
+  if (NTL::IsZero(batch_seed)) {
+    RandomBits(batch_seed, 256);
+  }
 
-  DoubleCRT fromKey = sKey.sKeys.at(0);    // copy object, not a reference
-  fromKey.automorph(galois_elt);
-  const DoubleCRT& toKey = sKey.sKeys.at(0); // this can be a reference
+  // The galois_elts we have no key for yet, each one once
+  std::vector<long> elts;
+  for (int32_t step : steps) {
+    size_t galois_elt = get_elt_from_step(step);
+    if (find_key(galois_elt) == nullptr &&
+        std::find(elts.begin(), elts.end(), long(galois_elt)) == elts.end()) {
+      elts.push_back(galois_elt);
+    }
+  }
 
-  // generate the RLWE instances with pseudorandom ai's
-  for (long i = 0; i < n; i++) {
-    ksMatrix.noiseBound = RLWE1(ksMatrix.b[i], a[i], toKey, p);
+  // Same layout as writeTo, with only the new keys
+  if (out != nullptr) {
+    writeEyeCatcher(*out, EyeCatcher::GK_BEGIN);
+    write_raw_int(*out, m);
+    write_raw_int(*out, elts.size());
   }
-  // Add in the multiples of the fromKey secret key
-  fromKey *= context.productOfPrimes(context.getSpecialPrimes());
-  for (long i = 0; i < n; i++) {
-    ksMatrix.b[i] += fromKey;
-    fromKey *= context.productOfPrimes(context.getDigit(i));
+  auto done = [&](KeySwitch& ksMatrix) {
+    size_t galois_elt = ksMatrix.fromKey.getPowerOfX();
+    if (out != nullptr) {
+      write_raw_int(*out, galois_elt);
+      ksMatrix.writeTo(*out);
+    }
+    HELIB_EXCLUSIVE_GUARD(keys_lock);
+    keys.emplace(galois_elt, std::move(ksMatrix));
+  };
+  sKey.buildKeySWmatrices(1, elts, 0, 0, p, batch_seed, done);
+  if (out != nullptr) {
+    writeEyeCatcher(*out, EyeCatcher::GK_END);
   }
+}
 
-  // Push the new matrix onto our list
-  keys[galois_elt] = ksMatrix;
+void GaloisKey2k::generate_power_of_two_steps(const SecKey& sKey) {
+  int64_t row_size = step_elts.size();
+  std::vector<int32_t> steps;
+  for (int64_t step = 1; step < row_size; step <<= 1) {
+    steps.push_back(int32_t(step));
+    steps.push_back(-int32_t(step));
+  }
+  generate_steps(sKey, steps);
 }
 
-void GaloisKey2k::key_switch(Ctxt& ctxt, size_t galois_elt) {
+void GaloisKey2k::key_switch(Ctxt& ctxt, size_t galois_elt) const {
   if (ctxt.context.getZMStar().getM() != m) {
     throw RuntimeError("GaloisKey2k::key_switch: Mismatched context");
   }
 
-  auto it = keys.find(galois_elt);
-  if (it == keys.end()) {
-    throw RuntimeError("GaloisKey2k::key_switch: Key-switching matrix not found");
-  }
-  const KeySwitch& ksMatrix = it->second;
+  const KeySwitch& ksMatrix = get_key(galois_elt);
 
   ctxt.dropSmallAndSpecialPrimes();
 
@@ -110,7 +177,7 @@ void GaloisKey2k::key_switch(Ctxt& ctxt, size_t galois_elt) {
     // For a part relative to 1 or base,  only scale and add
     if (part.skHandle.isOne() || part.skHandle.isBase(0)) {
       part.addPrimesAndScale(ctxt.context.getSpecialPrimes());
-      tmp.addPart(part, /*matchPrimeSet=*/true);
+      tmp.addPart(std::move(part), /*matchPrimeSet=*/true);
       continue;
     }
 
@@ -122,15 +189,10 @@ void GaloisKey2k::key_switch(Ctxt& ctxt, size_t galois_elt) {
     }
     tmp.keySwitchPart(part, ksMatrix); // switch this part & update noiseBound
   }
-  ctxt = tmp;
+  ctxt = std::move(tmp);
 }
 
-void GaloisKey2k::rotate(Ctxt& ctxt, int32_t step) {
-  if (ctxt.context.getZMStar().getM() != m) {
-    throw RuntimeError("GaloisKey2k::key_switch: Mismatched context");
-  }
-
-  size_t galois_elt = get_elt_from_step(step);
+void GaloisKey2k::apply_galois(Ctxt& ctxt, size_t galois_elt) const {
   for (CtxtPart& part : ctxt.parts) {
     part.automorph(galois_elt);
     if (!part.skHandle.isOne()) {
@@ -141,4 +203,160 @@ void GaloisKey2k::rotate(Ctxt& ctxt, int32_t step) {
   key_switch(ctxt, galois_elt);
 }
 
+void GaloisKey2k::rotate(Ctxt& ctxt, int32_t step) const {
+  if (ctxt.context.getZMStar().getM() != m) {
+    throw RuntimeError("GaloisKey2k::key_switch: Mismatched context");
+  }
+
+  for (size_t galois_elt : get_elts_for_step(step)) {
+    apply_galois(ctxt, galois_elt);
+  }
+}
+
+Ctxt GaloisKey2k::hoisted_galois(const Ctxt& ctxt,
+                                 const std::vector<DoubleCRT>& digits,
+                                 NTL::xdouble added_noise,
+                                 size_t galois_elt) const {
+  const KeySwitch& ksMatrix = get_key(galois_elt);
+  const Context& context = ctxt.context;
+  double logProd = context.logOfProduct(context.getSpecialPrimes());
+
+  Ctxt result(ZeroCtxtLike, ctxt); // an empty ciphertext, same plaintext space
+  result.intFactor = ctxt.intFactor;
+  result.ptxtMag = ctxt.ptxtMag;
+  result.noiseBound = ctxt.noiseBound * NTL::xexp(logProd); // after mod-up
+  result.ratFactor = ctxt.ratFactor * NTL::xexp(logProd);
+  result.primeSet = ctxt.primeSet | context.getSpecialPrimes();
+
+  // The part relative to 1 only needs the automorphism and scaling
+  CtxtPart part = ctxt.parts[0];
+  part.automorph(galois_elt);
+  part.addPrimesAndScale(context.getSpecialPrimes());
+  result.addPart(std::move(part), /*matchPrimeSet=*/true);
+
+  if (digits.empty()) {
+    return result;
+  }
+
+  if (result.ptxtSpace > 1) { // g==1 for CKKS, g>1 for BGV
+    NTL::ZZ ptxt_space = ksMatrix.ptxtSpace;
+    result.reducePtxtSpace(ptxt_space);
+  }
+
+  // The digits of the automorphism are the automorphism of the digits
+  std::vector<DoubleCRT> rotated = digits;
+  for (DoubleCRT& digit : rotated) {
+    digit.automorph(galois_elt);
+  }
+  result.keySwitchDigits(ksMatrix, rotated);
+  result.noiseBound += added_noise * ksMatrix.noiseBound;
+  return result;
+}
+
+std::vector<Ctxt> GaloisKey2k::rotateMany(const Ctxt& ctxt,
+                                          const std::vector<int32_t>& steps) const {
+  if (ctxt.context.getZMStar().getM() != m) {
+    throw RuntimeError("GaloisKey2k::rotateMany: Mismatched context");
+  }
+
+  // Resolve all the steps first, so that a missing key throws here
+  std::vector<std::vector<size_t>> elts(steps.size());
+  for (size_t j = 0; j < steps.size(); j++) {
+    elts[j] = get_elts_for_step(steps[j]);
+  }
+
+  Ctxt base(ctxt);
+  base.dropSmallAndSpecialPrimes();
+  // hoisted_galois takes part 0 to be relative to 1, with no key switch
+  if (base.parts.size() >= 1)
+    assertTrue(base.parts[0].skHandle.isOne(),
+               "Invalid ciphertext (secret key handle for part 0 is not one)");
+  if (base.parts.size() > 2 ||
+      (base.parts.size() == 2 && !base.parts[1].skHandle.isBase(0))) {
+    throw RuntimeError("GaloisKey2k::rotateMany: Ciphertext must be linear in the secret key");
+  }
+
+  std::vector<DoubleCRT> digits;
+  NTL::xdouble added_noise(0.0);
+  if (base.parts.size() == 2) {
+    added_noise = base.parts[1].breakIntoDigits(digits);
+  }
+
+  if (base.isEmpty()) {
+    return std::vector<Ctxt>(steps.size(), base);
+  }
+
+  // Start from empty placeholders; only identity steps need a copy of base
+  std::vector<Ctxt> result;
+  result.reserve(steps.size());
+  for (size_t j = 0; j < steps.size(); j++) {
+    result.emplace_back(ZeroCtxtLike, base);
+  }
+
+  NTL_EXEC_RANGE(long(steps.size()), first, last)
+  for (long j = first; j < last; j++) {
+    if (elts[j].empty()) {
+      result[j] = base;
+      continue;
+    }
+    // Only the first key switch can use the digits of base
+    result[j] = hoisted_galois(base, digits, added_noise, elts[j][0]);
+    for (size_t k = 1; k < elts[j].size(); k++) {
+      apply_galois(result[j], elts[j][k]);
+    }
+  }
+  NTL_EXEC_RANGE_END
+
+  return result;
+}
+
+void GaloisKey2k::writeTo(std::ostream& str) const {
+  HELIB_SHARED_GUARD(keys_lock);
+
+  writeEyeCatcher(str, EyeCatcher::GK_BEGIN);
+  /*
+      Write out raw
+      1. size_t m;
+      2. the number of keys;
+      3. for every key, its galois_elt and its KeySwitch
+  */
+  write_raw_int(str, m);
+  write_raw_int(str, keys.size());
+  for (const auto& key : keys) {
+    write_raw_int(str, key.first);
+    key.second.writeTo(str);
+  }
+  writeEyeCatcher(str, EyeCatcher::GK_END);
+}
+
+void GaloisKey2k::read(std::istream& str, const Context& context) {
+  if (size_t(context.getZMStar().getM()) != m) {
+    throw RuntimeError("GaloisKey2k::read: Mismatched context");
+  }
+
+  bool eyeCatcherFound = readEyeCatcher(str, EyeCatcher::GK_BEGIN);
+  assertTrue<IOError>(eyeCatcherFound,
+                      "Could not find pre-Galois keys eyecatcher");
+
+  long stored_m = read_raw_int(str);
+  assertEq<IOError>(stored_m, long(m), "GaloisKey2k::read: Mismatched m");
+
+  long count = read_raw_int(str);
+  assertTrue<IOError>(count >= 0, "GaloisKey2k::read: Negative key count");
+  for (long i = 0; i < count; i++) {
+    size_t galois_elt = read_raw_int(str);
+    KeySwitch ksMatrix = KeySwitch::readFrom(str, context);
+    assertEq<IOError>(long(galois_elt),
+                      ksMatrix.fromKey.getPowerOfX(),
+                      "GaloisKey2k::read: Key does not match its galois_elt");
+
+    HELIB_EXCLUSIVE_GUARD(keys_lock);
+    keys.emplace(galois_elt, std::move(ksMatrix));
+  }
+
+  eyeCatcherFound = readEyeCatcher(str, EyeCatcher::GK_END);
+  assertTrue<IOError>(eyeCatcherFound,
+                      "Could not find post-Galois keys eyecatcher");
+}
+
 } // namespace helib
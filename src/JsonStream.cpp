@@ -0,0 +1,304 @@
+/* Copyright (C) 2020 IBM Corp.
+ * This program is Licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. See accompanying LICENSE file.
+ */
+#include <charconv>
+#include <climits>
+
+#include <helib/exceptions.h>
+
+#include "JsonStream.h"
+
+namespace helib {
+
+void JsonWriter::separate()
+{
+  if (afterKey) {
+    afterKey = false;
+  } else if (!first.empty()) {
+    if (!first.back())
+      str.put(',');
+    first.back() = false;
+  }
+}
+
+void JsonWriter::beginObject()
+{
+  separate();
+  str.put('{');
+  first.push_back(true);
+}
+
+void JsonWriter::endObject()
+{
+  str.put('}');
+  first.pop_back();
+}
+
+void JsonWriter::beginArray()
+{
+  separate();
+  str.put('[');
+  first.push_back(true);
+}
+
+void JsonWriter::endArray()
+{
+  str.put(']');
+  first.pop_back();
+}
+
+void JsonWriter::key(std::string_view name)
+{
+  if (!first.back())
+    str.put(',');
+  first.back() = false;
+  str.put('"');
+  str.write(name.data(), name.size());
+  str.write("\":", 2);
+  afterKey = true;
+}
+
+void JsonWriter::value(const json& j)
+{
+  separate();
+  str << j.dump();
+}
+
+void JsonWriter::row(const long* data, long n)
+{
+  separate();
+  // The integers are formatted into a block, written out whenever it is full
+  char block[4096];
+  char* const end = block + sizeof(block);
+  char* p = block;
+  *p++ = '[';
+  for (long i = 0; i < n; i++) {
+    // Room for a comma, any long and the closing bracket
+    if (end - p < 24) {
+      str.write(block, p - block);
+      p = block;
+    }
+    if (i > 0)
+      *p++ = ',';
+    p = std::to_chars(p, end, data[i]).ptr;
+  }
+  *p++ = ']';
+  str.write(block, p - block);
+}
+
+JsonReader::JsonReader(std::istream& str) : buf(str.rdbuf())
+{
+  if (buf == nullptr)
+    fail("No stream buffer to read from");
+}
+
+void JsonReader::fail(const std::string& what)
+{
+  throw IOError("Error with JSON IO. " + what);
+}
+
+void JsonReader::skipSpace()
+{
+  for (int c = next(); c == ' ' || c == '\t' || c == '\n' || c == '\r';
+       c = next())
+    buf->sbumpc();
+}
+
+void JsonReader::expect(char c)
+{
+  skipSpace();
+  if (next() == std::char_traits<char>::eof())
+    fail("Unexpected end of input");
+  if (next() != c)
+    fail(std::string("Expected '") + c + "'");
+  buf->sbumpc();
+}
+
+int JsonReader::peek()
+{
+  skipSpace();
+  return next();
+}
+
+void JsonReader::readObject(std::initializer_list<Field> fields)
+{
+  std::vector<bool> found(fields.size(), false);
+  std::string key;
+  beginObject();
+  while (nextKey(key)) {
+    std::size_t i = 0;
+    while (i < fields.size() && fields.begin()[i].key != key)
+      i++;
+    if (i == fields.size()) {
+      skipValue();
+    } else {
+      found[i] = true;
+      fields.begin()[i].read();
+    }
+  }
+
+  for (std::size_t i = 0; i < fields.size(); i++)
+    if (fields.begin()[i].required && !found[i])
+      fail("Missing key '" + std::string(fields.begin()[i].key) + "'");
+}
+
+void JsonReader::beginObject()
+{
+  expect('{');
+  first.push_back(true);
+}
+
+bool JsonReader::nextKey(std::string& key)
+{
+  if (peek() == '}') {
+    buf->sbumpc();
+    first.pop_back();
+    return false;
+  }
+  if (!first.back())
+    expect(',');
+  first.back() = false;
+  key = readString();
+  expect(':');
+  return true;
+}
+
+void JsonReader::beginArray()
+{
+  expect('[');
+  first.push_back(true);
+}
+
+bool JsonReader::nextElement()
+{
+  if (peek() == ']') {
+    buf->sbumpc();
+    first.pop_back();
+    return false;
+  }
+  if (!first.back())
+    expect(',');
+  first.back() = false;
+  return true;
+}
+
+long JsonReader::readLong()
+{
+  bool negative = peek() == '-';
+  if (negative)
+    buf->sbumpc();
+  int c = next();
+  if (c < '0' || c > '9')
+    fail("Expected an integer");
+
+  const unsigned long max =
+      negative ? static_cast<unsigned long>(LONG_MAX) + 1 : LONG_MAX;
+  unsigned long value = 0;
+  do {
+    unsigned long digit = c - '0';
+    if (value > (max - digit) / 10)
+      fail("Integer out of range");
+    value = 10 * value + digit;
+    buf->sbumpc();
+    c = next();
+  } while (c >= '0' && c <= '9');
+  if (c == '.' || c == 'e' || c == 'E')
+    fail("Expected an integer, got a floating-point number");
+
+  if (!negative)
+    return static_cast<long>(value);
+  // -value, without overflowing on LONG_MIN
+  return value == 0 ? 0 : -static_cast<long>(value - 1) - 1;
+}
+
+long JsonReader::readRow(long* data, long n)
+{
+  long count = 0;
+  beginArray();
+  while (nextElement()) {
+    if (count == n)
+      fail("More than " + std::to_string(n) + " integers in an array");
+    data[count++] = readLong();
+  }
+  return count;
+}
+
+std::string JsonReader::readString()
+{
+  if (peek() != '"')
+    fail("Expected a string");
+  std::string text;
+  scanValue(&text);
+  // Only strings with escape sequences need to be decoded
+  if (text.find('\\') == std::string::npos)
+    return text.substr(1, text.size() - 2);
+  return json::parse(text).get<std::string>();
+}
+
+json JsonReader::readValue()
+{
+  std::string text;
+  scanValue(&text);
+  return json::parse(text);
+}
+
+void JsonReader::skipValue() { scanValue(nullptr); }
+
+void JsonReader::scanValue(std::string* text)
+{
+  // Moves the next character to text
+  auto take = [this, text]() {
+    int c = buf->sbumpc();
+    if (c == std::char_traits<char>::eof())
+      fail("Unexpected end of input");
+    if (text != nullptr)
+      text->push_back(c);
+    return c;
+  };
+  auto scanString = [&take]() {
+    take(); // the opening quote
+    for (int c = take(); c != '"'; c = take())
+      if (c == '\\')
+        take();
+  };
+
+  int c = peek();
+  if (c == '"') {
+    scanString();
+  } else if (c == '{' || c == '[') {
+    // Containers are delimited by their brackets, and are checked by
+    // json::parse when they are read
+    long depth = 0;
+    do {
+      c = next();
+      if (c == '"') {
+        scanString();
+        continue;
+      }
+      if (c == '{' || c == '[')
+        depth++;
+      else if (c == '}' || c == ']')
+        depth--;
+      take();
+    } while (depth > 0);
+  } else {
+    // A number, true, false or null
+    std::size_t count = 0;
+    for (; (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || c == '-' ||
+           c == '+' || c == '.' || c == 'E';
+         c = next(), count++)
+      take();
+    if (count == 0)
+      fail("Expected a value");
+  }
+}
+
+} // namespace helib
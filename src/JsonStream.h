@@ -0,0 +1,181 @@
+/* Copyright (C) 2020 IBM Corp.
+ * This program is Licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. See accompanying LICENSE file.
+ */
+#ifndef HELIB_JSONSTREAM_H
+#define HELIB_JSONSTREAM_H
+/**
+ * @file JsonStream.h
+ * @brief - Internal header (not installed) for the streaming JSON
+ * serialization of keys and ciphertexts.
+ *
+ * The writeToJSON(JsonWriter&) and readJSON(JsonReader&) methods produce and
+ * consume the same documents as the ones going through a JsonWrapper, but
+ * without building them in memory: the DoubleCRT rows are written from, and
+ * read into, the residues themselves, and only the small leaves of the
+ * documents (numbers with metadata, index sets, contexts, ...) go through a
+ * json object.
+ */
+
+#include <functional>
+#include <initializer_list>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "io.h"
+
+namespace helib {
+
+/**
+ * @class JsonWriter
+ * @brief Writes a JSON document to a stream as its parts are given.
+ *
+ * The output is byte for byte that of `json::dump()` on the same document,
+ * provided the keys of every object are given in sorted order, as they are
+ * kept by `json`.
+ **/
+class JsonWriter
+{
+public:
+  explicit JsonWriter(std::ostream& str) : str(str) {}
+
+  void beginObject();
+  void endObject();
+  void beginArray();
+  void endArray();
+
+  //! @brief The key of the next value in the current object. It is written
+  //! as is, so it should not need escaping
+  void key(std::string_view name);
+
+  //! @brief A whole value, e.g. a leaf of the document
+  void value(const json& j);
+
+  //! @brief An array of the n integers at data
+  void row(const long* data, long n);
+
+private:
+  // Writes the comma before a value, if it is not the first of its array
+  void separate();
+
+  std::ostream& str;
+  // Whether nothing was written yet in each of the enclosing containers
+  std::vector<bool> first;
+  bool afterKey = false;
+};
+
+/**
+ * @class JsonReader
+ * @brief Reads a JSON document from a stream as its parts are asked for.
+ *
+ * Nothing is read past the end of the document. Malformed input raises an
+ * IOError.
+ **/
+class JsonReader
+{
+public:
+  explicit JsonReader(std::istream& str);
+
+  //! @brief A key of an object and the function reading its value
+  struct Field
+  {
+    std::string_view key;
+    std::function<void()> read;
+    bool required = true;
+  };
+
+  /**
+   * @brief Read an object, in any order of its keys: the value of a key in
+   * fields is read by its function, any other value is skipped. Raises an
+   * IOError if a required key is missing.
+   **/
+  void readObject(std::initializer_list<Field> fields);
+
+  void beginObject();
+  //! @brief Read the next key of the current object, or its end
+  //! @return false at the end of the object
+  bool nextKey(std::string& key);
+
+  void beginArray();
+  //! @brief Move to the next element of the current array, or past its end
+  //! @return false at the end of the array
+  bool nextElement();
+
+  //! @brief The first character of the next value
+  int peek();
+
+  long readLong();
+  std::string readString();
+
+  /**
+   * @brief Read an array of integers into data
+   * @param data Where to write the integers.
+   * @param n The size of data, an IOError is raised if there are more.
+   * @return The number of integers read.
+   **/
+  long readRow(long* data, long n);
+
+  //! @brief Read a whole value, e.g. a leaf of the document
+  json readValue();
+  void skipValue();
+
+private:
+  // The next character, that is not consumed (EOF at the end of the stream)
+  int next() { return buf->sgetc(); }
+  // Consume the next character, which must be c
+  void expect(char c);
+  void skipSpace();
+  // Consume a value, appending it to text unless it is null
+  void scanValue(std::string* text);
+  [[noreturn]] void fail(const std::string& what);
+
+  std::streambuf* buf;
+  // Whether nothing was read yet in each of the enclosing containers
+  std::vector<bool> first;
+};
+
+//! @brief Write a typed JSON object (see toTypedJson) whose content is
+//! written by writeContent
+template <typename T, typename F>
+inline void writeTypedJson(JsonWriter& writer, const F& writeContent)
+{
+  writer.beginObject();
+  writer.key("HElibVersion");
+  writer.value(version::asString);
+  writer.key("content");
+  writeContent();
+  writer.key("serializationVersion");
+  writer.value(jsonSerializationVersion);
+  writer.key("type");
+  writer.value(T::typeName);
+  writer.endObject();
+}
+
+//! @brief Read a typed JSON object (see fromTypedJson) whose content is read
+//! by readContent. The metadata is checked once the object is read, as it
+//! comes after the content when the keys are sorted
+template <typename T, typename F>
+inline void readTypedJson(JsonReader& reader, const F& readContent)
+{
+  std::string obj_ser_ver, obj_helib_ver, obj_ty;
+  reader.readObject(
+      {{"HElibVersion", [&]() { obj_helib_ver = reader.readString(); }},
+       {"content", readContent},
+       {"serializationVersion", [&]() { obj_ser_ver = reader.readString(); }},
+       {"type", [&]() { obj_ty = reader.readString(); }}});
+  checkTypedJsonMetadata<T>(obj_ser_ver, obj_helib_ver, obj_ty);
+}
+
+} // namespace helib
+
+#endif // HELIB_JSONSTREAM_H
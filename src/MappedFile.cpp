@@ -0,0 +1,127 @@
+/* Copyright (C) 2012-2020 IBM Corp.
+ * This program is Licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. See accompanying LICENSE file.
+ */
+/* MappedFile.cpp - Reading keys and ciphertexts from memory-mapped files
+ */
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <helib/MappedFile.h>
+#include <helib/exceptions.h>
+
+namespace helib {
+
+MappedFile::MappedFile(const std::string& path) : path(path)
+{
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw IOError("Could not open " + path + ": " + std::strerror(errno));
+
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    int err = errno;
+    ::close(fd);
+    throw IOError("Could not stat " + path + ": " + std::strerror(err));
+  }
+  if (!S_ISREG(st.st_mode)) {
+    ::close(fd);
+    throw IOError("Could not map " + path + ": not a regular file");
+  }
+  length = st.st_size;
+
+  // mmap does not take empty mappings
+  if (length > 0) {
+    void* p = ::mmap(nullptr,
+                     length,
+                     PROT_READ,
+                     MAP_PRIVATE,
+                     fd,
+                     0);
+    if (p == MAP_FAILED) {
+      int err = errno;
+      ::close(fd);
+      throw IOError("Could not map " + path + ": " + std::strerror(err));
+    }
+    base = static_cast<char*>(p);
+  }
+  // The mapping stays valid once the file is closed
+  ::close(fd);
+}
+
+std::shared_ptr<MappedFile> MappedFile::mapIfRegular(const std::string& path)
+{
+  // Checked before opening the file: opening a pipe may block, or take it
+  // from its writer
+  struct stat st;
+  if (::stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+    return nullptr;
+  try {
+    return std::make_shared<MappedFile>(path);
+  } catch (const IOError&) {
+    return nullptr;
+  }
+}
+
+MappedFile::~MappedFile()
+{
+  if (base != nullptr)
+    ::munmap(base, length);
+}
+
+MappedStreamBuf::MappedStreamBuf(std::shared_ptr<MappedFile> file) :
+    file(std::move(file))
+{
+  char* begin = this->file->data();
+  setg(begin, begin, begin + this->file->size());
+}
+
+MappedStreamBuf::pos_type MappedStreamBuf::seekoff(
+    off_type off,
+    std::ios_base::seekdir dir,
+    std::ios_base::openmode which)
+{
+  if (!(which & std::ios_base::in))
+    return pos_type(off_type(-1));
+
+  off_type pos;
+  if (dir == std::ios_base::beg)
+    pos = off;
+  else if (dir == std::ios_base::cur)
+    pos = (gptr() - eback()) + off;
+  else
+    pos = (egptr() - eback()) + off;
+
+  if (pos < 0 || pos > egptr() - eback())
+    return pos_type(off_type(-1));
+  setg(eback(), eback() + pos, egptr());
+  return pos_type(pos);
+}
+
+MappedStreamBuf::pos_type MappedStreamBuf::seekpos(
+    pos_type pos,
+    std::ios_base::openmode which)
+{
+  return seekoff(off_type(pos), std::ios_base::beg, which);
+}
+
+MappedStream::MappedStream(std::shared_ptr<MappedFile> file) :
+    std::istream(nullptr), buf(std::move(file))
+{
+  // buf is only constructed after the base class
+  rdbuf(&buf);
+}
+
+} // namespace helib
@@ -0,0 +1,1020 @@
+/* Copyright (C) 2012-2020 IBM Corp.
+ * This program is Licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. See accompanying LICENSE file.
+ */
+
+/* NativeNTT.cpp - negacyclic NTT and element-wise modular arithmetic, with
+ * scalar, AVX2 and AVX-512 versions that are selected at runtime.
+ *
+ * The vector versions are compiled with function-level target attributes,
+ * so the library itself does not need to be built with -mavx2 and runs on
+ * any x86-64 CPU.
+ */
+#include <atomic>
+
+#include <helib/NativeNTT.h>
+#include <helib/assertions.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define HELIB_NATIVE_X86
+// gcc 12 reports bogus -Wmaybe-uninitialized warnings inside the AVX-512
+// intrinsics (from their use of _mm512_undefined_epi32)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#include <immintrin.h>
+#pragma GCC diagnostic pop
+#define HELIB_TARGET_AVX2 __attribute__((target("avx2")))
+#define HELIB_TARGET_AVX512 __attribute__((target("avx512f,avx512dq")))
+#define HELIB_TARGET_IFMA                                                      \
+  __attribute__((target("avx512f,avx512dq,avx512ifma")))
+#endif
+
+namespace helib {
+
+using u64 = std::uint64_t;
+__extension__ typedef unsigned __int128 u128;
+
+//=============== Runtime selection ===============
+
+static SimdLevel computeSimdLevel()
+{
+#ifdef HELIB_NATIVE_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq")) {
+    if (__builtin_cpu_supports("avx512ifma"))
+      return SimdLevel::AVX512_IFMA;
+    return SimdLevel::AVX512;
+  }
+  if (__builtin_cpu_supports("avx2"))
+    return SimdLevel::AVX2;
+#endif
+  return SimdLevel::SCALAR;
+}
+
+SimdLevel detectSimdLevel()
+{
+  static const SimdLevel level = computeSimdLevel();
+  return level;
+}
+
+static std::atomic<int>& currentSimdLevel()
+{
+  static std::atomic<int> level(static_cast<int>(detectSimdLevel()));
+  return level;
+}
+
+SimdLevel getSimdLevel()
+{
+  return static_cast<SimdLevel>(
+      currentSimdLevel().load(std::memory_order_relaxed));
+}
+
+void setSimdLevel(SimdLevel level)
+{
+  if (level > detectSimdLevel())
+    level = detectSimdLevel();
+  currentSimdLevel().store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+static std::atomic<bool> nativeNTTFlag(true);
+
+bool nativeNTTEnabled() { return nativeNTTFlag.load(std::memory_order_relaxed); }
+
+void setNativeNTTEnabled(bool enabled)
+{
+  nativeNTTFlag.store(enabled, std::memory_order_relaxed);
+}
+
+//=============== Scalar kernels ===============
+
+// Shoup's precomputed quotient floor(w * 2^64 / q), for w < q
+static inline u64 shoupPrecon(u64 w, u64 q)
+{
+  return static_cast<u64>((static_cast<u128>(w) << 64) / q);
+}
+
+// w * x mod q, in [0, 2q), for any 64-bit x
+static inline u64 mulShoupLazy(u64 x, u64 w, u64 wp, u64 q)
+{
+  u64 quot = static_cast<u64>((static_cast<u128>(wp) * x) >> 64);
+  return w * x - quot * q;
+}
+
+// x >= b ? x - b : x
+static inline u64 condSub(u64 x, u64 b) { return x >= b ? x - b : x; }
+
+static inline u64 mulModSlow(u64 a, u64 b, u64 q)
+{
+  return static_cast<u64>(static_cast<u128>(a) * b % q);
+}
+
+static u64 powModSlow(u64 a, u64 e, u64 q)
+{
+  u64 res = 1;
+  for (; e; e >>= 1) {
+    if (e & 1)
+      res = mulModSlow(res, a, q);
+    a = mulModSlow(a, a, q);
+  }
+  return res;
+}
+
+// One stage of the forward transform: m blocks, each with t butterflies
+// between its two halves. Values are kept in [0, 4q).
+static inline void forwardStage(u64* a,
+                                long m,
+                                long t,
+                                const u64* W,
+                                const u64* Wp,
+                                u64 q)
+{
+  const u64 q2 = 2 * q;
+  for (long i = 0; i < m; i++) {
+    u64 w = W[m + i];
+    u64 wp = Wp[m + i];
+    u64* X = a + 2 * i * t;
+    u64* Y = X + t;
+    for (long j = 0; j < t; j++) {
+      u64 x = condSub(X[j], q2);
+      u64 y = mulShoupLazy(Y[j], w, wp, q);
+      X[j] = x + y;
+      Y[j] = x - y + q2;
+    }
+  }
+}
+
+// One stage of the inverse transform, the mirror image of forwardStage.
+// Values are kept in [0, 2q).
+static inline void inverseStage(u64* a,
+                                long h,
+                                long t,
+                                const u64* W,
+                                const u64* Wp,
+                                u64 q)
+{
+  const u64 q2 = 2 * q;
+  for (long i = 0; i < h; i++) {
+    u64 w = W[h + i];
+    u64 wp = Wp[h + i];
+    u64* X = a + 2 * i * t;
+    u64* Y = X + t;
+    for (long j = 0; j < t; j++) {
+      u64 x = X[j];
+      u64 y = Y[j];
+      X[j] = condSub(x + y, q2);
+      Y[j] = mulShoupLazy(x - y + q2, w, wp, q);
+    }
+  }
+}
+
+static void forwardScalar(u64* a,
+                          long n,
+                          u64 q,
+                          const u64* W,
+                          const u64* Wp)
+{
+  for (long m = 1, t = n / 2; m < n; m <<= 1, t >>= 1)
+    forwardStage(a, m, t, W, Wp, q);
+  for (long j = 0; j < n; j++)
+    a[j] = condSub(condSub(a[j], 2 * q), q);
+}
+
+static void inverseScalar(u64* a,
+                          long n,
+                          u64 q,
+                          const u64* W,
+                          const u64* Wp,
+                          u64 nInv,
+                          u64 nInvp)
+{
+  for (long h = n / 2, t = 1; h >= 1; h >>= 1, t <<= 1)
+    inverseStage(a, h, t, W, Wp, q);
+  for (long j = 0; j < n; j++)
+    a[j] = condSub(mulShoupLazy(a[j], nInv, nInvp, q), q);
+}
+
+#ifdef HELIB_NATIVE_X86
+
+//=============== AVX2 kernels ===============
+// AVX2 has no unsigned 64-bit compares, so these use signed compares and
+// need all the values to be below 2^63, i.e., q < 2^61.
+
+// The high 64 bits of the 128-bit products
+HELIB_TARGET_AVX2 static inline __m256i mulhiAVX2(__m256i a, __m256i b)
+{
+  const __m256i lo32 = _mm256_set1_epi64x(0xffffffffL);
+  __m256i ah = _mm256_srli_epi64(a, 32);
+  __m256i bh = _mm256_srli_epi64(b, 32);
+  __m256i ll = _mm256_mul_epu32(a, b);
+  __m256i lh = _mm256_mul_epu32(a, bh);
+  __m256i hl = _mm256_mul_epu32(ah, b);
+  __m256i hh = _mm256_mul_epu32(ah, bh);
+  __m256i mid = _mm256_add_epi64(_mm256_srli_epi64(ll, 32),
+                                 _mm256_and_si256(lh, lo32));
+  mid = _mm256_add_epi64(mid, _mm256_and_si256(hl, lo32));
+  __m256i hi = _mm256_add_epi64(hh, _mm256_srli_epi64(lh, 32));
+  hi = _mm256_add_epi64(hi, _mm256_srli_epi64(hl, 32));
+  return _mm256_add_epi64(hi, _mm256_srli_epi64(mid, 32));
+}
+
+// The low 64 bits of the products
+HELIB_TARGET_AVX2 static inline __m256i mulloAVX2(__m256i a, __m256i b)
+{
+  __m256i ll = _mm256_mul_epu32(a, b);
+  __m256i lh = _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32));
+  __m256i hl = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), b);
+  return _mm256_add_epi64(ll,
+                          _mm256_slli_epi64(_mm256_add_epi64(lh, hl), 32));
+}
+
+HELIB_TARGET_AVX2 static inline __m256i mulShoupAVX2(__m256i x,
+                                                     __m256i w,
+                                                     __m256i wp,
+                                                     __m256i q)
+{
+  __m256i quot = mulhiAVX2(wp, x);
+  return _mm256_sub_epi64(mulloAVX2(w, x), mulloAVX2(quot, q));
+}
+
+HELIB_TARGET_AVX2 static inline __m256i condSubAVX2(__m256i x, __m256i b)
+{
+  __m256i r = _mm256_sub_epi64(x, b);
+  __m256i neg = _mm256_cmpgt_epi64(_mm256_setzero_si256(), r);
+  return _mm256_add_epi64(r, _mm256_and_si256(neg, b));
+}
+
+HELIB_TARGET_AVX2 static void forwardAVX2(u64* a,
+                                          long n,
+                                          u64 q,
+                                          const u64* W,
+                                          const u64* Wp)
+{
+  const __m256i vq = _mm256_set1_epi64x(q);
+  const __m256i vq2 = _mm256_set1_epi64x(2 * q);
+
+  long m = 1, t = n / 2;
+  for (; t >= 4; m <<= 1, t >>= 1) {
+    for (long i = 0; i < m; i++) {
+      __m256i w = _mm256_set1_epi64x(W[m + i]);
+      __m256i wp = _mm256_set1_epi64x(Wp[m + i]);
+      u64* X = a + 2 * i * t;
+      u64* Y = X + t;
+      for (long j = 0; j < t; j += 4) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(X + j));
+        __m256i y = _mm256_loadu_si256((const __m256i*)(Y + j));
+        x = condSubAVX2(x, vq2);
+        y = mulShoupAVX2(y, w, wp, vq);
+        _mm256_storeu_si256((__m256i*)(X + j), _mm256_add_epi64(x, y));
+        _mm256_storeu_si256((__m256i*)(Y + j),
+                            _mm256_add_epi64(_mm256_sub_epi64(x, y), vq2));
+      }
+    }
+  }
+  for (; m < n; m <<= 1, t >>= 1)
+    forwardStage(a, m, t, W, Wp, q);
+
+  long j = 0;
+  for (; j + 4 <= n; j += 4) {
+    __m256i x = _mm256_loadu_si256((const __m256i*)(a + j));
+    x = condSubAVX2(condSubAVX2(x, vq2), vq);
+    _mm256_storeu_si256((__m256i*)(a + j), x);
+  }
+  for (; j < n; j++)
+    a[j] = condSub(condSub(a[j], 2 * q), q);
+}
+
+HELIB_TARGET_AVX2 static void inverseAVX2(u64* a,
+                                          long n,
+                                          u64 q,
+                                          const u64* W,
+                                          const u64* Wp,
+                                          u64 nInv,
+                                          u64 nInvp)
+{
+  const __m256i vq = _mm256_set1_epi64x(q);
+  const __m256i vq2 = _mm256_set1_epi64x(2 * q);
+
+  long h = n / 2, t = 1;
+  for (; h >= 1 && t < 4; h >>= 1, t <<= 1)
+    inverseStage(a, h, t, W, Wp, q);
+  for (; h >= 1; h >>= 1, t <<= 1) {
+    for (long i = 0; i < h; i++) {
+      __m256i w = _mm256_set1_epi64x(W[h + i]);
+      __m256i wp = _mm256_set1_epi64x(Wp[h + i]);
+      u64* X = a + 2 * i * t;
+      u64* Y = X + t;
+      for (long j = 0; j < t; j += 4) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(X + j));
+        __m256i y = _mm256_loadu_si256((const __m256i*)(Y + j));
+        __m256i s = condSubAVX2(_mm256_add_epi64(x, y), vq2);
+        __m256i d = _mm256_add_epi64(_mm256_sub_epi64(x, y), vq2);
+        _mm256_storeu_si256((__m256i*)(X + j), s);
+        _mm256_storeu_si256((__m256i*)(Y + j), mulShoupAVX2(d, w, wp, vq));
+      }
+    }
+  }
+
+  const __m256i vn = _mm256_set1_epi64x(nInv);
+  const __m256i vnp = _mm256_set1_epi64x(nInvp);
+  long j = 0;
+  for (; j + 4 <= n; j += 4) {
+    __m256i x = _mm256_loadu_si256((const __m256i*)(a + j));
+    x = condSubAVX2(mulShoupAVX2(x, vn, vnp, vq), vq);
+    _mm256_storeu_si256((__m256i*)(a + j), x);
+  }
+  for (; j < n; j++)
+    a[j] = condSub(mulShoupLazy(a[j], nInv, nInvp, q), q);
+}
+
+HELIB_TARGET_AVX2 static void addModAVX2(u64* r,
+                                         const u64* a,
+                                         const u64* b,
+                                         long n,
+                                         u64 q)
+{
+  const __m256i vq = _mm256_set1_epi64x(q);
+  long j = 0;
+  for (; j + 4 <= n; j += 4) {
+    __m256i x = _mm256_loadu_si256((const __m256i*)(a + j));
+    __m256i y = _mm256_loadu_si256((const __m256i*)(b + j));
+    _mm256_storeu_si256((__m256i*)(r + j),
+                        condSubAVX2(_mm256_add_epi64(x, y), vq));
+  }
+  for (; j < n; j++)
+    r[j] = condSub(a[j] + b[j], q);
+}
+
+HELIB_TARGET_AVX2 static void subModAVX2(u64* r,
+                                         const u64* a,
+                                         const u64* b,
+                                         long n,
+                                         u64 q)
+{
+  const __m256i vq = _mm256_set1_epi64x(q);
+  long j = 0;
+  for (; j + 4 <= n; j += 4) {
+    __m256i x = _mm256_loadu_si256((const __m256i*)(a + j));
+    __m256i y = _mm256_loadu_si256((const __m256i*)(b + j));
+    __m256i d = _mm256_add_epi64(x, _mm256_sub_epi64(vq, y));
+    _mm256_storeu_si256((__m256i*)(r + j), condSubAVX2(d, vq));
+  }
+  for (; j < n; j++)
+    r[j] = condSub(a[j] + (q - b[j]), q);
+}
+
+HELIB_TARGET_AVX2 static void addScalarAVX2(u64* r,
+                                            const u64* a,
+                                            u64 s,
+                                            long n,
+                                            u64 q)
+{
+  const __m256i vq = _mm256_set1_epi64x(q);
+  const __m256i vs = _mm256_set1_epi64x(s);
+  long j = 0;
+  for (; j + 4 <= n; j += 4) {
+    __m256i x = _mm256_loadu_si256((const __m256i*)(a + j));
+    _mm256_storeu_si256((__m256i*)(r + j),
+                        condSubAVX2(_mm256_add_epi64(x, vs), vq));
+  }
+  for (; j < n; j++)
+    r[j] = condSub(a[j] + s, q);
+}
+
+HELIB_TARGET_AVX2 static void mulScalarAVX2(u64* r,
+                                            const u64* a,
+                                            u64 s,
+                                            long n,
+                                            u64 q)
+{
+  u64 sp = shoupPrecon(s, q);
+  const __m256i vq = _mm256_set1_epi64x(q);
+  const __m256i vs = _mm256_set1_epi64x(s);
+  const __m256i vsp = _mm256_set1_epi64x(sp);
+  long j = 0;
+  for (; j + 4 <= n; j += 4) {
+    __m256i x = _mm256_loadu_si256((const __m256i*)(a + j));
+    _mm256_storeu_si256((__m256i*)(r + j),
+                        condSubAVX2(mulShoupAVX2(x, vs, vsp, vq), vq));
+  }
+  for (; j < n; j++)
+    r[j] = condSub(mulShoupLazy(a[j], s, sp, q), q);
+}
+
+//=============== AVX-512 kernels ===============
+// With unsigned compares (via min) these work for all q < 2^62.
+
+HELIB_TARGET_AVX512 static inline __m512i mulhiAVX512(__m512i a, __m512i b)
+{
+  const __m512i lo32 = _mm512_set1_epi64(0xffffffffL);
+  __m512i ah = _mm512_srli_epi64(a, 32);
+  __m512i bh = _mm512_srli_epi64(b, 32);
+  __m512i ll = _mm512_mul_epu32(a, b);
+  __m512i lh = _mm512_mul_epu32(a, bh);
+  __m512i hl = _mm512_mul_epu32(ah, b);
+  __m512i hh = _mm512_mul_epu32(ah, bh);
+  __m512i mid = _mm512_add_epi64(_mm512_srli_epi64(ll, 32),
+                                 _mm512_and_si512(lh, lo32));
+  mid = _mm512_add_epi64(mid, _mm512_and_si512(hl, lo32));
+  __m512i hi = _mm512_add_epi64(hh, _mm512_srli_epi64(lh, 32));
+  hi = _mm512_add_epi64(hi, _mm512_srli_epi64(hl, 32));
+  return _mm512_add_epi64(hi, _mm512_srli_epi64(mid, 32));
+}
+
+HELIB_TARGET_AVX512 static inline __m512i mulShoupAVX512(__m512i x,
+                                                         __m512i w,
+                                                         __m512i wp,
+                                                         __m512i q)
+{
+  __m512i quot = mulhiAVX512(wp, x);
+  return _mm512_sub_epi64(_mm512_mullo_epi64(w, x),
+                          _mm512_mullo_epi64(quot, q));
+}
+
+HELIB_TARGET_AVX512 static inline __m512i condSubAVX512(__m512i x, __m512i b)
+{
+  return _mm512_min_epu64(x, _mm512_sub_epi64(x, b));
+}
+
+HELIB_TARGET_AVX512 static void forwardAVX512(u64* a,
+                                              long n,
+                                              u64 q,
+                                              const u64* W,
+                                              const u64* Wp)
+{
+  const __m512i vq = _mm512_set1_epi64(q);
+  const __m512i vq2 = _mm512_set1_epi64(2 * q);
+
+  long m = 1, t = n / 2;
+  for (; t >= 8; m <<= 1, t >>= 1) {
+    for (long i = 0; i < m; i++) {
+      __m512i w = _mm512_set1_epi64(W[m + i]);
+      __m512i wp = _mm512_set1_epi64(Wp[m + i]);
+      u64* X = a + 2 * i * t;
+      u64* Y = X + t;
+      for (long j = 0; j < t; j += 8) {
+        __m512i x = _mm512_loadu_si512(X + j);
+        __m512i y = _mm512_loadu_si512(Y + j);
+        x = condSubAVX512(x, vq2);
+        y = mulShoupAVX512(y, w, wp, vq);
+        _mm512_storeu_si512(X + j, _mm512_add_epi64(x, y));
+        _mm512_storeu_si512(Y + j,
+                            _mm512_add_epi64(_mm512_sub_epi64(x, y), vq2));
+      }
+    }
+  }
+  for (; m < n; m <<= 1, t >>= 1)
+    forwardStage(a, m, t, W, Wp, q);
+
+  long j = 0;
+  for (; j + 8 <= n; j += 8) {
+    __m512i x = _mm512_loadu_si512(a + j);
+    _mm512_storeu_si512(a + j, condSubAVX512(condSubAVX512(x, vq2), vq));
+  }
+  for (; j < n; j++)
+    a[j] = condSub(condSub(a[j], 2 * q), q);
+}
+
+HELIB_TARGET_AVX512 static void inverseAVX512(u64* a,
+                                              long n,
+                                              u64 q,
+                                              const u64* W,
+                                              const u64* Wp,
+                                              u64 nInv,
+                                              u64 nInvp)
+{
+  const __m512i vq = _mm512_set1_epi64(q);
+  const __m512i vq2 = _mm512_set1_epi64(2 * q);
+
+  long h = n / 2, t = 1;
+  for (; h >= 1 && t < 8; h >>= 1, t <<= 1)
+    inverseStage(a, h, t, W, Wp, q);
+  for (; h >= 1; h >>= 1, t <<= 1) {
+    for (long i = 0; i < h; i++) {
+      __m512i w = _mm512_set1_epi64(W[h + i]);
+      __m512i wp = _mm512_set1_epi64(Wp[h + i]);
+      u64* X = a + 2 * i * t;
+      u64* Y = X + t;
+      for (long j = 0; j < t; j += 8) {
+        __m512i x = _mm512_loadu_si512(X + j);
+        __m512i y = _mm512_loadu_si512(Y + j);
+        __m512i s = condSubAVX512(_mm512_add_epi64(x, y), vq2);
+        __m512i d = _mm512_add_epi64(_mm512_sub_epi64(x, y), vq2);
+        _mm512_storeu_si512(X + j, s);
+        _mm512_storeu_si512(Y + j, mulShoupAVX512(d, w, wp, vq));
+      }
+    }
+  }
+
+  const __m512i vn = _mm512_set1_epi64(nInv);
+  const __m512i vnp = _mm512_set1_epi64(nInvp);
+  long j = 0;
+  for (; j + 8 <= n; j += 8) {
+    __m512i x = _mm512_loadu_si512(a + j);
+    _mm512_storeu_si512(a + j,
+                        condSubAVX512(mulShoupAVX512(x, vn, vnp, vq), vq));
+  }
+  for (; j < n; j++)
+    a[j] = condSub(mulShoupLazy(a[j], nInv, nInvp, q), q);
+}
+
+HELIB_TARGET_AVX512 static void addModAVX512(u64* r,
+                                             const u64* a,
+                                             const u64* b,
+                                             long n,
+                                             u64 q)
+{
+  const __m512i vq = _mm512_set1_epi64(q);
+  long j = 0;
+  for (; j + 8 <= n; j += 8) {
+    __m512i x = _mm512_loadu_si512(a + j);
+    __m512i y = _mm512_loadu_si512(b + j);
+    _mm512_storeu_si512(r + j, condSubAVX512(_mm512_add_epi64(x, y), vq));
+  }
+  for (; j < n; j++)
+    r[j] = condSub(a[j] + b[j], q);
+}
+
+HELIB_TARGET_AVX512 static void subModAVX512(u64* r,
+                                             const u64* a,
+                                             const u64* b,
+                                             long n,
+                                             u64 q)
+{
+  const __m512i vq = _mm512_set1_epi64(q);
+  long j = 0;
+  for (; j + 8 <= n; j += 8) {
+    __m512i x = _mm512_loadu_si512(a + j);
+    __m512i y = _mm512_loadu_si512(b + j);
+    __m512i d = _mm512_add_epi64(x, _mm512_sub_epi64(vq, y));
+    _mm512_storeu_si512(r + j, condSubAVX512(d, vq));
+  }
+  for (; j < n; j++)
+    r[j] = condSub(a[j] + (q - b[j]), q);
+}
+
+HELIB_TARGET_AVX512 static void addScalarAVX512(u64* r,
+                                                const u64* a,
+                                                u64 s,
+                                                long n,
+                                                u64 q)
+{
+  const __m512i vq = _mm512_set1_epi64(q);
+  const __m512i vs = _mm512_set1_epi64(s);
+  long j = 0;
+  for (; j + 8 <= n; j += 8) {
+    __m512i x = _mm512_loadu_si512(a + j);
+    _mm512_storeu_si512(r + j, condSubAVX512(_mm512_add_epi64(x, vs), vq));
+  }
+  for (; j < n; j++)
+    r[j] = condSub(a[j] + s, q);
+}
+
+HELIB_TARGET_AVX512 static void mulScalarAVX512(u64* r,
+                                                const u64* a,
+                                                u64 s,
+                                                long n,
+                                                u64 q)
+{
+  u64 sp = shoupPrecon(s, q);
+  const __m512i vq = _mm512_set1_epi64(q);
+  const __m512i vs = _mm512_set1_epi64(s);
+  const __m512i vsp = _mm512_set1_epi64(sp);
+  long j = 0;
+  for (; j + 8 <= n; j += 8) {
+    __m512i x = _mm512_loadu_si512(a + j);
+    _mm512_storeu_si512(r + j,
+                        condSubAVX512(mulShoupAVX512(x, vs, vsp, vq), vq));
+  }
+  for (; j < n; j++)
+    r[j] = condSub(mulShoupLazy(a[j], s, sp, q), q);
+}
+
+//=============== AVX-512 IFMA kernels ===============
+// For q < 2^50 all the lazy values fit in 52 bits, and the 52-bit
+// multiply-add instructions replace the emulated 64-bit products.
+
+HELIB_TARGET_IFMA static inline __m512i mulShoupIFMA(__m512i x,
+                                                     __m512i w,
+                                                     __m512i wp52,
+                                                     __m512i q)
+{
+  const __m512i zero = _mm512_setzero_si512();
+  const __m512i lo52 = _mm512_set1_epi64((1L << 52) - 1);
+  __m512i quot = _mm512_madd52hi_epu64(zero, wp52, x);
+  __m512i r = _mm512_sub_epi64(_mm512_madd52lo_epu64(zero, w, x),
+                               _mm512_madd52lo_epu64(zero, quot, q));
+  return _mm512_and_si512(r, lo52);
+}
+
+HELIB_TARGET_IFMA static void forwardIFMA(u64* a,
+                                          long n,
+                                          u64 q,
+                                          const u64* W,
+                                          const u64* Wp,
+                                          const u64* Wp52)
+{
+  const __m512i vq = _mm512_set1_epi64(q);
+  const __m512i vq2 = _mm512_set1_epi64(2 * q);
+
+  long m = 1, t = n / 2;
+  for (; t >= 8; m <<= 1, t >>= 1) {
+    for (long i = 0; i < m; i++) {
+      __m512i w = _mm512_set1_epi64(W[m + i]);
+      __m512i wp = _mm512_set1_epi64(Wp52[m + i]);
+      u64* X = a + 2 * i * t;
+      u64* Y = X + t;
+      for (long j = 0; j < t; j += 8) {
+        __m512i x = _mm512_loadu_si512(X + j);
+        __m512i y = _mm512_loadu_si512(Y + j);
+        x = condSubAVX512(x, vq2);
+        y = mulShoupIFMA(y, w, wp, vq);
+        _mm512_storeu_si512(X + j, _mm512_add_epi64(x, y));
+        _mm512_storeu_si512(Y + j,
+                            _mm512_add_epi64(_mm512_sub_epi64(x, y), vq2));
+      }
+    }
+  }
+  for (; m < n; m <<= 1, t >>= 1)
+    forwardStage(a, m, t, W, Wp, q);
+
+  long j = 0;
+  for (; j + 8 <= n; j += 8) {
+    __m512i x = _mm512_loadu_si512(a + j);
+    _mm512_storeu_si512(a + j, condSubAVX512(condSubAVX512(x, vq2), vq));
+  }
+  for (; j < n; j++)
+    a[j] = condSub(condSub(a[j], 2 * q), q);
+}
+
+HELIB_TARGET_IFMA static void inverseIFMA(u64* a,
+                                          long n,
+                                          u64 q,
+                                          const u64* W,
+                                          const u64* Wp,
+                                          const u64* Wp52,
+                                          u64 nInv,
+                                          u64 nInvp52)
+{
+  const __m512i vq = _mm512_set1_epi64(q);
+  const __m512i vq2 = _mm512_set1_epi64(2 * q);
+
+  long h = n / 2, t = 1;
+  for (; h >= 1 && t < 8; h >>= 1, t <<= 1)
+    inverseStage(a, h, t, W, Wp, q);
+  for (; h >= 1; h >>= 1, t <<= 1) {
+    for (long i = 0; i < h; i++) {
+      __m512i w = _mm512_set1_epi64(W[h + i]);
+      __m512i wp = _mm512_set1_epi64(Wp52[h + i]);
+      u64* X = a + 2 * i * t;
+      u64* Y = X + t;
+      for (long j = 0; j < t; j += 8) {
+        __m512i x = _mm512_loadu_si512(X + j);
+        __m512i y = _mm512_loadu_si512(Y + j);
+        __m512i s = condSubAVX512(_mm512_add_epi64(x, y), vq2);
+        __m512i d = _mm512_add_epi64(_mm512_sub_epi64(x, y), vq2);
+        _mm512_storeu_si512(X + j, s);
+        _mm512_storeu_si512(Y + j, mulShoupIFMA(d, w, wp, vq));
+      }
+    }
+  }
+
+  const __m512i vn = _mm512_set1_epi64(nInv);
+  const __m512i vnp = _mm512_set1_epi64(nInvp52);
+  long j = 0;
+  for (; j + 8 <= n; j += 8) {
+    __m512i x = _mm512_loadu_si512(a + j);
+    _mm512_storeu_si512(a + j,
+                        condSubAVX512(mulShoupIFMA(x, vn, vnp, vq), vq));
+  }
+  for (; j < n; j++)
+    a[j] = condSub(mulModSlow(a[j], nInv, q), q);
+}
+
+// r = a * b mod q, for q < 2^50, by Barrett reduction of the 104-bit
+// products (HAC Algorithm 14.42 with base 2). With s the bit length of q and
+// mu = floor(2^2s / q), the estimated quotient is at most 2 below the exact
+// one, so two conditional subtractions finish the job.
+HELIB_TARGET_IFMA static void mulModIFMA(u64* r,
+                                         const u64* a,
+                                         const u64* b,
+                                         long n,
+                                         u64 q)
+{
+  long s = 64 - __builtin_clzl(q);
+  u64 mu = static_cast<u64>((static_cast<u128>(1) << (2 * s)) / q);
+
+  const __m512i zero = _mm512_setzero_si512();
+  const __m512i lo52 = _mm512_set1_epi64((1L << 52) - 1);
+  const __m512i vq = _mm512_set1_epi64(q);
+  const __m512i vmu = _mm512_set1_epi64(mu);
+  const __m128i shiftHi1 = _mm_cvtsi64_si128(53 - s);
+  const __m128i shiftLo1 = _mm_cvtsi64_si128(s - 1);
+  const __m128i shiftHi2 = _mm_cvtsi64_si128(51 - s);
+  const __m128i shiftLo2 = _mm_cvtsi64_si128(s + 1);
+
+  long j = 0;
+  for (; j + 8 <= n; j += 8) {
+    __m512i x = _mm512_loadu_si512(a + j);
+    __m512i y = _mm512_loadu_si512(b + j);
+    // x*y = hi * 2^52 + lo
+    __m512i hi = _mm512_madd52hi_epu64(zero, x, y);
+    __m512i lo = _mm512_madd52lo_epu64(zero, x, y);
+    // q1 = floor(x*y / 2^(s-1)) < 2^(s+1)
+    __m512i q1 = _mm512_or_si512(_mm512_sll_epi64(hi, shiftHi1),
+                                 _mm512_srl_epi64(lo, shiftLo1));
+    // q3 = floor(q1*mu / 2^(s+1))
+    __m512i thi = _mm512_madd52hi_epu64(zero, q1, vmu);
+    __m512i tlo = _mm512_madd52lo_epu64(zero, q1, vmu);
+    __m512i q3 = _mm512_or_si512(_mm512_sll_epi64(thi, shiftHi2),
+                                 _mm512_srl_epi64(tlo, shiftLo2));
+    // x*y - q3*q is in [0, 3q), so its low 52 bits are all we need
+    __m512i rem =
+        _mm512_and_si512(_mm512_sub_epi64(lo, _mm512_madd52lo_epu64(zero, q3, vq)),
+                         lo52);
+    rem = condSubAVX512(condSubAVX512(rem, vq), vq);
+    _mm512_storeu_si512(r + j, rem);
+  }
+  for (; j < n; j++)
+    r[j] = mulModSlow(a[j], b[j], q);
+}
+
+#endif // HELIB_NATIVE_X86
+
+//=============== NativeNTT ===============
+
+NativeNTT::NativeNTT(long _n, long _q, long psi) : n(_n), q(_q)
+{
+  assertTrue<InvalidArgument>(n >= 1 && (n & (n - 1)) == 0,
+                              "NativeNTT: n must be a power of two");
+  assertTrue<InvalidArgument>(supports(_q),
+                              "NativeNTT: modulus must be in (2, 2^62)");
+  assertTrue<InvalidArgument>(psi > 0 && psi < _q,
+                              "NativeNTT: root must be in (0, q)");
+
+  logn = 0;
+  while ((1L << logn) < n)
+    logn++;
+
+  u64 w = psi;
+  assertTrue<InvalidArgument>(powModSlow(w, n, q) == q - 1,
+                              "NativeNTT: psi is not a primitive 2n-th root "
+                              "of unity");
+  u64 wInv = powModSlow(w, 2 * n - 1, q);
+
+  std::vector<u64> pw(n), ipw(n);
+  pw[0] = ipw[0] = 1;
+  for (long i = 1; i < n; i++) {
+    pw[i] = mulModSlow(pw[i - 1], w, q);
+    ipw[i] = mulModSlow(ipw[i - 1], wInv, q);
+  }
+
+  fwdW.resize(n);
+  fwdWp.resize(n);
+  invW.resize(n);
+  invWp.resize(n);
+  for (long i = 0; i < n; i++) {
+    long r = 0;
+    for (long b = 0; b < logn; b++)
+      r |= ((i >> b) & 1) << (logn - 1 - b);
+    fwdW[i] = pw[r];
+    fwdWp[i] = shoupPrecon(fwdW[i], q);
+    invW[i] = ipw[r];
+    invWp[i] = shoupPrecon(invW[i], q);
+  }
+
+  // n divides q-1, so n * (q - (q-1)/n) = 1 mod q
+  nInv = q - (q - 1) / n;
+  nInvp = shoupPrecon(nInv, q);
+
+  if (q < (1UL << 50)) {
+    fwdWp52.resize(n);
+    invWp52.resize(n);
+    for (long i = 0; i < n; i++) {
+      fwdWp52[i] = static_cast<u64>((static_cast<u128>(fwdW[i]) << 52) / q);
+      invWp52[i] = static_cast<u64>((static_cast<u128>(invW[i]) << 52) / q);
+    }
+    nInvp52 = static_cast<u64>((static_cast<u128>(nInv) << 52) / q);
+  }
+}
+
+void NativeNTT::forward(long* a) const
+{
+  u64* x = reinterpret_cast<u64*>(a);
+#ifdef HELIB_NATIVE_X86
+  SimdLevel level = getSimdLevel();
+  if (level >= SimdLevel::AVX512_IFMA && !fwdWp52.empty()) {
+    forwardIFMA(x, n, q, fwdW.data(), fwdWp.data(), fwdWp52.data());
+    return;
+  }
+  if (level >= SimdLevel::AVX512) {
+    forwardAVX512(x, n, q, fwdW.data(), fwdWp.data());
+    return;
+  }
+  if (level >= SimdLevel::AVX2 && q < (1UL << 61)) {
+    forwardAVX2(x, n, q, fwdW.data(), fwdWp.data());
+    return;
+  }
+#endif
+  forwardScalar(x, n, q, fwdW.data(), fwdWp.data());
+}
+
+void NativeNTT::inverse(long* a) const
+{
+  u64* x = reinterpret_cast<u64*>(a);
+#ifdef HELIB_NATIVE_X86
+  SimdLevel level = getSimdLevel();
+  if (level >= SimdLevel::AVX512_IFMA && !invWp52.empty()) {
+    inverseIFMA(x,
+                n,
+                q,
+                invW.data(),
+                invWp.data(),
+                invWp52.data(),
+                nInv,
+                nInvp52);
+    return;
+  }
+  if (level >= SimdLevel::AVX512) {
+    inverseAVX512(x, n, q, invW.data(), invWp.data(), nInv, nInvp);
+    return;
+  }
+  if (level >= SimdLevel::AVX2 && q < (1UL << 61)) {
+    inverseAVX2(x, n, q, invW.data(), invWp.data(), nInv, nInvp);
+    return;
+  }
+#endif
+  inverseScalar(x, n, q, invW.data(), invWp.data(), nInv, nInvp);
+}
+
+//=============== Element-wise kernels ===============
+
+void eltwiseAddMod(long* result, const long* a, const long* b, long n, long q)
+{
+  u64* r = reinterpret_cast<u64*>(result);
+  const u64* x = reinterpret_cast<const u64*>(a);
+  const u64* y = reinterpret_cast<const u64*>(b);
+#ifdef HELIB_NATIVE_X86
+  SimdLevel level = getSimdLevel();
+  if (level >= SimdLevel::AVX512) {
+    addModAVX512(r, x, y, n, q);
+    return;
+  }
+  if (level >= SimdLevel::AVX2) {
+    addModAVX2(r, x, y, n, q);
+    return;
+  }
+#endif
+  for (long j = 0; j < n; j++)
+    r[j] = condSub(x[j] + y[j], q);
+}
+
+void eltwiseAddMod(long* result, const long* a, long scalar, long n, long q)
+{
+  u64* r = reinterpret_cast<u64*>(result);
+  const u64* x = reinterpret_cast<const u64*>(a);
+#ifdef HELIB_NATIVE_X86
+  SimdLevel level = getSimdLevel();
+  if (level >= SimdLevel::AVX512) {
+    addScalarAVX512(r, x, scalar, n, q);
+    return;
+  }
+  if (level >= SimdLevel::AVX2) {
+    addScalarAVX2(r, x, scalar, n, q);
+    return;
+  }
+#endif
+  for (long j = 0; j < n; j++)
+    r[j] = condSub(x[j] + scalar, q);
+}
+
+void eltwiseSubMod(long* result, const long* a, const long* b, long n, long q)
+{
+  u64* r = reinterpret_cast<u64*>(result);
+  const u64* x = reinterpret_cast<const u64*>(a);
+  const u64* y = reinterpret_cast<const u64*>(b);
+#ifdef HELIB_NATIVE_X86
+  SimdLevel level = getSimdLevel();
+  if (level >= SimdLevel::AVX512) {
+    subModAVX512(r, x, y, n, q);
+    return;
+  }
+  if (level >= SimdLevel::AVX2) {
+    subModAVX2(r, x, y, n, q);
+    return;
+  }
+#endif
+  for (long j = 0; j < n; j++)
+    r[j] = condSub(x[j] + (q - y[j]), q);
+}
+
+void eltwiseSubMod(long* result, const long* a, long scalar, long n, long q)
+{
+  // a - s = a + (q - s) mod q
+  eltwiseAddMod(result, a, scalar == 0 ? 0 : q - scalar, n, q);
+}
+
+void eltwiseMulMod(long* result,
+                   const long* a,
+                   const long* b,
+                   long n,
+                   long q,
+                   NTL::mulmod_t qinv)
+{
+#ifdef HELIB_NATIVE_X86
+  if (getSimdLevel() >= SimdLevel::AVX512_IFMA && q < (1L << 50)) {
+    mulModIFMA(reinterpret_cast<u64*>(result),
+               reinterpret_cast<const u64*>(a),
+               reinterpret_cast<const u64*>(b),
+               n,
+               q);
+    return;
+  }
+#endif
+  // Without IFMA, emulating the 128-bit products in vector registers is
+  // slower than NTL's floating-point MulMod
+  for (long j = 0; j < n; j++)
+    result[j] = NTL::MulMod(a[j], b[j], q, qinv);
+}
+
+void eltwiseMulMod(long* result, const long* a, long scalar, long n, long q)
+{
+  u64* r = reinterpret_cast<u64*>(result);
+  const u64* x = reinterpret_cast<const u64*>(a);
+#ifdef HELIB_NATIVE_X86
+  SimdLevel level = getSimdLevel();
+  if (level >= SimdLevel::AVX512) {
+    mulScalarAVX512(r, x, scalar, n, q);
+    return;
+  }
+  if (level >= SimdLevel::AVX2 && q < (1L << 61)) {
+    mulScalarAVX2(r, x, scalar, n, q);
+    return;
+  }
+#endif
+  u64 sp = shoupPrecon(scalar, q);
+  for (long j = 0; j < n; j++)
+    r[j] = condSub(mulShoupLazy(x[j], scalar, sp, q), q);
+}
+
+// x mod q for a 128-bit x, as hi * (2^64 mod q) + lo with two lazy Shoup
+// products, which are in [0, 4q)
+static inline u64 reduce128(u128 x, u64 r64, u64 r64p, u64 onep, u64 q)
+{
+  u64 t = mulShoupLazy(static_cast<u64>(x >> 64), r64, r64p, q) +
+          mulShoupLazy(static_cast<u64>(x), 1, onep, q);
+  return condSub(condSub(t, 2 * q), q);
+}
+
+void eltwiseFusedDotMod(long* ra,
+                        long* rb,
+                        const long* const* d,
+                        const long* const* a,
+                        const long* const* b,
+                        long count,
+                        long n,
+                        long q)
+{
+  assertInRange<InvalidArgument>(q,
+                                 3L,
+                                 1L << 62,
+                                 "eltwiseFusedDotMod: modulus out of range");
+
+  u64 uq = q;
+  u64 r64 = static_cast<u64>((static_cast<u128>(1) << 64) % uq);
+  u64 r64p = shoupPrecon(r64, uq);
+  u64 onep = shoupPrecon(1, uq);
+
+  // How many products (q-1)^2 fit in an accumulator, keeping one slot for
+  // the initial value (or the partial reduction)
+  u128 maxProd = static_cast<u128>(uq - 1) * (uq - 1);
+  u128 slots = ~static_cast<u128>(0) / maxProd - 1;
+  long lazy = (slots < static_cast<u128>(count)) ? long(slots) : count;
+
+  u64* xa = reinterpret_cast<u64*>(ra);
+  u64* xb = reinterpret_cast<u64*>(rb);
+  for (long j = 0; j < n; j++) {
+    u128 accA = xa[j];
+    u128 accB = xb[j];
+    for (long k = 0, budget = lazy; k < count; k++, budget--) {
+      if (budget == 0) {
+        accA = reduce128(accA, r64, r64p, onep, uq);
+        accB = reduce128(accB, r64, r64p, onep, uq);
+        budget = lazy;
+      }
+      u64 dk = d[k][j];
+      accA += static_cast<u128>(dk) * static_cast<u64>(a[k][j]);
+      accB += static_cast<u128>(dk) * static_cast<u64>(b[k][j]);
+    }
+    xa[j] = reduce128(accA, r64, r64p, onep, uq);
+    xb[j] = reduce128(accB, r64, r64p, onep, uq);
+  }
+}
+
+} // namespace helib
@@ -803,7 +803,9 @@ long PAlgebra::genToPow(long i, long j) const
 
 ************************************************************************/
 
-PAlgebraModBase* buildPAlgebraMod(const PAlgebra& zMStar, long r)
+PAlgebraModBase* buildPAlgebraMod(const PAlgebra& zMStar,
+                                  long r,
+                                  const SlotFactorization* factorization)
 {
   NTL::ZZ p = zMStar.getP();
 
@@ -814,9 +816,9 @@ PAlgebraModBase* buildPAlgebraMod(const PAlgebra& zMStar, long r)
                               "Modulus p is less than 2 (nor -1 for CKKS)");
   assertTrue<InvalidArgument>(r > 0, "Hensel lifting r is less than 1");
   if (p == 2 && r == 1)
-    return new PAlgebraModDerived<PA_GF2>(zMStar, r);
+    return new PAlgebraModDerived<PA_GF2>(zMStar, r, factorization);
   else
-    return new PAlgebraModDerived<PA_zz_p>(zMStar, r);
+    return new PAlgebraModDerived<PA_zz_p>(zMStar, r, factorization);
 }
 
 template <typename T>
@@ -839,16 +841,14 @@ NTL::zz_pEX FrobeniusMap(const NTL::zz_pEXModulus& F)
 }
 
 template <typename type>
-PAlgebraModDerived<type>::PAlgebraModDerived(const PAlgebra& _zMStar, long _r) :
+PAlgebraModDerived<type>::PAlgebraModDerived(
+    const PAlgebra& _zMStar,
+    long _r,
+    const SlotFactorization* factorization) :
     zMStar(_zMStar), r(_r)
 
 {
   NTL::ZZ p = zMStar.getP();
-  long m = zMStar.getM();
-
-  // For dry-run, use a tiny m value for the PAlgebra tables
-  if (isDryRun())
-    m = (p == 3) ? 4 : 3;
 
   assertTrue<InvalidArgument>(r > 0l, "Hensel lifting r is less than 1");
 
@@ -861,6 +861,33 @@ PAlgebraModDerived<type>::PAlgebraModDerived(const PAlgebra& _zMStar, long _r) :
 
   RBak bak;
   bak.save();
+
+  if (factorization != nullptr)
+    setFactors(*factorization);
+  else
+    factorPhimX();
+
+  // set factorsOverZZ
+  resize(factorsOverZZ, nSlots);
+  for (long i = 0; i < nSlots; i++)
+    conv(factorsOverZZ[i], factors[i]);
+
+  genCrtTable();
+  genMaskTable();
+}
+
+template <typename type>
+void PAlgebraModDerived<type>::factorPhimX()
+{
+  NTL::ZZ p = zMStar.getP();
+  long m = zMStar.getM();
+
+  // For dry-run, use a tiny m value for the PAlgebra tables
+  if (isDryRun())
+    m = (p == 3) ? 4 : 3;
+
+  long nSlots = zMStar.getNSlots();
+
   SetModulus(p);
 
   // Compute the factors Ft of Phi_m(X) mod p, for all t \in T
@@ -922,14 +949,50 @@ PAlgebraModDerived<type>::PAlgebraModDerived(const PAlgebra& _zMStar, long _r) :
     build(PhimXMod, phimxmod1);
     pPowRContext.save();
   }
+}
 
-  // set factorsOverZZ
-  resize(factorsOverZZ, nSlots);
-  for (long i = 0; i < nSlots; i++)
-    conv(factorsOverZZ[i], factors[i]);
+template <typename type>
+void PAlgebraModDerived<type>::setFactors(
+    const SlotFactorization& factorization)
+{
+  long nSlots = zMStar.getNSlots();
+  assertEq<InvalidArgument>(factorization.r,
+                            r,
+                            "Factorization of Phi_m(X) modulo another p^r");
+  assertEq<InvalidArgument>(lsize(factorization.factors),
+                            nSlots,
+                            "Factorization of Phi_m(X) with a wrong number "
+                            "of factors");
+  assertEq<InvalidArgument>(lsize(factorization.crtCoeffs),
+                            nSlots,
+                            "Factorization of Phi_m(X) with a wrong number "
+                            "of CRT coefficients");
+
+  SetModulus(pPowR);
 
-  genCrtTable();
-  genMaskTable();
+  resize(factors, nSlots);
+  resize(crtCoeffs, nSlots);
+  for (long i = 0; i < nSlots; i++) {
+    conv(factors[i], factorization.factors[i]);
+    conv(crtCoeffs[i], factorization.crtCoeffs[i]);
+  }
+
+  RX phimxmod;
+  conv(phimxmod, zMStar.getPhimX()); // Phi_m(X) mod p^r
+  build(PhimXMod, phimxmod);
+  pPowRContext.save();
+}
+
+template <typename type>
+SlotFactorization PAlgebraModDerived<type>::getSlotFactorization() const
+{
+  SlotFactorization factorization;
+  factorization.r = r;
+  factorization.factors = factorsOverZZ;
+  resize(factorization.crtCoeffs, lsize(crtCoeffs));
+  for (long i = 0; i < lsize(crtCoeffs); i++)
+    conv(factorization.crtCoeffs[i], crtCoeffs[i]);
+  return factorization;
 }
 
 // Assumes current zz_p modulus is p^r
@@ -0,0 +1,288 @@
+/* Copyright (C) 2012-2020 IBM Corp.
+ * This program is Licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. See accompanying LICENSE file.
+ */
+
+/* PrimeFactorFFT.cpp - a direct FFT for lengths with small prime factors,
+ * combining the Good-Thomas index mapping, radix-p Cooley-Tukey steps for
+ * prime powers, and Rader's algorithm for the larger primes.
+ */
+#include <helib/PrimeFactorFFT.h>
+#include <helib/CModulus.h>
+#include <helib/timing.h>
+
+namespace helib {
+
+// Rough cost of one butterfly of a prime length p, per element, when done
+// with Rader's algorithm: two FFTs of size 2^k >= 2(p-1)-1, plus the
+// pointwise product and the bookkeeping. A direct butterfly costs about p.
+static double raderCost(long p)
+{
+  long k = NTL::NextPowerOfTwo(2 * (p - 1) - 1);
+  return 2.0 + 2.0 * double(1L << k) * k / p;
+}
+
+static bool useRader(long p) { return p > 3 && raderCost(p) < p; }
+
+bool PrimeFactorFFT::preferable(long n)
+{
+  NTL::Vec<NTL::Pair<long, long>> fac;
+  factorize(fac, n);
+
+  // the Good-Thomas permutations, then e radix-p steps for each p^e
+  double direct = 2.0;
+  for (long i : range(fac.length())) {
+    long p = fac[i].a;
+    double butterfly = useRader(p) ? raderCost(p) : double(p);
+    direct += fac[i].b * (butterfly + 1.0); // +1 for the twiddle factors
+  }
+
+  // Bluestein: two FFTs of size 2^k >= 2n-1, a pointwise product and two
+  // passes of multiplications by powers of the root
+  long k = NTL::NextPowerOfTwo(2 * n - 1);
+  double bluestein = (2.0 * double(1L << k) * k + 3.0 * n) / n;
+
+  return direct < bluestein;
+}
+
+PrimeFactorFFT::PrimeFactorFFT(long _n, const NTL::zz_p& omega) :
+    n(_n), q(NTL::zz_p::modulus())
+{
+  assertTrue<InvalidArgument>(n >= 1, "PrimeFactorFFT: length must be >= 1");
+  assertTrue<InvalidArgument>(power(omega, n) == 1,
+                              "PrimeFactorFFT: omega^n != 1");
+
+  NTL::Vec<NTL::Pair<long, long>> fac;
+  factorize(fac, n);
+
+  // The CRT idempotents: idem[i] = 1 mod n_i and 0 mod n_j for j != i
+  std::vector<long> idem(fac.length());
+
+  factors.resize(fac.length());
+  long stride = n;
+  for (long i : range(fac.length())) {
+    Factor& f = factors[i];
+    f.p = fac[i].a;
+    f.e = fac[i].b;
+    f.len = NTL::power_long(f.p, f.e);
+    stride /= f.len;
+    f.stride = stride;
+
+    long cofactor = n / f.len;
+    idem[i] = NTL::MulMod(cofactor,
+                          NTL::InvMod(cofactor % f.len, f.len),
+                          n);
+
+    // omega^idem[i] has order len, and x^{j k idem[i]} only depends on
+    // j mod len, which is what makes the factors independent
+    NTL::zz_p w = power(omega, idem[i]);
+    f.wPow.resize(f.len);
+    f.wPowAux.resize(f.len);
+    NTL::zz_p x(1);
+    for (long j : range(f.len)) {
+      f.wPow[j] = rep(x);
+      f.wPowAux[j] = NTL::PrepMulModPrecon(f.wPow[j], q);
+      x *= w;
+    }
+
+    f.digitRev.resize(f.len);
+    for (long j : range(f.len)) {
+      long r = 0;
+      long y = j;
+      for (long d = 0; d < f.e; d++) {
+        r = r * f.p + y % f.p;
+        y /= f.p;
+      }
+      f.digitRev[j] = r;
+    }
+
+    f.zeta.resize(f.p);
+    f.zetaAux.resize(f.p);
+    for (long r : range(f.p)) {
+      f.zeta[r] = f.wPow[(f.len / f.p) * r];
+      f.zetaAux[r] = f.wPowAux[(f.len / f.p) * r];
+    }
+
+    if (useRader(f.p)) {
+      f.rader = true;
+      long L = f.p - 1;
+      long g = primroot(f.p, L);
+      long gInv = NTL::InvMod(g, f.p);
+      f.gPow.resize(L);
+      f.gInvPow.resize(L);
+      for (long b = 0, gb = 1, gib = 1; b < L; b++) {
+        f.gPow[b] = gb;
+        f.gInvPow[b] = gib;
+        gb = NTL::MulMod(gb, g, f.p);
+        gib = NTL::MulMod(gib, gInv, f.p);
+      }
+
+      // out[g^{-a}] = u[0] + sum_b u[g^b] zeta^{g^{b-a}}, a cyclic
+      // convolution of u[g^b] with the kernel zeta^{g^{-b}}
+      NTL::zz_pX kpoly;
+      kpoly.rep.SetLength(L);
+      for (long b : range(L))
+        kpoly.rep[b].LoopHole() = f.zeta[f.gInvPow[b]];
+      kpoly.normalize();
+
+      f.raderK = NTL::NextPowerOfTwo(2 * L - 1);
+      f.kernel.SetSize(f.raderK);
+      TofftRep(f.kernel, kpoly, f.raderK);
+    }
+  }
+
+  // Position t of the buffer has coordinates (t_1, ..., t_r) in row-major
+  // order, and holds the element with index sum_i t_i * idem[i] mod n, both
+  // on input and on output
+  perm.resize(n);
+  for (long t : range(n)) {
+    long j = 0;
+    long y = t;
+    for (long i = lsize(factors) - 1; i >= 0; i--) {
+      long ti = y % factors[i].len;
+      y /= factors[i].len;
+      j = NTL::AddMod(j, NTL::MulMod(ti, idem[i], n), n);
+    }
+    perm[t] = j;
+  }
+}
+
+// Length-p DFT of u in place, with the p-th root of unity of f
+void PrimeFactorFFT::butterfly(long* u, const Factor& f) const
+{
+  long p = f.p;
+
+  if (p == 2) {
+    long a = u[0];
+    long b = u[1];
+    u[0] = NTL::AddMod(a, b, q);
+    u[1] = NTL::SubMod(a, b, q);
+    return;
+  }
+
+  if (!f.rader) {
+    static thread_local std::vector<long> tls_out;
+    std::vector<long>& out = tls_out;
+    out.resize(p);
+    for (long t : range(p)) {
+      long acc = u[0];
+      for (long r = 1, idx = t; r < p; r++) {
+        acc = NTL::AddMod(acc,
+                          NTL::MulModPrecon(u[r], f.zeta[idx], q, f.zetaAux[idx]),
+                          q);
+        idx += t;
+        if (idx >= p)
+          idx -= p;
+      }
+      out[t] = acc;
+    }
+    std::copy(out.begin(), out.end(), u);
+    return;
+  }
+
+  // Rader's algorithm
+  long L = p - 1;
+  NTL_THREAD_LOCAL static NTL::zz_pX c;
+
+  long u0 = u[0];
+  long sum = u0;
+  c.rep.SetLength(L);
+  for (long b : range(L)) {
+    long x = u[f.gPow[b]];
+    sum = NTL::AddMod(sum, x, q);
+    c.rep[b].LoopHole() = x;
+  }
+  c.normalize();
+
+  NTL::fftRep& R = Cmodulus::getScratch_fftRep(f.raderK);
+  TofftRep(R, c, f.raderK);
+  mul(R, R, f.kernel);
+  FromfftRep(c, R, 0, 2 * L - 2);
+
+  // fold the linear convolution modulo X^L - 1
+  for (long a : range(L)) {
+    long conv = NTL::AddMod(rep(coeff(c, a)), rep(coeff(c, a + L)), q);
+    u[f.gInvPow[a]] = NTL::AddMod(u0, conv, q);
+  }
+  u[0] = sum;
+}
+
+// Length-p^e DFT of v in place, the input being in base-p digit-reversed
+// order and the output in natural order
+void PrimeFactorFFT::primePowerDFT(long* v, const Factor& f) const
+{
+  long p = f.p;
+  long len = f.len;
+
+  static thread_local std::vector<long> tls_u;
+  std::vector<long>& u = tls_u;
+  u.resize(p);
+
+  // Combine p transforms of length sub into one of length sub*p
+  for (long sub = 1; sub < len; sub *= p) {
+    long blk = sub * p;
+    long stepExp = len / blk;
+    for (long start = 0; start < len; start += blk) {
+      for (long k = 0; k < sub; k++) {
+        long* base = v + start + k;
+        long step = stepExp * k;
+        u[0] = base[0];
+        for (long r = 1, idx = step; r < p; r++) {
+          long x = base[r * sub];
+          u[r] = (idx == 0)
+                     ? x
+                     : NTL::MulModPrecon(x, f.wPow[idx], q, f.wPowAux[idx]);
+          idx += step;
+          if (idx >= len)
+            idx -= len;
+        }
+        butterfly(u.data(), f);
+        for (long t : range(p))
+          base[t * sub] = u[t];
+      }
+    }
+  }
+}
+
+void PrimeFactorFFT::apply(long* out, const long* in) const
+{
+  HELIB_TIMER_START;
+
+  static thread_local std::vector<long> tls_buf;
+  static thread_local std::vector<long> tls_vec;
+  std::vector<long>& buf = tls_buf;
+  std::vector<long>& vec = tls_vec;
+
+  buf.resize(n);
+  for (long t : range(n))
+    buf[t] = in[perm[t]];
+
+  // Transform along each factor in turn
+  for (const Factor& f : factors) {
+    long len = f.len;
+    long stride = f.stride;
+    vec.resize(len);
+    for (long outer = 0; outer < n; outer += len * stride) {
+      for (long inner : range(stride)) {
+        long* base = buf.data() + outer + inner;
+        for (long i : range(len))
+          vec[f.digitRev[i]] = base[i * stride];
+        primePowerDFT(vec.data(), f);
+        for (long i : range(len))
+          base[i * stride] = vec[i];
+      }
+    }
+  }
+
+  for (long t : range(n))
+    out[perm[t]] = buf[t];
+}
+
+} // namespace helib
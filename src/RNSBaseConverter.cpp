@@ -0,0 +1,210 @@
+/* Copyright (C) 2012-2020 IBM Corp.
+ * This program is Licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. See accompanying LICENSE file.
+ */
+
+/* RNSBaseConverter.cpp - fast base extension between sets of primes
+ */
+#include <algorithm>
+#include <cmath>
+
+#include <NTL/BasicThreadPool.h>
+
+#include <helib/RNSBaseConverter.h>
+#include <helib/Context.h>
+#include <helib/timing.h>
+
+namespace helib {
+
+RNSBaseConverter::RNSBaseConverter(const Context& context,
+                                   const IndexSet& _from,
+                                   const IndexSet& _to) :
+    from(_from), to(_to)
+{
+  assertTrue(disjoint(from, to),
+             "RNSBaseConverter: source and target sets must be disjoint");
+  assertTrue(!empty(from), "RNSBaseConverter: empty source set");
+
+  for (long j : from)
+    fromQ.push_back(context.ithPrime(j));
+  for (long i : to)
+    toQ.push_back(context.ithPrime(i));
+
+  long nFrom = fromQ.size();
+  long nTo = toQ.size();
+
+  // qhat_j^{-1} mod q_j
+  qhatInv.resize(nFrom);
+  qhatInvPrecon.resize(nFrom);
+  qRecip.resize(nFrom);
+  for (long j : range(nFrom)) {
+    long q = fromQ[j];
+    long qhat = 1;
+    for (long k : range(nFrom))
+      if (k != j)
+        qhat = NTL::MulMod(qhat, fromQ[k] % q, q);
+    qhatInv[j] = NTL::InvMod(qhat, q);
+    qhatInvPrecon[j] = NTL::PrepMulModPrecon(qhatInv[j], q);
+    qRecip[j] = 1.0L / static_cast<long double>(q);
+  }
+
+  // qhat_j mod p_i and v*Q mod p_i
+  qhatMod.resize(nTo * nFrom);
+  qhatModPrecon.resize(nTo * nFrom);
+  vQMod.resize(nTo * (nFrom + 1));
+  for (long i : range(nTo)) {
+    long p = toQ[i];
+    for (long j : range(nFrom)) {
+      long qhat = 1;
+      for (long k : range(nFrom))
+        if (k != j)
+          qhat = NTL::MulMod(qhat, fromQ[k] % p, p);
+      qhatMod[i * nFrom + j] = qhat;
+      qhatModPrecon[i * nFrom + j] = NTL::PrepMulModPrecon(qhat, p);
+    }
+
+    long Q = productMod(p);
+    long* vQ = &vQMod[i * (nFrom + 1)];
+    vQ[0] = 0;
+    for (long v : range(1, nFrom + 1))
+      vQ[v] = NTL::AddMod(vQ[v - 1], Q, p);
+  }
+}
+
+long RNSBaseConverter::productMod(long t) const
+{
+  if (t == 1)
+    return 0;
+  long res = 1;
+  for (long q : fromQ)
+    res = NTL::MulMod(res, q % t, t);
+  return res;
+}
+
+void RNSBaseConverter::convert(long* out,
+                               long outStride,
+                               const long* in,
+                               long inStride,
+                               long n,
+                               double* frac) const
+{
+  HELIB_TIMER_START;
+
+  long nFrom = fromQ.size();
+  long nTo = toQ.size();
+
+  // Scratch space, thread_local so concurrent conversions do not interfere
+  static thread_local std::vector<long> tls_y;
+  static thread_local std::vector<long> tls_v;
+  static thread_local std::vector<long double> tls_sum;
+
+  std::vector<long>& y = tls_y;           // y[j*n + h] = y_j of column h
+  std::vector<long>& v = tls_v;           // v[h] = round(sum_j y_j/q_j)
+  std::vector<long double>& sum = tls_sum; // sum[h] = sum_j y_j/q_j
+  y.resize(nFrom * n);
+  v.resize(n);
+  sum.assign(n, 0.0L);
+
+  // y_j = c_j * qhat_j^{-1} mod q_j, and the sum of y_j/q_j
+  for (long j : range(nFrom)) {
+    long q = fromQ[j];
+    long t = qhatInv[j];
+    NTL::mulmod_precon_t tqinv = qhatInvPrecon[j];
+    long double qrecip = qRecip[j];
+    const long* c = in + j * inStride;
+    long* yj = &y[j * n];
+    for (long h : range(n)) {
+      yj[h] = NTL::MulModPrecon(c[h], t, q, tqinv);
+      sum[h] += yj[h] * qrecip;
+    }
+  }
+
+  for (long h : range(n)) {
+    long double r = std::round(sum[h]);
+    v[h] = static_cast<long>(r);
+    if (frac)
+      frac[h] = static_cast<double>(sum[h] - r);
+  }
+
+  // out_i = sum_j y_j * (qhat_j mod p_i) - v * (Q mod p_i)
+  NTL_EXEC_RANGE(nTo, first, last)
+  for (long i : range(first, last)) {
+    long p = toQ[i];
+    long* row = out + i * outStride;
+    const long* vQ = &vQMod[i * (nFrom + 1)];
+
+    for (long h : range(n))
+      row[h] = NTL::SubMod(0, vQ[v[h]], p);
+
+    for (long j : range(nFrom)) {
+      long b = qhatMod[i * nFrom + j];
+      NTL::mulmod_precon_t bninv = qhatModPrecon[i * nFrom + j];
+      const long* yj = &y[j * n];
+      if (fromQ[j] <= p) {
+        for (long h : range(n))
+          row[h] =
+              NTL::AddMod(row[h], NTL::MulModPrecon(yj[h], b, p, bninv), p);
+      } else { // y_j may be larger than p, reduce it first
+        for (long h : range(n))
+          row[h] = NTL::AddMod(row[h],
+                               NTL::MulModPrecon(yj[h] % p, b, p, bninv),
+                               p);
+      }
+    }
+  }
+  NTL_EXEC_RANGE_END
+}
+
+void RNSBaseConverter::convertTo(long* out,
+                                 long t,
+                                 const long* in,
+                                 long inStride,
+                                 long n) const
+{
+  HELIB_TIMER_START;
+  assertInRange(t, 2L, NTL_SP_BOUND, "Modulus t out of range");
+
+  long nFrom = fromQ.size();
+
+  // qhat_j mod t and Q mod t
+  std::vector<long> qhatModT(nFrom, 1);
+  for (long j : range(nFrom))
+    for (long k : range(nFrom))
+      if (k != j)
+        qhatModT[j] = NTL::MulMod(qhatModT[j], fromQ[k] % t, t);
+  long QModT = productMod(t);
+
+  static thread_local std::vector<long double> tls_sum;
+  std::vector<long double>& sum = tls_sum;
+  sum.assign(n, 0.0L);
+  std::fill_n(out, n, 0L);
+
+  // Accumulate in the same order as convert, so we get the same quotients
+  for (long j : range(nFrom)) {
+    long q = fromQ[j];
+    long tj = qhatInv[j];
+    NTL::mulmod_precon_t tqinv = qhatInvPrecon[j];
+    long double qrecip = qRecip[j];
+    long b = qhatModT[j];
+    const long* c = in + j * inStride;
+    for (long h : range(n)) {
+      long y = NTL::MulModPrecon(c[h], tj, q, tqinv);
+      sum[h] += y * qrecip;
+      out[h] = NTL::AddMod(out[h], NTL::MulMod(y % t, b, t), t);
+    }
+  }
+
+  for (long h : range(n)) {
+    long v = static_cast<long>(std::round(sum[h]));
+    out[h] = NTL::SubMod(out[h], NTL::MulMod(v % t, QModT, t), t);
+  }
+}
+
+} // namespace helib
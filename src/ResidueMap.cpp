@@ -0,0 +1,379 @@
+/* Copyright (C) 2012-2020 IBM Corp.
+ * This program is Licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. See accompanying LICENSE file.
+ */
+
+/* ResidueMap.cpp - contiguous storage for the rows of a DoubleCRT object
+ */
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include <helib/ResidueMap.h>
+
+namespace helib {
+
+namespace {
+
+std::atomic<long> allocations{0};
+std::atomic<std::size_t> poolLimit{0}; // no pooling unless asked for
+
+// The released buffers of one thread, smallest first
+class ScratchPool
+{
+public:
+  ~ScratchPool()
+  {
+    dead = true;
+    for (const auto& b : buffers)
+      std::free(b.second);
+  }
+
+  // A pooled buffer of at least bytes (and not much more), or nullptr
+  long* take(std::size_t& bytes)
+  {
+    auto it = std::lower_bound(buffers.begin(),
+                               buffers.end(),
+                               std::make_pair(bytes, (long*)nullptr));
+    if (it == buffers.end() || it->first > 4 * bytes)
+      return nullptr;
+    long* p = it->second;
+    bytes = it->first;
+    held -= bytes;
+    buffers.erase(it);
+    return p;
+  }
+
+  // Free the largest buffers until the pool holds at most limit bytes
+  void trim(std::size_t limit)
+  {
+    while (held > limit) {
+      held -= buffers.back().first;
+      std::free(buffers.back().second);
+      buffers.pop_back();
+    }
+  }
+
+  // Keep the buffer if there is room for it, otherwise free it
+  void give(long* p, std::size_t bytes)
+  {
+    std::size_t limit = poolLimit.load(std::memory_order_relaxed);
+    while (!buffers.empty() && held + bytes > limit) {
+      // make room by dropping the largest buffer, if it is not the new one
+      if (buffers.back().first < bytes)
+        break;
+      held -= buffers.back().first;
+      std::free(buffers.back().second);
+      buffers.pop_back();
+    }
+    if (held + bytes > limit) {
+      std::free(p);
+      return;
+    }
+    auto entry = std::make_pair(bytes, p);
+    buffers.insert(
+        std::upper_bound(buffers.begin(), buffers.end(), entry),
+        entry);
+    held += bytes;
+  }
+
+  // Set when the pool of this thread is gone: the buffers of objects that
+  // outlive it (e.g., globals) are then simply freed
+  static thread_local bool dead;
+
+private:
+  std::vector<std::pair<std::size_t, long*>> buffers;
+  std::size_t held = 0;
+};
+
+thread_local bool ScratchPool::dead = false;
+
+// The pool of the current thread, nullptr if it was already destroyed
+ScratchPool* scratchPool()
+{
+  if (ScratchPool::dead)
+    return nullptr;
+  static thread_local ScratchPool pool;
+  return &pool;
+}
+
+} // namespace
+
+void ResidueMap::AlignedFree::operator()(long* p) const
+{
+  if (bytes == 0)
+    return; // the rows of a view
+  if (ScratchPool* pool = scratchPool())
+    pool->give(p, bytes);
+  else
+    std::free(p);
+}
+
+long ResidueMap::allocationCount() { return allocations.load(); }
+
+std::size_t ResidueMap::getScratchPoolLimit() { return poolLimit.load(); }
+
+void ResidueMap::setScratchPoolLimit(std::size_t bytes)
+{
+  poolLimit.store(bytes);
+  if (ScratchPool* pool = scratchPool())
+    pool->trim(bytes);
+}
+
+ResidueMap::ResidueMap(long rowLength) : rowLen(rowLength)
+{
+  assertTrue(rowLength >= 0, "Row length must be non-negative");
+  constexpr long perAlign = ROW_ALIGN / sizeof(long);
+  stride = ((rowLen + perAlign - 1) / perAlign) * perAlign;
+}
+
+ResidueMap ResidueMap::view(long rowLength,
+                            const IndexSet& s,
+                            long* rows,
+                            std::shared_ptr<void> backing)
+{
+  assertTrue(reinterpret_cast<std::uintptr_t>(rows) % ROW_ALIGN == 0,
+             "The rows of a view must be aligned");
+  assertTrue(backing != nullptr, "A view must have a backing");
+
+  ResidueMap res(rowLength);
+  res.buf = std::unique_ptr<long[], AlignedFree>(rows, AlignedFree{0});
+  res.backing = std::move(backing);
+  res.capacity = s.card();
+  if (s.card() > 0)
+    res.slot.resize(s.last() + 1, -1);
+  for (long j : s) {
+    res.slot[j] = res.nRows++;
+    res.owner.push_back(j);
+  }
+  res.indexSet = s;
+  return res;
+}
+
+ResidueMap::ResidueMap(const ResidueMap& other) :
+    rowLen(other.rowLen),
+    stride(other.stride),
+    indexSet(other.indexSet),
+    slot(other.slot),
+    owner(other.owner)
+{
+  if (other.nRows > 0) {
+    grow(other.nRows);
+    std::memcpy(buf.get(),
+                other.buf.get(),
+                sizeof(long) * other.nRows * stride);
+  }
+  nRows = other.nRows;
+}
+
+ResidueMap::ResidueMap(ResidueMap&& other) noexcept :
+    rowLen(other.rowLen),
+    stride(other.stride),
+    nRows(other.nRows),
+    capacity(other.capacity),
+    indexSet(std::move(other.indexSet)),
+    slot(std::move(other.slot)),
+    owner(std::move(other.owner)),
+    buf(std::move(other.buf)),
+    backing(std::move(other.backing))
+{
+  other.nRows = 0;
+  other.capacity = 0;
+  other.indexSet.clear();
+}
+
+ResidueMap& ResidueMap::operator=(const ResidueMap& other)
+{
+  if (this == &other)
+    return *this;
+
+  // Reuse our buffer if it is large enough, and ours
+  if (stride != other.stride || capacity < other.nRows || isView()) {
+    buf.reset();
+    backing.reset();
+    capacity = 0;
+  }
+  rowLen = other.rowLen;
+  stride = other.stride;
+  nRows = 0;
+  if (other.nRows > 0) {
+    grow(other.nRows);
+    std::memcpy(buf.get(),
+                other.buf.get(),
+                sizeof(long) * other.nRows * stride);
+  }
+  nRows = other.nRows;
+  indexSet = other.indexSet;
+  slot = other.slot;
+  owner = other.owner;
+  return *this;
+}
+
+ResidueMap& ResidueMap::operator=(ResidueMap&& other) noexcept
+{
+  if (this == &other)
+    return *this;
+
+  rowLen = other.rowLen;
+  stride = other.stride;
+  nRows = other.nRows;
+  capacity = other.capacity;
+  indexSet = std::move(other.indexSet);
+  slot = std::move(other.slot);
+  owner = std::move(other.owner);
+  buf = std::move(other.buf);
+  backing = std::move(other.backing);
+
+  other.nRows = 0;
+  other.capacity = 0;
+  other.indexSet.clear();
+  return *this;
+}
+
+// Reallocate the buffer so it can hold at least minCapacity rows, keeping
+// the content of the rows that are currently in use.
+void ResidueMap::grow(long minCapacity)
+{
+  if (minCapacity <= capacity)
+    return;
+
+  long newCapacity = std::max(minCapacity, 2 * capacity);
+  // std::aligned_alloc requires the size to be a multiple of the alignment,
+  // which holds since stride is a multiple of ROW_ALIGN/sizeof(long).
+  std::size_t bytes = sizeof(long) * std::max(newCapacity * stride, 1L);
+  bytes = ((bytes + ROW_ALIGN - 1) / ROW_ALIGN) * ROW_ALIGN;
+  ScratchPool* pool = scratchPool();
+  long* p = pool ? pool->take(bytes) : nullptr;
+  if (p == nullptr) {
+    p = static_cast<long*>(std::aligned_alloc(ROW_ALIGN, bytes));
+    if (p == nullptr)
+      throw std::bad_alloc();
+    allocations.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  std::unique_ptr<long[], AlignedFree> newBuf(p, AlignedFree{bytes});
+  if (nRows > 0)
+    std::memcpy(newBuf.get(), buf.get(), sizeof(long) * nRows * stride);
+  buf = std::move(newBuf);
+  backing.reset();
+  // a pooled buffer may hold more rows than we asked for
+  capacity = (stride > 0) ? long(bytes / (sizeof(long) * stride)) : newCapacity;
+}
+
+// Replace the rows of a view by a copy in a buffer of our own
+void ResidueMap::copyRows()
+{
+  if (nRows == 0) {
+    buf.reset();
+    backing.reset();
+    capacity = 0;
+    return;
+  }
+  capacity = 0; // so that grow() reallocates, and drops the backing
+  grow(nRows);
+}
+
+void ResidueMap::reserve(long n) { grow(n); }
+
+void ResidueMap::insert(long j)
+{
+  if (indexSet.contains(j))
+    return;
+
+  grow(nRows + 1);
+  if (lsize(slot) <= j)
+    slot.resize(j + 1, -1);
+  slot[j] = nRows;
+  owner.push_back(j);
+  nRows++;
+  indexSet.insert(j);
+}
+
+void ResidueMap::insert(const IndexSet& s)
+{
+  if (s.card() > 0) {
+    grow(nRows + s.card());
+    if (lsize(slot) <= s.last())
+      slot.resize(s.last() + 1, -1);
+  }
+  for (long j : s)
+    insert(j);
+}
+
+void ResidueMap::remove(long j)
+{
+  if (!indexSet.contains(j))
+    return;
+
+  // Move the last row into the slot that was freed, to keep the buffer dense
+  detach();
+  long r = slot[j];
+  long last = nRows - 1;
+  if (r != last) {
+    std::memcpy(buf.get() + r * stride,
+                buf.get() + last * stride,
+                sizeof(long) * rowLen);
+    owner[r] = owner[last];
+    slot[owner[r]] = r;
+  }
+  owner.pop_back();
+  slot[j] = -1;
+  nRows--;
+  indexSet.remove(j);
+}
+
+void ResidueMap::remove(const IndexSet& s)
+{
+  if (&s == &indexSet) {
+    clear();
+    return;
+  }
+  for (long j : s)
+    remove(j);
+}
+
+void ResidueMap::setIndexSet(const IndexSet& s)
+{
+  remove(indexSet / s);
+  insert(s / indexSet);
+}
+
+void ResidueMap::clear()
+{
+  // A view does not keep its rows (nor their backing) to be written over
+  if (isView()) {
+    buf.reset();
+    backing.reset();
+    capacity = 0;
+  }
+  nRows = 0;
+  slot.clear();
+  owner.clear();
+  indexSet.clear();
+}
+
+bool operator==(const ResidueMap& map1, const ResidueMap& map2)
+{
+  if (map1.getIndexSet() != map2.getIndexSet())
+    return false;
+  if (map1.rowLength() != map2.rowLength())
+    return false;
+
+  long n = map1.rowLength();
+  for (long i : map1.getIndexSet())
+    if (!std::equal(map1[i], map1[i] + n, map2[i]))
+      return false;
+  return true;
+}
+
+} // namespace helib
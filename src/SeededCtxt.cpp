@@ -0,0 +1,108 @@
+/* Copyright (C) 2012-2020 IBM Corp.
+ * This program is Licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. See accompanying LICENSE file.
+ */
+/* SeededCtxt.cpp - Secret-key ciphertexts whose part 1 is kept as a seed
+ */
+#include <helib/SeededCtxt.h>
+#include <helib/CounterPRG.h>
+#include <helib/timing.h>
+#include "binio.h"
+
+namespace helib {
+
+SeededCtxt::SeededCtxt(const PubKey& pubKey) : ctxt(pubKey) {}
+
+Ctxt SeededCtxt::expand() const
+{
+  HELIB_TIMER_START;
+
+  assertFalse(isEmpty(), "Cannot expand an empty SeededCtxt");
+
+  // The same stream as in SecKey::skEncrypt, over the primes of the
+  // ciphertext only. DoubleCRT::randomize does the rows in parallel
+  Ctxt res(ctxt);
+  CtxtPart part(ctxt.getContext(), ctxt.primeSet, seededHandle);
+  part.randomize(CounterPRG(seed), /*stream=*/0);
+  res.parts.push_back(std::move(part));
+  return res;
+}
+
+void SeededCtxt::writeTo(std::ostream& str) const
+{
+  assertFalse(isEmpty(), "Cannot write an empty SeededCtxt");
+
+  SerializeHeader<SeededCtxt>().writeTo(str);
+  writeEyeCatcher(str, EyeCatcher::SCTXT_BEGIN);
+
+  /*  Writing out in binary:
+    1.  the fields of Ctxt::writeTo, up to primeSet
+    2.  CtxtPart part 0
+    3.  SKHandle of part 1
+    4.  the seed of part 1, SEED_BITS/8 little-endian bytes
+  */
+
+  write_raw_ZZ(str, ctxt.ptxtSpace);
+  write_raw_ZZ(str, ctxt.intFactor);
+  write_raw_xdouble(str, ctxt.ptxtMag);
+  write_raw_xdouble(str, ctxt.ratFactor);
+  write_raw_xdouble(str, ctxt.noiseBound);
+  ctxt.primeSet.writeTo(str);
+  ctxt.parts[0].writeTo(str);
+  seededHandle.writeTo(str);
+
+  unsigned char bytes[SEED_BITS / 8];
+  NTL::BytesFromZZ(bytes, seed, SEED_BITS / 8);
+  str.write(reinterpret_cast<const char*>(bytes), SEED_BITS / 8);
+
+  writeEyeCatcher(str, EyeCatcher::SCTXT_END);
+}
+
+SeededCtxt SeededCtxt::readFrom(std::istream& str, const PubKey& pubKey)
+{
+  SeededCtxt res(pubKey);
+  res.read(str);
+  return res;
+}
+
+void SeededCtxt::read(std::istream& str)
+{
+  const auto header = SerializeHeader<SeededCtxt>::readFrom(str);
+  assertTrue<IOError>(header.isReadableVersion(),
+                      "Header: version " + header.versionString() +
+                          " not supported");
+
+  bool eyeCatcherFound = readEyeCatcher(str, EyeCatcher::SCTXT_BEGIN);
+  assertTrue<IOError>(eyeCatcherFound,
+                      "Could not find pre-seeded-ciphertext eye catcher");
+
+  read_raw_ZZ(str, ctxt.ptxtSpace);
+  read_raw_ZZ(str, ctxt.intFactor);
+  ctxt.ptxtMag = read_raw_xdouble(str);
+  ctxt.ratFactor = read_raw_xdouble(str);
+  ctxt.noiseBound = read_raw_xdouble(str);
+  ctxt.primeSet = IndexSet::readFrom(str);
+  ctxt.parts.assign(1, CtxtPart(ctxt.getContext(), IndexSet::emptySet()));
+  ctxt.parts[0].read(str);
+  assertTrue<IOError>(ctxt.parts[0].getIndexSet() == ctxt.primeSet,
+                      "Part 0 of a seeded ciphertext is not over its primes");
+  seededHandle = SKHandle::readFrom(str);
+
+  unsigned char bytes[SEED_BITS / 8];
+  str.read(reinterpret_cast<char*>(bytes), SEED_BITS / 8);
+  assertTrue<IOError>(bool(str), "Could not read the seed of part 1");
+  NTL::ZZFromBytes(seed, bytes, SEED_BITS / 8);
+
+  eyeCatcherFound = readEyeCatcher(str, EyeCatcher::SCTXT_END);
+  assertTrue<IOError>(eyeCatcherFound,
+                      "Could not find post-seeded-ciphertext eye catcher");
+}
+
+} // namespace helib
@@ -11,7 +11,9 @@
  */
 #include "binio.h"
 #include <helib/assertions.h>
+#include <helib/MappedFile.h>
 #include <sys/types.h> // byte order macros in a platform-independent way.
+#include <cstring>
 
 namespace helib {
 
@@ -30,6 +32,23 @@ void writeEyeCatcher(std::ostream& str,
   str.write(eye.data(), eye.size());
 }
 
+// The slot of the streams that holds the flag of setMappableLayout
+static int mappableLayoutIndex()
+{
+  static const int index = std::ios_base::xalloc();
+  return index;
+}
+
+void setMappableLayout(std::ios_base& str, bool mappable)
+{
+  str.iword(mappableLayoutIndex()) = mappable;
+}
+
+bool hasMappableLayout(std::ios_base& str)
+{
+  return str.iword(mappableLayoutIndex()) != 0;
+}
+
 // compile only 64-bit (-m64) therefore long must be at least 64-bit
 long read_raw_int(std::istream& str)
 {
@@ -145,6 +164,184 @@ void read_ntl_vec_long(std::istream& str, NTL::vec_long& vl)
   }
 }
 
+void write_raw_long_row(std::ostream& str,
+                        const long* row,
+                        long len,
+                        long intSize)
+{
+  assertTrue<InvalidArgument>(intSize == Binio::BIT64 ||
+                                  intSize == Binio::BIT32,
+                              "intSize must be 32 or 64 bit for binary IO");
+  write_raw_int32(str, len);
+  write_raw_int32(str, intSize);
+
+  if (intSize == Binio::BIT64) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    str.write(reinterpret_cast<const char*>(row), len * Binio::BIT64);
+#else
+    for (long i = 0; i < len; i++) {
+      write_raw_int(str, row[i]);
+    }
+#endif
+  } else {
+    for (long i = 0; i < len; i++) {
+      write_raw_int32(str, row[i]);
+    }
+  }
+}
+
+// The 8 bytes at p as a little-endian word
+static inline std::uint64_t loadLE64(const unsigned char* p)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  std::uint64_t w;
+  std::memcpy(&w, p, sizeof(w));
+  return w;
+#else
+  std::uint64_t w = 0;
+  for (long i = 0; i < 8; i++)
+    w |= std::uint64_t(p[i]) << (8 * i);
+  return w;
+#endif
+}
+
+// Every 8 entries take exactly bits bytes, so each group of 8 starts on a
+// byte and entry j of a group is always at the same bit offset j*bits in it.
+// The inner loop has no data-dependent branches, and the loop over groups
+// is a plain strided one that the compiler can vectorize. in must be
+// readable for 8 bytes past the end of the packed data.
+static void unpackBits(long* row,
+                       const unsigned char* in,
+                       long len,
+                       long bits)
+{
+  const std::uint64_t mask = (std::uint64_t(1) << bits) - 1;
+  long groups = len / 8;
+  if (bits <= 57) { // an entry and its shift fit in one word
+    for (long g = 0; g < groups; g++) {
+      const unsigned char* base = in + g * bits;
+      long* out = row + 8 * g;
+      for (long j = 0; j < 8; j++) {
+        long off = j * bits;
+        out[j] = long((loadLE64(base + (off >> 3)) >> (off & 7)) & mask);
+      }
+    }
+  } else {
+    for (long g = 0; g < groups; g++) {
+      const unsigned char* base = in + g * bits;
+      long* out = row + 8 * g;
+      for (long j = 0; j < 8; j++) {
+        long off = j * bits;
+        long s = off & 7;
+        const unsigned char* p = base + (off >> 3);
+        // the top s bits come from the 9th byte (the shift by 8 - s keeps
+        // it defined when s == 0)
+        std::uint64_t w =
+            (loadLE64(p) >> s) | ((std::uint64_t(p[8]) << (8 - s)) << 56);
+        out[j] = long(w & mask);
+      }
+    }
+  }
+  for (long k = 8 * groups; k < len; k++) { // the last partial group
+    long off = k * bits;
+    long s = off & 7;
+    const unsigned char* p = in + (off >> 3);
+    std::uint64_t w =
+        (loadLE64(p) >> s) | ((std::uint64_t(p[8]) << (8 - s)) << 56);
+    row[k] = long(w & mask);
+  }
+}
+
+void write_packed_long_row(std::ostream& str,
+                           const long* row,
+                           long len,
+                           long bits)
+{
+  assertInRange<InvalidArgument>(bits,
+                                 1l,
+                                 63l,
+                                 "Packed rows take 1 to 63 bits per entry",
+                                 true);
+  write_raw_int32(str, len);
+  write_raw_int32(str, Binio::PACKED);
+  write_raw_int32(str, bits);
+
+  std::vector<unsigned char> buf((len * bits + 7) / 8);
+  unsigned char* out = buf.data();
+  // At most 7 + 63 bits are pending at any time
+  __extension__ typedef unsigned __int128 u128;
+  u128 acc = 0;
+  long pending = 0;
+  for (long k = 0; k < len; k++) {
+    std::uint64_t v = row[k];
+    if ((v >> bits) != 0)
+      throw InvalidArgument("Row entry does not fit in " +
+                            std::to_string(bits) + " bits");
+    acc |= static_cast<u128>(v) << pending;
+    pending += bits;
+    for (; pending >= 8; pending -= 8) {
+      *out++ = static_cast<unsigned char>(acc);
+      acc >>= 8;
+    }
+  }
+  if (pending > 0)
+    *out++ = static_cast<unsigned char>(acc);
+  str.write(reinterpret_cast<const char*>(buf.data()), buf.size());
+}
+
+void read_raw_long_row(std::istream& str, long* row, long len)
+{
+  int sizeOfRow = read_raw_int32(str);
+  int intSize = read_raw_int32(str);
+  read_raw_long_row_data(str, row, len, sizeOfRow, intSize);
+}
+
+void read_raw_long_row_data(std::istream& str,
+                            long* row,
+                            long len,
+                            int sizeOfRow,
+                            int intSize)
+{
+  assertTrue<InvalidArgument>(intSize == Binio::BIT64 ||
+                                  intSize == Binio::BIT32 ||
+                                  intSize == Binio::PACKED,
+                              "intSize must be 32 or 64 bit for binary IO");
+  if (sizeOfRow != len)
+    throw IOError("Row length mismatch: read " + std::to_string(sizeOfRow) +
+                  ", expected " + std::to_string(len));
+
+  if (intSize == Binio::PACKED) {
+    long bits = read_raw_int32(str);
+    assertInRange<IOError>(bits,
+                           1l,
+                           63l,
+                           "Packed row with " + std::to_string(bits) +
+                               " bits per entry",
+                           true);
+    // Thread-local, since keys and ciphertexts may be read in parallel
+    thread_local std::vector<unsigned char> tls_buf;
+    std::size_t nbytes = (len * bits + 7) / 8;
+    tls_buf.assign(nbytes + 8, 0); // 8 readable bytes past the end
+    str.read(reinterpret_cast<char*>(tls_buf.data()), nbytes);
+    if (!str)
+      throw IOError("Could not read a packed row of " + std::to_string(len) +
+                    " entries");
+    unpackBits(row, tls_buf.data(), len, bits);
+  } else if (intSize == Binio::BIT64) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    str.read(reinterpret_cast<char*>(row), len * Binio::BIT64);
+#else
+    for (long i = 0; i < len; i++) {
+      row[i] = read_raw_int(str);
+    }
+#endif
+  } else {
+    for (long i = 0; i < len; i++) {
+      row[i] = read_raw_int32(str);
+    }
+  }
+}
+
 void write_raw_double(std::ostream& str, const double d)
 {
   // FIXME: this is not portable:
@@ -29,8 +29,14 @@ struct Binio
 {
   static constexpr int BIT32 = 4;
   static constexpr int BIT64 = 8;
+  // Rows whose entries take just the bits they need, see write_packed_long_row
+  static constexpr int PACKED = 1;
+  // The rows of a DoubleCRT as they are in memory, see DoubleCRT::writeTo
+  static constexpr int ALIGNED = 2;
 
   static constexpr std::array<char, 4> VERSION_0_0_1_0 = {0, 0, 1, 0};
+  // The DoubleCRT rows of keys and ciphertexts are bit-packed
+  static constexpr std::array<char, 4> VERSION_0_0_2_0 = {0, 0, 2, 0};
 };
 
 struct EyeCatcher
@@ -49,6 +55,13 @@ struct EyeCatcher
   static constexpr std::array<char, SIZE> SK_END        = {']','S','K','|'};
   static constexpr std::array<char, SIZE> SKM_BEGIN     = {'|','K','M','['};
   static constexpr std::array<char, SIZE> SKM_END       = {']','K','M','|'};
+  static constexpr std::array<char, SIZE> SKM_PRG       = {'|','K','P','|'};
+  static constexpr std::array<char, SIZE> GK_BEGIN      = {'|','G','K','['};
+  static constexpr std::array<char, SIZE> GK_END        = {']','G','K','|'};
+  static constexpr std::array<char, SIZE> SCTXT_BEGIN   = {'|','S','X','['};
+  static constexpr std::array<char, SIZE> SCTXT_END     = {']','S','X','|'};
+  static constexpr std::array<char, SIZE> CCACHE_BEGIN  = {'|','C','C','['};
+  static constexpr std::array<char, SIZE> CCACHE_END    = {']','C','C','|'};
   // clang-format on
 };
 
@@ -63,6 +76,9 @@ class Context;
 class PubKey;
 class SecKey;
 class Ctxt;
+class SeededCtxt;
+// Only a tag for the header of a context cache (see Context::writeCacheTo)
+struct ContextCache;
 
 template <>
 inline constexpr char nameToStructId<Context>()
@@ -84,6 +100,44 @@ inline constexpr char nameToStructId<Ctxt>()
 {
   return 20;
 }
+template <>
+inline constexpr char nameToStructId<SeededCtxt>()
+{
+  return 25;
+}
+template <>
+inline constexpr char nameToStructId<ContextCache>()
+{
+  return 30;
+}
+
+// The version of the format in which T is written. Those with DoubleCRT
+// parts moved to 0.0.2.0 (bit-packed rows), the others are still 0.0.1.0
+template <typename T>
+inline constexpr std::array<char, 4> serializeVersion()
+{
+  return Binio::VERSION_0_0_1_0;
+}
+template <>
+inline constexpr std::array<char, 4> serializeVersion<PubKey>()
+{
+  return Binio::VERSION_0_0_2_0;
+}
+template <>
+inline constexpr std::array<char, 4> serializeVersion<SecKey>()
+{
+  return Binio::VERSION_0_0_2_0;
+}
+template <>
+inline constexpr std::array<char, 4> serializeVersion<Ctxt>()
+{
+  return Binio::VERSION_0_0_2_0;
+}
+template <>
+inline constexpr std::array<char, 4> serializeVersion<SeededCtxt>()
+{
+  return Binio::VERSION_0_0_2_0;
+}
 
 // Already broken into bytes, thus should be the same written and read in bog
 // or little endian.
@@ -94,7 +148,7 @@ struct SerializeHeader
   const std::array<char, EyeCatcher::SIZE> beginCatcher =
       EyeCatcher::HEADER_BEGIN;
   // 32 bit number: 8 bits for major, minor, patch, fix
-  const std::array<char, 4> version = Binio::VERSION_0_0_1_0;
+  const std::array<char, 4> version = serializeVersion<T>();
   // The helib version that output this header.
   const std::array<char, 4> helibVersion = {version::major,
                                             version::minor,
@@ -136,6 +190,14 @@ struct SerializeHeader
     return header;
   }
 
+  // Whether this build can read what follows the header: the current
+  // version of T, or 0.0.1.0 (the readers take both kinds of rows)
+  bool isReadableVersion() const
+  {
+    return version == serializeVersion<T>() ||
+           version == Binio::VERSION_0_0_1_0;
+  }
+
   std::string versionString() const
   {
     // version has only 4 numbers.
@@ -156,6 +218,31 @@ void write_ntl_vec_long(std::ostream& str,
                         long intSize = Binio::BIT64);
 void read_ntl_vec_long(std::istream& str, NTL::vec_long& vl);
 
+// Same format as write/read_ntl_vec_long, but for a raw row of len longs.
+// The reader raises an error if the stored length is not len.
+void write_raw_long_row(std::ostream& str,
+                        const long* row,
+                        long len,
+                        long intSize = Binio::BIT64);
+void read_raw_long_row(std::istream& str, long* row, long len);
+
+// The rest of a row whose length and intSize were already read, for readers
+// that must look at intSize first
+void read_raw_long_row_data(std::istream& str,
+                            long* row,
+                            long len,
+                            int sizeOfRow,
+                            int intSize);
+
+// A row of len entries in [0, 2^bits), 1 <= bits <= 63, written with just
+// bits bits each: int32 len, int32 Binio::PACKED, int32 bits, then the
+// ceil(len*bits/8) bytes of the entries as a little-endian bit stream.
+// read_raw_long_row reads these rows as well
+void write_packed_long_row(std::ostream& str,
+                           const long* row,
+                           long len,
+                           long bits);
+
 long read_raw_int(std::istream& str);
 int read_raw_int32(std::istream& str);
 void write_raw_int(std::ostream& str, long num);
@@ -1,3 +1,5 @@
+#include <fstream>
+#include <utility>
 #include <helib/c_galoiskey2k.h>
 #include <helib/GaloisKey2k.h>
 
@@ -31,3 +33,78 @@ C_FUNC GK_rotate(void *gk, void *ctxt, int step) {
     gk_->rotate(*ctxt_, step);
     return S_OK;
 }
+
+C_FUNC GK_generate_power_of_two_steps(void *gk, void *seckey) {
+    helib::GaloisKey2k *gk_ = FromVoid<helib::GaloisKey2k>(gk);
+    IfNullRet(gk_, E_POINTER);
+    helib::SecKey *seckey_ = FromVoid<helib::SecKey>(seckey);
+    IfNullRet(seckey_, E_POINTER);
+    gk_->generate_power_of_two_steps(*seckey_);
+    return S_OK;
+}
+
+C_FUNC GK_generate_steps(void *gk, void *seckey, const int *steps, long count, const char *path) {
+    helib::GaloisKey2k *gk_ = FromVoid<helib::GaloisKey2k>(gk);
+    IfNullRet(gk_, E_POINTER);
+    helib::SecKey *seckey_ = FromVoid<helib::SecKey>(seckey);
+    IfNullRet(seckey_, E_POINTER);
+    IfNullRet(steps, E_POINTER);
+    if (count < 0) {
+        return E_INVALIDARG;
+    }
+    std::vector<int32_t> steps_(steps, steps + count);
+    if (path == nullptr) {
+        gk_->generate_steps(*seckey_, steps_);
+        return S_OK;
+    }
+    std::ofstream str(path, std::ios::binary);
+    if (!str) {
+        return E_FAIL;
+    }
+    gk_->generate_steps(*seckey_, steps_, NTL::ZZ::zero(), &str);
+    return str ? S_OK : E_FAIL;
+}
+
+C_FUNC GK_rotate_many(void *gk, void *ctxt, const int *steps, long count, void **results) {
+    helib::GaloisKey2k *gk_ = FromVoid<helib::GaloisKey2k>(gk);
+    IfNullRet(gk_, E_POINTER);
+    helib::Ctxt *ctxt_ = FromVoid<helib::Ctxt>(ctxt);
+    IfNullRet(ctxt_, E_POINTER);
+    IfNullRet(steps, E_POINTER);
+    IfNullRet(results, E_POINTER);
+    if (count < 0) {
+        return E_INVALIDARG;
+    }
+    std::vector<int32_t> steps_(steps, steps + count);
+    std::vector<helib::Ctxt> rotated = gk_->rotateMany(*ctxt_, steps_);
+    for (long i = 0; i < count; i++) {
+        results[i] = new helib::Ctxt(std::move(rotated[i]));
+    }
+    return S_OK;
+}
+
+C_FUNC GK_save(void *gk, const char *path) {
+    helib::GaloisKey2k *gk_ = FromVoid<helib::GaloisKey2k>(gk);
+    IfNullRet(gk_, E_POINTER);
+    IfNullRet(path, E_POINTER);
+    std::ofstream str(path, std::ios::binary);
+    if (!str) {
+        return E_FAIL;
+    }
+    gk_->writeTo(str);
+    return str ? S_OK : E_FAIL;
+}
+
+C_FUNC GK_load(void *gk, void *context, const char *path) {
+    helib::GaloisKey2k *gk_ = FromVoid<helib::GaloisKey2k>(gk);
+    IfNullRet(gk_, E_POINTER);
+    helib::Context *context_ = FromVoid<helib::Context>(context);
+    IfNullRet(context_, E_POINTER);
+    IfNullRet(path, E_POINTER);
+    std::ifstream str(path, std::ios::binary);
+    if (!str) {
+        return E_FAIL;
+    }
+    gk_->read(str, *context_);
+    return S_OK;
+}
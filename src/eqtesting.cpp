@@ -78,8 +78,9 @@ void mapTo01(const EncryptedArray& ea, Ctxt& ctxt, bool multithread)
     long e = 1;
     long b = NTL::NumBits(d);
     Ctxt orig = ctxt;
+    Ctxt tmp(ZeroCtxtLike, ctxt); // reused, assigning keeps its buffers
     for (long i = b - 2; i >= 0; i--) {
-      Ctxt tmp = ctxt;
+      tmp = ctxt;
       tmp.frobeniusAutomorph(e);
       ctxt *= tmp;
       e *= 2;
@@ -166,10 +166,13 @@ static inline json toTypedJson(const json& tc)
           {"content", tc}};
 }
 
+// Raises an IOError unless the metadata of a typed JSON object is that of T
+// in this version of HElib
 template <typename T>
-static inline json fromTypedJson(const json& j)
+static inline void checkTypedJsonMetadata(const std::string& obj_ser_ver,
+                                          const std::string& obj_helib_ver,
+                                          const std::string& obj_ty)
 {
-  std::string obj_ser_ver = j.at("serializationVersion").get<std::string>();
   if (obj_ser_ver != jsonSerializationVersion) {
     std::stringstream sstr;
     sstr << "Serialization version mismatch.  Expected: "
@@ -177,7 +180,6 @@ static inline json fromTypedJson(const json& j)
     throw IOError(sstr.str());
   }
 
-  std::string obj_helib_ver = j.at("HElibVersion").get<std::string>();
   if (obj_helib_ver != version::asString) {
     std::stringstream sstr;
     sstr << "HElib version mismatch.  Expected: " << version::asString
@@ -185,13 +187,21 @@ static inline json fromTypedJson(const json& j)
     throw IOError(sstr.str());
   }
 
-  std::string obj_ty = j.at("type").get<std::string>();
   if (obj_ty != T::typeName) {
     std::stringstream fmt;
     fmt << "Type mismatch deserializing json object."
         << "  Expected: " << T::typeName << " actual: " << obj_ty;
     throw IOError(fmt.str());
   }
+}
+
+template <typename T>
+static inline json fromTypedJson(const json& j)
+{
+  std::string obj_ser_ver = j.at("serializationVersion").get<std::string>();
+  std::string obj_helib_ver = j.at("HElibVersion").get<std::string>();
+  std::string obj_ty = j.at("type").get<std::string>();
+  checkTypedJsonMetadata<T>(obj_ser_ver, obj_helib_ver, obj_ty);
   return j.at("content");
 }
 
@@ -15,15 +15,20 @@
  *
  * Copyright IBM Corporation 2012 All rights reserved.
  */
+#include <atomic>
+#include <list>
 #include <unordered_set>
 #include <NTL/ZZ.h>
 #include <helib/permutations.h>
 
 #include "binio.h"
 #include "io.h"
+#include "JsonStream.h"
 
 #include <helib/keySwitching.h>
 #include <helib/keys.h>
+#include <helib/CounterPRG.h>
+#include <helib/multicore.h>
 #include <helib/apiAttributes.h>
 #include <helib/log.h>
 
@@ -57,6 +62,8 @@ bool KeySwitch::operator==(const KeySwitch& other) const
 
   if (prgSeed != other.prgSeed)
     return false;
+  if (prgKind != other.prgKind)
+    return false;
 
   if (b.size() != other.b.size())
     return false;
@@ -75,6 +82,178 @@ unsigned long KeySwitch::NumCols() const { return b.size(); }
 
 bool KeySwitch::isDummy() const { return (toKeyID == -1); }
 
+struct KeySwitch::ACache
+{
+  HELIB_MUTEX_TYPE mutex;
+  // Set (with release) only once a is complete; a is never changed after
+  // that, so a reader that sees it set (with acquire) may use a unlocked
+  std::atomic<bool> ready{false};
+  std::vector<DoubleCRT> a;
+};
+
+void KeySwitch::generateA(std::vector<DoubleCRT>& a,
+                          const Context& context,
+                          const IndexSet& s,
+                          long n) const
+{
+  a.clear();
+
+  if (prgKind == PrgKind::NTL_STREAM) {
+    // The stream runs over every prime of every ai, so they must all be
+    // generated in full, one after the other
+    a.resize(n, DoubleCRT(context, context.fullPrimes()));
+    RandomState state; // the destructor "restores the state" (see NumbTh.h)
+    SetSeed(prgSeed);
+    for (long i = 0; i < n; i++)
+      a[i].randomize();
+    return;
+  }
+
+  assertTrue(prgKind == PrgKind::COUNTER, "Unknown KeySwitch::PrgKind");
+  CounterPRG prg(prgSeed);
+  a.resize(n, DoubleCRT(context, s));
+  for (long i = 0; i < n; i++)
+    a[i].randomize(prg, i);
+}
+
+const std::vector<DoubleCRT>& KeySwitch::getA(std::vector<DoubleCRT>& scratch,
+                                              const IndexSet& s,
+                                              long n) const
+{
+  assertInRange(n, 0L, lsize(b), "Not enough columns", true);
+  if (n == 0) {
+    scratch.clear();
+    return scratch;
+  }
+  const Context& context = b[0].getContext();
+
+  std::shared_ptr<ACache> cache = aCache;
+  if (!cache) {
+    generateA(scratch, context, s, n);
+    return scratch;
+  }
+
+  // Keep all the ai's over all the primes, so they serve every key switch
+  HELIB_MUTEX_GUARD(cache->mutex);
+  if (!cache->ready.load(std::memory_order_relaxed)) {
+    generateA(cache->a, context, context.fullPrimes(), lsize(b));
+    cache->ready.store(true, std::memory_order_release);
+  }
+  return cache->a;
+}
+
+void KeySwitch::setACaching(ACaching policy) const
+{
+  aCaching = policy;
+  aCache.reset();
+  if (policy == ACaching::NONE)
+    return;
+
+  aCache = std::make_shared<ACache>();
+  if (policy == ACaching::EAGER && !b.empty()) {
+    const Context& context = b[0].getContext();
+    generateA(aCache->a, context, context.fullPrimes(), lsize(b));
+    aCache->ready.store(true, std::memory_order_release);
+  }
+}
+
+struct KeySwitch::TCache
+{
+  HELIB_MUTEX_TYPE mutex;
+  // The most recently used first
+  std::list<std::shared_ptr<const Truncated>> copies;
+  std::size_t bytes = 0;
+};
+
+std::shared_ptr<const KeySwitch::Truncated> KeySwitch::getTruncated(
+    const IndexSet& s) const
+{
+  std::shared_ptr<TCache> cache = tCache;
+  if (!cache || b.empty())
+    return nullptr;
+
+  const IndexSet& full = b[0].getIndexSet();
+  if (s == full || !(s <= full) ||
+      s.card() > truncation.maxFraction * full.card())
+    return nullptr;
+
+  // Moves the copy over s, if there is one, to the front of the list
+  auto lookUp = [&cache, &s]() -> std::shared_ptr<const Truncated> {
+    for (auto it = cache->copies.begin(); it != cache->copies.end(); ++it)
+      if ((*it)->primes == s) {
+        cache->copies.splice(cache->copies.begin(), cache->copies, it);
+        return cache->copies.front();
+      }
+    return nullptr;
+  };
+  {
+    HELIB_MUTEX_GUARD(cache->mutex);
+    if (std::shared_ptr<const Truncated> found = lookUp())
+      return found;
+  }
+
+  // The ai's are copied too if they are kept and complete, otherwise they
+  // are generated over s anyway. A lazy cache may be filled by another
+  // thread's key switch meanwhile, so ready is read with acquire: once it is
+  // seen set, kept->a is complete and no longer written
+  const Context& context = b[0].getContext();
+  std::shared_ptr<ACache> kept = aCache;
+  bool withA = kept && kept->ready.load(std::memory_order_acquire);
+  std::size_t bytes = std::size_t(s.card()) * context.getPhiM() *
+                      sizeof(long) * b.size() * (withA ? 2 : 1);
+  if (bytes > truncation.budget)
+    return nullptr;
+
+  // The copy is made without holding the lock, so that the key switches
+  // over other prime sets are not held up by it.
+  // Adding to zero over s only reads the rows of s
+  auto truncate = [&](std::vector<DoubleCRT>& out,
+                      const std::vector<DoubleCRT>& in) {
+    out.reserve(in.size());
+    for (const DoubleCRT& x : in) {
+      out.emplace_back(context, s);
+      out.back().Add(x, /*matchIndexSets=*/false);
+    }
+  };
+  auto t = std::make_shared<Truncated>();
+  t->primes = s;
+  t->bytes = bytes;
+  truncate(t->b, b);
+  if (withA)
+    truncate(t->a, kept->a);
+
+  // If another thread made a copy over s in the meantime, that one is kept
+  HELIB_MUTEX_GUARD(cache->mutex);
+  if (std::shared_ptr<const Truncated> found = lookUp())
+    return found;
+  cache->copies.push_front(t);
+  cache->bytes += bytes;
+  while (cache->bytes > truncation.budget) {
+    cache->bytes -= cache->copies.back()->bytes;
+    cache->copies.pop_back();
+  }
+  return t;
+}
+
+void KeySwitch::setTruncation(const TruncationPolicy& policy) const
+{
+  assertTrue<InvalidArgument>(policy.maxFraction >= 0.0,
+                              "maxFraction must be non-negative");
+  truncation = policy;
+  tCache.reset();
+  if (policy.budget > 0)
+    tCache = std::make_shared<TCache>();
+}
+
+std::size_t KeySwitch::truncatedBytes() const
+{
+  std::shared_ptr<TCache> cache = tCache;
+  if (!cache)
+    return 0;
+  HELIB_MUTEX_GUARD(cache->mutex);
+  return cache->bytes;
+}
+
 void KeySwitch::verify(SecKey& sk)
 {
   long fromSPower = fromKey.getPowerOfS();
@@ -127,16 +306,7 @@ void KeySwitch::verify(SecKey& sk)
   std::cout << "IndexSet of toKey: " << _toKey.getMap().getIndexSet() << "\n";
 
   std::vector<DoubleCRT> a;
-  a.resize(n, DoubleCRT(context, fullPrimes)); // defined modulo all primes
-
-  {
-    RandomState state;
-
-    SetSeed(prgSeed);
-    for (long i = 0; i < n; i++)
-      a[i].randomize();
-
-  } // the RandomState destructor "restores the state" (see NumbTh.h)
+  generateA(a, context, fullPrimes, n); // defined modulo all primes
 
   std::vector<NTL::ZZX> A, B;
 
@@ -193,6 +363,16 @@ void KeySwitch::readMatrix(std::istream& str, const Context& context)
   this->readJSON(str, context);
 }
 
+static KeySwitch::PrgKind prgKindFromLong(long kind)
+{
+  assertInRange<IOError>(kind,
+                         static_cast<long>(KeySwitch::PrgKind::NTL_STREAM),
+                         static_cast<long>(KeySwitch::PrgKind::COUNTER),
+                         "Unknown KeySwitch PRG kind",
+                         /*right_inclusive=*/true);
+  return static_cast<KeySwitch::PrgKind>(kind);
+}
+
 void KeySwitch::writeTo(std::ostream& str) const
 {
   writeEyeCatcher(str, EyeCatcher::SKM_BEGIN);
@@ -204,6 +384,7 @@ void KeySwitch::writeTo(std::ostream& str) const
       4. vector<DoubleCRT> b;
       5. ZZ prgSeed;
       6. xdouble noiseBound;
+      7. (only if not NTL_STREAM) PrgKind prgKind;
   */
 
   fromKey.writeTo(str);
@@ -215,6 +396,13 @@ void KeySwitch::writeTo(std::ostream& str) const
   write_raw_ZZ(str, prgSeed);
   write_raw_xdouble(str, noiseBound);
 
+  // Matrices with NTL-stream ai's are written as they always were, the
+  // others record how their ai's are generated
+  if (prgKind != PrgKind::NTL_STREAM) {
+    writeEyeCatcher(str, EyeCatcher::SKM_PRG);
+    write_raw_int(str, static_cast<long>(prgKind));
+  }
+
   writeEyeCatcher(str, EyeCatcher::SKM_END);
 }
 
@@ -227,18 +415,31 @@ KeySwitch KeySwitch::readFrom(std::istream& str, const Context& context)
 
   ret.fromKey = SKHandle::readFrom(str);
   ret.toKeyID = read_raw_int(str);
-  ret.ptxtSpace = read_raw_int(str);
+  read_raw_ZZ(str, ret.ptxtSpace); // written with write_raw_ZZ
   ret.b = read_raw_vector<DoubleCRT>(str, context);
   read_raw_ZZ(str, ret.prgSeed);
   ret.noiseBound = read_raw_xdouble(str);
 
-  eyeCatcherFound = readEyeCatcher(str, EyeCatcher::SKM_END);
+  std::array<char, EyeCatcher::SIZE> eye;
+  str.read(eye.data(), EyeCatcher::SIZE);
+  if (eye == EyeCatcher::SKM_PRG) {
+    ret.prgKind = prgKindFromLong(read_raw_int(str));
+    eyeCatcherFound = readEyeCatcher(str, EyeCatcher::SKM_END);
+  } else {
+    eyeCatcherFound = (eye == EyeCatcher::SKM_END);
+  }
   assertTrue(eyeCatcherFound, "Could not find post-secret key eyecatcher");
 
   return ret;
 }
 
-void KeySwitch::writeToJSON(std::ostream& str) const { str << writeToJSON(); }
+void KeySwitch::writeToJSON(std::ostream& str) const
+{
+  executeRedirectJsonError<void>([&]() {
+    JsonWriter writer(str);
+    this->writeToJSON(writer);
+  });
+}
 
 JsonWrapper KeySwitch::writeToJSON() const
 {
@@ -257,15 +458,17 @@ JsonWrapper KeySwitch::writeToJSON() const
             {"b", writeVectorToJSON(b)},
             {"prgSeed", prgSeed},
             {"noiseBound", noiseBound}};
+  if (prgKind != PrgKind::NTL_STREAM)
+    j["prgKind"] = static_cast<long>(prgKind);
 
   return wrap(toTypedJson<KeySwitch>(j));
 }
 
 KeySwitch KeySwitch::readFromJSON(std::istream& str, const Context& context)
 {
-  json j;
-  str >> j;
-  return KeySwitch::readFromJSON(wrap(j), context);
+  KeySwitch res;
+  res.readJSON(str, context);
+  return res;
 }
 
 KeySwitch KeySwitch::readFromJSON(const JsonWrapper& jw, const Context& context)
@@ -277,9 +480,10 @@ KeySwitch KeySwitch::readFromJSON(const JsonWrapper& jw, const Context& context)
 
 void KeySwitch::readJSON(std::istream& str, const Context& context)
 {
-  json j;
-  str >> j;
-  this->readJSON(wrap(j), context);
+  executeRedirectJsonError<void>([&]() {
+    JsonReader reader(str);
+    this->readJSON(reader, context);
+  });
 }
 
 void KeySwitch::readJSON(const JsonWrapper& jw, const Context& context)
@@ -293,6 +497,75 @@ void KeySwitch::readJSON(const JsonWrapper& jw, const Context& context)
   this->b = readVectorFromJSON<DoubleCRT>(j.at("b"), context);
   this->prgSeed = j.at("prgSeed").get<NTL::ZZ>();
   this->noiseBound = j.at("noiseBound").get<NTL::xdouble>();
+  this->prgKind = j.contains("prgKind")
+                      ? prgKindFromLong(j.at("prgKind").get<long>())
+                      : PrgKind::NTL_STREAM;
+  setACaching(aCaching); // drop the ai's of the previous matrix, if kept
+  setTruncation(truncation); // and its truncated copies
+}
+
+void KeySwitch::writeToJSON(JsonWriter& writer) const
+{
+  // The keys are sorted, as in the json objects
+  writeTypedJson<KeySwitch>(writer, [&]() {
+    writer.beginObject();
+    writer.key("b");
+    writer.beginArray();
+    for (const DoubleCRT& bi : b)
+      bi.writeToJSON(writer);
+    writer.endArray();
+    writer.key("fromKey");
+    writer.value(unwrap(this->fromKey.writeToJSON()));
+    writer.key("noiseBound");
+    writer.value(noiseBound);
+    if (prgKind != PrgKind::NTL_STREAM) {
+      writer.key("prgKind");
+      writer.value(static_cast<long>(prgKind));
+    }
+    writer.key("prgSeed");
+    writer.value(prgSeed);
+    writer.key("ptxtSpace");
+    writer.value(this->ptxtSpace);
+    writer.key("toKeyID");
+    writer.value(this->toKeyID);
+    writer.endObject();
+  });
+}
+
+void KeySwitch::readJSON(JsonReader& reader, const Context& context)
+{
+  auto readB = [&]() {
+    this->b.clear();
+    reader.beginArray();
+    while (reader.nextElement()) {
+      this->b.emplace_back(context, IndexSet::emptySet());
+      this->b.back().readJSON(reader);
+    }
+  };
+
+  this->prgKind = PrgKind::NTL_STREAM;
+  readTypedJson<KeySwitch>(reader, [&]() {
+    reader.readObject(
+        {{"b", readB},
+         {"fromKey",
+          [&]() {
+            this->fromKey = SKHandle::readFromJSON(wrap(reader.readValue()));
+          }},
+         {"noiseBound",
+          [&]() {
+            this->noiseBound = reader.readValue().get<NTL::xdouble>();
+          }},
+         {"prgKind",
+          [&]() { this->prgKind = prgKindFromLong(reader.readLong()); },
+          /*required=*/false},
+         {"prgSeed",
+          [&]() { this->prgSeed = reader.readValue().get<NTL::ZZ>(); }},
+         {"ptxtSpace",
+          [&]() { this->ptxtSpace = reader.readValue().get<NTL::ZZ>(); }},
+         {"toKeyID", [&]() { this->toKeyID = reader.readLong(); }}});
+  });
+  setACaching(aCaching); // drop the ai's of the previous matrix, if kept
+  setTruncation(truncation); // and its truncated copies
 }
 
 long KSGiantStepSize(long D)
@@ -311,11 +584,13 @@ void addAllMatrices(SecKey& sKey, long keyID)
   long m = context.getM();
 
   // key-switching matrices for the automorphisms
+  std::vector<long> vals;
   for (long i = 0; i < m; i++) {
     if (!context.getZMStar().inZmStar(i))
       continue;
-    sKey.GenKeySWmatrix(1, i, keyID, keyID);
+    vals.push_back(i);
   }
+  sKey.GenKeySWmatrices(1, vals, keyID, keyID);
   sKey.setKeySwitchMap(); // re-compute the key-switching map
 }
 
@@ -378,10 +653,10 @@ static void add1Dmats4dim(SecKey& sKey, long i, long keyID)
 */
 }
 #else
-// adds all matrices for dim i.
+// adds to vals the powers of X of all matrices for dim i.
 // i == -1 => Frobenius (NOTE: in matmul1D, i ==#gens means something else,
 //   so it is best to avoid that).
-static void add1Dmats4dim(SecKey& sKey, long i, long keyID)
+static void add1Dmats4dim(std::vector<long>& vals, SecKey& sKey, long i)
 {
   const PAlgebra& zMStar = sKey.getContext().getZMStar();
   long ord;
@@ -397,10 +672,10 @@ static void add1Dmats4dim(SecKey& sKey, long i, long keyID)
   }
 
   for (long j = 1; j < ord; j++)
-    sKey.GenKeySWmatrix(1, zMStar.genToPow(i, j), keyID, keyID);
+    vals.push_back(zMStar.genToPow(i, j));
 
   if (!native)
-    sKey.GenKeySWmatrix(1, zMStar.genToPow(i, -ord), keyID, keyID);
+    vals.push_back(zMStar.genToPow(i, -ord));
 
   sKey.setKSStrategy(i, HELIB_KSS_FULL);
 }
@@ -528,10 +803,10 @@ MAUTO
 
 #else
 // same as above, but uses BS/GS strategy
-static void addSome1Dmats4dim(SecKey& sKey,
+static void addSome1Dmats4dim(std::vector<long>& vals,
+                              SecKey& sKey,
                               long i,
-                              UNUSED long bound,
-                              long keyID)
+                              UNUSED long bound)
 {
   const PAlgebra& zMStar = sKey.getContext().getZMStar();
   long ord;
@@ -550,14 +825,14 @@ static void addSome1Dmats4dim(SecKey& sKey,
 
   // baby steps
   for (long j = 1; j < g; j++)
-    sKey.GenKeySWmatrix(1, zMStar.genToPow(i, j), keyID, keyID);
+    vals.push_back(zMStar.genToPow(i, j));
 
   // giant steps
   for (long j = g; j < ord; j += g)
-    sKey.GenKeySWmatrix(1, zMStar.genToPow(i, j), keyID, keyID);
+    vals.push_back(zMStar.genToPow(i, j));
 
   if (!native)
-    sKey.GenKeySWmatrix(1, zMStar.genToPow(i, -ord), keyID, keyID);
+    vals.push_back(zMStar.genToPow(i, -ord));
 
   sKey.setKSStrategy(i, HELIB_KSS_BSGS);
 
@@ -577,14 +852,17 @@ void addSome1DMatrices(SecKey& sKey, long bound, long keyID)
 {
   const Context& context = sKey.getContext();
 
-  // key-switching matrices for the automorphisms
+  // key-switching matrices for the automorphisms, generated together
+  // so that the threads are shared by all the dimensions
+  std::vector<long> vals;
   for (long i : range(context.getZMStar().numOfGens())) {
     // For generators of small order, add all the powers
     if (bound >= context.getZMStar().OrderOf(i))
-      add1Dmats4dim(sKey, i, keyID);
+      add1Dmats4dim(vals, sKey, i);
     else // For generators of large order, add only some of the powers
-      addSome1Dmats4dim(sKey, i, bound, keyID);
+      addSome1Dmats4dim(vals, sKey, i, bound);
   }
+  sKey.GenKeySWmatrices(1, vals, keyID, keyID);
   sKey.setKeySwitchMap(); // re-compute the key-switching map
 }
 
@@ -602,11 +880,13 @@ void addBSGS1DMatrices(SecKey& sKey, long keyID)
 void addSomeFrbMatrices(SecKey& sKey, long bound, long keyID)
 {
   const Context& context = sKey.getContext();
+  std::vector<long> vals;
   if (bound >= LONG(context.getOrdP()))
-    add1Dmats4dim(sKey, -1, keyID);
+    add1Dmats4dim(vals, sKey, -1);
   else // For generators of large order, add only some of the powers
-    addSome1Dmats4dim(sKey, -1, bound, keyID);
+    addSome1Dmats4dim(vals, sKey, -1, bound);
 
+  sKey.GenKeySWmatrices(1, vals, keyID, keyID);
   sKey.setKeySwitchMap(); // re-compute the key-switching map
 }
 
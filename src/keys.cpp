@@ -16,9 +16,16 @@
 * Added functionallity for separating the SK, PK, and key switching matrices.
 */
 
+#include <algorithm>
 #include <queue>
+#include <sstream>
+#include <unordered_set>
+
+#include <NTL/BasicThreadPool.h>
 
 #include <helib/keys.h>
+#include <helib/SeededCtxt.h>
+#include <helib/CounterPRG.h>
 #include <helib/timing.h>
 #include <helib/EncryptedArray.h>
 #include <helib/Ptxt.h>
@@ -31,6 +38,7 @@
 #include "internal_symbols.h" // DECRYPT_ON_PWFL_BASIS
 
 #include "io.h"
+#include "JsonStream.h"
 
 namespace helib {
 
@@ -84,6 +92,21 @@ double RLWE(DoubleCRT& c0,
   return RLWE1(c0, c1, s, p);
 }
 
+// As RLWE, but for secret-key encryption: with a prgSeed, c1 is drawn from
+// CounterPRG(*prgSeed), so each of its rows can later be expanded from the
+// seed and its prime alone (see SeededCtxt)
+static double skRLWE(DoubleCRT& c0,
+                     DoubleCRT& c1,
+                     const DoubleCRT& s,
+                     NTL::ZZ& p,
+                     const NTL::ZZ* prgSeed)
+{
+  if (prgSeed == nullptr)
+    return RLWE(c0, c1, s, p);
+  c1.randomize(CounterPRG(*prgSeed), /*stream=*/0);
+  return RLWE1(c0, c1, s, p);
+}
+
 /******************** PubKey implementation **********************/
 /********************************************************************/
 // Computes the keySwitchMap pointers, using breadth-first search (BFS)
@@ -109,6 +132,20 @@ PubKey::PubKey(const PubKey& other) :
   recryptEkey.privateAssign(other.recryptEkey);
 }
 
+PubKey::PubKey(PubKey&& other) :
+    context(other.context),
+    pubEncrKey(*this),
+    skBounds(std::move(other.skBounds)),
+    keySwitching(std::move(other.keySwitching)),
+    keySwitchMap(std::move(other.keySwitchMap)),
+    KS_strategy(std::move(other.KS_strategy)),
+    recryptKeyID(other.recryptKeyID),
+    recryptEkey(*this)
+{
+  pubEncrKey.privateAssign(std::move(other.pubEncrKey));
+  recryptEkey.privateAssign(std::move(other.recryptEkey));
+}
+
 void PubKey::clear()
 {
   pubEncrKey.clear();
@@ -934,10 +971,9 @@ void PubKey::writeTo(std::ostream& str) const
 PubKey PubKey::readFrom(std::istream& str, const Context& context)
 {
   const auto header = SerializeHeader<PubKey>::readFrom(str);
-  assertEq<IOError>(header.version,
-                    Binio::VERSION_0_0_1_0,
-                    "Header: version " + header.versionString() +
-                        " not supported");
+  assertTrue<IOError>(header.isReadableVersion(),
+                      "Header: version " + header.versionString() +
+                          " not supported");
 
   bool eyeCatcherFound = readEyeCatcher(str, EyeCatcher::PK_BEGIN);
   assertTrue<IOError>(eyeCatcherFound,
@@ -986,7 +1022,10 @@ PubKey PubKey::readFrom(std::istream& str, const Context& context)
 
 void PubKey::writeToJSON(std::ostream& str) const
 {
-  executeRedirectJsonError<void>([&]() { str << writeToJSON(); });
+  executeRedirectJsonError<void>([&]() {
+    JsonWriter writer(str);
+    this->writeToJSON(writer);
+  });
 }
 
 JsonWrapper PubKey::writeToJSON() const
@@ -1009,11 +1048,9 @@ JsonWrapper PubKey::writeToJSON() const
 
 PubKey PubKey::readFromJSON(std::istream& str, const Context& context)
 {
-  return executeRedirectJsonError<PubKey>([&]() {
-    json j;
-    str >> j;
-    return readFromJSON(wrap(j), context);
-  });
+  PubKey pk{context};
+  pk.readJSON(str);
+  return pk;
 }
 
 PubKey PubKey::readFromJSON(const JsonWrapper& jw, const Context& context)
@@ -1026,9 +1063,8 @@ PubKey PubKey::readFromJSON(const JsonWrapper& jw, const Context& context)
 void PubKey::readJSON(std::istream& str)
 {
   executeRedirectJsonError<void>([&]() {
-    json j;
-    str >> j;
-    readJSON(wrap(j));
+    JsonReader reader(str);
+    this->readJSON(reader);
   });
 }
 
@@ -1071,6 +1107,112 @@ void PubKey::readJSON(const JsonWrapper& tjw)
   executeRedirectJsonError<void>(body);
 }
 
+void PubKey::writeToJSON(JsonWriter& writer) const
+{
+  // The keys are sorted, as in the json objects
+  writeTypedJson<PubKey>(writer, [&]() {
+    writer.beginObject();
+    writer.key("KS_strategy");
+    writer.value(this->KS_strategy);
+    writer.key("context");
+    writer.value(unwrap(this->getContext().writeToJSON()));
+    writer.key("keySwitchMap");
+    writer.beginArray();
+    for (const std::vector<long>& row : this->keySwitchMap)
+      writer.row(row.data(), row.size());
+    writer.endArray();
+    writer.key("keySwitching");
+    writer.beginArray();
+    for (const KeySwitch& ks : keySwitching)
+      ks.writeToJSON(writer);
+    writer.endArray();
+    writer.key("pubEncrKey");
+    this->pubEncrKey.writeToJSON(writer);
+    writer.key("recryptEkey");
+    if (this->recryptKeyID >= 0)
+      this->recryptEkey.writeToJSON(writer);
+    else
+      writer.value("nullptr");
+    writer.key("recryptKeyID");
+    writer.value(this->recryptKeyID);
+    writer.key("skBounds");
+    writer.value(this->skBounds);
+    writer.endObject();
+  });
+}
+
+void PubKey::readJSON(JsonReader& reader)
+{
+  // Everything is read aside, and moved into the key once all of it is read
+  Ctxt encrKey(*this);
+  std::vector<double> bounds;
+  std::vector<KeySwitch> matrices;
+  std::vector<std::vector<long>> switchMap;
+  NTL::Vec<long> strategy;
+  long recryptID = -1;
+  Ctxt recryptKey(*this);
+  bool hasRecryptKey = false;
+
+  auto readContext = [&]() {
+    Context ser_context = Context::readFromJSON(wrap(reader.readValue()));
+    assertEq(context, ser_context, "Context mismatch");
+  };
+  auto readSwitchMap = [&]() {
+    reader.beginArray();
+    while (reader.nextElement()) {
+      std::vector<long>& row = switchMap.emplace_back();
+      reader.beginArray();
+      while (reader.nextElement())
+        row.push_back(reader.readLong());
+    }
+  };
+  auto readMatrices = [&]() {
+    reader.beginArray();
+    while (reader.nextElement()) {
+      matrices.emplace_back();
+      matrices.back().readJSON(reader, context);
+    }
+  };
+  auto readRecryptKey = [&]() {
+    // "nullptr" when there is no bootstrapping key
+    if (reader.peek() == '"') {
+      reader.skipValue();
+    } else {
+      recryptKey.readJSON(reader);
+      hasRecryptKey = true;
+    }
+  };
+
+  readTypedJson<PubKey>(reader, [&]() {
+    reader.readObject(
+        {{"KS_strategy",
+          [&]() { strategy = reader.readValue().get<NTL::Vec<long>>(); }},
+         {"context", readContext},
+         {"keySwitchMap", readSwitchMap},
+         {"keySwitching", readMatrices},
+         {"pubEncrKey", [&]() { encrKey.readJSON(reader); }},
+         {"recryptEkey", readRecryptKey, /*required=*/false},
+         {"recryptKeyID", [&]() { recryptID = reader.readLong(); }},
+         {"skBounds",
+          [&]() { bounds = reader.readValue().get<std::vector<double>>(); }}});
+  });
+  assertTrue<IOError>(recryptID < 0 || hasRecryptKey,
+                      "Missing key 'recryptEkey'");
+
+  this->clear();
+  this->pubEncrKey = std::move(encrKey);
+  this->skBounds = std::move(bounds);
+  this->keySwitching = std::move(matrices);
+  this->keySwitchMap = std::move(switchMap);
+  // build the key-switching map for all keys
+  for (long i = this->skBounds.size() - 1; i >= 0; i--)
+    this->setKeySwitchMap(i);
+  this->KS_strategy = strategy;
+  this->recryptKeyID = recryptID;
+  if (this->recryptKeyID >= 0)
+    this->recryptEkey = std::move(recryptKey);
+}
+
 /******************** SecKey implementation **********************/
 /********************************************************************/
 
@@ -1187,6 +1329,17 @@ void SecKey::GenKeySWmatrix(long fromSPower,
   if (haveKeySWmatrix(fromSPower, fromXPower, fromIdx, toIdx))
     return; // nothing to do here
 
+  // Push the new matrix onto our list
+  keySwitching.push_back(
+      buildKeySWmatrix(fromSPower, fromXPower, fromIdx, toIdx, p));
+}
+
+KeySwitch SecKey::buildKeySWmatrix(long fromSPower,
+                                   long fromXPower,
+                                   long fromIdx,
+                                   long toIdx,
+                                   NTL::ZZ p) const
+{
   DoubleCRT fromKey = sKeys.at(fromIdx);    // copy object, not a reference
   const DoubleCRT& toKey = sKeys.at(toIdx); // this can be a reference
 
@@ -1208,17 +1361,10 @@ void SecKey::GenKeySWmatrix(long fromSPower,
       n,
       DoubleCRT(context, context.getCtxtPrimes() | context.getSpecialPrimes()));
 
+  // the pseudorandom ai's, one CounterPRG stream per column and prime
+  ksMatrix.prgKind = KeySwitch::PrgKind::COUNTER;
   std::vector<DoubleCRT> a;
-  a.resize(
-      n,
-      DoubleCRT(context, context.getCtxtPrimes() | context.getSpecialPrimes()));
-
-  {
-    RandomState state;
-    SetSeed(ksMatrix.prgSeed);
-    for (long i = 0; i < n; i++)
-      a[i].randomize();
-  } // restore state upon destruction of state
+  ksMatrix.generateA(a, context, context.fullPrimes(), n);
 
   // Record the plaintext space for this key-switching matrix
   if (isCKKS())
@@ -1256,9 +1402,6 @@ void SecKey::GenKeySWmatrix(long fromSPower,
     fromKey *= context.productOfPrimes(context.getDigit(i));
   }
 
-  // Push the new matrix onto our list
-  keySwitching.push_back(ksMatrix);
-
 #if 0
   // HERE
   std::cout
@@ -1267,6 +1410,97 @@ void SecKey::GenKeySWmatrix(long fromSPower,
     << toIdx << " " << p << " "
     << (log(ksMatrix.noiseBound)/log(2.0)) << "\n";
 #endif
+  return ksMatrix;
+}
+
+// Seed the PRG of the calling thread for one matrix of GenKeySWmatrices.
+// SetSeed hashes the string, so that the streams of different matrices
+// look independent even though they come from the same seed. The seed
+// determines the errors of the matrices, so it is as secret as the key.
+static void setKeySWmatrixSeed(const NTL::ZZ& seed,
+                               long fromSPower,
+                               long fromXPower,
+                               long fromIdx,
+                               long toIdx)
+{
+  std::stringstream ss;
+  ss << seed << ' ' << fromSPower << ' ' << fromXPower << ' ' << fromIdx
+     << ' ' << toIdx;
+  std::string s = ss.str();
+  NTL::SetSeed((const unsigned char*)s.c_str(), s.size());
+}
+
+void SecKey::buildKeySWmatrices(
+    long fromSPower,
+    const std::vector<long>& fromXPowers,
+    long fromIdx,
+    long toIdx,
+    NTL::ZZ p,
+    const NTL::ZZ& seed,
+    const std::function<void(KeySwitch&)>& done) const
+{
+  // One group of matrices per round of the threads, so that the finished
+  // ones are handed over before the next are started
+  long groupSize = std::max(1L, NTL::AvailableThreads());
+  for (long start = 0; start < lsize(fromXPowers); start += groupSize) {
+    long cnt = std::min(groupSize, lsize(fromXPowers) - start);
+    std::vector<KeySwitch> group(cnt);
+
+    NTL_EXEC_RANGE(cnt, first, last)
+    NTL::RandomStreamPush push{}; // restores the PRG of this thread on exit
+    for (long j = first; j < last; j++) {
+      long t = fromXPowers[start + j];
+      setKeySWmatrixSeed(seed, fromSPower, t, fromIdx, toIdx);
+      group[j] = buildKeySWmatrix(fromSPower, t, fromIdx, toIdx, p);
+    }
+    NTL_EXEC_RANGE_END
+
+    for (KeySwitch& ksMatrix : group)
+      done(ksMatrix);
+  }
+}
+
+void SecKey::GenKeySWmatrices(long fromSPower,
+                              const std::vector<long>& fromXPowers,
+                              long fromIdx,
+                              long toIdx,
+                              NTL::ZZ p,
+                              const NTL::ZZ& seed,
+                              const KeySWSink& sink)
+{
+  HELIB_TIMER_START;
+
+  NTL::ZZ batchSeed = seed;
+  if (NTL::IsZero(batchSeed))
+    RandomBits(batchSeed, 256);
+
+  // The matrices to generate, without the trivial ones, those we already
+  // have and repetitions
+  std::vector<long> todo;
+  std::unordered_set<long> seen;
+  for (long t : fromXPowers) {
+    if (fromSPower <= 0 || t <= 0)
+      continue;
+    if (fromSPower == 1 && t == 1 && fromIdx == toIdx)
+      continue;
+    if (haveKeySWmatrix(fromSPower, t, fromIdx, toIdx))
+      continue;
+    if (!seen.insert(t).second) // a repetition
+      continue;
+    todo.push_back(t);
+  }
+
+  buildKeySWmatrices(fromSPower,
+                     todo,
+                     fromIdx,
+                     toIdx,
+                     p,
+                     batchSeed,
+                     [&](KeySwitch& ksMatrix) {
+                       if (sink)
+                         sink(ksMatrix);
+                       keySwitching.push_back(std::move(ksMatrix));
+                     });
 }
 
 // Decryption
@@ -1590,6 +1824,61 @@ void SecKey::Encrypt(Ctxt& ctxt, const EncodedPtxt& eptxt) const
 }
 
 void SecKey::Encrypt(Ctxt& ctxt, const EncodedPtxt_BGV& eptxt) const
+{
+  skEncrypt(ctxt, eptxt, /*prgSeed=*/nullptr);
+}
+
+void SecKey::Encrypt(Ctxt& ctxt, const EncodedPtxt_CKKS& eptxt) const
+{
+  skEncrypt(ctxt, eptxt, /*prgSeed=*/nullptr);
+}
+
+void SecKey::Encrypt(SeededCtxt& ctxt, const EncodedPtxt& eptxt) const
+{
+  assertEq((const PubKey*)this,
+           &ctxt.ctxt.pubKey,
+           "Encrypt: public key mismatch");
+
+  // A fresh seed for each ciphertext, as for any other randomness
+  NTL::ZZ seed;
+  NTL::RandomBits(seed, SeededCtxt::SEED_BITS);
+
+  Ctxt& c = ctxt.ctxt;
+  if (eptxt.isBGV())
+    skEncrypt(c, eptxt.getBGV(), &seed);
+  else if (eptxt.isCKKS())
+    skEncrypt(c, eptxt.getCKKS(), &seed);
+  else
+    throw LogicError("Encrypt: bad EncodedPtxt");
+
+  // Keep the seed rather than part 1
+  ctxt.seed = seed;
+  ctxt.seededHandle = c.parts[1].skHandle;
+  c.parts.pop_back();
+}
+
+#ifndef BIGINT_P
+template <>
+void SecKey::Encrypt(SeededCtxt& ctxt, const Ptxt<BGV>& plaintxt) const
+{
+  EncodedPtxt eptxt;
+  plaintxt.encode(eptxt);
+  Encrypt(ctxt, eptxt);
+}
+
+template <>
+void SecKey::Encrypt(SeededCtxt& ctxt, const Ptxt<CKKS>& plaintxt) const
+{
+  // The same magnitude as in PubKey::Encrypt(Ctxt&, const Ptxt<CKKS>&)
+  EncodedPtxt eptxt;
+  plaintxt.encode(eptxt, /*mag=*/NextPow2(Norm(plaintxt.getSlotRepr())));
+  Encrypt(ctxt, eptxt);
+}
+#endif
+
+void SecKey::skEncrypt(Ctxt& ctxt,
+                       const EncodedPtxt_BGV& eptxt,
+                       const NTL::ZZ* prgSeed) const
 {
   HELIB_TIMER_START;
 
@@ -1616,7 +1905,8 @@ void SecKey::Encrypt(Ctxt& ctxt, const EncodedPtxt_BGV& eptxt) const
 
   // Sample a new RLWE instance
   const DoubleCRT& sKey = sKeys.at(skIdx);
-  ctxt.noiseBound = RLWE(ctxt.parts[0], ctxt.parts[1], sKey, ptxtSpace);
+  ctxt.noiseBound =
+      skRLWE(ctxt.parts[0], ctxt.parts[1], sKey, ptxtSpace, prgSeed);
 
   // The logic here has changed to be identical
   // to that used in public key encryption
@@ -1654,7 +1944,9 @@ void SecKey::Encrypt(Ctxt& ctxt, const EncodedPtxt_BGV& eptxt) const
   ctxt.noiseBound += ptxt_bound;
 }
 
-void SecKey::Encrypt(Ctxt& ctxt, const EncodedPtxt_CKKS& eptxt) const
+void SecKey::skEncrypt(Ctxt& ctxt,
+                       const EncodedPtxt_CKKS& eptxt,
+                       const NTL::ZZ* prgSeed) const
 {
   HELIB_TIMER_START;
 
@@ -1679,7 +1971,8 @@ void SecKey::Encrypt(Ctxt& ctxt, const EncodedPtxt_CKKS& eptxt) const
   // Sample a new RLWE instance
   const DoubleCRT& sKey = sKeys.at(skIdx);
   auto one = NTL::ZZ(1);
-  double error_bound = RLWE(ctxt.parts[0], ctxt.parts[1], sKey, one);
+  double error_bound =
+      skRLWE(ctxt.parts[0], ctxt.parts[1], sKey, one, prgSeed);
 
   // This follows the same logic in PubKey::Encrypt(EncodedPtxt_CKKS).
   // See documentation there
@@ -1788,10 +2081,9 @@ void SecKey::writeTo(std::ostream& str, bool sk_only) const
 SecKey SecKey::readFrom(std::istream& str, const Context& context, bool sk_only)
 {
   const auto header = SerializeHeader<SecKey>::readFrom(str);
-  assertEq<IOError>(header.version,
-                    Binio::VERSION_0_0_1_0,
-                    "Header: version " + header.versionString() +
-                        " not supported");
+  assertTrue<IOError>(header.isReadableVersion(),
+                      "Header: version " + header.versionString() +
+                          " not supported");
 
   bool eyeCatcherFound = readEyeCatcher(str, EyeCatcher::SK_BEGIN);
   assertTrue<IOError>(eyeCatcherFound,
@@ -1818,7 +2110,10 @@ SecKey SecKey::readFrom(std::istream& str, const Context& context, bool sk_only)
 
 void SecKey::writeToJSON(std::ostream& str, bool sk_only) const
 {
-  executeRedirectJsonError<void>([&]() { str << writeToJSON(sk_only); });
+  executeRedirectJsonError<void>([&]() {
+    JsonWriter writer(str);
+    this->writeToJSON(writer, sk_only);
+  });
 }
 
 JsonWrapper SecKey::writeToJSON(bool sk_only) const
@@ -1843,12 +2138,9 @@ SecKey SecKey::readFromJSON(std::istream& str,
                             const Context& context,
                             bool sk_only)
 {
-  auto body = [&]() {
-    json j;
-    str >> j;
-    return SecKey::readFromJSON(wrap(j), context, sk_only);
-  };
-  return executeRedirectJsonError<SecKey>(body);
+  SecKey ret{context};
+  ret.readJSON(str, sk_only);
+  return ret;
 }
 
 SecKey SecKey::readFromJSON(const JsonWrapper& jw,
@@ -1863,9 +2155,8 @@ SecKey SecKey::readFromJSON(const JsonWrapper& jw,
 void SecKey::readJSON(std::istream& str, bool sk_only)
 {
   executeRedirectJsonError<void>([&]() {
-    json j;
-    str >> j;
-    this->readJSON(wrap(j), sk_only);
+    JsonReader reader(str);
+    this->readJSON(reader, sk_only);
   });
 }
 
@@ -1885,4 +2176,62 @@ void SecKey::readJSON(const JsonWrapper& tjw, bool sk_only)
   });
 }
 
+void SecKey::writeToJSON(JsonWriter& writer, bool sk_only) const
+{
+  writeTypedJson<SecKey>(writer, [&]() {
+    writer.beginObject();
+    if (sk_only) {
+      // json contains context and secret key(s)
+      writer.key("context");
+      writer.value(unwrap(this->getContext().writeToJSON()));
+    } else {
+      // json contains public key and secret key(s)
+      writer.key("PubKey");
+      this->PubKey::writeToJSON(writer);
+    }
+    writer.key("sKeys");
+    writer.beginArray();
+    for (const DoubleCRT& sKey : this->sKeys)
+      sKey.writeToJSON(writer);
+    writer.endArray();
+    writer.endObject();
+  });
+}
+
+void SecKey::readJSON(JsonReader& reader, bool sk_only)
+{
+  std::vector<DoubleCRT> keys;
+  auto readPubKey = [&]() {
+    if (sk_only)
+      reader.skipValue();
+    else
+      this->PubKey::readJSON(reader);
+  };
+  auto readContext = [&]() {
+    if (sk_only)
+      assertEq(this->getContext(),
+               Context::readFromJSON(wrap(reader.readValue())),
+               "Context mismatch");
+    else
+      reader.skipValue();
+  };
+  auto readKeys = [&]() {
+    reader.beginArray();
+    while (reader.nextElement()) {
+      keys.emplace_back(context, IndexSet::emptySet());
+      keys.back().readJSON(reader);
+    }
+  };
+
+  readTypedJson<SecKey>(reader, [&]() {
+    reader.readObject({{"PubKey", readPubKey, !sk_only},
+                       {"context", readContext, sk_only},
+                       {"sKeys", readKeys}});
+  });
+
+  if (sk_only)
+    this->PubKey::clear();
+  this->sKeys = std::move(keys);
+}
+
 } // namespace helib
@@ -14,10 +14,13 @@
 #include <algorithm>
 #include <NTL/BasicThreadPool.h>
 #include <helib/matmul.h>
+#include <helib/HoistedCtxt.h>
 #include <helib/norms.h>
 #include <helib/fhe_stats.h>
 #include <helib/apiAttributes.h>
 
+#include "binio.h"
+
 #ifndef BIGINT_P
 namespace helib {
 
@@ -42,276 +45,6 @@ static bool comp_hoist(bool hoist)
 }
 #endif
 
-/********************************************************************/
-/****************** Auxiliary stuff: should go elsewhere   **********/
-
-/**
- * @class BasicAutomorphPrecon
- * @brief Pre-computation to speed many automorphism on the same ciphertext.
- *
- * The expensive part of homomorphic automorphism is breaking the ciphertext
- * parts into digits. The usual setting is we first rotate the ciphertext
- * parts, then break them into digits. But when we apply many automorphisms
- * it is faster to break the original ciphertext into digits, then rotate
- * the digits (as opposed to first rotate, then break).
- * An BasicAutomorphPrecon object breaks the original ciphertext and keeps
- * the digits, then when you call automorph is only needs to apply the
- * native automorphism and key switching to the digits, which is fast(er).
- **/
-class BasicAutomorphPrecon
-{
-  Ctxt ctxt;
-  NTL::xdouble noise;
-  std::vector<DoubleCRT> polyDigits;
-
-public:
-  BasicAutomorphPrecon(const Ctxt& _ctxt) : ctxt(_ctxt), noise(1.0)
-  {
-    HELIB_TIMER_START;
-    if (ctxt.parts.size() >= 1)
-      assertTrue(
-          ctxt.parts[0].skHandle.isOne(),
-          "Invalid ciphertext (secret key handle for part 0 is not one)");
-    if (ctxt.parts.size() <= 1)
-      return; // nothing to do
-
-    ctxt.cleanUp();
-    const Context& context = ctxt.getContext();
-    const PubKey& pubKey = ctxt.getPubKey();
-    long keyID = ctxt.getKeyID();
-
-    // The call to cleanUp() should ensure that this assertion passes.
-    assertTrue(ctxt.inCanonicalForm(keyID),
-               "Ciphertext is not in canonical form");
-
-    ctxt.relin_CKKS_adjust();
-
-    // Compute the number of digits that we need and the estimated
-    // added noise from switching this ciphertext.
-
-    NTL::xdouble addedNoise = ctxt.parts[1].breakIntoDigits(polyDigits);
-    NTL::xdouble max_ks_noise(0.0);
-    for (const KeySwitch& ks : pubKey.keySWlist()) {
-      if (max_ks_noise < ks.noiseBound)
-        max_ks_noise = ks.noiseBound;
-    }
-    addedNoise *= max_ks_noise;
-
-    double logProd = context.logOfProduct(context.getSpecialPrimes());
-    noise = ctxt.getNoiseBound() * NTL::xexp(logProd);
-
-    double ratio = NTL::conv<double>(addedNoise / noise);
-
-    HELIB_STATS_UPDATE("KS-noise-ratio-hoist", ratio);
-    if (ratio > 1) {
-      Warning("KS-noise-ratio-hoist=" + std::to_string(ratio));
-    }
-    // std::stderr << "*** HOIST INIT\n";
-    // fprintf(stderr, "   KS-log-noise-ratio-hoist: %f\n",
-    // log(addedNoise/noise)/log(2.0));
-
-    noise += addedNoise;
-  }
-
-  std::shared_ptr<Ctxt> automorph(long k) const
-  {
-    HELIB_TIMER_START;
-
-    // A hack: record this automorphism rather than actually performing it
-    if (isSetAutomorphVals()) { // defined in NumbTh.h
-      recordAutomorphVal(k);
-      return std::make_shared<Ctxt>(ctxt);
-    }
-
-    if (k == 1 || ctxt.isEmpty())
-      return std::make_shared<Ctxt>(ctxt); // nothing to do
-
-    const Context& context = ctxt.getContext();
-    const PubKey& pubKey = ctxt.getPubKey();
-
-    // empty ctxt
-    std::shared_ptr<Ctxt> result = std::make_shared<Ctxt>(ZeroCtxtLike, ctxt);
-    result->noiseBound = noise; // noise estimate
-    result->intFactor = ctxt.intFactor;
-
-    result->primeSet = ctxt.primeSet | context.getSpecialPrimes();
-    // VJS-NOTE: added this to make addPart work
-
-    if (ctxt.isCKKS()) {
-      result->ptxtMag = ctxt.ptxtMag;
-      double logProd = context.logOfProduct(context.getSpecialPrimes());
-      result->ratFactor = ctxt.ratFactor * NTL::xexp(logProd);
-    }
-
-    if (ctxt.parts.size() == 1) { // only constant part, no need to key-switch
-      CtxtPart tmpPart = ctxt.parts[0];
-      tmpPart.automorph(k);
-      tmpPart.addPrimesAndScale(context.getSpecialPrimes());
-      result->addPart(tmpPart, /*matchPrimeSet=*/true);
-      return result;
-    }
-
-    // Ensure that we have a key-switching matrices for this automorphism
-    long keyID = ctxt.getKeyID();
-    if (!pubKey.isReachable(k, keyID)) {
-      throw LogicError("no key-switching matrices for k=" + std::to_string(k) +
-                       ", keyID=" + std::to_string(keyID));
-    }
-
-    // Get the first key-switching matrix for this automorphism
-    const KeySwitch& W = pubKey.getNextKSWmatrix(k, keyID);
-    long amt = W.fromKey.getPowerOfX();
-
-    // Start by rotating the constant part, no need to key-switch it
-    CtxtPart tmpPart = ctxt.parts[0];
-    tmpPart.automorph(amt);
-    tmpPart.addPrimesAndScale(context.getSpecialPrimes());
-    result->addPart(tmpPart, /*matchPrimeSet=*/true);
-
-    // Then rotate the digits and key-switch them
-    std::vector<DoubleCRT> tmpDigits = polyDigits;
-    for (auto&& tmp : tmpDigits) // rotate each of the digits
-      tmp.automorph(amt);
-
-    result->keySwitchDigits(W, tmpDigits); // key-switch the digits
-
-    long m = context.getM();
-    if ((amt - k) % m != 0) { // amt != k (mod m), more automorphisms to do
-      k = NTL::MulMod(k, NTL::InvMod(amt, m), m); // k *= amt^{-1} mod m
-      result->smartAutomorph(k);                  // call usual smartAutomorph
-    }
-    return result;
-  }
-};
-
-class GeneralAutomorphPrecon
-{
-public:
-  virtual ~GeneralAutomorphPrecon() {}
-
-  virtual std::shared_ptr<Ctxt> automorph(long i) const = 0;
-};
-
-class GeneralAutomorphPrecon_UNKNOWN : public GeneralAutomorphPrecon
-{
-private:
-  Ctxt ctxt;
-  long dim;
-  const PAlgebra& zMStar;
-
-public:
-  GeneralAutomorphPrecon_UNKNOWN(const Ctxt& _ctxt,
-                                 long _dim,
-                                 const EncryptedArray& ea) :
-      ctxt(_ctxt), dim(_dim), zMStar(ea.getPAlgebra())
-  {
-    ctxt.cleanUp();
-  }
-
-  std::shared_ptr<Ctxt> automorph(long i) const override
-  {
-    std::shared_ptr<Ctxt> result = std::make_shared<Ctxt>(ctxt);
-
-    // guard against i == 0, as dim may be #gens
-    if (i != 0)
-      result->smartAutomorph(zMStar.genToPow(dim, i));
-
-    return result;
-  }
-};
-
-class GeneralAutomorphPrecon_FULL : public GeneralAutomorphPrecon
-{
-private:
-  BasicAutomorphPrecon precon;
-  long dim;
-  const PAlgebra& zMStar;
-
-public:
-  GeneralAutomorphPrecon_FULL(const Ctxt& _ctxt,
-                              long _dim,
-                              const EncryptedArray& ea) :
-      precon(_ctxt), dim(_dim), zMStar(ea.getPAlgebra())
-  {}
-
-  std::shared_ptr<Ctxt> automorph(long i) const override
-  {
-    return precon.automorph(zMStar.genToPow(dim, i));
-  }
-};
-
-class GeneralAutomorphPrecon_BSGS : public GeneralAutomorphPrecon
-{
-private:
-  long dim;
-  const PAlgebra& zMStar;
-
-  long D;
-  long g;
-  long h;
-  std::vector<std::shared_ptr<BasicAutomorphPrecon>> precon;
-
-public:
-  GeneralAutomorphPrecon_BSGS(const Ctxt& _ctxt,
-                              long _dim,
-                              const EncryptedArray& ea) :
-      dim(_dim), zMStar(ea.getPAlgebra())
-  {
-    D = (dim == -1) ? zMStar.getOrdP() : zMStar.OrderOf(dim);
-    g = KSGiantStepSize(D);
-    h = divc(D, g);
-
-    BasicAutomorphPrecon precon0(_ctxt);
-    precon.resize(h);
-
-    // parallel for k in [0..h)
-    NTL_EXEC_RANGE(h, first, last)
-    for (long k = first; k < last; k++) {
-      std::shared_ptr<Ctxt> p = precon0.automorph(zMStar.genToPow(dim, g * k));
-      precon[k] = std::make_shared<BasicAutomorphPrecon>(*p);
-    }
-    NTL_EXEC_RANGE_END
-  }
-
-  std::shared_ptr<Ctxt> automorph(long i) const override
-  {
-    assertInRange(i, 0l, D, "Automorphism index i is not in [0, D)");
-    long j = i % g;
-    long k = i / g;
-    // i == j + g*k
-    return precon[k]->automorph(zMStar.genToPow(dim, j));
-  }
-};
-
-std::shared_ptr<GeneralAutomorphPrecon> buildGeneralAutomorphPrecon(
-    const Ctxt& ctxt,
-    long dim,
-    const EncryptedArray& ea)
-{
-  // allow dim == -1 (Frobenius)
-  // allow dim == #gens (the dummy generator of order 1)
-  assertInRange(dim,
-                -1l,
-                ea.dimension(),
-                "Dimension dim is not in [-1, ea.dimension()] (-1 Frobenius)",
-                true);
-
-  if (fhe_test_force_hoist >= 0) {
-    switch (ctxt.getPubKey().getKSStrategy(dim)) {
-    case HELIB_KSS_BSGS:
-      return std::make_shared<GeneralAutomorphPrecon_BSGS>(ctxt, dim, ea);
-
-    case HELIB_KSS_FULL:
-      return std::make_shared<GeneralAutomorphPrecon_FULL>(ctxt, dim, ea);
-
-    default:
-      return std::make_shared<GeneralAutomorphPrecon_UNKNOWN>(ctxt, dim, ea);
-    }
-  } else {
-    return std::make_shared<GeneralAutomorphPrecon_UNKNOWN>(ctxt, dim, ea);
-  }
-}
-
 /********************************************************************/
 /****************** Linear transformation classes *******************/
 
@@ -325,8 +58,16 @@ struct ConstMultiplier
   virtual std::shared_ptr<ConstMultiplier> upgrade(
       const Context& context) const = 0;
   // Upgrade to DCRT. Returns null if no upgrade required
+
+  virtual void writeTo(std::ostream& str) const = 0;
+  // Binary serialization, preceded by the kind of the constant
 };
 
+// The kinds of constants in the binary serialization
+static constexpr long CONST_NONE = 0;
+static constexpr long CONST_ZZX = 1;
+static constexpr long CONST_DCRT = 2;
+
 struct ConstMultiplier_DoubleCRT : ConstMultiplier
 {
   DoubleCRT data;
@@ -343,6 +84,13 @@ struct ConstMultiplier_DoubleCRT : ConstMultiplier
   {
     return nullptr;
   }
+
+  void writeTo(std::ostream& str) const override
+  {
+    write_raw_int(str, CONST_DCRT);
+    write_raw_double(str, sz);
+    data.writeTo(str);
+  }
 };
 
 struct ConstMultiplier_zzX : ConstMultiplier
@@ -362,6 +110,12 @@ struct ConstMultiplier_zzX : ConstMultiplier
         DoubleCRT(data, context, context.fullPrimes()),
         sz);
   }
+
+  void writeTo(std::ostream& str) const override
+  {
+    write_raw_int(str, CONST_ZZX);
+    write_ntl_vec_long(str, data);
+  }
 };
 
 template <typename RX>
@@ -422,6 +176,39 @@ void ConstMultiplierCache::upgrade(const Context& context)
   NTL_EXEC_RANGE_END
 }
 
+void ConstMultiplierCache::writeTo(std::ostream& str) const
+{
+  write_raw_int(str, multiplier.size());
+  for (const std::shared_ptr<ConstMultiplier>& mult : multiplier) {
+    if (mult)
+      mult->writeTo(str);
+    else
+      write_raw_int(str, CONST_NONE);
+  }
+}
+
+void ConstMultiplierCache::read(std::istream& str, const Context& context)
+{
+  long n = read_raw_int(str);
+  assertTrue<IOError>(n >= 0, "Negative number of constants");
+  multiplier.assign(n, nullptr);
+  for (std::shared_ptr<ConstMultiplier>& mult : multiplier) {
+    long kind = read_raw_int(str);
+    if (kind == CONST_ZZX) {
+      zzX data;
+      read_ntl_vec_long(str, data);
+      mult = std::make_shared<ConstMultiplier_zzX>(data);
+    } else if (kind == CONST_DCRT) {
+      double sz = read_raw_double(str);
+      mult = std::make_shared<ConstMultiplier_DoubleCRT>(
+          DoubleCRT::readFrom(str, context),
+          sz);
+    } else {
+      assertEq<IOError>(kind, CONST_NONE, "Unknown kind of constant");
+    }
+  }
+}
+
 static inline long dimSz(const EncryptedArray& ea, long dim)
 {
   return (dim == ea.dimension()) ? 1 : ea.sizeOfDimension(dim);
@@ -758,6 +545,11 @@ struct ConstMultiplier_DoubleCRT_CKKS : ConstMultiplier
   {
     return nullptr;
   }
+
+  void writeTo(UNUSED std::ostream& str) const override
+  {
+    throw LogicError("The constants of CKKS cannot be serialized");
+  }
 };
 
 struct ConstMultiplier_zzX_CKKS : ConstMultiplier
@@ -779,6 +571,11 @@ struct ConstMultiplier_zzX_CKKS : ConstMultiplier
         eptxt,
         context.fullPrimes());
   }
+
+  void writeTo(UNUSED std::ostream& str) const override
+  {
+    throw LogicError("The constants of CKKS cannot be serialized");
+  }
 };
 
 static std::shared_ptr<ConstMultiplier> build_ConstMultiplier_CKKS(
@@ -882,6 +679,34 @@ MatMul1DExec::MatMul1DExec(const MatMul1D& mat, bool _minimal) :
   }
 }
 
+void MatMul1DExec::writeTo(std::ostream& str) const
+{
+  write_raw_int(str, dim);
+  write_raw_int(str, minimal);
+  write_raw_int(str, g);
+  cache.writeTo(str);
+  cache1.writeTo(str);
+}
+
+MatMul1DExec MatMul1DExec::readFrom(std::istream& str,
+                                    const EncryptedArray& ea)
+{
+  MatMul1DExec res(ea);
+  res.dim = read_raw_int(str);
+  assertInRange<IOError>(res.dim,
+                         0l,
+                         ea.dimension(),
+                         "Matrix dimension not in [0, ea.dimension()]",
+                         true);
+  res.D = dimSz(ea, res.dim);
+  res.native = dimNative(ea, res.dim);
+  res.minimal = read_raw_int(str);
+  res.g = read_raw_int(str);
+  res.cache.read(str, ea.getContext());
+  res.cache1.read(str, ea.getContext());
+  return res;
+}
+
 /***************************************************************************
 
 BS/GS logic:
@@ -1695,6 +1520,33 @@ BlockMatMul1DExec::BlockMatMul1DExec(const BlockMatMul1D& mat,
                                            strategy);
 }
 
+void BlockMatMul1DExec::writeTo(std::ostream& str) const
+{
+  write_raw_int(str, dim);
+  write_raw_int(str, strategy);
+  cache.writeTo(str);
+  cache1.writeTo(str);
+}
+
+BlockMatMul1DExec BlockMatMul1DExec::readFrom(std::istream& str,
+                                              const EncryptedArray& ea)
+{
+  BlockMatMul1DExec res(ea);
+  res.dim = read_raw_int(str);
+  assertInRange<IOError>(res.dim,
+                         0l,
+                         ea.dimension(),
+                         "Matrix dimension not in [0, ea.dimension()]",
+                         true);
+  res.D = dimSz(ea, res.dim);
+  res.d = ea.getDegree();
+  res.native = dimNative(ea, res.dim);
+  res.strategy = read_raw_int(str);
+  res.cache.read(str, ea.getContext());
+  res.cache1.read(str, ea.getContext());
+  return res;
+}
+
 void BlockMatMul1DExec::mul(Ctxt& ctxt) const
 {
   HELIB_NTIMER_START(mul_BlockMatMul1DExec);
@@ -23,6 +23,8 @@
 #include <helib/fhe_stats.h>
 #include <helib/log.h>
 
+#include "binio.h"
+
 #ifndef BIGINT_P
 
 #ifdef HELIB_DEBUG
@@ -279,7 +281,9 @@ void RecryptData::init(const Context& context,
                        const NTL::Vec<long>& mvec_,
                        bool enableThick,
                        bool build_cache_,
-                       bool minimal)
+                       bool minimal,
+                       const SlotFactorization* factorization,
+                       std::istream* cachedMaps)
 {
   if (alMod != nullptr) { // were we called for a second time?
     std::cerr << "@Warning: multiple calls to RecryptData::init\n";
@@ -315,7 +319,9 @@ void RecryptData::init(const Context& context,
   long r = context.getAlMod().getR();
 
   // First part of Bootstrapping works wrt plaintext space p^{r'}
-  alMod = std::make_shared<PAlgebraMod>(context.getZMStar(), e - ePrime + r);
+  alMod = std::make_shared<PAlgebraMod>(context.getZMStar(),
+                                        e - ePrime + r,
+                                        factorization);
   ea = std::make_shared<EncryptedArray>(context, *alMod);
   // Polynomial defaults to F0, PAlgebraMod explicitly given
 
@@ -324,6 +330,18 @@ void RecryptData::init(const Context& context,
   if (!enableThick)
     return;
 
+  if (cachedMaps != nullptr) { // as written by writeMapsTo
+    unpackSlotEncoding.resize(read_raw_int(*cachedMaps));
+    for (NTL::ZZX& poly : unpackSlotEncoding) {
+      NTL::Vec<long> coeffs;
+      read_ntl_vec_long(*cachedMaps, coeffs);
+      convert(poly, coeffs);
+    }
+    firstMap.reset(EvalMap::readPtrFrom(*cachedMaps, *ea));
+    secondMap.reset(EvalMap::readPtrFrom(*cachedMaps, context.getEA()));
+    return;
+  }
+
   // Initialize the linear polynomial for unpacking the slots
   NTL::zz_pBak bak;
   bak.save();
@@ -358,6 +376,22 @@ void RecryptData::init(const Context& context,
                                         build_cache);
 }
 
+void RecryptData::writeMapsTo(std::ostream& str) const
+{
+  if (!alsoThick)
+    return;
+
+  // The coefficients of the encodings are in [0, p^{e-e'+r})
+  write_raw_int(str, unpackSlotEncoding.size());
+  for (const NTL::ZZX& poly : unpackSlotEncoding) {
+    NTL::Vec<long> coeffs;
+    convert(coeffs, poly);
+    write_ntl_vec_long(str, coeffs);
+  }
+  firstMap->writeTo(str);
+  secondMap->writeTo(str);
+}
+
 /********************************************************************/
 /********************************************************************/
 
@@ -791,9 +825,22 @@ void ThinRecryptData::init(const Context& context,
                            const NTL::Vec<long>& mvec_,
                            bool alsoThick,
                            bool build_cache_,
-                           bool minimal)
+                           bool minimal,
+                           const SlotFactorization* factorization,
+                           std::istream* cachedMaps)
 {
-  RecryptData::init(context, mvec_, alsoThick, build_cache_, minimal);
+  RecryptData::init(context,
+                    mvec_,
+                    alsoThick,
+                    build_cache_,
+                    minimal,
+                    factorization,
+                    cachedMaps);
+  if (cachedMaps != nullptr) { // after the thick maps, see writeMapsTo
+    coeffToSlot.reset(ThinEvalMap::readPtrFrom(*cachedMaps, *ea));
+    slotToCoeff.reset(ThinEvalMap::readPtrFrom(*cachedMaps, context.getEA()));
+    return;
+  }
   coeffToSlot =
       std::make_shared<ThinEvalMap>(*ea, minimal, mvec, true, build_cache);
   slotToCoeff = std::make_shared<ThinEvalMap>(context.getEA(),
@@ -803,6 +850,13 @@ void ThinRecryptData::init(const Context& context,
                                               build_cache);
 }
 
+void ThinRecryptData::writeMapsTo(std::ostream& str) const
+{
+  RecryptData::writeMapsTo(str);
+  coeffToSlot->writeTo(str);
+  slotToCoeff->writeTo(str);
+}
+
 // Extract digits from thinly packed slots
 
 long fhe_force_chen_han = 0;
@@ -16,6 +16,7 @@
 * Added tests for separated SK, PK and Key switching matrices
 */
 
+#include <algorithm>
 #include <cmath> // isinf
 #include <cstring>
 #include <sstream>
@@ -211,6 +212,49 @@ TEST(TestBinIO, headerSerializationDeserialization)
   EXPECT_TRUE(!memcmp(&header, &DeserialisedHeader, sizeof(header)));
 }
 
+TEST(TestBinIO, headersOfObjectsWithRowsHavePackedVersion)
+{
+  EXPECT_TRUE(helib::SerializeHeader<helib::Ctxt>().version ==
+              helib::Binio::VERSION_0_0_2_0);
+  EXPECT_TRUE(helib::SerializeHeader<helib::PubKey>().version ==
+              helib::Binio::VERSION_0_0_2_0);
+  EXPECT_TRUE(helib::SerializeHeader<helib::SecKey>().version ==
+              helib::Binio::VERSION_0_0_2_0);
+  EXPECT_TRUE(helib::SerializeHeader<helib::Context>().isReadableVersion());
+  EXPECT_TRUE(helib::SerializeHeader<helib::Ctxt>().isReadableVersion());
+}
+
+TEST(TestBinIO, packedRowsReadBack)
+{
+  for (long bits : {1l, 7l, 8l, 30l, 57l, 58l, 60l, 63l}) {
+    for (long len : {0l, 1l, 8l, 13l, 128l}) {
+      std::vector<long> row(len);
+      for (long i = 0; i < len; i++)
+        row[i] = NTL::RandomBits_long(bits);
+      if (len > 0)
+        row[0] = long((1ul << bits) - 1); // all bits set
+
+      std::stringstream ss;
+      helib::write_packed_long_row(ss, row.data(), len, bits);
+      EXPECT_EQ(ss.str().size(), std::size_t(12 + (len * bits + 7) / 8));
+
+      std::vector<long> read(len, -1);
+      helib::read_raw_long_row(ss, read.data(), len);
+      EXPECT_EQ(read, row) << "bits = " << bits << ", len = " << len;
+    }
+  }
+}
+
+TEST(TestBinIO, packedRowsThrowWhenEntryDoesNotFit)
+{
+  std::vector<long> row = {1, 2, 8};
+  std::stringstream ss;
+  EXPECT_THROW(helib::write_packed_long_row(ss, row.data(), 3, 3),
+               helib::InvalidArgument);
+  EXPECT_THROW(helib::write_packed_long_row(ss, row.data(), 3, 64),
+               helib::InvalidArgument);
+}
+
 TEST_P(TestBinIO_BGV, singleFunctionSerialization)
 {
   std::stringstream str;
@@ -323,6 +367,148 @@ TEST_P(TestBinIO_BGV, canPerformOperationWithDeserializedContext)
   EXPECT_NO_THROW(deserialized_context.getEA().rotate(ctxt, 1));
 }
 
+TEST_P(TestBinIO_BGV, contextCacheRestoresTheContext)
+{
+  std::stringstream str;
+
+  context.writeCacheTo(str);
+
+  helib::Context cached_context = helib::Context::readFromCache(str);
+
+  EXPECT_EQ(context, cached_context);
+  helib::SlotFactorization expected =
+      context.getAlMod().getSlotFactorization();
+  helib::SlotFactorization restored =
+      cached_context.getAlMod().getSlotFactorization();
+  EXPECT_EQ(restored.r, expected.r);
+  EXPECT_EQ(restored.factors, expected.factors);
+  EXPECT_EQ(restored.crtCoeffs, expected.crtCoeffs);
+
+  helib::SecKey cached_secretKey(cached_context);
+  cached_secretKey.GenSecKey();
+  helib::addSome1DMatrices(cached_secretKey);
+  const helib::PubKey& cached_publicKey = cached_secretKey;
+  helib::Ptxt<helib::BGV> ptxt(cached_context);
+  for (std::size_t i = 0; i < ptxt.size(); i++)
+    ptxt[i] = i % p;
+  helib::Ctxt ctxt(cached_publicKey);
+  cached_publicKey.Encrypt(ctxt, ptxt);
+  cached_context.getEA().rotate(ctxt, 1);
+  helib::Ptxt<helib::BGV> decrypted(cached_context);
+  cached_secretKey.Decrypt(decrypted, ctxt);
+  ptxt.rotate(1);
+  EXPECT_EQ(decrypted, ptxt);
+}
+
+TEST(TestBinIO_BGV, contextCacheRestoresBootstrappableContext)
+{
+  // clang-format off
+  helib::Context context = helib::ContextBuilder<helib::BGV>()
+      .m(1271)
+      .p(2)
+      .r(1)
+      .gens({1026, 249})
+      .ords({30, -2})
+      .bits(30)
+      .bootstrappable(true)
+      .mvec(helib::convert<NTL::Vec<long>>(std::vector<long>({31, 41})))
+      .build();
+  // clang-format on
+
+  std::stringstream str;
+
+  context.writeCacheTo(str);
+
+  helib::Context* cached_context = helib::Context::readPtrFromCache(str);
+
+  EXPECT_EQ(context, *cached_context);
+  ASSERT_TRUE(cached_context->isBootstrappable());
+  helib::SlotFactorization expected =
+      context.getRcData().alMod->getSlotFactorization();
+  helib::SlotFactorization restored =
+      cached_context->getRcData().alMod->getSlotFactorization();
+  EXPECT_GT(restored.r, 1);
+  EXPECT_EQ(restored.r, expected.r);
+  EXPECT_EQ(restored.factors, expected.factors);
+  EXPECT_EQ(restored.crtCoeffs, expected.crtCoeffs);
+
+  // The linear maps of recryption are read from the cache as they were
+  ASSERT_NE(cached_context->getRcData().coeffToSlot, nullptr);
+  ASSERT_NE(cached_context->getRcData().slotToCoeff, nullptr);
+  std::stringstream rewritten;
+  cached_context->writeCacheTo(rewritten);
+  EXPECT_EQ(rewritten.str(), str.str());
+  delete cached_context;
+}
+
+TEST(TestBinIO_BGV, contextCacheRestoresThickLinearMapsWithTheirConstants)
+{
+  // clang-format off
+  helib::Context context = helib::ContextBuilder<helib::BGV>()
+      .m(1271)
+      .p(2)
+      .r(1)
+      .gens({1026, 249})
+      .ords({30, -2})
+      .bits(30)
+      .bootstrappable(true)
+      .mvec(helib::convert<NTL::Vec<long>>(std::vector<long>({31, 41})))
+      .buildCache(true)
+      .thickboot()
+      .build();
+  // clang-format on
+
+  std::stringstream str;
+  context.writeCacheTo(str);
+  helib::Context cached_context = helib::Context::readFromCache(str);
+
+  EXPECT_EQ(context, cached_context);
+  const helib::ThinRecryptData& rcData = cached_context.getRcData();
+  EXPECT_TRUE(rcData.alsoThick);
+  EXPECT_TRUE(rcData.build_cache);
+  ASSERT_NE(rcData.firstMap, nullptr);
+  ASSERT_NE(rcData.secondMap, nullptr);
+  EXPECT_EQ(rcData.unpackSlotEncoding, context.getRcData().unpackSlotEncoding);
+
+  // The constants are DoubleCRT objects, written and read as they are
+  std::stringstream rewritten;
+  cached_context.writeCacheTo(rewritten);
+  EXPECT_EQ(rewritten.str(), str.str());
+}
+
+TEST_P(TestBinIO_BGV, contextCacheThrowsWhenDamaged)
+{
+  std::stringstream str;
+  context.writeCacheTo(str);
+  const std::string cache = str.str();
+
+  // One byte of the content
+  std::string damaged = cache;
+  damaged[damaged.size() / 2] ^= 1;
+  std::istringstream damaged_str(damaged);
+  EXPECT_THROW(helib::Context::readFromCache(damaged_str), helib::IOError);
+
+  // A size field far beyond what the stream holds
+  std::string oversized = cache;
+  const std::size_t eyeCatcher = oversized.find("|CC[");
+  ASSERT_NE(eyeCatcher, std::string::npos);
+  const std::size_t sizeField = eyeCatcher + 4;
+  ASSERT_LE(sizeField + 8, oversized.size());
+  for (std::size_t i = 0; i < 7; i++)
+    oversized[sizeField + i] = '\xff';
+  oversized[sizeField + 7] = '\x7f'; // little endian, so still positive
+  std::istringstream oversized_str(oversized);
+  EXPECT_THROW(helib::Context::readFromCache(oversized_str), helib::IOError);
+
+  std::istringstream truncated_str(cache.substr(0, cache.size() / 2));
+  EXPECT_THROW(helib::Context::readFromCache(truncated_str), helib::IOError);
+
+  // A context without its cache
+  std::stringstream context_str;
+  context.writeTo(context_str);
+  EXPECT_THROW(helib::Context::readFromCache(context_str), helib::IOError);
+}
+
 TEST_P(TestBinIO_BGV, singleFunctionSerializationOfKeys)
 {
   std::stringstream str;
@@ -732,6 +918,59 @@ TEST_P(TestBinIO_BGV, readCiphertextFromDeserializeCorrectly)
   EXPECT_EQ(ctxt, deserialized_ctxt);
 }
 
+TEST_P(TestBinIO_BGV, doubleCRTRowsArePackedAndOldRowsStillRead)
+{
+  helib::DoubleCRT dcrt(context, context.fullPrimes());
+  dcrt.randomize();
+  const helib::IndexSet& set = dcrt.getIndexSet();
+  long phim = context.getPhiM();
+
+  std::stringstream packed;
+  dcrt.writeTo(packed);
+  std::stringstream setOnly;
+  set.writeTo(setOnly);
+  std::size_t expected = setOnly.str().size();
+  for (long i : set)
+    expected +=
+        std::size_t(12 + (phim * NTL::NumBits(context.ithPrime(i) - 1) + 7) / 8);
+  EXPECT_EQ(packed.str().size(), expected);
+  EXPECT_EQ(helib::DoubleCRT::readFrom(packed, context), dcrt);
+
+  // The rows as they were written before 0.0.2.0, 64 bits per residue
+  std::stringstream old;
+  set.writeTo(old);
+  std::vector<long> row;
+  for (long i : set) {
+    row.assign(dcrt.getMap()[i], dcrt.getMap()[i] + phim);
+    context.ithModulus(i).permuteEvalOrder(row.data());
+    helib::write_raw_long_row(old, row.data(), phim);
+  }
+  EXPECT_EQ(helib::DoubleCRT::readFrom(old, context), dcrt);
+}
+
+TEST_P(TestBinIO_BGV, readCiphertextWithVersion0010Header)
+{
+  helib::Ctxt ctxt(publicKey);
+  publicKey.Encrypt(ctxt, NTL::ZZX(1));
+
+  std::stringstream ss;
+  ctxt.writeTo(ss);
+  std::string bytes = ss.str();
+  // version is right after the 4 bytes of the header eye catcher
+  std::copy(helib::Binio::VERSION_0_0_1_0.begin(),
+            helib::Binio::VERSION_0_0_1_0.end(),
+            bytes.begin() + helib::EyeCatcher::SIZE);
+
+  std::stringstream old(bytes);
+  helib::Ctxt deserialized_ctxt(publicKey);
+  deserialized_ctxt.read(old);
+  EXPECT_EQ(ctxt, deserialized_ctxt);
+
+  bytes[helib::EyeCatcher::SIZE + 2] = 3; // 0.0.3.0 is not known
+  std::stringstream unknown(bytes);
+  EXPECT_THROW(deserialized_ctxt.read(unknown), helib::IOError);
+}
+
 TEST_P(TestBinIO_BGV, readCiphertextInPlaceFromDeserializeCorrectly)
 {
   std::stringstream str;
@@ -1000,6 +1239,18 @@ TEST_P(TestBinIO_CKKS, canPerformOperationWithDeserializedContext)
   EXPECT_NO_THROW(deserialized_context.getEA().rotate(ctxt, 1));
 }
 
+TEST_P(TestBinIO_CKKS, contextCacheRestoresTheContext)
+{
+  std::stringstream str;
+
+  context.writeCacheTo(str);
+
+  helib::Context cached_context = helib::Context::readFromCache(str);
+
+  EXPECT_EQ(context, cached_context);
+  EXPECT_TRUE(cached_context.isCKKS());
+}
+
 TEST_P(TestBinIO_CKKS, singleFunctionSerializationOfKeys)
 {
   std::stringstream str;
@@ -15,6 +15,7 @@
 // The older tests with more extensive coverage can be found in the files
 // with names matching "GTest*".
 
+#include <thread>
 #include <helib/helib.h>
 #include <helib/debugging.h>
 
@@ -253,6 +254,364 @@ TEST_P(TestCtxtWithBadDimensions, rotate1DRotatesCorrectlyWithBadDimensions)
   }
 }
 
+TEST_P(TestCtxt, keySwitchingAPartsDependOnlyOnTheirPrime)
+{
+  const helib::KeySwitch& W = publicKey.keySWlist().at(0);
+  ASSERT_EQ(W.prgKind, helib::KeySwitch::PrgKind::COUNTER);
+  long n = W.NumCols();
+
+  std::vector<helib::DoubleCRT> full;
+  W.generateA(full, context, context.fullPrimes(), n);
+
+  // Every other prime, as if the ciphertext had fewer primes
+  helib::IndexSet some;
+  for (long i : context.fullPrimes())
+    if (i % 2 == 0)
+      some.insert(i);
+  std::vector<helib::DoubleCRT> scratch;
+  const std::vector<helib::DoubleCRT>& part = W.getA(scratch, some, n);
+
+  ASSERT_EQ(helib::lsize(part), n);
+  for (long k : helib::range(n)) {
+    helib::DoubleCRT expected = full[k];
+    expected.removePrimes(context.fullPrimes() / some);
+    EXPECT_EQ(part[k], expected) << "column " << k;
+  }
+}
+
+TEST_P(TestCtxt, rotationsWorkWithEveryACachingPolicy)
+{
+  std::vector<long> data(ea.size());
+  std::iota(data.begin(), data.end(), 0);
+  helib::Ptxt<helib::BGV> ptxt(context, data);
+  helib::Ctxt ctxt(publicKey);
+  publicKey.Encrypt(ctxt, ptxt);
+
+  helib::Ptxt<helib::BGV> expected(ptxt);
+  expected.frobeniusAutomorph(1);
+
+  for (auto policy : {helib::KeySwitch::ACaching::EAGER,
+                      helib::KeySwitch::ACaching::LAZY,
+                      helib::KeySwitch::ACaching::NONE}) {
+    for (const helib::KeySwitch& W : publicKey.keySWlist())
+      W.setACaching(policy);
+
+    // twice, so that LAZY uses the ai's it kept the first time
+    for (long rep = 0; rep < 2; rep++) {
+      helib::Ctxt tmp(ctxt);
+      tmp.frobeniusAutomorph(1);
+      helib::Ptxt<helib::BGV> result(context);
+      secretKey.Decrypt(result, tmp);
+      EXPECT_EQ(result, expected);
+    }
+  }
+}
+
+TEST_P(TestCtxt, lowLevelKeySwitchingUsesTruncatedKeys)
+{
+  std::vector<long> data(ea.size());
+  std::iota(data.begin(), data.end(), 0);
+  helib::Ptxt<helib::BGV> ptxt(context, data);
+  helib::Ctxt ctxt(publicKey);
+  publicKey.Encrypt(ctxt, ptxt);
+  ctxt.bringToSet(ctxt.naturalPrimeSet());
+
+  helib::Ptxt<helib::BGV> expected(ptxt);
+  expected.frobeniusAutomorph(1);
+
+  helib::KeySwitch::TruncationPolicy policy;
+  policy.maxFraction = 1.0;
+  for (std::size_t budget : {std::size_t(1) << 30, std::size_t(1)}) {
+    policy.budget = budget;
+    for (const helib::KeySwitch& W : publicKey.keySWlist())
+      W.setTruncation(policy);
+
+    // twice, so that the second key switch uses the copies of the first
+    std::vector<std::size_t> bytes;
+    for (long rep = 0; rep < 2; rep++) {
+      helib::Ctxt tmp(ctxt);
+      tmp.frobeniusAutomorph(1);
+      helib::Ptxt<helib::BGV> result(context);
+      secretKey.Decrypt(result, tmp);
+      EXPECT_EQ(result, expected);
+
+      bytes.push_back(0);
+      for (const helib::KeySwitch& W : publicKey.keySWlist())
+        bytes.back() += W.truncatedBytes();
+    }
+    EXPECT_EQ(bytes[0], bytes[1]);
+    if (budget > 1)
+      EXPECT_GT(bytes[0], 0u);
+    else
+      EXPECT_EQ(bytes[0], 0u);
+  }
+
+  for (const helib::KeySwitch& W : publicKey.keySWlist())
+    W.setTruncation(helib::KeySwitch::TruncationPolicy());
+}
+
+#ifdef HELIB_THREADS
+TEST_P(TestCtxt, truncatedKeysAreSafeWithLazyACachingAcrossThreads)
+{
+  std::vector<long> data(ea.size());
+  std::iota(data.begin(), data.end(), 0);
+  helib::Ptxt<helib::BGV> ptxt(context, data);
+  helib::Ctxt high(publicKey);
+  publicKey.Encrypt(high, ptxt);
+  helib::Ctxt low(high);
+  low.bringToSet(low.naturalPrimeSet());
+
+  helib::Ptxt<helib::BGV> expected(ptxt);
+  expected.frobeniusAutomorph(1);
+
+  helib::KeySwitch::TruncationPolicy policy;
+  policy.maxFraction = 1.0;
+  policy.budget = std::size_t(1) << 30;
+  const long nthreads = 4;
+  for (long rep = 0; rep < 3; rep++) {
+    // Start from empty caches, so that the first key switch at the full
+    // level fills the ai's while the low-level ones make truncated copies
+    for (const helib::KeySwitch& W : publicKey.keySWlist()) {
+      W.setACaching(helib::KeySwitch::ACaching::LAZY);
+      W.setTruncation(policy);
+    }
+
+    std::vector<helib::Ctxt> results;
+    for (long i = 0; i < nthreads; i++)
+      results.push_back(i % 2 == 0 ? high : low);
+    std::vector<std::thread> threads;
+    for (long i = 0; i < nthreads; i++)
+      threads.emplace_back([&results, i] { results[i].frobeniusAutomorph(1); });
+    for (std::thread& t : threads)
+      t.join();
+
+    for (long i = 0; i < nthreads; i++) {
+      helib::Ptxt<helib::BGV> result(context);
+      secretKey.Decrypt(result, results[i]);
+      EXPECT_EQ(result, expected) << "rep " << rep << ", thread " << i;
+    }
+  }
+
+  for (const helib::KeySwitch& W : publicKey.keySWlist()) {
+    W.setACaching(helib::KeySwitch::ACaching::NONE);
+    W.setTruncation(helib::KeySwitch::TruncationPolicy());
+  }
+}
+#endif
+
+TEST_P(TestCtxt, rotateManyMatchesRotate)
+{
+  std::vector<long> data(ea.size());
+  std::iota(data.begin(), data.end(), 0);
+  helib::Ptxt<helib::BGV> ptxt(context, data);
+  helib::Ctxt ctxt(publicKey);
+  publicKey.Encrypt(ctxt, ptxt);
+
+  std::vector<long> amounts = {0, 1, 3, -2, ea.size() + 1};
+  std::vector<helib::Ctxt> rotated = ea.rotateMany(ctxt, amounts);
+
+  ASSERT_EQ(rotated.size(), amounts.size());
+  for (long j : helib::range(helib::lsize(amounts))) {
+    helib::Ptxt<helib::BGV> expected(ptxt);
+    expected.rotate(amounts[j]);
+    helib::Ptxt<helib::BGV> result(context);
+    secretKey.Decrypt(result, rotated[j]);
+    EXPECT_EQ(result, expected) << "amount " << amounts[j];
+  }
+}
+
+TEST_P(TestCtxtWithBadDimensions, rotateManyMatchesRotateWithBadDimensions)
+{
+  std::vector<long> data(ea.size());
+  std::iota(data.begin(), data.end(), 0);
+  helib::Ptxt<helib::BGV> ptxt(context, data);
+  helib::Ctxt ctxt(publicKey);
+  publicKey.Encrypt(ctxt, ptxt);
+
+  // The same HoistedCtxt serves several batches
+  helib::HoistedCtxt hoisted(ctxt);
+  for (long batch = 0; batch < 2; batch++) {
+    std::vector<long> amounts = {batch + 1, batch + 4, -batch - 1};
+    std::vector<helib::Ctxt> rotated = ea.rotateMany(hoisted, amounts);
+
+    for (long j : helib::range(helib::lsize(amounts))) {
+      helib::Ptxt<helib::BGV> expected(ptxt);
+      expected.rotate(amounts[j]);
+      helib::Ptxt<helib::BGV> result(context);
+      secretKey.Decrypt(result, rotated[j]);
+      EXPECT_EQ(result, expected) << "amount " << amounts[j];
+    }
+  }
+}
+
+TEST_P(TestCtxt, squaringMatchesMultiplicationByACopy)
+{
+  std::vector<long> data(ea.size());
+  for (long i : helib::range(ea.size()))
+    data[i] = (5 * i + 3) % p;
+  helib::Ptxt<helib::BGV> ptxt(context, data);
+  helib::Ctxt ctxt(publicKey);
+  publicKey.Encrypt(ctxt, ptxt);
+
+  helib::Ptxt<helib::BGV> expected(ptxt);
+  expected *= ptxt;
+
+  // Without re-linearization: the parts c0^2, 2*c0*c1 and c1^2
+  helib::Ctxt squared(ctxt);
+  squared.multLowLvl(squared);
+  EXPECT_FALSE(squared.inCanonicalForm());
+  helib::Ctxt copy(ctxt);
+  helib::Ctxt multiplied(ctxt);
+  multiplied.multLowLvl(copy);
+
+  for (helib::Ctxt* c : {&squared, &multiplied}) {
+    helib::Ptxt<helib::BGV> result(context);
+    secretKey.Decrypt(result, *c);
+    EXPECT_EQ(result, expected);
+  }
+
+  // And through power, which squares repeatedly
+  helib::Ctxt fourth(ctxt);
+  fourth.power(4);
+  expected *= expected;
+  helib::Ptxt<helib::BGV> result(context);
+  secretKey.Decrypt(result, fourth);
+  EXPECT_EQ(result, expected);
+}
+
+TEST_P(TestCtxt, productAccumulatorMatchesSumOfProducts)
+{
+  helib::ProductAccumulator acc(publicKey);
+  helib::Ptxt<helib::BGV> expected(context);
+  for (long k : helib::range(3)) {
+    std::vector<long> data1(ea.size()), data2(ea.size());
+    for (long i : helib::range(ea.size())) {
+      data1[i] = (i + k) % p;
+      data2[i] = (3 * i + 2 * k + 1) % p;
+    }
+    helib::Ptxt<helib::BGV> ptxt1(context, data1);
+    helib::Ptxt<helib::BGV> ptxt2(context, data2);
+    helib::Ctxt ctxt1(publicKey);
+    helib::Ctxt ctxt2(publicKey);
+    publicKey.Encrypt(ctxt1, ptxt1);
+    publicKey.Encrypt(ctxt2, ptxt2);
+    // Terms with different primes
+    if (k == 1)
+      ctxt1.bringToSet(ctxt1.naturalPrimeSet());
+
+    acc.addProduct(ctxt1, ctxt2);
+    ptxt1 *= ptxt2;
+    expected += ptxt1;
+  }
+
+  helib::Ctxt sum = acc.getSum();
+  EXPECT_TRUE(sum.inCanonicalForm());
+  helib::Ptxt<helib::BGV> result(context);
+  secretKey.Decrypt(result, sum);
+  EXPECT_EQ(result, expected);
+}
+
+TEST_P(TestCtxt, innerProductWorksWithInputsAtDifferentLevels)
+{
+  std::vector<helib::Ctxt> v1, v2;
+  helib::Ptxt<helib::BGV> expected(context);
+  for (long k : helib::range(3)) {
+    std::vector<long> data1(ea.size()), data2(ea.size());
+    for (long i : helib::range(ea.size())) {
+      data1[i] = (2 * i + k) % p;
+      data2[i] = (i + 3 * k + 1) % p;
+    }
+    helib::Ptxt<helib::BGV> ptxt1(context, data1);
+    helib::Ptxt<helib::BGV> ptxt2(context, data2);
+    v1.emplace_back(publicKey);
+    v2.emplace_back(publicKey);
+    publicKey.Encrypt(v1.back(), ptxt1);
+    publicKey.Encrypt(v2.back(), ptxt2);
+    ptxt1 *= ptxt2;
+    expected += ptxt1;
+  }
+
+  // One term a level below the others
+  helib::IndexSet lower = v1[1].getPrimeSet();
+  lower.remove(lower.last());
+  ASSERT_FALSE(helib::empty(lower));
+  v1[1].bringToSet(lower);
+
+  helib::Ctxt result(publicKey);
+  helib::innerProduct(result, v1, v2);
+  EXPECT_TRUE(result.inCanonicalForm());
+  // The sum comes down to the level of its lowest term rather than up
+  EXPECT_TRUE(result.getPrimeSet() <= lower);
+  helib::Ptxt<helib::BGV> decrypted(context);
+  secretKey.Decrypt(decrypted, result);
+  EXPECT_EQ(decrypted, expected);
+}
+
+TEST_P(TestCtxt, batchKeyGenerationDoesNotDependOnThreadCount)
+{
+  // A few automorphisms that the fixture has no matrices for
+  std::vector<long> vals;
+  for (long t : helib::range(2, long(m)))
+    if (context.getZMStar().inZmStar(t) &&
+        !secretKey.haveKeySWmatrix(1, t, 0, 0) && vals.size() < 6)
+      vals.push_back(t);
+
+  // The seed determines the errors of the matrices, so it is as secret as
+  // the key: a fresh random one, reused only between the two runs
+  NTL::ZZ seed = NTL::RandomBits_ZZ(256);
+  helib_test::GlobalSettingsGuard guard;
+  std::vector<std::vector<helib::KeySwitch>> lists;
+  for (long nthreads : {1L, 4L}) {
+    NTL::SetNumThreads(nthreads);
+    helib::SecKey sk(secretKey);
+    std::vector<long> streamed;
+    sk.GenKeySWmatrices(1,
+                        vals,
+                        0,
+                        0,
+                        NTL::ZZ(0),
+                        seed,
+                        [&](const helib::KeySwitch& W) {
+                          streamed.push_back(W.fromKey.getPowerOfX());
+                        });
+    EXPECT_EQ(streamed, vals);
+    lists.push_back(sk.keySWlist());
+  }
+
+  EXPECT_EQ(lists[0], lists[1]);
+}
+
+TEST_P(TestCtxt, multiplicationReusesRowBuffersOnceWarm)
+{
+  helib::Ptxt<helib::BGV> ptxt(context, std::vector<long>(ea.size(), 2));
+  helib::Ctxt ctxt1(publicKey);
+  helib::Ctxt ctxt2(publicKey);
+  publicKey.Encrypt(ctxt1, ptxt);
+  publicKey.Encrypt(ctxt2, ptxt);
+
+  helib::Ctxt prod(ctxt1);
+  long allocations = 0;
+  {
+    // One thread, so that the same buffers go back to the same pool
+    helib_test::GlobalSettingsGuard guard;
+    NTL::SetNumThreads(1);
+    helib::ResidueMap::setScratchPoolLimit(std::size_t(64) << 20);
+    for (long i = 0; i < 4; i++) {
+      long before = helib::ResidueMap::allocationCount();
+      prod = ctxt1;
+      prod.multiplyBy(ctxt2);
+      ea.rotate(prod, 1);
+      allocations = helib::ResidueMap::allocationCount() - before;
+    }
+  }
+
+  EXPECT_EQ(allocations, 0);
+  helib::Ptxt<helib::BGV> result(context);
+  secretKey.Decrypt(result, prod);
+  ptxt *= ptxt; // all the slots are the same, the rotation does not matter
+  EXPECT_EQ(result, ptxt);
+}
+
 // Use this when thoroughly exploring an (m, p) grid of parameters.
 // std::vector<BGVParameters> getParameters(bool good)
 // {
@@ -0,0 +1,648 @@
+/* Copyright (C) 2020-2021 IBM Corp.
+ * This program is Licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. See accompanying LICENSE file.
+ */
+
+#include <cstdint>
+
+#include <helib/helib.h>
+#include <helib/CounterPRG.h>
+#include <helib/NativeNTT.h>
+#include <helib/PrimeFactorFFT.h>
+#include <helib/ResidueMap.h>
+#include <helib/RNSBaseConverter.h>
+
+#include "test_common.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+using helib_test::GlobalSettingsGuard;
+
+struct DCRTParameters
+{
+  DCRTParameters(unsigned m, unsigned p, unsigned bits) :
+      m(m), p(p), bits(bits){};
+
+  const unsigned m;
+  const unsigned p;
+  const unsigned bits;
+
+  friend std::ostream& operator<<(std::ostream& os,
+                                  const DCRTParameters& params)
+  {
+    return os << "{"
+              << "m = " << params.m << ", "
+              << "p = " << params.p << ", "
+              << "bits = " << params.bits << "}";
+  }
+};
+
+class TestDoubleCRT : public ::testing::TestWithParam<DCRTParameters>
+{
+protected:
+  helib::Context context;
+  NTL::ZZX poly;
+
+  TestDoubleCRT() :
+      context(helib::ContextBuilder<helib::BGV>()
+                  .m(GetParam().m)
+                  .p(GetParam().p)
+                  .r(1)
+                  .bits(GetParam().bits)
+                  .build())
+  {
+    // A random polynomial with coefficients much smaller than any prime
+    long phim = context.getPhiM();
+    poly.SetLength(phim);
+    for (long i : helib::range(phim))
+      poly[i] = NTL::RandomBnd(2001) - 1000;
+    poly.normalize();
+  }
+
+  virtual ~TestDoubleCRT() = default;
+};
+
+TEST(TestDoubleCRTStorage, rowsAreAlignedAndSurviveRemoval)
+{
+  helib::ResidueMap map(13);
+  EXPECT_EQ(map.rowStride() * long(sizeof(long)) % helib::ResidueMap::ROW_ALIGN,
+            0);
+
+  map.insert(helib::IndexSet(0, 9));
+  for (long i : map.getIndexSet())
+    for (long j : helib::range(13))
+      map[i][j] = 100 * i + j;
+
+  map.remove(helib::IndexSet(2, 4));
+  map.insert(20);
+  for (long j : helib::range(13))
+    map[20][j] = 2000 + j;
+
+  EXPECT_EQ(map.numRows(), 8);
+  for (long i : map.getIndexSet()) {
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(map[i]) %
+                  helib::ResidueMap::ROW_ALIGN,
+              0u);
+    for (long j : helib::range(13))
+      EXPECT_EQ(map[i][j], 100 * i + j);
+  }
+
+  helib::ResidueMap copy(map);
+  EXPECT_EQ(copy, map);
+  copy[20][0]++;
+  EXPECT_NE(copy, map);
+}
+
+TEST(TestDoubleCRTStorage, releasedBuffersAreReused)
+{
+  GlobalSettingsGuard guard;
+  helib::ResidueMap::setScratchPoolLimit(std::size_t(1) << 20);
+  {
+    // warm up the pool of this thread
+    helib::ResidueMap map(100);
+    map.insert(helib::IndexSet(0, 9));
+  }
+  long before = helib::ResidueMap::allocationCount();
+  for (long i = 0; i < 10; i++) {
+    helib::ResidueMap map(100);
+    map.insert(helib::IndexSet(0, 9));
+    helib::ResidueMap moved(std::move(map));
+    moved.remove(helib::IndexSet(0, 4));
+    map = moved;
+  }
+  EXPECT_EQ(helib::ResidueMap::allocationCount(), before + 1);
+
+  helib::ResidueMap::setScratchPoolLimit(0);
+  before = helib::ResidueMap::allocationCount();
+  for (long i = 0; i < 3; i++) {
+    helib::ResidueMap map(100);
+    map.insert(helib::IndexSet(0, 9));
+  }
+  EXPECT_EQ(helib::ResidueMap::allocationCount(), before + 3);
+}
+
+TEST(TestDoubleCRTStorage, viewsKeepTheirBackingUntilTheyGrow)
+{
+  helib::ResidueMap owned(13);
+  owned.insert(helib::IndexSet(3, 5));
+  for (long i : owned.getIndexSet())
+    for (long j : helib::range(13))
+      owned[i][j] = 100 * i + j;
+
+  // The rows of owned, in the order of the index set
+  auto rows = std::make_shared<helib::ResidueMap>(owned);
+  long* data = rows->data();
+  std::weak_ptr<void> backing = rows;
+  helib::ResidueMap view =
+      helib::ResidueMap::view(13, owned.getIndexSet(), data, std::move(rows));
+  EXPECT_TRUE(view.isView());
+  EXPECT_EQ(view, owned);
+
+  helib::ResidueMap copy(view);
+  EXPECT_FALSE(copy.isView());
+  EXPECT_EQ(copy, owned);
+
+  helib::ResidueMap moved(std::move(view));
+  EXPECT_TRUE(moved.isView());
+  EXPECT_FALSE(backing.expired());
+
+  moved.insert(7);
+  EXPECT_FALSE(moved.isView());
+  EXPECT_TRUE(backing.expired());
+  moved.remove(7);
+  EXPECT_EQ(moved, owned);
+}
+
+TEST(TestCounterPRG, matchesChaCha20TestVector)
+{
+  // RFC 8439, section 2.3.2
+  NTL::ZZ seed;
+  unsigned char key[32];
+  for (long i : helib::range(32))
+    key[i] = i;
+  NTL::ZZFromBytes(seed, key, 32);
+
+  helib::CounterPRG prg(seed);
+  std::uint32_t out[16];
+  prg.block(out, 1, {0x09000000, 0x4a000000, 0x00000000});
+
+  const std::uint32_t expected[16] = {0xe4e7f110,
+                                      0x15593bd1,
+                                      0x1fdd0f50,
+                                      0xc47120a3,
+                                      0xc7f4d1c7,
+                                      0x0368c033,
+                                      0x9aaa2204,
+                                      0x4e6cd4c3,
+                                      0x466482d2,
+                                      0x09aa9f07,
+                                      0x05d7c214,
+                                      0xa2028bd9,
+                                      0xd19c12b5,
+                                      0xb94e16de,
+                                      0xe883d0cb,
+                                      0x4e3c50a2};
+  for (long i : helib::range(16))
+    EXPECT_EQ(out[i], expected[i]) << "word " << i;
+}
+
+TEST_P(TestDoubleCRT, counterRandomizeRowsAreIndependent)
+{
+  helib::CounterPRG prg(NTL::conv<NTL::ZZ>(123456789));
+  helib::IndexSet all = context.fullPrimes();
+  helib::IndexSet one(all.last(), all.last());
+
+  helib::DoubleCRT a(context, all);
+  a.randomize(prg, 2);
+  helib::DoubleCRT b(context, one);
+  b.randomize(prg, 2);
+  helib::DoubleCRT c(context, all);
+  c.randomize(prg, 3);
+
+  helib::DoubleCRT expected = a;
+  expected.removePrimes(all / one);
+  EXPECT_EQ(b, expected);
+  EXPECT_NE(a, c);
+  for (long i : all)
+    for (long j : helib::range(context.getPhiM()))
+      ASSERT_LT(a.getMap()[i][j], context.ithPrime(i));
+}
+
+TEST_P(TestDoubleCRT, conversionRoundTrips)
+{
+  helib::DoubleCRT dcrt(poly, context, context.getCtxtPrimes());
+  NTL::ZZX back;
+  dcrt.toPoly(back);
+  EXPECT_EQ(back, poly);
+}
+
+TEST_P(TestDoubleCRT, removeAndAddPrimesKeepsValue)
+{
+  helib::IndexSet all = context.getCtxtPrimes() | context.getSpecialPrimes();
+  helib::DoubleCRT dcrt(poly, context, all);
+
+  helib::IndexSet dropped = context.getCtxtPrimes();
+  dcrt.removePrimes(dropped);
+  dcrt.addPrimes(dropped);
+
+  EXPECT_EQ(dcrt, helib::DoubleCRT(poly, context, all));
+}
+
+TEST_P(TestDoubleCRT, arithmeticMatchesPolynomialArithmetic)
+{
+  const helib::IndexSet& s = context.getCtxtPrimes();
+  NTL::ZZX other;
+  other.SetLength(context.getPhiM());
+  for (long i : helib::range(context.getPhiM()))
+    other[i] = NTL::RandomBnd(21) - 10;
+  other.normalize();
+
+  helib::DoubleCRT a(poly, context, s);
+  helib::DoubleCRT b(other, context, s);
+
+  helib::DoubleCRT sum = a;
+  sum += b;
+  EXPECT_EQ(sum, helib::DoubleCRT(poly + other, context, s));
+
+  helib::DoubleCRT diff = a;
+  diff -= b;
+  EXPECT_EQ(diff, helib::DoubleCRT(poly - other, context, s));
+
+  helib::DoubleCRT prod = a;
+  prod *= b;
+  NTL::ZZX expected;
+  MulMod(expected, poly, other, context.getZMStar().getPhimX());
+  EXPECT_EQ(prod, helib::DoubleCRT(expected, context, s));
+}
+
+TEST_P(TestDoubleCRT, automorphMatchesPolynomialAutomorphism)
+{
+  const helib::IndexSet& s = context.getCtxtPrimes();
+  long m = context.getM();
+
+  for (long k : {3L, m - 1, 5L}) {
+    if (NTL::GCD(k, m) != 1)
+      continue;
+
+    // poly(X^k) mod Phi_m(X)
+    NTL::ZZX permuted;
+    for (long i : helib::range(deg(poly) + 1))
+      SetCoeff(permuted, (i * k) % m, coeff(poly, i));
+    NTL::ZZX expected;
+    rem(expected, permuted, context.getZMStar().getPhimX());
+
+    helib::DoubleCRT dcrt(poly, context, s);
+    dcrt.automorph(k);
+    EXPECT_EQ(dcrt, helib::DoubleCRT(expected, context, s)) << "k = " << k;
+
+    if (k == m - 1) {
+      helib::DoubleCRT conj(poly, context, s);
+      conj.complexConj();
+      EXPECT_EQ(conj, dcrt);
+    }
+  }
+}
+
+TEST_P(TestDoubleCRT, automorphTablesAreCachedWithinBudget)
+{
+  long m = context.getM();
+  std::shared_ptr<const helib::AutomorphCache::Table> table =
+      context.getAutomorphTable(m - 1);
+  EXPECT_EQ(table, context.getAutomorphTable(m - 1));
+
+  // Room for two tables only
+  std::size_t tableSize = table->size() * sizeof(std::uint32_t);
+  context.setAutomorphCacheBudget(2 * tableSize);
+  for (long k : helib::range(2, m))
+    if (context.getZMStar().inZmStar(k))
+      context.getAutomorphTable(k);
+  EXPECT_LE(context.getAutomorphCache().memoryUsed(), 2 * tableSize);
+  EXPECT_EQ(context.getAutomorphCache().size(), 2u);
+
+  // Evicted tables are still usable and are rebuilt identically
+  EXPECT_EQ(*context.getAutomorphTable(m - 1), *table);
+
+  context.setAutomorphCacheBudget(helib::AutomorphCache::DEFAULT_BUDGET);
+}
+
+TEST_P(TestDoubleCRT, baseConversionMatchesIntegerCRT)
+{
+  const helib::IndexSet& from = context.getDigit(0);
+  helib::IndexSet to =
+      (context.getCtxtPrimes() | context.getSpecialPrimes()) / from;
+  std::shared_ptr<const helib::RNSBaseConverter> converter =
+      context.getBaseConverter(from, to);
+  EXPECT_EQ(converter, context.getBaseConverter(from, to));
+
+  // Random integers in the balanced interval modulo Q = prod(from)
+  const long n = 100;
+  NTL::ZZ Q = context.productOfPrimes(from);
+  std::vector<NTL::ZZ> x(n);
+  for (long h : helib::range(n))
+    x[h] = NTL::RandomBnd(Q) - Q / 2;
+
+  std::vector<long> in(from.card() * n);
+  long k = 0;
+  for (long j : from) {
+    for (long h : helib::range(n))
+      in[k * n + h] = rem(x[h], context.ithPrime(j));
+    k++;
+  }
+
+  std::vector<long> out(to.card() * n);
+  std::vector<double> frac(n);
+  converter->convert(out.data(), n, in.data(), n, n, frac.data());
+
+  k = 0;
+  for (long i : to) {
+    for (long h : helib::range(n))
+      EXPECT_EQ(out[k * n + h], rem(x[h], context.ithPrime(i)));
+    k++;
+  }
+  for (long h : helib::range(n))
+    EXPECT_NEAR(frac[h], NTL::conv<double>(x[h]) / NTL::conv<double>(Q), 1e-9);
+}
+
+TEST_P(TestDoubleCRT, scaleDownMatchesIntegerVersion)
+{
+  helib::IndexSet all = context.getCtxtPrimes() | context.getSpecialPrimes();
+  helib::DoubleCRT dcrt(context, all);
+  dcrt.randomize();
+
+  NTL::ZZ ptxtSpace(GetParam().p);
+  NTL::ZZ diffProd = context.productOfPrimes(context.getSpecialPrimes());
+
+  helib::DoubleCRT expected = dcrt;
+  NTL::ZZX delta;
+  expected.scaleDownToSet(context.getCtxtPrimes(), ptxtSpace, delta);
+
+  std::vector<double> fdelta;
+  dcrt.scaleDownToSet(context.getCtxtPrimes(), ptxtSpace, fdelta);
+
+  EXPECT_EQ(dcrt, expected);
+  ASSERT_GE(helib::lsize(fdelta), delta.rep.length());
+  for (long i : helib::range(helib::lsize(fdelta))) {
+    double d = NTL::conv<double>(NTL::conv<NTL::xdouble>(coeff(delta, i)) /
+                                 NTL::conv<NTL::xdouble>(diffProd));
+    EXPECT_NEAR(fdelta[i], d, 1e-9);
+  }
+}
+
+TEST_P(TestDoubleCRT, nativeKernelsMatchNTL)
+{
+  const helib::IndexSet& s = context.getCtxtPrimes();
+  NTL::ZZX other;
+  other.SetLength(context.getPhiM());
+  for (long i : helib::range(context.getPhiM()))
+    other[i] = NTL::RandomBnd(21) - 10;
+  other.normalize();
+
+  auto compute = [&](helib::DoubleCRT& a, NTL::ZZX& back) {
+    a = helib::DoubleCRT(poly, context, s);
+    helib::DoubleCRT b(other, context, s);
+    a *= b;
+    a += b;
+    a -= 3L;
+    a *= 5L;
+    a.toPoly(back);
+  };
+
+  GlobalSettingsGuard guard;
+
+  // Reference: NTL's FFT and scalar arithmetic
+  helib::setNativeNTTEnabled(false);
+  helib::setSimdLevel(helib::SimdLevel::SCALAR);
+  helib::DoubleCRT expected(context, s);
+  NTL::ZZX expectedPoly;
+  compute(expected, expectedPoly);
+
+  helib::setNativeNTTEnabled(true);
+  for (int level = 0; level <= int(helib::detectSimdLevel()); level++) {
+    helib::setSimdLevel(helib::SimdLevel(level));
+    helib::DoubleCRT dcrt(context, s);
+    NTL::ZZX back;
+    compute(dcrt, back);
+    EXPECT_EQ(dcrt, expected) << "SIMD level " << level;
+    EXPECT_EQ(back, expectedPoly) << "SIMD level " << level;
+  }
+}
+
+TEST_P(TestDoubleCRT, primeFactorFFTMatchesBluestein)
+{
+  long m = context.getM();
+  if (context.getZMStar().getPow2())
+    return; // not used for powers of two
+
+  const helib::Cmodulus& cmod = context.ithModulus(0);
+  NTL::zz_pPush push;
+  cmod.restoreModulus();
+
+  for (bool inverse : {false, true}) {
+    NTL::zz_p rt = NTL::conv<NTL::zz_p>(cmod.getRoot());
+    if (inverse)
+      rt = inv(rt);
+
+    NTL::zz_pX powers;
+    NTL::Vec<NTL::mulmod_precon_t> powers_aux;
+    NTL::fftRep Rb;
+    helib::BluesteinInit(m, rt, powers, powers_aux, Rb);
+
+    NTL::zz_pX x;
+    random(x, m);
+    NTL::zz_pX expected = x;
+    helib::BluesteinFFT(expected, m, rt, powers, powers_aux, Rb);
+
+    helib::PrimeFactorFFT direct(m, rt * rt);
+    std::vector<long> y(m);
+    for (long i : helib::range(m))
+      y[i] = rep(coeff(x, i));
+    direct.apply(y.data(), y.data());
+
+    for (long i : helib::range(m))
+      EXPECT_EQ(y[i], rep(coeff(expected, i))) << "i = " << i;
+  }
+}
+
+TEST_P(TestDoubleCRT, parallelOpsMatchSerialOps)
+{
+  const helib::IndexSet& s = context.getCtxtPrimes();
+  helib::IndexSet s1 = context.getSpecialPrimes();
+  long m = context.getM();
+  long k = (NTL::GCD(3, m) == 1) ? 3 : 5;
+  NTL::ZZ num = context.productOfPrimes(s) / 7 + 1;
+
+  NTL::ZZX other;
+  other.SetLength(context.getPhiM());
+  for (long i : helib::range(context.getPhiM()))
+    other[i] = NTL::RandomBnd(21) - 10;
+  other.normalize();
+
+  auto run = [&]() {
+    helib::DoubleCRT a(poly, context, s);
+    helib::DoubleCRT b(other, context, s);
+    a += b;
+    a *= b;
+    a -= num;
+    a *= num;
+    a /= NTL::ZZ(7);
+    a.automorph(k);
+    a.complexConj();
+    a.Exp(3);
+    b.Negate(a);
+    b.addPrimesAndScale(s1);
+    return b;
+  };
+
+  GlobalSettingsGuard guard;
+
+  helib::setDoubleCRTParallelThreshold(1L << 62);
+  helib::DoubleCRT serial = run();
+
+  NTL::SetNumThreads(4);
+  helib::setDoubleCRTParallelThreshold(0);
+  helib::DoubleCRT parallel = run();
+
+  EXPECT_EQ(parallel, serial);
+}
+
+TEST_P(TestDoubleCRT, innerProductsMatchMulAndAdd)
+{
+  const helib::IndexSet& s = context.getCtxtPrimes();
+  helib::IndexSet all = s | context.getSpecialPrimes();
+
+  std::vector<helib::DoubleCRT> d, a, b;
+  for (long k : helib::range(4)) {
+    d.emplace_back(context, all);
+    a.emplace_back(context, all);
+    b.emplace_back(context, all);
+    d[k].randomize();
+    a[k].randomize();
+    b[k].randomize();
+  }
+
+  helib::DoubleCRT accA(poly, context, s);
+  helib::DoubleCRT accB(context, s);
+  helib::DoubleCRT expectedA = accA;
+  helib::DoubleCRT expectedB = accB;
+  for (long k : helib::range(4)) {
+    helib::DoubleCRT tmp = d[k];
+    tmp.removePrimes(context.getSpecialPrimes());
+    helib::DoubleCRT tmp2 = tmp;
+    tmp.Mul(a[k], /*matchIndexSets=*/false);
+    expectedA += tmp;
+    tmp2.Mul(b[k], /*matchIndexSets=*/false);
+    expectedB += tmp2;
+  }
+
+  helib::DoubleCRT::innerProducts(accA, accB, d, a, b);
+  EXPECT_EQ(accA, expectedA);
+  EXPECT_EQ(accB, expectedB);
+}
+
+TEST_P(TestDoubleCRT, setAndAddProductMatchMul)
+{
+  const helib::IndexSet& s = context.getCtxtPrimes();
+  helib::IndexSet all = s | context.getSpecialPrimes();
+  helib::DoubleCRT a(context, all);
+  helib::DoubleCRT b(context, all);
+  a.randomize();
+  b.randomize();
+
+  helib::DoubleCRT expected(poly, context, s);
+  helib::DoubleCRT tmp = a;
+  tmp.removePrimes(context.getSpecialPrimes());
+  tmp.Mul(b, /*matchIndexSets=*/false);
+  expected += tmp;
+
+  helib::DoubleCRT prod(context, s);
+  prod.setProduct(a, b);
+  EXPECT_EQ(prod, tmp);
+
+  helib::DoubleCRT acc(poly, context, s);
+  acc.addProduct(a, b);
+  EXPECT_EQ(acc, expected);
+
+  // aliasing *this
+  acc = helib::DoubleCRT(poly, context, s);
+  helib::DoubleCRT square = acc;
+  square *= acc;
+  acc.setProduct(acc, acc);
+  EXPECT_EQ(acc, square);
+}
+
+TEST_P(TestDoubleCRT, digitNoiseEstimatePoliciesMatchExactDigits)
+{
+  using Policy = helib::Context::DigitNoiseEstimate;
+  helib::DoubleCRT dcrt(context, context.getCtxtPrimes());
+  dcrt.randomize();
+
+  std::vector<helib::DoubleCRT> exactDigits;
+  NTL::xdouble exact = dcrt.breakIntoDigits(exactDigits);
+
+  // The bound is the sum over the digits of noiseBoundForUniform
+  NTL::xdouble bound(0.0);
+  for (const helib::DoubleCRT& digit : exactDigits)
+    bound += context.noiseBoundForUniform(
+        NTL::xexp(context.logOfProduct(digit.getIndexSet())) / 2.0,
+        context.getPhiM());
+
+  // (up to rounding, as the sum need not be taken in the same order)
+  context.setDigitNoiseEstimate(Policy::BOUND);
+  std::vector<helib::DoubleCRT> digits;
+  EXPECT_NEAR(NTL::conv<double>(dcrt.breakIntoDigits(digits) / bound),
+              1.0,
+              1e-9);
+  EXPECT_EQ(digits, exactDigits);
+
+  // The first sampled call is exact, the next one scales the bound
+  context.setDigitNoiseEstimate(Policy::SAMPLED, 2);
+  EXPECT_EQ(dcrt.breakIntoDigits(digits), exact);
+  EXPECT_EQ(digits, exactDigits);
+  NTL::xdouble scaled = dcrt.breakIntoDigits(digits);
+  EXPECT_NEAR(NTL::conv<double>(scaled / exact), 1.0, 1e-9);
+  EXPECT_EQ(digits, exactDigits);
+  EXPECT_EQ(dcrt.breakIntoDigits(digits), exact);
+
+  EXPECT_THROW(context.setDigitNoiseEstimate(Policy::SAMPLED, 0),
+               helib::InvalidArgument);
+  context.setDigitNoiseEstimate(Policy::EXACT);
+  EXPECT_EQ(context.getDigitNoiseEstimate(), Policy::EXACT);
+}
+
+TEST_P(TestDoubleCRT, breakIntoDigitsDoesNotDependOnThreadCount)
+{
+  helib::DoubleCRT dcrt(context, context.getCtxtPrimes());
+  dcrt.randomize();
+
+  std::vector<std::vector<helib::DoubleCRT>> digits(2);
+  std::vector<NTL::xdouble> noise;
+  {
+    GlobalSettingsGuard guard;
+    NTL::SetNumThreads(1);
+    noise.push_back(dcrt.breakIntoDigits(digits[0]));
+    NTL::SetNumThreads(4);
+    noise.push_back(dcrt.breakIntoDigits(digits[1]));
+  }
+
+  EXPECT_EQ(noise[0], noise[1]);
+  EXPECT_EQ(digits[0], digits[1]);
+
+  // sum_i digit_i * prod_{k<i} P_k recovers dcrt, P_k the product of digit k
+  helib::DoubleCRT sum(context, dcrt.getIndexSet());
+  NTL::ZZ factor(1);
+  for (long i : helib::range(digits[0].size())) {
+    helib::DoubleCRT tmp = digits[0][i];
+    EXPECT_EQ(tmp.getIndexSet(),
+              dcrt.getIndexSet() | context.getSpecialPrimes());
+    tmp.removePrimes(context.getSpecialPrimes());
+    tmp *= factor;
+    sum += tmp;
+    factor *= context.productOfPrimes(context.getDigit(i));
+  }
+  EXPECT_EQ(sum, dcrt);
+}
+
+TEST_P(TestDoubleCRT, binaryIORoundTrips)
+{
+  helib::DoubleCRT dcrt(poly, context, context.getCtxtPrimes());
+  std::stringstream ss;
+  dcrt.writeTo(ss);
+  helib::DoubleCRT back = helib::DoubleCRT::readFrom(ss, context);
+  EXPECT_EQ(back, dcrt);
+}
+
+INSTANTIATE_TEST_SUITE_P(Parameters,
+                         TestDoubleCRT,
+                         ::testing::Values(DCRTParameters(45, 2, 300),
+                                           DCRTParameters(256, 17, 300),
+                                           DCRTParameters(4369, 2, 500)));
+
+} // namespace
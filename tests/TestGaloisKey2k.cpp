@@ -0,0 +1,209 @@
+/* Copyright (C) 2020-2021 IBM Corp.
+ * This program is Licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. See accompanying LICENSE file.
+ */
+
+#include <sstream>
+#include <thread>
+
+#include <helib/helib.h>
+#include <helib/GaloisKey2k.h>
+
+#include "test_common.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+class TestGaloisKey2k : public ::testing::Test
+{
+protected:
+  const long m = 2048;
+  const long p = 17;
+  helib::Context context;
+  helib::SecKey secretKey;
+  const helib::PubKey& publicKey;
+  NTL::ZZX poly;
+  helib::Ctxt ctxt;
+
+  TestGaloisKey2k() :
+      context(helib::ContextBuilder<helib::BGV>()
+                  .m(m)
+                  .p(p)
+                  .r(1)
+                  .bits(300)
+                  .build()),
+      secretKey(context),
+      publicKey((secretKey.GenSecKey(), secretKey)),
+      ctxt(publicKey)
+  {
+    long n = m / 2;
+    for (long i = 0; i < n; i++)
+      SetCoeff(poly, i, (3 * i + 1) % p);
+    publicKey.Encrypt(ctxt, poly);
+  }
+
+  // X -> X^galois_elt in Z_p[X]/(X^n + 1), coefficients in [0, p)
+  std::vector<long> automorph(const NTL::ZZX& a, long galois_elt) const
+  {
+    long n = m / 2;
+    std::vector<long> res(n, 0);
+    for (long i = 0; i <= deg(a); i++) {
+      long j = (i * galois_elt) % m;
+      long c = NTL::conv<long>(coeff(a, i)) % p;
+      if (j >= n)
+        res[j - n] = (res[j - n] + p - c) % p;
+      else
+        res[j] = (res[j] + c) % p;
+    }
+    return res;
+  }
+
+  std::vector<long> decrypt(const helib::Ctxt& c) const
+  {
+    NTL::ZZX a;
+    secretKey.Decrypt(a, c);
+    std::vector<long> res(m / 2, 0);
+    for (long i = 0; i <= deg(a); i++)
+      res[i] = ((NTL::conv<long>(coeff(a, i)) % p) + p) % p;
+    return res;
+  }
+
+  static long powMod3(long e, long m)
+  {
+    long x = 1;
+    for (long i = 0; i < e; i++)
+      x = (x * 3) % m;
+    return x;
+  }
+};
+
+TEST_F(TestGaloisKey2k, rotateByMissingStepUsesPowerOfTwoKeys)
+{
+  helib::GaloisKey2k gk(m);
+  gk.generate_power_of_two_steps(secretKey);
+
+  long row_size = m / 4;
+  for (long step : {1L, 5L, 11L, -7L, row_size - 1}) {
+    helib::Ctxt tmp(ctxt);
+    gk.rotate(tmp, step);
+    long elt = powMod3((step + row_size) % row_size, m);
+    EXPECT_EQ(decrypt(tmp), automorph(poly, elt)) << "step " << step;
+  }
+}
+
+TEST_F(TestGaloisKey2k, rotateManyMatchesRotate)
+{
+  helib::GaloisKey2k gk(m);
+  gk.generate_power_of_two_steps(secretKey);
+  gk.generate_step(secretKey, 0);
+  gk.generate_step(secretKey, 3);
+
+  std::vector<int32_t> steps = {0, 1, 3, 6, -5, -16};
+  std::vector<helib::Ctxt> rotated = gk.rotateMany(ctxt, steps);
+
+  ASSERT_EQ(rotated.size(), steps.size());
+  for (std::size_t j = 0; j < steps.size(); j++) {
+    helib::Ctxt expected(ctxt);
+    gk.rotate(expected, steps[j]);
+    EXPECT_EQ(decrypt(rotated[j]), decrypt(expected)) << "step " << steps[j];
+  }
+}
+
+TEST_F(TestGaloisKey2k, rotateThrowsWithoutAnyUsableKey)
+{
+  helib::GaloisKey2k gk(m);
+  gk.generate_step(secretKey, 1);
+
+  helib::Ctxt tmp(ctxt);
+  EXPECT_THROW(gk.rotate(tmp, 3), helib::RuntimeError);
+  EXPECT_THROW(gk.rotateMany(ctxt, {1, 3}), helib::RuntimeError);
+}
+
+TEST_F(TestGaloisKey2k, keysReadBackRotateTheSame)
+{
+  helib::GaloisKey2k gk(m);
+  gk.generate_step(secretKey, 1);
+  gk.generate_step(secretKey, -4);
+
+  std::stringstream str;
+  gk.writeTo(str);
+
+  helib::GaloisKey2k gk2(m);
+  gk2.read(str, context);
+
+  for (int32_t step : {1, -4}) {
+    helib::Ctxt expected(ctxt);
+    gk.rotate(expected, step);
+    helib::Ctxt tmp(ctxt);
+    gk2.rotate(tmp, step);
+    EXPECT_EQ(decrypt(tmp), decrypt(expected)) << "step " << step;
+  }
+}
+
+TEST_F(TestGaloisKey2k, generateStepsStreamsTheSameKeysForAnyThreadCount)
+{
+  std::vector<int32_t> steps = {1, 2, -3, 1, 0};
+  // The seed determines the errors of the keys, so it is as secret as the
+  // secret key: a fresh random one, reused only between the two runs
+  NTL::ZZ seed = NTL::RandomBits_ZZ(256);
+
+  helib::GaloisKey2k gk(m);
+  helib::GaloisKey2k gk1(m);
+  std::stringstream streamed;
+  {
+    helib_test::GlobalSettingsGuard guard;
+    NTL::SetNumThreads(4);
+    gk.generate_steps(secretKey, steps, seed, &streamed);
+
+    NTL::SetNumThreads(1);
+    gk1.generate_steps(secretKey, steps, seed);
+  }
+
+  helib::GaloisKey2k gk2(m);
+  gk2.read(streamed, context);
+
+  std::stringstream str, str1, str2;
+  gk.writeTo(str);
+  gk1.writeTo(str1);
+  gk2.writeTo(str2);
+  EXPECT_EQ(str1.str(), str.str());
+  EXPECT_EQ(str2.str(), str.str());
+
+  helib::Ctxt tmp(ctxt);
+  gk2.rotate(tmp, -3);
+  long row_size = m / 4;
+  EXPECT_EQ(decrypt(tmp), automorph(poly, powMod3(row_size - 3, m)));
+}
+
+#ifdef HELIB_THREADS
+TEST_F(TestGaloisKey2k, rotateWhileGeneratingKeys)
+{
+  helib::GaloisKey2k gk(m);
+  gk.generate_step(secretKey, 1);
+  long elt = powMod3(1, m);
+
+  std::thread generator([&] {
+    for (int32_t step : {2, 3, 5, 7})
+      gk.generate_step(secretKey, step);
+  });
+  for (long rep = 0; rep < 4; rep++) {
+    helib::Ctxt tmp(ctxt);
+    gk.rotate(tmp, 1);
+    EXPECT_EQ(decrypt(tmp), automorph(poly, elt));
+  }
+  generator.join();
+
+  helib::Ctxt tmp(ctxt);
+  gk.rotate(tmp, 7);
+  EXPECT_EQ(decrypt(tmp), automorph(poly, powMod3(7, m)));
+}
+#endif
+
+} // namespace
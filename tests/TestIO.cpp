@@ -66,6 +66,24 @@ static std::vector<std::complex<double>> createData(long size)
   return data;
 }
 
+// The same document, with the keys of every object in reverse order
+static nlohmann::ordered_json reverseKeys(const json& j)
+{
+  if (j.is_object()) {
+    nlohmann::ordered_json reversed = nlohmann::ordered_json::object();
+    for (auto it = j.rbegin(); it != j.rend(); ++it)
+      reversed[it.key()] = reverseKeys(it.value());
+    return reversed;
+  }
+  if (j.is_array()) {
+    nlohmann::ordered_json reversed = nlohmann::ordered_json::array();
+    for (const json& e : j)
+      reversed.push_back(reverseKeys(e));
+    return reversed;
+  }
+  return nlohmann::ordered_json::parse(j.dump());
+}
+
 static std::string addHeader(const std::string& data,
                              const std::string& scheme,
                              const std::string& type = "Ptxt")
@@ -900,6 +918,106 @@ TEST_P(TestIO_BGV, canPerformOperationsOnDeserializedCiphertext)
   EXPECT_NO_THROW(ptxt.decrypt(deserialized_ctxt, secretKey));
 }
 
+TEST_P(TestIO_BGV, jsonStreamsWriteTheJsonWrapperDocuments)
+{
+  helib::PtxtArray ptxt(ea);
+  ptxt.random();
+  helib::Ctxt ctxt(publicKey);
+  ptxt.encrypt(ctxt);
+
+  std::stringstream ss;
+  ctxt.writeToJSON(ss);
+  EXPECT_EQ(ss.str(), ctxt.writeToJSON().toString());
+
+  ss.str("");
+  publicKey.writeToJSON(ss);
+  EXPECT_EQ(ss.str(), publicKey.writeToJSON().toString());
+
+  ss.str("");
+  publicKey.keySWlist().front().writeToJSON(ss);
+  EXPECT_EQ(ss.str(), publicKey.keySWlist().front().writeToJSON().toString());
+
+  ss.str("");
+  secretKey.writeToJSON(ss);
+  EXPECT_EQ(ss.str(), secretKey.writeToJSON().toString());
+
+  ss.str("");
+  secretKey.writeToJSON(ss, /*sk_only=*/true);
+  EXPECT_EQ(ss.str(), secretKey.writeToJSON(/*sk_only=*/true).toString());
+}
+
+TEST_P(TestIO_BGV, jsonStreamsReadKeysInAnyOrder)
+{
+  helib::PtxtArray ptxt(ea);
+  ptxt.random();
+  helib::Ctxt ctxt(publicKey);
+  ptxt.encrypt(ctxt);
+
+  std::stringstream ss;
+  ss << reverseKeys(helib::unwrap(ctxt.writeToJSON()));
+  EXPECT_EQ(helib::Ctxt::readFromJSON(ss, publicKey), ctxt);
+
+  ss.str("");
+  ss.clear();
+  ss << reverseKeys(helib::unwrap(publicKey.writeToJSON()));
+  EXPECT_EQ(helib::PubKey::readFromJSON(ss, context), publicKey);
+
+  ss.str("");
+  ss.clear();
+  ss << reverseKeys(helib::unwrap(secretKey.writeToJSON()));
+  EXPECT_EQ(helib::SecKey::readFromJSON(ss, context), secretKey);
+}
+
+TEST_P(TestIO_BGV, jsonStreamsReadOneDocumentAtATime)
+{
+  helib::PtxtArray ptxt(ea);
+  ptxt.random();
+  helib::Ctxt ctxt(publicKey);
+  ptxt.encrypt(ctxt);
+  helib::Ctxt squared = ctxt;
+  squared.multiplyBy(ctxt);
+
+  std::stringstream ss;
+  ss << ctxt << squared.writeToJSON().pretty() << " " << ctxt;
+  EXPECT_EQ(helib::Ctxt::readFromJSON(ss, publicKey), ctxt);
+  EXPECT_EQ(helib::Ctxt::readFromJSON(ss, publicKey), squared);
+  EXPECT_EQ(helib::Ctxt::readFromJSON(ss, publicKey), ctxt);
+}
+
+TEST_P(TestIO_BGV, jsonStreamsThrowOnMalformedDocuments)
+{
+  helib::PtxtArray ptxt(ea);
+  ptxt.random();
+  helib::Ctxt ctxt(publicKey);
+  ptxt.encrypt(ctxt);
+  std::stringstream ss;
+  ss << ctxt;
+  std::string text = ss.str();
+
+  std::stringstream truncated(text.substr(0, text.size() / 2));
+  EXPECT_THROW(helib::Ctxt::readFromJSON(truncated, publicKey),
+               helib::IOError);
+
+  json j = helib::unwrap(ctxt.writeToJSON());
+  json& row = j.at("content").at("parts").at(0).at("DoubleCRT").at("map")[0];
+  row.push_back(0);
+  std::stringstream longRow;
+  longRow << j;
+  EXPECT_THROW(helib::Ctxt::readFromJSON(longRow, publicKey), helib::IOError);
+
+  row.erase(row.size() - 1);
+  row[0] = 0.5;
+  std::stringstream floatingPoint;
+  floatingPoint << j;
+  EXPECT_THROW(helib::Ctxt::readFromJSON(floatingPoint, publicKey),
+               helib::IOError);
+
+  std::stringstream wrongType;
+  publicKey.writeToJSON(wrongType);
+  EXPECT_THROW(helib::Ctxt::readFromJSON(wrongType, publicKey),
+               helib::IOError);
+}
+
 TEST_P(TestIO_BGV, ptxtWritesDataCorrectlyToOstream)
 {
   const long p2r = context.getSlotRing()->p2r;
@@ -1727,6 +1845,27 @@ TEST_P(TestIO_CKKS, canPerformOperationsOnDeserializedCiphertext)
   EXPECT_NO_THROW(ptxt.decrypt(deserialized_ctxt, secretKey));
 }
 
+TEST_P(TestIO_CKKS, jsonStreamsWriteTheJsonWrapperDocuments)
+{
+  helib::PtxtArray ptxt(ea);
+  ptxt.random();
+  helib::Ctxt ctxt(publicKey);
+  ptxt.encrypt(ctxt);
+
+  std::stringstream ss;
+  ctxt.writeToJSON(ss);
+  EXPECT_EQ(ss.str(), ctxt.writeToJSON().toString());
+  EXPECT_EQ(helib::Ctxt::readFromJSON(ss, publicKey), ctxt);
+
+  ss.str("");
+  publicKey.writeToJSON(ss);
+  EXPECT_EQ(ss.str(), publicKey.writeToJSON().toString());
+
+  ss.str("");
+  secretKey.writeToJSON(ss);
+  EXPECT_EQ(ss.str(), secretKey.writeToJSON().toString());
+}
+
 TEST_P(TestIO_CKKS, ptxtWritesDataCorrectlyToOstream)
 {
   std::vector<std::complex<double>> data(context.getEA().size());
@@ -0,0 +1,258 @@
+/* Copyright (C) 2020 IBM Corp.
+ * This program is Licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. See accompanying LICENSE file.
+ */
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include <helib/helib.h>
+#include <helib/MappedFile.h>
+
+#include "test_common.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+class TestMappedFile : public ::testing::Test
+{
+protected:
+  helib::Context context;
+  helib::SecKey secretKey;
+  const helib::PubKey& publicKey;
+  std::vector<std::string> paths;
+
+  TestMappedFile() :
+      context(helib::ContextBuilder<helib::BGV>()
+                  .m(1024)
+                  .p(17)
+                  .r(1)
+                  .bits(200)
+                  .build()),
+      secretKey(context),
+      publicKey((secretKey.GenSecKey(), secretKey))
+  {
+    helib::addSome1DMatrices(secretKey);
+  }
+
+  ~TestMappedFile()
+  {
+    for (const std::string& path : paths)
+      std::remove(path.c_str());
+  }
+
+  // A file for the current test, removed at its end
+  std::string filePath(const std::string& name)
+  {
+    paths.push_back("TestMappedFile_" + name + ".bin");
+    return paths.back();
+  }
+
+  template <typename T>
+  void writeMappable(const T& obj, const std::string& path)
+  {
+    std::ofstream out(path, std::ios::binary);
+    helib::setMappableLayout(out);
+    obj.writeTo(out);
+  }
+};
+
+#ifdef HELIB_MAPPED_FILES
+
+TEST_F(TestMappedFile, doubleCRTIsReadInPlaceFromTheMapping)
+{
+  helib::DoubleCRT dcrt(context, context.getCtxtPrimes());
+  dcrt.randomize();
+  const std::string path = filePath("dcrt");
+  writeMappable(dcrt, path);
+
+  auto file = std::make_shared<helib::MappedFile>(path);
+  helib::MappedStream str(file);
+  helib::DoubleCRT mapped = helib::DoubleCRT::readFrom(str, context);
+  EXPECT_TRUE(mapped.isView());
+  EXPECT_EQ(mapped, dcrt);
+
+  // Copies own their rows, and writing to a view leaves the file as it was
+  helib::DoubleCRT copy = mapped;
+  EXPECT_FALSE(copy.isView());
+  mapped += copy;
+  EXPECT_FALSE(mapped.isView());
+  helib::DoubleCRT twice = dcrt;
+  twice *= 2l;
+  EXPECT_EQ(mapped, twice);
+  EXPECT_EQ(copy, dcrt);
+  helib::MappedStream again(std::make_shared<helib::MappedFile>(path));
+  EXPECT_EQ(helib::DoubleCRT::readFrom(again, context), dcrt);
+}
+
+TEST_F(TestMappedFile, modifyingAViewLeavesOtherViewsOfTheRecordUnchanged)
+{
+  helib::DoubleCRT dcrt(context, context.getCtxtPrimes());
+  dcrt.randomize();
+  helib::Ptxt<helib::BGV> ptxt(context);
+  for (std::size_t i = 0; i < ptxt.size(); i++)
+    ptxt[i] = (5 * i + 2) % 17;
+  helib::Ctxt ctxt(publicKey);
+  publicKey.Encrypt(ctxt, ptxt);
+  const std::string dcrtPath = filePath("dcrt");
+  const std::string ctxtPath = filePath("ctxt");
+  writeMappable(dcrt, dcrtPath);
+  writeMappable(ctxt, ctxtPath);
+
+  // Both reads of the record are views of the same rows of one mapping
+  auto file = std::make_shared<helib::MappedFile>(dcrtPath);
+  helib::MappedStream str1(file);
+  helib::MappedStream str2(file);
+  helib::DoubleCRT first = helib::DoubleCRT::readFrom(str1, context);
+  helib::DoubleCRT second = helib::DoubleCRT::readFrom(str2, context);
+  ASSERT_TRUE(first.isView());
+  ASSERT_TRUE(second.isView());
+
+  first += dcrt;
+  EXPECT_FALSE(first.isView());
+  EXPECT_TRUE(second.isView());
+  EXPECT_EQ(second, dcrt);
+  first = helib::DoubleCRT::readFrom(str1.seekg(0), context);
+  second.automorph(3);
+  EXPECT_FALSE(second.isView());
+  EXPECT_EQ(first, dcrt);
+
+  // The same goes for ciphertexts, e.g., when squaring one of them
+  auto ctxtFile = std::make_shared<helib::MappedFile>(ctxtPath);
+  helib::MappedStream str3(ctxtFile);
+  helib::MappedStream str4(ctxtFile);
+  helib::Ctxt squared = helib::Ctxt::readFrom(str3, publicKey);
+  helib::Ctxt untouched = helib::Ctxt::readFrom(str4, publicKey);
+  squared.multiplyBy(squared);
+  EXPECT_EQ(untouched, ctxt);
+  helib::Ptxt<helib::BGV> decrypted(context);
+  secretKey.Decrypt(decrypted, untouched);
+  EXPECT_EQ(decrypted, ptxt);
+  secretKey.Decrypt(decrypted, squared);
+  EXPECT_EQ(decrypted, ptxt * ptxt);
+}
+
+#endif // ifdef HELIB_MAPPED_FILES
+
+TEST_F(TestMappedFile, mappableLayoutIsReadByOtherStreams)
+{
+  helib::DoubleCRT dcrt(context, context.getCtxtPrimes());
+  dcrt.randomize();
+  const std::string path = filePath("dcrt");
+  writeMappable(dcrt, path);
+
+  std::ifstream in(path, std::ios::binary);
+  helib::DoubleCRT copied = helib::DoubleCRT::readFrom(in, context);
+  EXPECT_FALSE(copied.isView());
+  EXPECT_EQ(copied, dcrt);
+
+  // Not at an aligned offset of the stream the rows were written to
+  std::stringstream str;
+  str << "xyz";
+  helib::setMappableLayout(str);
+  dcrt.writeTo(str);
+  str.ignore(3);
+  EXPECT_EQ(helib::DoubleCRT::readFrom(str, context), dcrt);
+}
+
+#ifdef HELIB_MAPPED_FILES
+
+TEST_F(TestMappedFile, packedRowsAreCopiedFromTheMapping)
+{
+  helib::DoubleCRT dcrt(context, context.getCtxtPrimes());
+  dcrt.randomize();
+  const std::string path = filePath("dcrt");
+  {
+    std::ofstream out(path, std::ios::binary);
+    dcrt.writeTo(out);
+  }
+
+  helib::MappedStream str(std::make_shared<helib::MappedFile>(path));
+  helib::DoubleCRT read = helib::DoubleCRT::readFrom(str, context);
+  EXPECT_FALSE(read.isView());
+  EXPECT_EQ(read, dcrt);
+}
+
+TEST_F(TestMappedFile, publicKeyIsReadInPlaceFromTheMapping)
+{
+  const std::string path = filePath("pk");
+  writeMappable(publicKey, path);
+
+  auto file = std::make_shared<helib::MappedFile>(path);
+  helib::MappedStream str(file);
+  helib::PubKey mapped = helib::PubKey::readFrom(str, context);
+  EXPECT_EQ(mapped, publicKey);
+  ASSERT_FALSE(mapped.keySWlist().empty());
+  for (const helib::KeySwitch& ks : mapped.keySWlist())
+    for (const helib::DoubleCRT& b : ks.b)
+      EXPECT_TRUE(b.isView());
+
+  // The key keeps the file mapped, and can be used as any other
+  file.reset();
+  helib::Ptxt<helib::BGV> ptxt(context);
+  for (std::size_t i = 0; i < ptxt.size(); i++)
+    ptxt[i] = i % 17;
+  helib::Ctxt ctxt(mapped);
+  mapped.Encrypt(ctxt, ptxt);
+  context.getEA().rotate(ctxt, 1);
+  helib::Ptxt<helib::BGV> decrypted(context);
+  secretKey.Decrypt(decrypted, ctxt);
+  ptxt.rotate(1);
+  EXPECT_EQ(decrypted, ptxt);
+}
+
+TEST_F(TestMappedFile, ciphertextIsReadFromTheMapping)
+{
+  helib::Ptxt<helib::BGV> ptxt(context);
+  for (std::size_t i = 0; i < ptxt.size(); i++)
+    ptxt[i] = (3 * i + 1) % 17;
+  helib::Ctxt ctxt(publicKey);
+  publicKey.Encrypt(ctxt, ptxt);
+  const std::string path = filePath("ctxt");
+  writeMappable(ctxt, path);
+
+  helib::MappedStream str(std::make_shared<helib::MappedFile>(path));
+  helib::Ctxt mapped = helib::Ctxt::readFrom(str, publicKey);
+  EXPECT_EQ(mapped, ctxt);
+
+  mapped.multiplyBy(mapped);
+  helib::Ptxt<helib::BGV> decrypted(context);
+  secretKey.Decrypt(decrypted, mapped);
+  EXPECT_EQ(decrypted, ptxt * ptxt);
+}
+
+TEST_F(TestMappedFile, mappingAMissingFileThrows)
+{
+  EXPECT_THROW(helib::MappedFile("TestMappedFile_missing.bin"),
+               helib::IOError);
+}
+
+TEST_F(TestMappedFile, onlyRegularFilesAreMapped)
+{
+  EXPECT_THROW(helib::MappedFile("/dev/null"), helib::IOError);
+  EXPECT_EQ(helib::MappedFile::mapIfRegular("/dev/null"), nullptr);
+  EXPECT_EQ(helib::MappedFile::mapIfRegular("TestMappedFile_missing.bin"),
+            nullptr);
+
+  const std::string path = filePath("dcrt");
+  helib::DoubleCRT dcrt(context, context.getCtxtPrimes());
+  dcrt.randomize();
+  writeMappable(dcrt, path);
+  std::shared_ptr<helib::MappedFile> file =
+      helib::MappedFile::mapIfRegular(path);
+  ASSERT_NE(file, nullptr);
+  helib::MappedStream str(file);
+  EXPECT_EQ(helib::DoubleCRT::readFrom(str, context), dcrt);
+}
+
+#endif // ifdef HELIB_MAPPED_FILES
+
+} // namespace
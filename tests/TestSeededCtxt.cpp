@@ -0,0 +1,151 @@
+/* Copyright (C) 2020 IBM Corp.
+ * This program is Licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. See accompanying LICENSE file.
+ */
+
+#include <cmath>
+#include <sstream>
+
+#include <helib/helib.h>
+#include <helib/SeededCtxt.h>
+
+#include "test_common.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+class TestSeededCtxt : public ::testing::Test
+{
+protected:
+  helib::Context context;
+  helib::SecKey secretKey;
+  const helib::PubKey& publicKey;
+  helib::Ptxt<helib::BGV> ptxt;
+
+  TestSeededCtxt() :
+      context(helib::ContextBuilder<helib::BGV>()
+                  .m(1024)
+                  .p(17)
+                  .r(1)
+                  .bits(200)
+                  .build()),
+      secretKey(context),
+      publicKey((secretKey.GenSecKey(), secretKey)),
+      ptxt(context)
+  {
+    for (std::size_t i = 0; i < ptxt.size(); i++)
+      ptxt[i] = (5 * i + 3) % 17;
+  }
+};
+
+TEST_F(TestSeededCtxt, expandedCiphertextDecryptsToPlaintext)
+{
+  helib::SeededCtxt seeded(publicKey);
+  EXPECT_TRUE(seeded.isEmpty());
+  EXPECT_THROW(seeded.expand(), helib::LogicError);
+
+  secretKey.Encrypt(seeded, ptxt);
+  EXPECT_FALSE(seeded.isEmpty());
+
+  helib::Ctxt ctxt = seeded.expand();
+  EXPECT_EQ(ctxt.getPrimeSet(), context.getCtxtPrimes());
+  helib::Ptxt<helib::BGV> decrypted(context);
+  secretKey.Decrypt(decrypted, ctxt);
+  EXPECT_EQ(decrypted, ptxt);
+
+  // The expanded ciphertext can be computed on as any other
+  ctxt.multiplyBy(ctxt);
+  secretKey.Decrypt(decrypted, ctxt);
+  EXPECT_EQ(decrypted, ptxt * ptxt);
+}
+
+TEST_F(TestSeededCtxt, eachEncryptionHasItsOwnSeed)
+{
+  helib::SeededCtxt seeded1(publicKey);
+  helib::SeededCtxt seeded2(publicKey);
+  secretKey.Encrypt(seeded1, ptxt);
+  secretKey.Encrypt(seeded2, ptxt);
+
+  EXPECT_NE(seeded1.getSeed(), seeded2.getSeed());
+  EXPECT_NE(seeded1.expand(), seeded2.expand());
+}
+
+TEST_F(TestSeededCtxt, readBackExpandsToTheSameCiphertext)
+{
+  helib::SeededCtxt seeded(publicKey);
+  secretKey.Encrypt(seeded, ptxt);
+
+  std::stringstream str;
+  seeded.writeTo(str);
+  helib::SeededCtxt deserialized = helib::SeededCtxt::readFrom(str, publicKey);
+
+  EXPECT_EQ(deserialized.getSeed(), seeded.getSeed());
+  EXPECT_EQ(deserialized.expand(), seeded.expand());
+}
+
+TEST_F(TestSeededCtxt, isAboutHalfTheSizeOfTheFullCiphertext)
+{
+  helib::SeededCtxt seeded(publicKey);
+  secretKey.Encrypt(seeded, ptxt);
+
+  std::stringstream seededStr;
+  seeded.writeTo(seededStr);
+  std::stringstream fullStr;
+  seeded.expand().writeTo(fullStr);
+
+  double ratio = double(seededStr.str().size()) / fullStr.str().size();
+  EXPECT_LT(ratio, 0.52);
+  EXPECT_GT(ratio, 0.48);
+}
+
+TEST_F(TestSeededCtxt, readThrowsOnBadEyeCatchers)
+{
+  helib::SeededCtxt seeded(publicKey);
+  secretKey.Encrypt(seeded, ptxt);
+
+  std::stringstream str;
+  seeded.writeTo(str);
+  std::string bytes = str.str();
+  bytes[bytes.size() - 1] = 'X';
+  std::stringstream corrupted(bytes);
+
+  helib::SeededCtxt deserialized(publicKey);
+  EXPECT_THROW(deserialized.read(corrupted), helib::IOError);
+}
+
+TEST(TestSeededCtxtCKKS, expandedCiphertextDecryptsToPlaintext)
+{
+  helib::Context context = helib::ContextBuilder<helib::CKKS>()
+                               .m(128)
+                               .precision(20)
+                               .bits(150)
+                               .build();
+  helib::SecKey secretKey(context);
+  secretKey.GenSecKey();
+
+  std::vector<double> data(context.getNSlots());
+  for (std::size_t i = 0; i < data.size(); i++)
+    data[i] = 1.0 / (i + 1);
+  helib::Ptxt<helib::CKKS> ptxt(context, data);
+
+  helib::SeededCtxt seeded(secretKey);
+  secretKey.Encrypt(seeded, ptxt);
+
+  std::stringstream str;
+  seeded.writeTo(str);
+  helib::Ctxt ctxt = helib::SeededCtxt::readFrom(str, secretKey).expand();
+
+  helib::Ptxt<helib::CKKS> decrypted(context);
+  secretKey.Decrypt(decrypted, ctxt);
+  for (std::size_t i = 0; i < decrypted.size(); i++)
+    EXPECT_NEAR(decrypted[i].real(), data[i], 1e-4) << "slot " << i;
+}
+
+} // namespace
@@ -12,7 +12,11 @@
 
 #ifndef TEST_COMMON_H
 #define TEST_COMMON_H
+#include <NTL/BasicThreadPool.h>
 #include <helib/ArgMap.h>
+#include <helib/DoubleCRT.h>
+#include <helib/NativeNTT.h>
+#include <helib/ResidueMap.h>
 
 namespace helib_test {
 
@@ -32,6 +36,40 @@ namespace helib_test {
     EXPECT_FLOAT_EQ(vec1[i].imag(), vec2[i].imag()) << "Slot " << i;           \
   }
 
+// Saves the process-wide NTT, SIMD, threading and scratch pool settings and
+// restores them when it goes out of scope, so that a test that changes them
+// does not leak them into the later tests if one of its assertions fails
+class GlobalSettingsGuard
+{
+public:
+  GlobalSettingsGuard() :
+      nativeNTT(helib::nativeNTTEnabled()),
+      simdLevel(helib::getSimdLevel()),
+      parallelThreshold(helib::getDoubleCRTParallelThreshold()),
+      threads(NTL::AvailableThreads()),
+      scratchPoolLimit(helib::ResidueMap::getScratchPoolLimit())
+  {}
+
+  ~GlobalSettingsGuard()
+  {
+    helib::setNativeNTTEnabled(nativeNTT);
+    helib::setSimdLevel(simdLevel);
+    helib::setDoubleCRTParallelThreshold(parallelThreshold);
+    NTL::SetNumThreads(threads);
+    helib::ResidueMap::setScratchPoolLimit(scratchPoolLimit);
+  }
+
+  GlobalSettingsGuard(const GlobalSettingsGuard&) = delete;
+  GlobalSettingsGuard& operator=(const GlobalSettingsGuard&) = delete;
+
+private:
+  const bool nativeNTT;
+  const helib::SimdLevel simdLevel;
+  const long parallelThreshold;
+  const long threads;
+  const std::size_t scratchPoolLimit;
+};
+
 extern char* path_of_executable;
 extern bool noPrint;
 extern bool verbose;
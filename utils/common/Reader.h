@@ -18,6 +18,8 @@
 #include <fstream>
 #include <exception>
 
+#include <helib/MappedFile.h>
+
 #include "TOC.h"
 
 template <typename D>
@@ -26,57 +28,82 @@ class Reader
 
 private:
   const std::string filepath;
-  std::ifstream readStream;
+#ifdef HELIB_MAPPED_FILES
+  std::shared_ptr<helib::MappedFile> mappedFile;
+#endif
+  std::unique_ptr<std::istream> readStream;
   D& scratch;
   std::shared_ptr<TOC> toc;
 
+  std::unique_ptr<std::istream> openStream() const
+  {
+#ifdef HELIB_MAPPED_FILES
+    if (mappedFile)
+      return std::make_unique<helib::MappedStream>(mappedFile);
+#endif
+
+    auto str = std::make_unique<std::ifstream>(filepath, std::ios::binary);
+    if (!str->is_open())
+      throw std::runtime_error("Could not open '" + filepath + "'.");
+    return str;
+  }
+
 public:
-  Reader(const std::string& fname, D& init) :
+  // With mapped set, a regular file is memory-mapped once for this reader
+  // and all its copies, and the rows of records written in the mappable
+  // layout (see helib::setMappableLayout) are used in place rather than
+  // copied. Other files, and all files without HELIB_MAPPED_FILES, are read
+  // as streams.
+  Reader(const std::string& fname, D& init, bool mapped = false) :
       filepath(fname),
-      readStream(filepath, std::ios::binary),
+#ifdef HELIB_MAPPED_FILES
+      mappedFile(mapped ? helib::MappedFile::mapIfRegular(fname) : nullptr),
+#endif
+      readStream(openStream()),
       scratch(init),
       toc(std::make_shared<TOC>())
   {
-    if (!readStream.is_open())
-      throw std::runtime_error("Could not open '" + filepath + "'.");
-    toc->read(readStream);
+#ifndef HELIB_MAPPED_FILES
+    (void)mapped;
+#endif
+    toc->read(*readStream);
   }
 
   Reader(const Reader& rdr) :
       filepath(rdr.filepath),
-      readStream(filepath, std::ios::binary),
+#ifdef HELIB_MAPPED_FILES
+      mappedFile(rdr.mappedFile),
+#endif
+      readStream(openStream()),
       scratch(rdr.scratch),
       toc(rdr.toc)
-  {
-    if (!readStream.is_open())
-      throw std::runtime_error("Could not open '" + rdr.filepath + "'.");
-  }
+  {}
 
   void readDatum(D& dest, int i, int j)
   {
-    if (readStream.eof())
-      readStream.clear();
+    if (readStream->eof())
+      readStream->clear();
 
-    readStream.seekg(toc->getIdx(i, j));
-    dest.read(readStream);
+    readStream->seekg(toc->getIdx(i, j));
+    dest.read(*readStream);
   }
 
   std::unique_ptr<D> readDatum(int i, int j)
   {
-    if (readStream.eof())
-      readStream.clear();
+    if (readStream->eof())
+      readStream->clear();
 
     std::unique_ptr<D> ptr = std::make_unique<D>(scratch);
-    readStream.seekg(toc->getIdx(i, j));
-    ptr->read(readStream);
+    readStream->seekg(toc->getIdx(i, j));
+    ptr->read(*readStream);
 
     return std::move(ptr);
   }
 
   std::unique_ptr<std::vector<std::vector<D>>> readAll()
   {
-    if (readStream.eof())
-      readStream.clear();
+    if (readStream->eof())
+      readStream->clear();
 
     auto m_ptr = std::make_unique<std::vector<std::vector<D>>>(
         toc->getRows(),
@@ -84,8 +111,8 @@ public:
 
     for (int i = 0; i < toc->getRows(); i++) {
       for (int j = 0; j < toc->getCols(); j++) {
-        readStream.seekg(toc->getIdx(i, j));
-        (*m_ptr)[i][j].read(readStream);
+        readStream->seekg(toc->getIdx(i, j));
+        (*m_ptr)[i][j].read(*readStream);
       }
     }
 
@@ -95,13 +122,13 @@ public:
   std::unique_ptr<std::vector<D>> readRow(int i)
   {
 
-    if (readStream.eof())
-      readStream.clear();
+    if (readStream->eof())
+      readStream->clear();
 
     auto v_ptr = std::make_unique<std::vector<D>>(toc->getCols(), scratch);
     for (int n = 0; n < toc->getCols(); n++) {
-      readStream.seekg(toc->getIdx(i, n));
-      (*v_ptr)[n].read(readStream);
+      readStream->seekg(toc->getIdx(i, n));
+      (*v_ptr)[n].read(*readStream);
     }
 
     return std::move(v_ptr);
@@ -109,13 +136,13 @@ public:
 
   std::unique_ptr<std::vector<D>> readCol(int j)
   {
-    if (readStream.eof())
-      readStream.clear();
+    if (readStream->eof())
+      readStream->clear();
 
     auto v_ptr = std::make_unique<std::vector<D>>(toc->getRows(), scratch);
     for (int n = 0; n < toc->getRows(); n++) {
-      readStream.seekg(toc->getIdx(n, j));
-      (*v_ptr)[n].read(readStream);
+      readStream->seekg(toc->getIdx(n, j));
+      (*v_ptr)[n].read(*readStream);
     }
 
     return std::move(v_ptr);
@@ -18,6 +18,8 @@
 #include <memory>
 #include <exception>
 
+#include <helib/MappedFile.h>
+
 #include "TOC.h"
 
 template <typename D>
@@ -28,6 +30,7 @@ private:
   std::shared_ptr<TOC> toc;
   std::fstream writeStream;
   const std::string filepath;
+  const bool mappable;
 
   void allocFile(long sizeInBytes) const
   {
@@ -61,13 +64,17 @@ private:
 
 public:
   // A fresh writer is responsible for setting the TOC.
+  // With mappable set, the records are written in the memory-mappable layout
+  // (see helib::setMappableLayout).
   Writer(const std::string& fpath,
          uint64_t rows,
          uint64_t cols,
-         long recordSizeInBytes) :
+         long recordSizeInBytes,
+         bool mappable = false) :
       // File needs alloc in body before stream is opened.
       toc(std::make_shared<TOC>(rows, cols)),
-      filepath(fpath)
+      filepath(fpath),
+      mappable(mappable)
   {
     // Estimate for ctxt sizes.
     const long tocSize = toc->memorySize();
@@ -86,6 +93,7 @@ public:
                                "' for writing out TOC.");
     writeStream.seekp(0);
     toc->write(writeStream);
+    helib::setMappableLayout(writeStream, mappable);
   }
 
   // A copied writer is not responsible for setting the TOC.
@@ -93,11 +101,13 @@ public:
       toc(other.toc),
       writeStream(other.filepath,
                   std::ios::in | std::ios::out | std::ios::binary),
-      filepath(other.filepath)
+      filepath(other.filepath),
+      mappable(other.mappable)
   {
     if (!writeStream.is_open())
       throw std::runtime_error("Could not open file '" + other.filepath +
                                "' for copied Writer.");
+    helib::setMappableLayout(writeStream, mappable);
   }
 
   void writeByLocation(const D& data, uint64_t row, uint64_t col)
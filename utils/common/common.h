@@ -24,6 +24,7 @@
 #include <fstream>
 
 #include <helib/helib.h>
+#include <helib/MappedFile.h>
 
 inline std::string stripExtension(const std::string& s)
 {
@@ -54,10 +55,23 @@ template <typename KEY>
 uniq_pair<helib::Context, KEY> loadContextAndKey(const std::string& keyFilePath,
                                                  bool read_only_sk = false)
 {
-  std::ifstream keyFile(keyFilePath, std::ios::binary);
-  if (!keyFile.is_open())
-    throw std::runtime_error("Cannot open Public Key file '" + keyFilePath +
-                             "'.");
+  // A regular file is read from a mapping of it, so that the rows of keys
+  // written in the mappable layout are used in place (and shared by all the
+  // processes that load the same key) rather than copied. Other files, e.g.
+  // pipes, are read as a stream
+  std::unique_ptr<std::istream> keyFilePtr;
+#ifdef HELIB_MAPPED_FILES
+  if (auto mappedKeyFile = helib::MappedFile::mapIfRegular(keyFilePath))
+    keyFilePtr = std::make_unique<helib::MappedStream>(mappedKeyFile);
+#endif
+  if (!keyFilePtr) {
+    auto str = std::make_unique<std::ifstream>(keyFilePath, std::ios::binary);
+    if (!str->is_open())
+      throw std::runtime_error("Cannot open Public Key file '" + keyFilePath +
+                               "'.");
+    keyFilePtr = std::move(str);
+  }
+  std::istream& keyFile = *keyFilePtr;
   unsigned long m, p, r;
   std::vector<long> gens, ords;
 
@@ -75,7 +89,9 @@ uniq_pair<helib::Context, KEY> loadContextAndKey(const std::string& keyFilePath,
   return {std::move(contextp), std::move(keyp)};
 }
 
-inline long estimateCtxtSize(const helib::Context& context, long offset)
+inline long estimateCtxtSize(const helib::Context& context,
+                             long offset,
+                             bool mappable = false)
 {
   // Return in bytes.
 
@@ -132,6 +148,16 @@ inline long estimateCtxtSize(const helib::Context& context, long offset)
   //    size of all the slots (column in DCRT) (PhiM long elements)
   long dcrt_size = (8 + 8 * context.getPhiM()) * context.getCtxtPrimes().card();
 
+  // In the mappable layout (see helib::setMappableLayout), the DCRT data is
+  // phim (int32) + layout (int32) + stride (int32) + order (int32) +
+  // pad (int32) + up to ROW_ALIGN - 1 bytes of padding, then the rows, each
+  // of stride longs
+  if (mappable) {
+    long stride = helib::ResidueMap(context.getPhiM()).rowStride();
+    dcrt_size = 20 + (helib::ResidueMap::ROW_ALIGN - 1) +
+                8 * stride * context.getCtxtPrimes().card();
+  }
+
   part_size += dcrt_size;
 
   // End DCRT size
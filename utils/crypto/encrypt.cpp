@@ -31,6 +31,7 @@ struct CmdLineOpts
   long batchSize = 0;
   long nthreads = 0; // Default is 0 for number of cpus.
   long offset = 0;
+  bool mappable = false;
 };
 
 template <typename SCHEME>
@@ -54,7 +55,10 @@ void encryptFromTo(const CmdLineOpts& cmdLineOpts,
   Writer<helib::Ctxt> writer(cmdLineOpts.outFilePath,
                              dims.first,
                              dims.second,
-                             estimateCtxtSize(context, cmdLineOpts.offset));
+                             estimateCtxtSize(context,
+                                              cmdLineOpts.offset,
+                                              cmdLineOpts.mappable),
+                             cmdLineOpts.mappable);
 
   // Setting the stage
   std::vector<helib::Ptxt<SCHEME>> ptxts;
@@ -126,6 +130,9 @@ int main(int argc, char* argv[])
            "number of threads to use. If not set or 0 defaults to the number of concurrent threads supported.", "num. of cores")
       .arg("--offset", cmdLineOpts.offset,
            "byte packing offset in output file.")
+    .toggle()
+      .arg("--mappable", cmdLineOpts.mappable,
+           "write the ciphertexts in the memory-mappable layout.", nullptr)
     .parse(argc, argv);
   // clang-format on
 
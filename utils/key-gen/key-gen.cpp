@@ -9,6 +9,7 @@
 #include <helib/helib.h>
 #include <helib/ArgMap.h>
 #include <helib/debugging.h>
+#include <helib/MappedFile.h>
 
 #include <NTL/BasicThreadPool.h>
 
@@ -24,6 +25,7 @@ struct CmdLineOpts
   bool noSKM = false;
   bool frobSKM = false;
   bool infoFile = false;
+  bool mappable = false;
 };
 
 // Captures parameters of both BGV and CKKS
@@ -64,7 +66,8 @@ void writeKeyToFile(std::string& pathPrefix,
                     helib::Context& context,
                     helib::SecKey& secretKey,
                     bool pkNotSk,
-                    bool write_only_sk = false)
+                    bool write_only_sk = false,
+                    bool mappable = false)
 {
   std::string path = pathPrefix + (pkNotSk ? ".pk" : ".sk");
   std::ofstream keysFile(path, std::ios::binary);
@@ -78,6 +81,7 @@ void writeKeyToFile(std::string& pathPrefix,
   // write the keys
   if (pkNotSk) {
     const helib::PubKey& pk = secretKey;
+    helib::setMappableLayout(keysFile, mappable);
     pk.writeTo(keysFile);
   } else {
     secretKey.writeTo(keysFile, write_only_sk);
@@ -97,6 +101,8 @@ int main(int argc, char* argv[])
                "generate Frobenius switch-key matrices.", nullptr)
          .arg("--info-file", cmdLineOpts.infoFile,
                "print algebra info to file.", nullptr)
+         .arg("--mappable", cmdLineOpts.mappable,
+               "write the public keys in the memory-mappable layout.", nullptr)
          .arg("-s",cmdLineOpts.write_only_sk,"write only the secret key polynomial to the secret key file.")
         .separator(helib::ArgMap::Separator::WHITESPACE)
         .named()
@@ -275,7 +281,8 @@ int main(int argc, char* argv[])
                    *contextp,
                    secretKey,
                    skOrPk,
-                   cmdLineOpts.write_only_sk);
+                   cmdLineOpts.write_only_sk,
+                   cmdLineOpts.mappable);
     NTL_EXEC_INDEX_END
     // now compute the evaluation key material
 
@@ -292,7 +299,7 @@ int main(int argc, char* argv[])
     }
     // and write to file <outputPrefixPath>Eval.pk
     std::string path = cmdLineOpts.outputPrefixPath + "Eval";
-    writeKeyToFile(path, *contextp, secretKey, 1);
+    writeKeyToFile(path, *contextp, secretKey, 1, false, cmdLineOpts.mappable);
 
   } catch (const std::invalid_argument& e) {
     std::cerr << "Exit due to invalid argument thrown:\n"